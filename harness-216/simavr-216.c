@@ -188,7 +188,7 @@ int main(int argc, char *argv[])
 {
 	elf_firmware_t f;
 	const char * fname;
-    unsigned long step, step_limit = F_CPU * 15; /* 15 seconds, 120,000,000 */
+    avr_cycle_count_t cycle_limit = F_CPU * 15; /* 15 seconds, 120,000,000 */
     struct timeval start_time, end_time, delta_t;
     int zsuccess;
     int fname_arg_index;
@@ -270,17 +270,14 @@ int main(int argc, char *argv[])
                             adc_hook,
                             NULL); 
 
-    /* nstodo: investigate using built in
-       avr_cycle_timer_register() to set an expiration time
-       within a general mechanism */
     gettimeofday(&start_time, NULL);
 
-    int state = cpu_Running;
-    for(step=0;
-        step < step_limit && state != cpu_Done && state != cpu_Crashed;
-        step++) { 
-		state = avr_run(avr);
-    }
+    /* runs until the cycle budget is used up, or the firmware is done or
+       crashed; keeps going while gdb has the core stopped */
+    int state;
+    do {
+      state = avr_run_until(avr, cycle_limit, NULL, NULL);
+    } while (state == cpu_Stopped && avr->cycle < cycle_limit);
 
     gettimeofday(&end_time, NULL);
     timersub(&end_time, &start_time, &delta_t);
@@ -288,8 +285,8 @@ int main(int argc, char *argv[])
     if(!disable_statistics) { 
       /* avr->cycles is ultimately a uint64_t, which may not be a  */
       fprintf(stderr,
-              "simulation terminated after %" PRIu64 " cycles, %lu steps, %lu.%06d real seconds\n",
-              avr->cycle, step,
+              "simulation terminated after %" PRIu64 " cycles, %lu.%06d real seconds\n",
+              avr->cycle,
               (unsigned long)delta_t.tv_sec, (int)delta_t.tv_usec);
       fprintf(stderr,
               "led_flipped_count: %d\n",
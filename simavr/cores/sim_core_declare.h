@@ -35,6 +35,14 @@
 #define _BV(v) (v)
 #define _VECTOR(v) (v)
 
+/*
+ * Instruction set variant, the cores without MUL define SIM_CORE_ISA to
+ * AVR_ISA_TINY before including this file
+ */
+#ifndef SIM_CORE_ISA
+#define SIM_CORE_ISA (FLASHEND > 0x1ffff ? AVR_ISA_MEGA_3PC : AVR_ISA_MEGA)
+#endif
+
 /*
  * This declares a typical AVR core, using constants what appears
  * to be in every io*.h file...
@@ -84,6 +92,7 @@
 	.flashend = FLASHEND, \
 	.e2end = E2END, \
 	.vector_size = _vector_size, \
+	.isa = SIM_CORE_ISA, \
 	.fuse = _FUSE_HELPER, \
 	.signature = { SIGNATURE_0,SIGNATURE_1,SIGNATURE_2 }, \
 	.lockbits = 0xFF, \
@@ -100,6 +109,7 @@
 	.ramend = RAMEND, \
 	.flashend = FLASHEND, \
 	.e2end = E2END, \
-	.vector_size = _vector_size
+	.vector_size = _vector_size, \
+	.isa = SIM_CORE_ISA
 #endif
 #endif /* __SIM_CORE_DECLARE_H__ */
@@ -59,6 +59,7 @@ static const struct mcu_t {
 		.flashend = FLASHEND,
 		.e2end = E2END,
 		.vector_size = 2,
+		.isa = AVR_ISA_TINY,
 // Disable signature when using an old avr toolchain
 #ifdef SIGNATURE_0
 		.signature = { SIGNATURE_0,SIGNATURE_1,SIGNATURE_2 },
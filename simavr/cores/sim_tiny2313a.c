@@ -34,6 +34,7 @@ static void reset(struct avr_t * avr);
 #define __ASSEMBLER__
 #include "avr/iotn2313a.h"
 
+#define SIM_CORE_ISA AVR_ISA_TINY
 #include "sim_core_declare.h"
 
 /*
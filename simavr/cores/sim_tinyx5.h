@@ -24,6 +24,7 @@
 #ifndef __SIM_TINYX5_H__
 #define __SIM_TINYX5_H__
 
+#define SIM_CORE_ISA AVR_ISA_TINY
 #include "sim_core_declare.h"
 #include "avr_eeprom.h"
 #include "avr_watchdog.h"
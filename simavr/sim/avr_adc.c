@@ -227,7 +227,7 @@ avr_adc_write_adcsra(
 	}
 	if (aden && !avr_regbit_get(avr, p->aden)) {
 		// stop ADC
-		avr_cycle_timer_cancel(avr, avr_adc_int_raise, p);
+		avr_cycle_timer_cancel_handle(avr, p->int_timer);
 		avr_regbit_clear(avr, p->adsc);
 		v = avr->data[p->adsc.reg];	// Peter Ross pross@xvid.org
 	}
@@ -249,9 +249,8 @@ avr_adc_write_adcsra(
 			AVR_LOG(avr, LOG_TRACE, "ADC: starting at %uKHz\n", div / 13 / 100);
 		div /= p->first ? 25 : 13;	// first cycle is longer
 
-		avr_cycle_timer_register(avr,
-				avr_hz_to_cycles(avr, div),
-				avr_adc_int_raise, p);
+		avr_cycle_timer_reschedule(avr, p->int_timer,
+				avr_hz_to_cycles(avr, div));
 	}
 	avr_core_watch_write(avr, addr, v);
 	avr_adc_configure_trigger(avr, addr, v, param);
@@ -301,7 +300,7 @@ static void avr_adc_reset(avr_io_t * port)
 	avr_adc_t * p = (avr_adc_t *)port;
 
 	// stop ADC
-	avr_cycle_timer_cancel(p->io.avr, avr_adc_int_raise, p);
+	avr_cycle_timer_cancel_handle(p->io.avr, p->int_timer);
 	avr_regbit_clear(p->io.avr, p->adsc);
 
 	for (int i = 0; i < ADC_IRQ_COUNT; i++)
@@ -342,6 +341,7 @@ void avr_adc_init(avr_t * avr, avr_adc_t * p)
 
 	avr_register_io(avr, &p->io);
 	avr_register_vector(avr, &p->adc);
+	p->int_timer = avr_cycle_timer_get_handle(avr, avr_adc_int_raise, p);
 	// allocate this module's IRQ
 	avr_io_setirqs(&p->io, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_COUNT, NULL);
 
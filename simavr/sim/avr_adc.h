@@ -139,6 +139,7 @@ typedef struct avr_adc_t {
 	uint16_t		temp;		// temp sensor reading
 	uint8_t			first;
 	uint8_t			read_status;	// marked one when adcl is read
+	avr_cycle_timer_handle_t int_timer;	// end of conversion
 } avr_adc_t;
 
 void avr_adc_init(avr_t * avr, avr_adc_t * port);
@@ -20,6 +20,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include "avr_ioport.h"
 
 #define D(_w)
@@ -48,30 +49,44 @@ avr_ioport_update_irqs(
 {
 	avr_t * avr = p->io.avr;
 	uint8_t ddr = avr->data[p->r_ddr];
+	uint8_t port = avr->data[p->r_port];
 	// Set the PORT value if the pin is marked as output
 	// otherwise, if there is an 'external' pullup, set it
 	// otherwise, if the PORT pin was 1 to indicate an
 	// internal pullup, set that.
-	for (int i = 0; i < 8; i++) {
-		if (ddr & (1 << i))
-			avr_raise_irq(p->io.irq + i, (avr->data[p->r_port] >> i) & 1);
-		else if (p->external.pull_mask & (1 << i))
-			avr_raise_irq(p->io.irq + i, (p->external.pull_value >> i) & 1);
-		else if ((avr->data[p->r_port] >> i) & 1)
-			avr_raise_irq(p->io.irq + i, 1);
+	uint8_t pull = p->external.pull_mask & ~ddr;
+	uint8_t mask = ddr | pull | port;
+	uint8_t value = (port & ~pull) | (p->external.pull_value & pull);
+	// only raise the pins that weren't driven before, or changed value;
+	// pins that aren't driven anymore keep their last value, as before
+	uint8_t changed = mask & (~p->driven.mask | (value ^ p->driven.value));
+	uint8_t update = ++p->driven.update;
+	// the changed pins only count as driven once they are raised, so an
+	// update nested in one of their callbacks still raises the others
+	p->driven.mask = mask & ~changed;
+	p->driven.value = value;
+	for (uint8_t c = changed; c; c &= c - 1) {
+		int i = __builtin_ctz(c);
+		p->driven.raising = 1 << i;
+		p->driven.mask |= 1 << i;
+		avr_raise_irq(p->io.irq + i, (value >> i) & 1);
+		// a callback wrote the port, that update raised the rest
+		if (p->driven.update != update)
+			break;
 	}
+	p->driven.raising = 0;
+
 	uint8_t pin = (avr->data[p->r_pin] & ~ddr) | (avr->data[p->r_port] & ddr);
 	pin = (pin & ~p->external.pull_mask) | p->external.pull_value;
 	avr_raise_irq(p->io.irq + IOPORT_IRQ_PIN_ALL, pin);
+	if (changed)
+		avr_raise_irq(p->io.irq + IOPORT_IRQ_PINS_CHANGED, changed);
 
 	// if IRQs are registered on the PORT register (for example, VCD dumps) send
 	// those as well
 	avr_io_addr_t port_io = AVR_DATA_TO_IO(p->r_port);
-	if (avr->io[port_io].irq) {
-		avr_raise_irq(avr->io[port_io].irq + AVR_IOMEM_IRQ_ALL, avr->data[p->r_port]);
-		for (int i = 0; i < 8; i++)
-			avr_raise_irq(avr->io[port_io].irq + i, (avr->data[p->r_port] >> i) & 1);
- 	}
+	if (avr->io[port_io].irq)
+		avr_iomem_raise_irq(avr, port_io, avr->data[p->r_port], 0);
 }
 
 static void
@@ -143,6 +158,10 @@ avr_ioport_irq_notify(
 	int output = value & AVR_IOPORT_OUTPUT;
 	value &= 0xff;
 	uint8_t mask = 1 << irq->irq;
+	// raised by something else than the port, the next update has to
+	// raise it again if the port drives it
+	if (p->driven.raising != mask)
+		p->driven.mask &= ~mask;
 		// set the real PIN bit. ddr doesn't matter here as it's masked when read.
 	avr->data[p->r_pin] &= ~mask;
 	if (value)
@@ -164,6 +183,8 @@ avr_ioport_reset(
 		avr_io_t * port)
 {
 	avr_ioport_t * p = (avr_ioport_t *)port;
+	// nothing is driven anymore, the next update raises all the pins again
+	memset(&p->driven, 0, sizeof(p->driven));
 	for (int i = 0; i < IOPORT_IRQ_PIN_ALL; i++)
 		avr_irq_register_notify(p->io.irq + i, avr_ioport_irq_notify, p);
 }
@@ -245,6 +266,7 @@ static const char * irq_names[IOPORT_IRQ_COUNT] = {
 	[IOPORT_IRQ_DIRECTION_ALL] = "8>ddr",
 	[IOPORT_IRQ_REG_PORT] = "8>port",
 	[IOPORT_IRQ_REG_PIN] = "8>pin",
+	[IOPORT_IRQ_PINS_CHANGED] = "8>changed",
 };
 
 static	avr_io_t	_io = {
@@ -273,6 +295,8 @@ void avr_ioport_init(avr_t * avr, avr_ioport_t * p)
 
 	for (int i = 0; i < IOPORT_IRQ_COUNT; i++)
 		p->io.irq[i].flags |= IRQ_FLAG_FILTERED;
+	// raised once per update that changes pins, same mask or not
+	p->io.irq[IOPORT_IRQ_PINS_CHANGED].flags &= ~IRQ_FLAG_FILTERED;
 
 	avr_register_io_write(avr, p->r_port, avr_ioport_write, p);
 	avr_register_io_read(avr, p->r_pin, avr_ioport_read, p);
@@ -36,6 +36,7 @@ enum {
 	IOPORT_IRQ_DIRECTION_ALL,
 	IOPORT_IRQ_REG_PORT,
 	IOPORT_IRQ_REG_PIN,
+	IOPORT_IRQ_PINS_CHANGED,	// mask of the pins that changed, once per update
 	IOPORT_IRQ_COUNT
 };
 
@@ -114,6 +115,14 @@ typedef struct avr_ioport_t {
 	struct {
 		uint8_t pull_mask, pull_value;
 	} external;
+
+	// pins last raised by the port, and with which value, so an update
+	// only raises the pin IRQs that changed
+	struct {
+		uint8_t mask, value;
+		uint8_t raising;	// pin being raised by the port itself
+		uint8_t update;		// counts updates, to spot nested ones
+	} driven;
 } avr_ioport_t;
 
 void avr_ioport_init(avr_t * avr, avr_ioport_t * port);
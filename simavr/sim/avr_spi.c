@@ -55,7 +55,7 @@ static void avr_spi_write(struct avr_t * avr, avr_io_addr_t addr, uint8_t v, voi
 		avr_regbit_clear(avr, p->spi.raised);
 
 		avr_core_watch_write(avr, addr, v);
-		avr_cycle_timer_register_usec(avr, 100, avr_spi_raise, p); // should be speed dependent
+		avr_cycle_timer_reschedule_usec(avr, p->raise_timer, 100); // should be speed dependent
 	}
 }
 
@@ -102,6 +102,7 @@ void avr_spi_init(avr_t * avr, avr_spi_t * p)
 
 	avr_register_io(avr, &p->io);
 	avr_register_vector(avr, &p->spi);
+	p->raise_timer = avr_cycle_timer_get_handle(avr, avr_spi_raise, p);
 	// allocate this module's IRQ
 	avr_io_setirqs(&p->io, AVR_IOCTL_SPI_GETIRQ(p->name), SPI_IRQ_COUNT, NULL);
 
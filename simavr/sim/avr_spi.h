@@ -53,6 +53,7 @@ typedef struct avr_spi_t {
 	avr_int_vector_t spi;	// spi interrupt
 
 	uint8_t		input_data_register;
+	avr_cycle_timer_handle_t raise_timer;	// end of transfer
 } avr_spi_t;
 
 void avr_spi_init(avr_t * avr, avr_spi_t * port);
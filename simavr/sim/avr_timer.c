@@ -309,9 +309,8 @@ avr_timer_tov(
 		if (p->comp[compi].comp_cycles) {
 			if (p->comp[compi].comp_cycles < p->tov_cycles && p->comp[compi].comp_cycles >= (avr->cycle - when)) {
 				avr_timer_comp_on_tov(p, when, compi);
-				avr_cycle_timer_register(avr,
-					p->comp[compi].comp_cycles - (avr->cycle - next),
-					dispatch[compi], p);
+				avr_cycle_timer_reschedule(avr, p->comp[compi].comp_timer,
+					p->comp[compi].comp_cycles - (avr->cycle - next));
 			} else if (p->tov_cycles == p->comp[compi].comp_cycles && !start)
 				dispatch[compi](avr, when, param);
 		}
@@ -372,10 +371,9 @@ avr_timer_cancel_all_cycle_timers(
 	}
 
 
-	avr_cycle_timer_cancel(avr, avr_timer_tov, timer);
-	avr_cycle_timer_cancel(avr, avr_timer_compa, timer);
-	avr_cycle_timer_cancel(avr, avr_timer_compb, timer);
-	avr_cycle_timer_cancel(avr, avr_timer_compc, timer);
+	avr_cycle_timer_cancel_handle(avr, timer->tov_timer);
+	for (int compi = 0; compi < AVR_TIMER_COMP_COUNT; compi++)
+		avr_cycle_timer_cancel_handle(avr, timer->comp[compi].comp_timer);
 }
 
 static void
@@ -412,7 +410,7 @@ avr_timer_tcnt_write(
 
 		// this reset the timers bases to the new base
 		if (p->tov_cycles > 1) {
-			avr_cycle_timer_register(avr, p->tov_cycles - cycles, avr_timer_tov, p);
+			avr_cycle_timer_reschedule(avr, p->tov_timer, p->tov_cycles - cycles);
 			p->tov_base = 0;
 			avr_timer_tov(avr, avr->cycle - cycles, p);
 		}
@@ -513,14 +511,15 @@ avr_timer_configure(
 	if (!use_ext_clock || virt_ext_clock) {
 		if (p->tov_cycles > 1) {
 			if (reset) {
-				avr_cycle_timer_register(avr, p->tov_cycles, avr_timer_tov, p);
+				avr_cycle_timer_reschedule(avr, p->tov_timer, p->tov_cycles);
 				// calling it once, with when == 0 tells it to arm the A/B/C timers if needed
 				p->tov_base = 0;
 				avr_timer_tov(avr, avr->cycle, p);
 				p->phase_accumulator = 0.0f;
 			} else {
 				uint64_t orig_tov_base = p->tov_base;
-				avr_cycle_timer_register(avr, p->tov_cycles - (avr->cycle - orig_tov_base), avr_timer_tov, p);
+				avr_cycle_timer_reschedule(avr, p->tov_timer,
+						p->tov_cycles - (avr->cycle - orig_tov_base));
 				// calling it once, with when == 0 tells it to arm the A/B/C timers if needed
 				p->tov_base = 0;
 				avr_timer_tov(avr, orig_tov_base, p);
@@ -924,8 +923,13 @@ avr_timer_init(
 	 * high bytes because the datasheet says that the low address is always
 	 * the trigger.
 	 */
+	static const avr_cycle_timer_t dispatch[AVR_TIMER_COMP_COUNT] =
+		{ avr_timer_compa, avr_timer_compb, avr_timer_compc };
+
+	p->tov_timer = avr_cycle_timer_get_handle(avr, avr_timer_tov, p);
 	for (int compi = 0; compi < AVR_TIMER_COMP_COUNT; compi++) {
 		p->comp[compi].timer = p;
+		p->comp[compi].comp_timer = avr_cycle_timer_get_handle(avr, dispatch[compi], p);
 
 		avr_register_vector(avr, &p->comp[compi].interrupt);
 
@@ -114,6 +114,7 @@ typedef struct avr_timer_comp_t {
 		avr_regbit_t		com;			// comparator output mode registers
 		avr_regbit_t		com_pin;		// where comparator output is connected
 		uint64_t			comp_cycles;
+		avr_cycle_timer_handle_t comp_timer;	// its cycle timer
 } avr_timer_comp_t, *avr_timer_comp_p;
 
 enum {
@@ -163,6 +164,7 @@ typedef struct avr_timer_t {
 	float			phase_accumulator;
 	uint64_t		tov_base;	// MCU cycle when the last overflow occured; when clocked externally holds external clock count
 	uint16_t		tov_top;	// current top value to calculate tnct
+	avr_cycle_timer_handle_t tov_timer;	// overflow cycle timer
 } avr_timer_t;
 
 void avr_timer_init(avr_t * avr, avr_timer_t * port);
@@ -119,8 +119,7 @@ _avr_twi_delay_state(
 {
 	p->next_twstate = state;
 	// TODO: calculate clock rate, convert to cycles, and use that
-	avr_cycle_timer_register_usec(
-			p->io.avr, twi_cycles, avr_twi_set_state_timer, p);
+	avr_cycle_timer_reschedule_usec(p->io.avr, p->state_timer, twi_cycles);
 }
 
 static void
@@ -479,6 +478,7 @@ void avr_twi_init(avr_t * avr, avr_twi_t * p)
 	p->io = _io;
 	avr_register_io(avr, &p->io);
 	avr_register_vector(avr, &p->twi);
+	p->state_timer = avr_cycle_timer_get_handle(avr, avr_twi_set_state_timer, p);
 
 	//printf("%s TWI%c init\n", __FUNCTION__, p->name);
 
@@ -92,6 +92,7 @@ typedef struct avr_twi_t {
 	uint8_t state;
 	uint8_t peer_addr;
 	uint8_t next_twstate;
+	avr_cycle_timer_handle_t state_timer;	// delays next_twstate
 } avr_twi_t;
 
 void
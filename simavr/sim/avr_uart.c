@@ -212,7 +212,7 @@ avr_uart_read(
 
 avr_uart_read_check:
 	if (uart_fifo_isempty(&p->input)) {
-		avr_cycle_timer_cancel(avr, avr_uart_rxc_raise, p);
+		avr_cycle_timer_cancel_handle(avr, p->rxc_timer);
 		avr_uart_clear_interrupt(avr, &p->rxc);
 		avr_raise_irq(p->io.irq + UART_IRQ_OUT_XOFF, 0);
 		avr_raise_irq(p->io.irq + UART_IRQ_OUT_XON, 1);
@@ -302,9 +302,9 @@ avr_uart_udr_write(
 			AVR_LOG(avr, LOG_TRACE,
 					"UART%c: tx buffer overflow %d\n",
 					p->name, (int)p->tx_cnt);
-		if (avr_cycle_timer_status(avr, avr_uart_txc_raise, p) == 0)
-			avr_cycle_timer_register(avr, p->cycles_per_byte,
-					avr_uart_txc_raise, p); // start the tx pump
+		if (avr_cycle_timer_status_handle(avr, p->txc_timer) == 0)
+			avr_cycle_timer_reschedule(avr, p->txc_timer,
+					p->cycles_per_byte); // start the tx pump
 	}
 }
 
@@ -378,7 +378,7 @@ avr_uart_write(
 		// If the FIFO is not empty (clear timer is flying) we don't
 		// need to raise the interrupt, it will happen when the timer
 		// is fired.
-		if (avr_cycle_timer_status(avr, avr_uart_txc_raise, p) == 0)
+		if (avr_cycle_timer_status_handle(avr, p->txc_timer) == 0)
 			avr_raise_interrupt(avr, &p->udrc);
 	}
 	if (clear_txc)
@@ -397,7 +397,7 @@ avr_uart_write(
 			}
 		} else {
 			avr_raise_irq(p->io.irq + UART_IRQ_OUT_XOFF, 1);
-			avr_cycle_timer_cancel(avr, avr_uart_rxc_raise, p);
+			avr_cycle_timer_cancel_handle(avr, p->rxc_timer);
 			// flush the Receive Buffer
 			uart_fifo_reset(&p->input);
 			// clear the rxc interrupt flag
@@ -430,9 +430,9 @@ avr_uart_irq_input(
 	//avr_uart_regbit_clear(avr, p->rxb8);
 
 	if (uart_fifo_isempty(&p->input) &&
-			(avr_cycle_timer_status(avr, avr_uart_rxc_raise, p) == 0)
+			(avr_cycle_timer_status_handle(avr, p->rxc_timer) == 0)
 			) {
-		avr_cycle_timer_register(avr, p->cycles_per_byte, avr_uart_rxc_raise, p); // start the rx pump
+		avr_cycle_timer_reschedule(avr, p->rxc_timer, p->cycles_per_byte); // start the rx pump
 		p->rx_cnt = 0;
 		avr_uart_regbit_clear(avr, p->dor);
 	} else if (uart_fifo_isfull(&p->input)) {
@@ -465,8 +465,8 @@ avr_uart_reset(
 	avr_uart_clear_interrupt(avr, &p->txc);
 	avr_uart_clear_interrupt(avr, &p->rxc);
 	avr_irq_register_notify(p->io.irq + UART_IRQ_INPUT, avr_uart_irq_input, p);
-	avr_cycle_timer_cancel(avr, avr_uart_rxc_raise, p);
-	avr_cycle_timer_cancel(avr, avr_uart_txc_raise, p);
+	avr_cycle_timer_cancel_handle(avr, p->rxc_timer);
+	avr_cycle_timer_cancel_handle(avr, p->txc_timer);
 	uart_fifo_reset(&p->input);
 	p->tx_cnt =  0;
 
@@ -532,6 +532,9 @@ avr_uart_init(
 	avr_register_vector(avr, &p->txc);
 	avr_register_vector(avr, &p->udrc);
 
+	p->rxc_timer = avr_cycle_timer_get_handle(avr, avr_uart_rxc_raise, p);
+	p->txc_timer = avr_cycle_timer_get_handle(avr, avr_uart_txc_raise, p);
+
 	// allocate this module's IRQ
 	avr_io_setirqs(&p->io, AVR_IOCTL_UART_GETIRQ(p->name), UART_IRQ_COUNT, NULL);
 	// Only call callbacks when the value change...
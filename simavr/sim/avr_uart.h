@@ -125,6 +125,7 @@ typedef struct avr_uart_t {
 	uint32_t		flags;
 	avr_cycle_count_t cycles_per_byte;
 	avr_cycle_count_t rxc_raise_time; // the cpu cycle when rxc flag was raised last time
+	avr_cycle_timer_handle_t rxc_timer, txc_timer;	// the rx and tx pumps
 
 	uint8_t *		stdio_out;
 	int				stdio_len;	// current size in the stdio output
@@ -96,10 +96,10 @@ static void avr_watchdog_set_cycle_count_and_timer(
 				message[enable_changed][wdp_changed], 2048 << wdp,
 				1 << wdp, (int)p->cycle_count);
 
-		avr_cycle_timer_register(avr, p->cycle_count, avr_watchdog_timer, p);
+		avr_cycle_timer_reschedule(avr, p->timer, p->cycle_count);
 	} else if (enable_changed) {
 		AVR_LOG(avr, LOG_TRACE, "WATCHDOG: disabled\n");
-		avr_cycle_timer_cancel(avr, avr_watchdog_timer, p);
+		avr_cycle_timer_cancel_handle(avr, p->timer);
 	}
 }
 
@@ -137,7 +137,7 @@ static void avr_watchdog_write(
 		if (wdce_v && wde_v) {
 			avr_regbit_set(avr, p->wdce);
 
-			avr_cycle_timer_register(avr, 4, avr_wdce_clear, p);
+			avr_cycle_timer_reschedule(avr, p->wdce_timer, 4);
 		} else {
 			if (wde_v) // wde can be set but not cleared
 				avr_regbit_set(avr, p->wde);
@@ -161,8 +161,7 @@ static int avr_watchdog_ioctl(
 	if (ctl == AVR_IOCTL_WATCHDOG_RESET) {
 		if (avr_regbit_get(p->io.avr, p->wde) ||
 				avr_regbit_get(p->io.avr, p->watchdog.enable))
-			avr_cycle_timer_register(p->io.avr, p->cycle_count,
-					avr_watchdog_timer, p);
+			avr_cycle_timer_reschedule(p->io.avr, p->timer, p->cycle_count);
 		res = 0;
 	}
 
@@ -223,6 +222,8 @@ void avr_watchdog_init(avr_t * avr, avr_watchdog_t * p)
 
 	avr_register_io(avr, &p->io);
 	avr_register_vector(avr, &p->watchdog);
+	p->timer = avr_cycle_timer_get_handle(avr, avr_watchdog_timer, p);
+	p->wdce_timer = avr_cycle_timer_get_handle(avr, avr_wdce_clear, p);
 
 	avr_register_io_write(avr, p->wdce.reg, avr_watchdog_write, p);
 
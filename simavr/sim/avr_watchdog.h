@@ -41,6 +41,7 @@ typedef struct avr_watchdog_t {
 	avr_int_vector_t watchdog;	// watchdog interrupt
 
 	avr_cycle_count_t	cycle_count;
+	avr_cycle_timer_handle_t timer, wdce_timer;
 
 	struct {
 		uint8_t		wdrf;		// saved watchdog reset flag
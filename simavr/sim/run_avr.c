@@ -48,6 +48,8 @@ display_usage(
 			"       [-ff <.hex file>]   Load next .hex file as flash\n"
 			"       [-ee <.hex file>]   Load next .hex file as eeprom\n"
 			"       [--input|-i <file>] A .vcd file to use as input signals\n"
+			"       [--irq-stats <base>] Count IRQ raises, write <base>.csv\n"
+			"                           and the IRQ graph in <base>.dot\n"
 			"       [-v]                Raise verbosity level\n"
 			"                           (can be passed more than once)\n"
 			"       <firmware>          A .hex or an ELF file. ELF files are\n"
@@ -69,14 +71,29 @@ list_cores()
 }
 
 static avr_t * avr = NULL;
+static const char * irq_stats = NULL;
+
+static void
+dump_irq_stats(void)
+{
+	if (!irq_stats)
+		return;
+	char fname[strlen(irq_stats) + 5];
+	sprintf(fname, "%s.csv", irq_stats);
+	avr_irq_pool_dump_csv(&avr->irq_pool, fname);
+	sprintf(fname, "%s.dot", irq_stats);
+	avr_irq_pool_dump_dot(&avr->irq_pool, fname);
+}
 
 static void
 sig_int(
 		int sign)
 {
 	printf("signal caught, simavr terminating\n");
-	if (avr)
+	if (avr) {
+		dump_irq_stats();
 		avr_terminate(avr);
+	}
 	exit(0);
 }
 
@@ -119,6 +136,11 @@ main(
 				vcd_input = argv[++pi];
 			else
 				display_usage(basename(argv[0]));
+		} else if (!strcmp(argv[pi], "--irq-stats")) {
+			if (pi < argc-1)
+				irq_stats = argv[++pi];
+			else
+				display_usage(basename(argv[0]));
 		} else if (!strcmp(argv[pi], "-t") || !strcmp(argv[pi], "--trace")) {
 			trace++;
 		} else if (!strcmp(argv[pi], "-ti")) {
@@ -183,6 +205,8 @@ main(
 		exit(1);
 	}
 	avr_init(avr);
+	if (irq_stats)
+		avr_irq_pool_stats(&avr->irq_pool, 1);
 	avr_load_firmware(avr, &f);
 	if (f.flashbase) {
 		printf("Attempted to load a bootloader at %04x\n", f.flashbase);
@@ -195,8 +219,8 @@ main(
 			if (avr->interrupts.vector[vi]->vector == trace_vectors[ti])
 				avr->interrupts.vector[vi]->trace = 1;
 	}
+	static avr_vcd_t input;
 	if (vcd_input) {
-		static avr_vcd_t input;
 		if (avr_vcd_init_input(avr, vcd_input, &input)) {
 			fprintf(stderr, "%s: Warning: VCD input file %s failed\n", argv[0], vcd_input);
 		}
@@ -207,6 +231,9 @@ main(
 	if (gdb) {
 		avr->state = cpu_Stopped;
 		avr_gdb_init(avr);
+		// reverse execution replays them from its log
+		for (int i = 0; i < input.signal_count; i++)
+			avr_gdb_add_input(avr, &input.signal[i].irq);
 	}
 
 	signal(SIGINT, sig_int);
@@ -218,5 +245,6 @@ main(
 			break;
 	}
 
+	dump_irq_stats();
 	avr_terminate(avr);
 }
@@ -32,6 +32,7 @@
 #include "sim_core.h"
 #include "sim_time.h"
 #include "sim_gdb.h"
+#include "sim_jit.h"
 #include "avr_uart.h"
 #include "sim_vcd_file.h"
 #include "avr/avr_mcu_section.h"
@@ -103,8 +104,12 @@ avr_init(
 	memset(avr->flash, 0xff, avr->flashend + 1);
 	*((uint16_t*)&avr->flash[avr->flashend + 1]) = AVR_OVERFLOW_OPCODE;
 	avr->codeend = avr->flashend;
+	// one extra entry for the overflow opcode
+	avr->decoded = calloc(((avr->flashend + 1) >> 1) + 1, sizeof(avr_decoded_t));
 	avr->data = malloc(avr->ramend + 1);
 	memset(avr->data, 0, avr->ramend + 1);
+	avr->data_class = malloc(AVR_DATA_CLASS_SIZE);
+	avr_data_class_update(avr, 0, AVR_DATA_CLASS_SIZE);
 #ifdef CONFIG_SIMAVR_TRACE
 	avr->trace_data = calloc(1, sizeof(struct avr_trace_data_t));
 #endif
@@ -124,7 +129,7 @@ avr_init(
 	avr->run = avr_callback_run_raw;
 	avr->sleep = avr_callback_sleep_raw;
 	// number of address bytes to push/pull on/off the stack
-	avr->address_size = avr->eind ? 3 : 2;
+	avr->address_size = avr->isa == AVR_ISA_MEGA_3PC ? 3 : 2;
 	avr->log = 1;
 	avr_reset(avr);
 	avr_regbit_set(avr, avr->reset_flags.porf);		// by  default set to power-on reset
@@ -146,9 +151,17 @@ avr_terminate(
 		avr->vcd = NULL;
 	}
 	avr_deallocate_ios(avr);
+	avr_cycle_timer_free(avr);
 
 	if (avr->flash) free(avr->flash);
 	if (avr->data) free(avr->data);
+	if (avr->data_class) free(avr->data_class);
+	avr->data_class = NULL;
+	if (avr->decoded) free(avr->decoded);
+	avr->decoded = NULL;
+#if AVR_HAS_JIT
+	avr_jit_free(avr);
+#endif
 	if (avr->io_console_buffer.buf) {
 		avr->io_console_buffer.len = 0;
 		avr->io_console_buffer.size = 0;
@@ -174,8 +187,9 @@ avr_reset(
 		avr->data[i] = 0;
 	_avr_sp_set(avr, avr->ramend);
 	avr->pc = avr->reset_pc;	// Likely to be zero
-	for (int i = 0; i < 8; i++)
-		avr->sreg[i] = 0;
+	avr->sreg = 0;
+	avr->flags.pending = 0;
+	avr_idle_reset(avr);
 	avr_interrupt_reset(avr);
 	avr_cycle_timer_reset(avr);
 	if (avr->reset)
@@ -204,6 +218,23 @@ avr_sadly_crashed(
 		avr->state = cpu_Crashed;
 }
 
+uint8_t
+avr_get_sreg_flag(
+		avr_t * avr,
+		uint8_t flag)
+{
+	return avr_sreg_get(avr, flag);
+}
+
+void
+avr_set_sreg_flag(
+		avr_t * avr,
+		uint8_t flag,
+		uint8_t v)
+{
+	avr_sreg_set(avr, flag, v);
+}
+
 void
 avr_set_command_register(
 		avr_t * avr,
@@ -258,6 +289,7 @@ avr_loadcode(
 		abort();
 	}
 	memcpy(avr->flash + address, code, size);
+	avr_decode_flash(avr, address, size);
 }
 
 /**
@@ -289,59 +321,6 @@ avr_callback_sleep_gdb(
 		;
 }
 
-void
-avr_callback_run_gdb(
-		avr_t * avr)
-{
-  // if stopped, timeout after ten ms (instead of a microsecond)
-  avr_gdb_processor(avr, avr->state == cpu_Stopped ? 10000 : 0);
-
-	if (avr->state == cpu_Stopped)
-		return ;
-
-	// if we are stepping one instruction, we "run" for one..
-	int step = avr->state == cpu_Step;
-	if (step)
-		avr->state = cpu_Running;
-
-	avr_flashaddr_t new_pc = avr->pc;
-
-	if (avr->state == cpu_Running) {
-		new_pc = avr_run_one(avr);
-#if CONFIG_SIMAVR_TRACE
-		avr_dump_state(avr);
-#endif
-	}
-
-	// run the cycle timers, get the suggested sleep time
-	// until the next timer is due
-	avr_cycle_count_t sleep = avr_cycle_timer_process(avr);
-
-	avr->pc = new_pc;
-
-	if (avr->state == cpu_Sleeping) {
-		if (!avr->sreg[S_I]) {
-			if (avr->log)
-				AVR_LOG(avr, LOG_TRACE, "simavr: sleeping with interrupts off, quitting gracefully\n");
-			avr->state = cpu_Done;
-			return;
-		}
-		/*
-		 * try to sleep for as long as we can (?)
-		 */
-		avr->sleep(avr, sleep);
-		avr->cycle += 1 + sleep;
-	}
-	// Interrupt servicing might change the PC too, during 'sleep'
-	if (avr->state == cpu_Running || avr->state == cpu_Sleeping)
-		avr_service_interrupts(avr);
-
-	// if we were stepping, use this state to inform remote gdb
-	if (step)
-		avr->state = cpu_StepDone;
-
-}
-
 /*
 To avoid simulated time and wall clock time to diverge over time
 this function tries to keep them in sync (roughly) by sleeping
@@ -363,14 +342,22 @@ avr_callback_sleep_raw(
 	return;
 }
 
-void
-avr_callback_run_raw(
-		avr_t * avr)
+/*
+ * The "raw" run loop is shared by all the executors,
+ * it's inlined in each callback so the executor call stays direct.
+ * 'skip_idle' is constant in each of them, and tells if the idle and
+ * counting loops can be fast-forwarded.
+ */
+static inline void
+_avr_callback_run_raw(
+		avr_t * avr,
+		avr_flashaddr_t (*run_one)(avr_t * avr),
+		int skip_idle)
 {
 	avr_flashaddr_t new_pc = avr->pc;
 
 	if (avr->state == cpu_Running) {
-		new_pc = avr_run_one(avr);
+		new_pc = run_one(avr);
 #if CONFIG_SIMAVR_TRACE
 		avr_dump_state(avr);
 #endif
@@ -378,12 +365,17 @@ avr_callback_run_raw(
 
 	// run the cycle timers, get the suggested sleep time
 	// until the next timer is due
-	avr_cycle_count_t sleep = avr_cycle_timer_process(avr);
+	avr_cycle_count_t sleep = avr_cycle_timer_process_due(avr);
 
 	avr->pc = new_pc;
+	// skip the rest of an idle loop until then
+	if (skip_idle)
+		avr_idle_fast_forward(avr, sleep);
+	else
+		avr_idle_reset(avr);
 
 	if (avr->state == cpu_Sleeping) {
-		if (!avr->sreg[S_I]) {
+		if (!avr_sreg_get(avr, S_I)) {
 			if (avr->log)
 				AVR_LOG(avr, LOG_TRACE, "simavr: sleeping with interrupts off, quitting gracefully\n");
 			avr->state = cpu_Done;
@@ -405,6 +397,70 @@ avr_callback_run_raw(
 	}
 }
 
+void
+avr_callback_run_raw(
+		avr_t * avr)
+{
+	_avr_callback_run_raw(avr, avr_run_one, 1);
+}
+
+void
+avr_callback_run_noskip(
+		avr_t * avr)
+{
+	_avr_callback_run_raw(avr, avr_run_one, 0);
+}
+
+/*
+ * gdb mode goes thru the same loop, one instruction at a time, so the
+ * processor can check the breakpoints before each of them. Idle loops
+ * aren't skipped, a stepi has to be one instruction, and breakpoints
+ * and tracepoints have to see every iteration.
+ */
+void
+avr_callback_run_gdb(
+		avr_t * avr)
+{
+	// if stopped, timeout after ten ms (instead of a microsecond)
+	avr_gdb_processor(avr, avr->state == cpu_Stopped ? 10000 : 0);
+
+	if (avr->state == cpu_Stopped)
+		return ;
+
+	// if we are stepping one instruction, we "run" for one..
+	int step = avr->state == cpu_Step;
+	if (step)
+		avr->state = cpu_Running;
+
+	_avr_callback_run_raw(avr, avr_run_one, 0);
+	avr_gdb_processor_done(avr);
+
+	// if we were stepping, use this state to inform remote gdb
+	if (step && avr->state != cpu_Done)
+		avr->state = cpu_StepDone;
+}
+
+void
+avr_callback_run_threaded(
+		avr_t * avr)
+{
+	_avr_callback_run_raw(avr, avr_run_one_threaded, 1);
+}
+
+void
+avr_callback_run_blocks(
+		avr_t * avr)
+{
+	_avr_callback_run_raw(avr, avr_run_one_blocks, 1);
+}
+
+void
+avr_callback_run_jit(
+		avr_t * avr)
+{
+	_avr_callback_run_raw(avr, avr_run_one_jit, 1);
+}
+
 
 int
 avr_run(
@@ -414,6 +470,75 @@ avr_run(
 	return avr->state;
 }
 
+/*
+ * Does nothing, it's only there so the bursts and the sleeps stop at
+ * the cycle avr_run_until() was asked to stop at.
+ */
+static avr_cycle_count_t
+_avr_run_until_timer(
+		avr_t * avr,
+		avr_cycle_count_t when,
+		void * param)
+{
+	return 0;
+}
+
+/*
+ * Same, every AVR_RUN_UNTIL_POLL cycles, so a burst or a sleep never
+ * goes long without avr_run_until() looking at run_break.
+ */
+static avr_cycle_count_t
+_avr_run_until_poll(
+		avr_t * avr,
+		avr_cycle_count_t when,
+		void * param)
+{
+	return when + AVR_RUN_UNTIL_POLL;
+}
+
+int
+avr_run_until(
+		avr_t * avr,
+		avr_cycle_count_t cycle,
+		avr_run_until_p until,
+		void * param)
+{
+	avr_cycle_count_t limit = avr->run_cycle_limit;
+
+	if (avr->cycle < cycle) {
+		avr_cycle_timer_register(avr, cycle - avr->cycle, _avr_run_until_timer, NULL);
+		avr_cycle_timer_register(avr, AVR_RUN_UNTIL_POLL, _avr_run_until_poll, NULL);
+		/*
+		 * With nothing to look at between bursts, they can be as long as
+		 * the timers, interrupts and that no-op timer let them be. gdb
+		 * has to see every instruction, and a predicate every burst.
+		 */
+		if (!until && !avr->gdb)
+			avr->run_cycle_limit = cycle - avr->cycle;
+	}
+	while (avr->cycle < cycle && !avr->run_break) {
+		avr->run(avr);
+		if (avr->state == cpu_Done || avr->state == cpu_Crashed ||
+				avr->state == cpu_Stopped)
+			break;
+		if (until && until(avr, param))
+			break;
+	}
+	avr->run_cycle_limit = limit;
+	avr_cycle_timer_cancel(avr, _avr_run_until_timer, NULL);
+	avr_cycle_timer_cancel(avr, _avr_run_until_poll, NULL);
+	avr->run_break = 0;
+	return avr->state;
+}
+
+int
+avr_run_cycles(
+		avr_t * avr,
+		avr_cycle_count_t count)
+{
+	return avr_run_until(avr, avr->cycle + count, NULL, NULL);
+}
+
 avr_t *
 avr_core_allocate(
 		const avr_t * core,
@@ -421,6 +546,7 @@ avr_core_allocate(
 {
 	uint8_t * b = malloc(coreLen);
 	memcpy(b, core, coreLen);
+	((avr_t *)b)->core_size = coreLen;
 	return (avr_t *)b;
 }
 
@@ -152,6 +152,28 @@ typedef void (*avr_run_t)(
 #define AVR_FUSE_HIGH	1
 #define AVR_FUSE_EXT	2
 
+/*
+ * Instruction set variants, each has its own executors, see sim_core.c
+ */
+enum {
+	AVR_ISA_MEGA = 0,	// MUL, 2 bytes PC (up to 128KB of flash)
+	AVR_ISA_TINY,		// no MUL/FMUL (the tinys, and the avr35 usb162)
+	AVR_ISA_MEGA_3PC,	// 3 bytes PC and EIND (mega2560)
+};
+
+// avr->idle.pc when there is no idle loop candidate
+#define AVR_IDLE_NONE	((avr_flashaddr_t)~0)
+
+/*
+ * Last ALU instruction that set some flags: its operands, its result, and
+ * the SREG bits that still have to be worked out from them.
+ */
+typedef struct avr_sreg_lazy_t {
+	uint8_t		op;			// AVR_FLAGS_*, see sim_core.h
+	uint8_t		pending;	// SREG bits that are not in avr->sreg yet
+	uint16_t	rd, rr, res;
+} avr_sreg_lazy_t;
+
 /*
  * Main AVR instance. Some of these fields are set by the AVR "Core" definition files
  * the rest is runtime data (as little as possible)
@@ -170,6 +192,7 @@ typedef struct avr_t {
 	avr_io_addr_t		rampz;	// optional, only for ELPM/SPM on >64Kb cores
 	avr_io_addr_t		eind;	// optional, only for EIJMP/EICALL on >64Kb cores
 	uint8_t				address_size;	// 2, or 3 for cores >128KB in flash
+	uint8_t				isa;	// AVR_ISA_*, from sim_core_declare.h
 	struct {
 		avr_regbit_t		porf;
 		avr_regbit_t		extrf;
@@ -194,6 +217,30 @@ typedef struct avr_t {
 	// for a maximum run cycle limit... run_cycle_count is set during cycle timer processing.
 	avr_cycle_count_t	run_cycle_count;	// cycles to run before next timer
 	avr_cycle_count_t	run_cycle_limit;	// maximum run cycle interval limit
+	// cycle the next cycle timer is due at, kept by the timer pool so the
+	// run loops only call avr_cycle_timer_process() when needed. Zero when
+	// there are no timers (the process call gives the default sleep then)
+	avr_cycle_count_t	next_timer_cycle;
+	// set by the host (signal handler, other thread...) to make
+	// avr_run_until() return, it is cleared when it does. It's seen at
+	// the end of the burst, AVR_RUN_UNTIL_POLL cycles later at most; a
+	// hook can also zero run_cycle_count to end that now
+	volatile uint8_t	run_break;
+
+	/*
+	 * Idle loop tracking, see avr_idle_fast_forward(): the start of the
+	 * last candidate loop seen, and the core state when it got there.
+	 */
+	struct {
+		avr_flashaddr_t		pc;		// AVR_IDLE_NONE if none
+		avr_cycle_count_t	cycle;
+		avr_cycle_count_t	skip;	// cycles per iteration, once found idle
+		uint8_t				sreg;
+		uint8_t				regs[32];
+		// counting loops: their counter registers, low byte first
+		uint8_t				counter[4];
+		uint8_t				counter_size;	// 0 for idle loops
+	} idle;
 
 	/**
 	 * Sleep requests are accumulated in sleep_usec until the minimum sleep value
@@ -239,10 +286,15 @@ typedef struct avr_t {
 	 */
 	avr_irq_pool_t	irq_pool;
 
-	// Mirror of the SREG register, to facilitate the access to bits
-	// in the opcode decoder.
-	// This array is re-synthesized back/forth when SREG changes
-	uint8_t		sreg[8];
+	/*
+	 * SREG, packed like the real register. The flags set by the last ALU
+	 * instruction are only worked out when something needs them, until
+	 * then 'flags' has what it takes to compute them. Use the avr_sreg_*()
+	 * accessors from sim_core.h, or avr_get_sreg_flag() and
+	 * avr_set_sreg_flag(), rather than these directly.
+	 */
+	uint8_t			sreg;
+	avr_sreg_lazy_t	flags;
 
 	/* Interrupt state:
 		00: idle (no wait, no pending interrupts) or disabled
@@ -303,10 +355,20 @@ typedef struct avr_t {
 		} io[4];
 	} io_shared_io[4];
 
+	// size of the whole core struct, IO modules included, as allocated
+	// by avr_core_allocate()
+	uint32_t		core_size;
+
 	// flash memory (initialized to 0xff, and code loaded into it)
 	uint8_t *		flash;
+	// pre-decoded flash, one entry per flash word, see sim_core.h
+	struct avr_decoded_t * decoded;
+	// native translations of the hot blocks, see sim_jit.h
+	struct avr_jit_t *	jit;
 	// this is the general purpose registers, IO registers, and SRAM
 	uint8_t *		data;
+	// access class of each data address, see avr_data_class_update()
+	uint8_t *		data_class;
 
 	// queue of io modules
 	struct avr_io_t * io_port;
@@ -339,6 +401,14 @@ typedef struct avr_t {
 	// crashed even if not activated at startup
 	// if zero, the simulator will just exit() in case of a crash
 	int		gdb_port;
+	// while the core runs, the gdb server only looks at its socket
+	// every 'gdb_poll' cycles, AVR_GDB_POLL_CYCLES if zero
+	uint32_t	gdb_poll;
+	// for reverse execution, the gdb server saves the core state every
+	// 'gdb_checkpoint' cycles (AVR_GDB_CHECKPOINT_CYCLES if zero), and
+	// keeps at most 'gdb_history' bytes of them (AVR_GDB_HISTORY_SIZE)
+	uint32_t	gdb_checkpoint;
+	uint32_t	gdb_history;
 
 	// buffer for console debugging output from register
 	struct {
@@ -383,6 +453,29 @@ avr_reset(
 int
 avr_run(
 		avr_t * avr);
+
+typedef int (*avr_run_until_p)(struct avr_t * avr, void * param);
+/*
+ * Keeps running the AVR until 'cycle' is reached, or until the core is
+ * Done, Crashed or Stopped, or 'until' (if any) returns nonzero, or
+ * avr->run_break is set. 'until' and run_break are checked after each
+ * burst. With an 'until' predicate, or gdb, the bursts are bound by
+ * run_cycle_limit as usual; otherwise they only stop for timers,
+ * interrupts and state changes, and a timer every AVR_RUN_UNTIL_POLL
+ * cycles bounds them, and the sleeps. Returns the core state.
+ */
+#define AVR_RUN_UNTIL_POLL	100000
+int
+avr_run_until(
+		avr_t * avr,
+		avr_cycle_count_t cycle,
+		avr_run_until_p until,
+		void * param);
+// same as avr_run_until(), for 'count' cycles from now
+int
+avr_run_cycles(
+		avr_t * avr,
+		avr_cycle_count_t count);
 // finish any pending operations
 void
 avr_terminate(
@@ -425,6 +518,22 @@ avr_core_watch_read(
 		avr_t *avr,
 		uint16_t addr);
 
+/*
+ * SREG flags, for the code that doesn't include sim_core.h. avr->sreg used
+ * to be an array, one byte per flag: what was avr->sreg[S_I] is now
+ * avr_get_sreg_flag(avr, S_I), and avr->sreg[S_I] = v is
+ * avr_set_sreg_flag(avr, S_I, v).
+ */
+uint8_t
+avr_get_sreg_flag(
+		avr_t * avr,
+		uint8_t flag);
+void
+avr_set_sreg_flag(
+		avr_t * avr,
+		uint8_t flag,
+		uint8_t v);
+
 // called when the core has detected a crash somehow.
 // this might activate gdb server
 void
@@ -465,6 +574,30 @@ void avr_callback_sleep_gdb(avr_t * avr, avr_cycle_count_t howLong);
 void avr_callback_run_gdb(avr_t * avr);
 void avr_callback_sleep_raw(avr_t * avr, avr_cycle_count_t howLong);
 void avr_callback_run_raw(avr_t * avr);
+/*
+ * Same as avr_callback_run_raw, but idle and counting loops are never
+ * fast-forwarded (see avr_idle_fast_forward()), every instruction runs.
+ */
+void avr_callback_run_noskip(avr_t * avr);
+/*
+ * Same as avr_callback_run_raw, but uses the "threaded" executor, that
+ * dispatches instructions with computed gotos. It is cycle exact with the
+ * default one, just faster on most hosts. Set avr->run to it after avr_init()
+ */
+void avr_callback_run_threaded(avr_t * avr);
+/*
+ * Same again, with the executor that runs straight line code in basic
+ * blocks, and only checks for timers and interrupts between blocks.
+ * Note that the executors only get to run more than one instruction per
+ * call if avr->run_cycle_limit is raised above its default of 1.
+ */
+void avr_callback_run_blocks(avr_t * avr);
+/*
+ * Same as avr_callback_run_blocks, but the hot blocks are also translated
+ * to x86-64 code. It's only there if simavr was built with
+ * CONFIG_SIMAVR_JIT=1, otherwise this is the blocks executor.
+ */
+void avr_callback_run_jit(avr_t * avr);
 
 /**
  * Accumulates sleep requests (and returns a sleep time of 0) until
@@ -0,0 +1,160 @@
+/*
+	sim_checkpoint.c
+
+	Copies of the whole core state, to go back to
+
+	Copyright 2026 agent <agent@local>
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sim_avr.h"
+#include "avr_eeprom.h"
+#include "sim_checkpoint.h"
+
+static uint32_t
+avr_checkpoint_core_size(
+		avr_t * avr)
+{
+	// cores made by hand only have the avr_t
+	return avr->core_size ? avr->core_size : sizeof(avr_t);
+}
+
+avr_checkpoint_t *
+avr_checkpoint_save(
+		avr_t * avr)
+{
+	uint32_t core_size = avr_checkpoint_core_size(avr);
+	avr_checkpoint_t * c = calloc(1, sizeof(*c));
+	if (!c)
+		return NULL;
+	c->cycle = avr->cycle;
+	c->core = malloc(core_size);
+	c->data = malloc(avr->ramend + 1);
+	c->irq_count = avr->irq_pool.count;
+	c->irq = malloc((c->irq_count ? c->irq_count : 1) * sizeof(c->irq[0]));
+	if (!c->core || !c->data || !c->irq ||
+			avr_cycle_timer_pool_copy(&c->timers, &avr->cycle_timers))
+		goto error;
+	memcpy(c->core, avr, core_size);
+	memcpy(c->data, avr->data, avr->ramend + 1);
+	for (int i = 0; i < c->irq_count; i++) {
+		avr_irq_t * irq = avr->irq_pool.irq[i];
+		c->irq[i].irq = irq;
+		c->irq[i].value = irq ? irq->value : 0;
+		c->irq[i].flags = irq ? irq->flags : 0;
+	}
+	if (avr->e2end) {
+		c->eeprom = malloc(avr->e2end + 1);
+		if (!c->eeprom)
+			goto error;
+		avr_eeprom_desc_t ee = { .offset = 0, .size = avr->e2end + 1, .ee = c->eeprom };
+		if (avr_ioctl(avr, AVR_IOCTL_EEPROM_GET, &ee) < 0) {
+			// no EEPROM module, then
+			free(c->eeprom);
+			c->eeprom = NULL;
+		}
+	}
+	c->size = sizeof(*c) + core_size + avr->ramend + 1 +
+			(c->eeprom ? avr->e2end + 1 : 0) +
+			c->irq_count * sizeof(c->irq[0]) +
+			c->timers.slot_size * (sizeof(c->timers.slot[0]) +
+					sizeof(c->timers.heap[0]) + sizeof(c->timers.hash[0]));
+	return c;
+error:
+	avr_checkpoint_free(c);
+	return NULL;
+}
+
+int
+avr_checkpoint_restore(
+		avr_t * avr,
+		const avr_checkpoint_t * c)
+{
+	uint32_t core_size = avr_checkpoint_core_size(avr);
+	uint8_t * core = (uint8_t *)avr;
+	avr_irq_pool_t * pool = &avr->irq_pool;
+
+	// the IRQs that live in the core struct keep their hooks
+	avr_irq_t * keep = malloc((pool->count ? pool->count : 1) * sizeof(*keep));
+	if (!keep || avr_cycle_timer_pool_copy(&avr->cycle_timers, &c->timers)) {
+		free(keep);
+		return -1;
+	}
+	for (int i = 0; i < pool->count; i++)
+		if (pool->irq[i])
+			keep[i] = *pool->irq[i];
+
+	avr_t live = *avr;
+	memcpy(core, c->core, core_size);
+	// the settings, and what isn't owned by the core
+	avr->run = live.run;
+	avr->sleep = live.sleep;
+	avr->custom = live.custom;
+	avr->time_base = live.time_base;
+	avr->sleep_usec = live.sleep_usec;
+	avr->run_break = live.run_break;
+	avr->irq_pool = live.irq_pool;
+	avr->cycle_timers = live.cycle_timers;
+	avr->trace = live.trace;
+	avr->log = live.log;
+	avr->trace_data = live.trace_data;
+	avr->vcd = live.vcd;
+	avr->gdb = live.gdb;
+	avr->gdb_port = live.gdb_port;
+	avr->gdb_poll = live.gdb_poll;
+	avr->gdb_checkpoint = live.gdb_checkpoint;
+	avr->gdb_history = live.gdb_history;
+	avr->io_console_buffer = live.io_console_buffer;
+
+	for (int i = 0; i < pool->count; i++) {
+		avr_irq_t * irq = pool->irq[i];
+		if (irq && (uint8_t *)irq >= core && (uint8_t *)irq < core + core_size)
+			*irq = keep[i];
+	}
+	free(keep);
+	for (int i = 0; i < c->irq_count && i < pool->count; i++) {
+		avr_irq_t * irq = pool->irq[i];
+		if (!irq || irq != c->irq[i].irq)
+			continue;
+		irq->value = c->irq[i].value;
+		irq->flags = (c->irq[i].flags & ~IRQ_FLAG_MUTED) | (irq->flags & IRQ_FLAG_MUTED);
+	}
+	memcpy(avr->data, c->data, avr->ramend + 1);
+	if (c->eeprom) {
+		avr_eeprom_desc_t ee = { .offset = 0, .size = avr->e2end + 1, .ee = c->eeprom };
+		avr_ioctl(avr, AVR_IOCTL_EEPROM_SET, &ee);
+	}
+	return 0;
+}
+
+void
+avr_checkpoint_free(
+		avr_checkpoint_t * c)
+{
+	if (!c)
+		return;
+	free(c->core);
+	free(c->data);
+	free(c->eeprom);
+	free(c->irq);
+	free(c->timers.slot);
+	free(c->timers.heap);
+	free(c->timers.hash);
+	free(c);
+}
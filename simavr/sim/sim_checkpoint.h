@@ -0,0 +1,83 @@
+/*
+	sim_checkpoint.h
+
+	Copies of the whole core state, to go back to
+
+	Copyright 2026 agent <agent@local>
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SIM_CHECKPOINT_H__
+#define __SIM_CHECKPOINT_H__
+
+#include "sim_avr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A checkpoint is a copy of the core struct as made by avr_core_allocate()
+ * (so avr_t, and the IO modules the core declares after it), of the data
+ * space, the EEPROM, the cycle timers, and the values of the IRQs of the
+ * pool. Restoring it puts the core back to where it was, for all the
+ * simulation is concerned.
+ *
+ * What lives outside of the core is not part of it: the flash (so code
+ * that writes to it with SPM can't be gone back over), the host side of
+ * the IRQs (boards, VCD files, ptys...), and the hooks on the IRQs, as
+ * they are when restoring. The run/sleep callbacks, logging, gdb and
+ * VCD settings aren't restored either.
+ *
+ * Checkpoints are only meaningful between two instructions.
+ */
+typedef struct avr_checkpoint_t {
+	avr_cycle_count_t	cycle;	//!< avr->cycle when it was taken
+	uint32_t			size;	//!< memory it takes, all included
+	uint8_t *			core;	//!< avr->core_size bytes
+	uint8_t *			data;	//!< avr->ramend + 1 bytes
+	uint8_t *			eeprom;	//!< avr->e2end + 1 bytes, if the core has one
+	uint32_t			irq_count;
+	struct {
+		struct avr_irq_t *	irq;
+		uint32_t			value;
+		uint8_t				flags;
+	} *					irq;	//!< the IRQ pool, in order
+	avr_cycle_timer_pool_t	timers;
+} avr_checkpoint_t;
+
+//! Returns a new checkpoint of 'avr', or NULL if out of memory
+avr_checkpoint_t *
+avr_checkpoint_save(
+		avr_t * avr);
+/*
+ * Puts 'avr' back in the state it was when 'c' was taken. Returns -1 if
+ * out of memory, 'avr' is then left as it was.
+ */
+int
+avr_checkpoint_restore(
+		avr_t * avr,
+		const avr_checkpoint_t * c);
+void
+avr_checkpoint_free(
+		avr_checkpoint_t * c);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_CHECKPOINT_H__ */
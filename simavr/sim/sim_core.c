@@ -28,6 +28,7 @@
 #include "sim_gdb.h"
 #include "avr_flash.h"
 #include "avr_watchdog.h"
+#include "sim_jit.h"
 
 // SREG bit names
 const char * _sreg_bit_name = "cznvshti";
@@ -80,7 +81,7 @@ int donttrace = 0;
 #define SREG() if (avr->trace && donttrace == 0) {\
 	printf("%04x: \t\t\t\t\t\t\t\t\tSREG = ", avr->pc); \
 	for (int _sbi = 0; _sbi < 8; _sbi++)\
-		printf("%c", avr->sreg[_sbi] ? toupper(_sreg_bit_name[_sbi]) : '.');\
+		printf("%c", avr_sreg_get(avr, _sbi) ? toupper(_sreg_bit_name[_sbi]) : '.');\
 	printf("\n");\
 }
 
@@ -121,22 +122,61 @@ _avr_flash_read16le(
 	return(avr->flash[addr] | (avr->flash[addr + 1] << 8));
 }
 
-void avr_core_watch_write(avr_t *avr, uint16_t addr, uint8_t v)
+void
+avr_data_class_update(
+		avr_t * avr,
+		uint32_t addr,
+		uint32_t count)
 {
-	if (addr > avr->ramend) {
-		AVR_LOG(avr, LOG_ERROR, FONT_RED
-				"CORE: *** Invalid write address "
-				"PC=%04x SP=%04x O=%04x Address %04x=%02x out of ram\n"
-				FONT_DEFAULT,
-				avr->pc, _avr_sp_get(avr), _avr_flash_read16le(avr, avr->pc), addr, v);
-		crash(avr);
+	uint32_t end = addr + count;
+
+	if (end > AVR_DATA_CLASS_SIZE)
+		end = AVR_DATA_CLASS_SIZE;
+	for (; addr < end; addr++) {
+		uint8_t class = AVR_DATA_SRAM;
+
+		if (addr > avr->ramend)
+			class = AVR_DATA_INVALID;
+		else if (avr->gdb && avr_gdb_watched(avr, addr))
+			class = AVR_DATA_WATCHED;
+		else if (addr < 32)
+			class = AVR_DATA_GPR;
+		else if (addr == R_SREG)
+			class = AVR_DATA_SREG;
+		else if (addr == R_SPL || addr == R_SPH)
+			class = AVR_DATA_SP;
+		else if (addr < 32 + MAX_IOs) {
+			avr_io_addr_t io = AVR_DATA_TO_IO(addr);
+			if (avr->io[io].r.c || avr->io[io].w.c || avr->io[io].irq)
+				class = AVR_DATA_IO;
+			else if (addr <= avr->ioend)
+				class = AVR_DATA_IO_PLAIN;
+		}
+		avr->data_class[addr] = class;
 	}
-	if (addr < 32) {
-		AVR_LOG(avr, LOG_ERROR, FONT_RED
-				"CORE: *** Invalid write address PC=%04x SP=%04x O=%04x Address %04x=%02x low registers\n"
-				FONT_DEFAULT,
-				avr->pc, _avr_sp_get(avr), _avr_flash_read16le(avr, avr->pc), addr, v);
-		crash(avr);
+}
+
+void avr_core_watch_write(avr_t *avr, uint16_t addr, uint8_t v)
+{
+	switch (avr->data_class[addr]) {
+		case AVR_DATA_INVALID:
+			AVR_LOG(avr, LOG_ERROR, FONT_RED
+					"CORE: *** Invalid write address "
+					"PC=%04x SP=%04x O=%04x Address %04x=%02x out of ram\n"
+					FONT_DEFAULT,
+					avr->pc, _avr_sp_get(avr), _avr_flash_read16le(avr, avr->pc), addr, v);
+			crash(avr);
+			return;
+		case AVR_DATA_GPR:
+			AVR_LOG(avr, LOG_ERROR, FONT_RED
+					"CORE: *** Invalid write address PC=%04x SP=%04x O=%04x Address %04x=%02x low registers\n"
+					FONT_DEFAULT,
+					avr->pc, _avr_sp_get(avr), _avr_flash_read16le(avr, avr->pc), addr, v);
+			crash(avr);
+			break;
+		case AVR_DATA_WATCHED:
+			avr_gdb_handle_watchpoints(avr, addr, AVR_GDB_WATCH_WRITE);
+			break;
 	}
 #if AVR_STACK_WATCH
 	/*
@@ -151,61 +191,80 @@ void avr_core_watch_write(avr_t *avr, uint16_t addr, uint8_t v)
 	}
 #endif
 
-	if (avr->gdb) {
-		avr_gdb_handle_watchpoints(avr, addr, AVR_GDB_WATCH_WRITE);
-	}
-
 	avr->data[addr] = v;
 }
 
 uint8_t avr_core_watch_read(avr_t *avr, uint16_t addr)
 {
-	if (addr > avr->ramend) {
-		AVR_LOG(avr, LOG_ERROR, FONT_RED
-				"CORE: *** Invalid read address "
-				"PC=%04x SP=%04x O=%04x Address %04x out of ram (%04x)\n"
-				FONT_DEFAULT,
-				avr->pc, _avr_sp_get(avr), _avr_flash_read16le(avr, avr->pc), addr, avr->ramend);
-		crash(avr);
-	}
-
-	if (avr->gdb) {
-		avr_gdb_handle_watchpoints(avr, addr, AVR_GDB_WATCH_READ);
+	switch (avr->data_class[addr]) {
+		case AVR_DATA_INVALID:
+			AVR_LOG(avr, LOG_ERROR, FONT_RED
+					"CORE: *** Invalid read address "
+					"PC=%04x SP=%04x O=%04x Address %04x out of ram (%04x)\n"
+					FONT_DEFAULT,
+					avr->pc, _avr_sp_get(avr), _avr_flash_read16le(avr, avr->pc), addr, avr->ramend);
+			crash(avr);
+			return 0;
+		case AVR_DATA_WATCHED:
+			avr_gdb_handle_watchpoints(avr, addr, AVR_GDB_WATCH_READ);
+			break;
 	}
-
 	return avr->data[addr];
 }
 
 /*
- * Set a register (r < 256)
- * if it's an IO register (> 31) also (try to) call any callback that was
+ * Stores to anything that isn't plain memory, see avr_data_class_update().
+ * For IO registers (> 31) also (try to) call any callback that was
  * registered to track changes to that register.
  */
-static inline void _avr_set_r(avr_t * avr, uint16_t r, uint8_t v)
+static void
+_avr_set_data(
+		avr_t * avr,
+		uint16_t r,
+		uint8_t v)
 {
-	REG_TOUCH(avr, r);
-
+	switch (avr->data_class[r]) {
+		case AVR_DATA_INVALID:
+			// logs it, and crashes
+			avr_core_watch_write(avr, r, v);
+			return;
+		case AVR_DATA_WATCHED:
+			// IO write callbacks go thru avr_core_watch_write() themselves
+			if (r < 32 || r >= 32 + MAX_IOs || !avr->io[AVR_DATA_TO_IO(r)].w.c)
+				avr_gdb_handle_watchpoints(avr, r, AVR_GDB_WATCH_WRITE);
+			break;
+	}
 	if (r == R_SREG) {
 		avr->data[R_SREG] = v;
 		// unsplit the SREG
 		SET_SREG_FROM(avr, v);
 		SREG();
 	}
-	if (r > 31) {
+	if (r > 31 && r < 32 + MAX_IOs) {
 		avr_io_addr_t io = AVR_DATA_TO_IO(r);
 		if (avr->io[io].w.c)
 			avr->io[io].w.c(avr, r, v, avr->io[io].w.param);
 		else
 			avr->data[r] = v;
-		if (avr->io[io].irq) {
-			avr_raise_irq(avr->io[io].irq + AVR_IOMEM_IRQ_ALL, v);
-			for (int i = 0; i < 8; i++)
-				avr_raise_irq(avr->io[io].irq + i, (v >> i) & 1);
-		}
+		if (avr->io[io].irq)
+			avr_iomem_raise_irq(avr, io, v, 0);
 	} else
 		avr->data[r] = v;
 }
 
+/*
+ * Set a register, or any other data address
+ */
+static inline void _avr_set_r(avr_t * avr, uint16_t r, uint8_t v)
+{
+	REG_TOUCH(avr, r);
+
+	if (avr->data_class[r] <= AVR_DATA_IO_PLAIN)
+		avr->data[r] = v;
+	else
+		_avr_set_data(avr, r, v);
+}
+
 static inline void
 _avr_set_r16le(
 	avr_t * avr,
@@ -240,20 +299,25 @@ inline void _avr_sp_set(avr_t * avr, uint16_t sp)
 }
 
 /*
- * Set any address to a value; split between registers and SRAM
+ * Set any address to a value; plain SRAM is stored directly, anything
+ * else goes thru _avr_set_data()
  */
 static inline void _avr_set_ram(avr_t * avr, uint16_t addr, uint8_t v)
 {
-	if (addr < MAX_IOs + 31)
-		_avr_set_r(avr, addr, v);
+	T(if (addr < 256) REG_TOUCH(avr, addr);)
+	if (avr->data_class[addr] <= AVR_DATA_IO_PLAIN)
+		avr->data[addr] = v;
 	else
-		avr_core_watch_write(avr, addr, v);
+		_avr_set_data(avr, addr, v);
 }
 
 /*
- * Get a value from SRAM.
+ * Loads from anything that isn't plain memory
  */
-static inline uint8_t _avr_get_ram(avr_t * avr, uint16_t addr)
+static uint8_t
+_avr_get_data(
+		avr_t * avr,
+		uint16_t addr)
 {
 	if (addr == R_SREG) {
 		/*
@@ -262,22 +326,31 @@ static inline uint8_t _avr_get_ram(avr_t * avr, uint16_t addr)
 		 */
 		READ_SREG_INTO(avr, avr->data[R_SREG]);
 
-	} else if (addr > 31 && addr < 31 + MAX_IOs) {
+	} else if (addr > 31 && addr < 32 + MAX_IOs) {
 		avr_io_addr_t io = AVR_DATA_TO_IO(addr);
 
+		// these reads have side effects, no idle loop can do them
+		if (avr->io[io].r.c || avr->io[io].irq)
+			avr_idle_reset(avr);
 		if (avr->io[io].r.c)
 			avr->data[addr] = avr->io[io].r.c(avr, addr, avr->io[io].r.param);
 
-		if (avr->io[io].irq) {
-			uint8_t v = avr->data[addr];
-			avr_raise_irq(avr->io[io].irq + AVR_IOMEM_IRQ_ALL, v);
-			for (int i = 0; i < 8; i++)
-				avr_raise_irq(avr->io[io].irq + i, (v >> i) & 1);
-		}
+		if (avr->io[io].irq)
+			avr_iomem_raise_irq(avr, io, avr->data[addr], 1);
 	}
 	return avr_core_watch_read(avr, addr);
 }
 
+/*
+ * Get a value from SRAM.
+ */
+static inline uint8_t _avr_get_ram(avr_t * avr, uint16_t addr)
+{
+	if (avr->data_class[addr] <= AVR_DATA_IO_PLAIN)
+		return avr->data[addr];
+	return _avr_get_data(avr, addr);
+}
+
 /*
  * Stack push accessors.
  */
@@ -296,22 +369,33 @@ static inline uint8_t _avr_pop8(avr_t * avr)
 	return res;
 }
 
-int _avr_push_addr(avr_t * avr, avr_flashaddr_t addr)
+/*
+ * Return address accessors, 'size' is a constant in the executors so
+ * these loops get unrolled
+ */
+static inline int
+_avr_push_addr_size(
+		avr_t * avr,
+		avr_flashaddr_t addr,
+		int size)
 {
 	uint16_t sp = _avr_sp_get(avr);
 	addr >>= 1;
-	for (int i = 0; i < avr->address_size; i++, addr >>= 8, sp--) {
+	for (int i = 0; i < size; i++, addr >>= 8, sp--) {
 		_avr_set_ram(avr, sp, addr);
 	}
 	_avr_sp_set(avr, sp);
-	return avr->address_size;
+	return size;
 }
 
-avr_flashaddr_t _avr_pop_addr(avr_t * avr)
+static inline avr_flashaddr_t
+_avr_pop_addr_size(
+		avr_t * avr,
+		int size)
 {
 	uint16_t sp = _avr_sp_get(avr) + 1;
 	avr_flashaddr_t res = 0;
-	for (int i = 0; i < avr->address_size; i++, sp++) {
+	for (int i = 0; i < size; i++, sp++) {
 		res = (res << 8) | _avr_get_ram(avr, sp);
 	}
 	res <<= 1;
@@ -319,6 +403,16 @@ avr_flashaddr_t _avr_pop_addr(avr_t * avr)
 	return res;
 }
 
+int _avr_push_addr(avr_t * avr, avr_flashaddr_t addr)
+{
+	return _avr_push_addr_size(avr, addr, avr->address_size);
+}
+
+avr_flashaddr_t _avr_pop_addr(avr_t * avr)
+{
+	return _avr_pop_addr_size(avr, avr->address_size);
+}
+
 /*
  * "Pretty" register names
  */
@@ -390,73 +484,75 @@ void avr_dump_state(avr_t * avr)
 }
 #endif
 
+/*
+ * Operand extraction, used by the decoder to fill the avr_decoded_t
+ */
 #define get_d5(o) \
 		const uint8_t d = (o >> 4) & 0x1f;
 
-#define get_vd5(o) \
-		get_d5(o) \
-		const uint8_t vd = avr->data[d];
-
 #define get_r5(o) \
 		const uint8_t r = ((o >> 5) & 0x10) | (o & 0xf);
 
+#define get_d5_r5(o) \
+		get_r5(o); \
+		get_d5(o);
+
 #define get_d5_a6(o) \
 		get_d5(o); \
 		const uint8_t A = ((((o >> 9) & 3) << 4) | ((o) & 0xf)) + 32;
 
-#define get_vd5_s3(o) \
-		get_vd5(o); \
-		const uint8_t s = o & 7;
-
-#define get_vd5_s3_mask(o) \
-		get_vd5_s3(o); \
-		const uint8_t mask = 1 << s;
-
-#define get_vd5_vr5(o) \
-		get_r5(o); \
+#define get_d5_s3(o) \
 		get_d5(o); \
-		const uint8_t vd = avr->data[d], vr = avr->data[r];
-
-#define get_d5_vr5(o) \
-		get_d5(o); \
-		get_r5(o); \
-		const uint8_t vr = avr->data[r];
+		const uint8_t s = o & 7;
 
 #define get_h4_k8(o) \
 		const uint8_t h = 16 + ((o >> 4) & 0xf); \
 		const uint8_t k = ((o & 0x0f00) >> 4) | (o & 0xf);
 
-#define get_vh4_k8(o) \
-		get_h4_k8(o) \
-		const uint8_t vh = avr->data[h];
-
 #define get_d5_q6(o) \
 		get_d5(o) \
 		const uint8_t q = ((o & 0x2000) >> 8) | ((o & 0x0c00) >> 7) | (o & 0x7);
 
-#define get_io5(o) \
-		const uint8_t io = ((o >> 3) & 0x1f) + 32;
-
 #define get_io5_b3(o) \
-		get_io5(o); \
+		const uint8_t io = ((o >> 3) & 0x1f) + 32; \
 		const uint8_t b = o & 0x7;
 
-#define get_io5_b3mask(o) \
-		get_io5(o); \
-		const uint8_t mask = 1 << (o & 0x7);
-
 //	const int16_t o = ((int16_t)(op << 4)) >> 3; // CLANG BUG!
 #define get_o12(op) \
 		const int16_t o = ((int16_t)((op << 4) & 0xffff)) >> 3;
 
-#define get_vp2_k6(o) \
+#define get_p2_k6(o) \
 		const uint8_t p = 24 + ((o >> 3) & 0x6); \
-		const uint8_t k = ((o & 0x00c0) >> 2) | (o & 0xf); \
-		const uint16_t vp = avr->data[p] | (avr->data[p + 1] << 8);
+		const uint8_t k = ((o & 0x00c0) >> 2) | (o & 0xf);
 
 #define get_sreg_bit(o) \
 		const uint8_t b = (o >> 4) & 7;
 
+/*
+ * Operand fetch from an already decoded instruction, used by the executor
+ */
+#define get_vd5(op) \
+		const uint8_t d = op->d; \
+		const uint8_t vd = avr->data[d];
+
+#define get_vd5_vr5(op) \
+		const uint8_t d = op->d, r = op->r; \
+		const uint8_t vd = avr->data[d], vr = avr->data[r];
+
+#define get_d5_vr5(op) \
+		const uint8_t d = op->d, r = op->r; \
+		const uint8_t vr = avr->data[r];
+
+#define get_vh4_k8(op) \
+		const uint8_t h = op->d; \
+		const uint8_t k = op->k; \
+		const uint8_t vh = avr->data[h];
+
+#define get_vp2_k6(op) \
+		const uint8_t p = op->d; \
+		const uint8_t k = op->k; \
+		const uint16_t vp = avr->data[p] | (avr->data[p + 1] << 8);
+
 /*
  * Add a "jump" address to the jump trace buffer
  */
@@ -490,118 +586,110 @@ void avr_dump_state(avr_t * avr)
  *
  * Helper functions for calculating the status register bit values.
  * See the Atmel data sheet for the instruction set for more info.
+ * The bits are only worked out when needed, see avr_sreg_lazy()
  *
 \****************************************************************************/
 
-static  void
-_avr_flags_zns (struct avr_t * avr, uint8_t res)
+/*
+ * Works out the flags of the recorded instruction, only the bits of its
+ * recipe are valid.
+ */
+static uint8_t
+_avr_sreg_lazy_compute(
+		const avr_sreg_lazy_t * f)
 {
-	avr->sreg[S_Z] = res == 0;
-	avr->sreg[S_N] = (res >> 7) & 1;
-	avr->sreg[S_S] = avr->sreg[S_N] ^ avr->sreg[S_V];
+	const uint8_t rd = f->rd, rr = f->rr, res = f->res;
+	uint8_t c = 0, z = f->res == 0, n = res >> 7, v = 0, h = 0;
+
+	switch (f->op) {
+		case AVR_FLAGS_ADD: {
+			uint8_t carry = (rd & rr) | (rr & ~res) | (~res & rd);
+			h = (carry >> 3) & 1;
+			c = (carry >> 7) & 1;
+			v = (((rd & rr & ~res) | (~rd & ~rr & res)) >> 7) & 1;
+		}	break;
+		case AVR_FLAGS_SUB: {
+			uint8_t carry = (~rd & rr) | (rr & res) | (res & ~rd);
+			h = (carry >> 3) & 1;
+			c = (carry >> 7) & 1;
+			v = (((rd & ~rr & ~res) | (~rd & rr & res)) >> 7) & 1;
+		}	break;
+		case AVR_FLAGS_INC:
+			v = res == 0x80;
+			break;
+		case AVR_FLAGS_DEC:
+			v = res == 0x7f;
+			break;
+		case AVR_FLAGS_SHIFT:
+			c = rd & 1;
+			v = n ^ c;
+			break;
+		case AVR_FLAGS_LSR:
+			c = rd & 1;
+			n = 0;
+			v = c;
+			break;
+		case AVR_FLAGS_ADIW:
+		case AVR_FLAGS_SBIW:
+			n = f->res >> 15;
+			if (f->op == AVR_FLAGS_ADIW) {
+				v = ((~f->rd & f->res) >> 15) & 1;
+				c = ((~f->res & f->rd) >> 15) & 1;
+			} else {
+				v = ((f->rd & ~f->res) >> 15) & 1;
+				c = ((f->res & ~f->rd) >> 15) & 1;
+			}
+			break;
+		case AVR_FLAGS_MUL:
+			c = rr;
+			break;
+	}
+	return (c << S_C) | (z << S_Z) | (n << S_N) | (v << S_V) |
+			((n ^ v) << S_S) | (h << S_H);
 }
 
-static  void
-_avr_flags_zns16 (struct avr_t * avr, uint16_t res)
+void
+avr_sreg_lazy_flush(
+		avr_t * avr)
 {
-	avr->sreg[S_Z] = res == 0;
-	avr->sreg[S_N] = (res >> 15) & 1;
-	avr->sreg[S_S] = avr->sreg[S_N] ^ avr->sreg[S_V];
+	const uint8_t pending = avr->flags.pending;
+
+	avr->sreg = (avr->sreg & ~pending) |
+			(_avr_sreg_lazy_compute(&avr->flags) & pending);
+	avr->flags.pending = 0;
 }
 
-static  void
+static inline void
 _avr_flags_add_zns (struct avr_t * avr, uint8_t res, uint8_t rd, uint8_t rr)
 {
-	/* carry & half carry */
-	uint8_t add_carry = (rd & rr) | (rr & ~res) | (~res & rd);
-	avr->sreg[S_H] = (add_carry >> 3) & 1;
-	avr->sreg[S_C] = (add_carry >> 7) & 1;
-
-	/* overflow */
-	avr->sreg[S_V] = (((rd & rr & ~res) | (~rd & ~rr & res)) >> 7) & 1;
-
-	/* zns */
-	_avr_flags_zns(avr, res);
+	avr_sreg_lazy(avr, AVR_FLAGS_ADD, AVR_SREG_HSVNZC, rd, rr, res);
 }
 
-
-static  void
+static inline void
 _avr_flags_sub_zns (struct avr_t * avr, uint8_t res, uint8_t rd, uint8_t rr)
 {
-	/* carry & half carry */
-	uint8_t sub_carry = (~rd & rr) | (rr & res) | (res & ~rd);
-	avr->sreg[S_H] = (sub_carry >> 3) & 1;
-	avr->sreg[S_C] = (sub_carry >> 7) & 1;
-
-	/* overflow */
-	avr->sreg[S_V] = (((rd & ~rr & ~res) | (~rd & rr & res)) >> 7) & 1;
-
-	/* zns */
-	_avr_flags_zns(avr, res);
+	avr_sreg_lazy(avr, AVR_FLAGS_SUB, AVR_SREG_HSVNZC, rd, rr, res);
 }
 
-static  void
-_avr_flags_Rzns (struct avr_t * avr, uint8_t res)
-{
-	if (res)
-		avr->sreg[S_Z] = 0;
-	avr->sreg[S_N] = (res >> 7) & 1;
-	avr->sreg[S_S] = avr->sreg[S_N] ^ avr->sreg[S_V];
-}
-
-static  void
+static inline void
 _avr_flags_sub_Rzns (struct avr_t * avr, uint8_t res, uint8_t rd, uint8_t rr)
 {
-	/* carry & half carry */
-	uint8_t sub_carry = (~rd & rr) | (rr & res) | (res & ~rd);
-	avr->sreg[S_H] = (sub_carry >> 3) & 1;
-	avr->sreg[S_C] = (sub_carry >> 7) & 1;
-
-	/* overflow */
-	avr->sreg[S_V] = (((rd & ~rr & ~res) | (~rd & rr & res)) >> 7) & 1;
-
-	_avr_flags_Rzns(avr, res);
-}
-
-static  void
-_avr_flags_zcvs (struct avr_t * avr, uint8_t res, uint8_t vr)
-{
-	avr->sreg[S_Z] = res == 0;
-	avr->sreg[S_C] = vr & 1;
-	avr->sreg[S_V] = avr->sreg[S_N] ^ avr->sreg[S_C];
-	avr->sreg[S_S] = avr->sreg[S_N] ^ avr->sreg[S_V];
-}
-
-static  void
-_avr_flags_zcnvs (struct avr_t * avr, uint8_t res, uint8_t vr)
-{
-	avr->sreg[S_Z] = res == 0;
-	avr->sreg[S_C] = vr & 1;
-	avr->sreg[S_N] = res >> 7;
-	avr->sreg[S_V] = avr->sreg[S_N] ^ avr->sreg[S_C];
-	avr->sreg[S_S] = avr->sreg[S_N] ^ avr->sreg[S_V];
+	/*
+	 * Z is only ever cleared, for multi byte compares. Rather than
+	 * working out the previous flags, a bit past the result keeps Z clear.
+	 */
+	uint8_t z = avr_sreg_get(avr, S_Z);
+	avr_sreg_lazy(avr, AVR_FLAGS_SUB, AVR_SREG_HSVNZC, rd, rr, res | (!z << 8));
 }
 
-static  void
+static inline void
 _avr_flags_znv0s (struct avr_t * avr, uint8_t res)
 {
-	avr->sreg[S_V] = 0;
-	_avr_flags_zns(avr, res);
-}
-
-static inline int _avr_is_instruction_32_bits(avr_t * avr, avr_flashaddr_t pc)
-{
-	uint16_t o = _avr_flash_read16le(avr, pc) & 0xfc0f;
-	return	o == 0x9200 || // STS ! Store Direct to Data Space
-			o == 0x9000 || // LDS Load Direct from Data Space
-			o == 0x940c || // JMP Long Jump
-			o == 0x940d || // JMP Long Jump
-			o == 0x940e ||  // CALL Long Call to sub
-			o == 0x940f; // CALL Long Call to sub
+	avr_sreg_lazy(avr, AVR_FLAGS_LOGIC, AVR_SREG_SVNZ, 0, 0, res);
 }
 
 /*
- * Main opcode decoder
+ * Opcode decoder
  *
  * The decoder was written by following the datasheet in no particular order.
  * As I went along, I noticed "bit patterns" that could be used to factor opcodes
@@ -611,134 +699,74 @@ static inline int _avr_is_instruction_32_bits(avr_t * avr, avr_flashaddr_t pc)
  * I assume that the decoder could easily be 2/3 of it's current size.
  *
  * + It lacks the "extended" XMega jumps.
- * + It also doesn't check whether the core it's
- *   emulating is supposed to have the fancy instructions, like multiply and such.
+ * + The instructions the core doesn't have (multiplies on the tinys, ELPM
+ *   without RAMPZ, EIJMP/EICALL without EIND) are decoded as invalid, so the
+ *   executors don't have to check for them.
  *
- * The number of cycles taken by instruction has been added, but might not be
- * entirely accurate.
+ * The decoder only extracts the operands into an avr_decoded_t, it is called
+ * once per flash word, the first time the instruction is fetched (or when
+ * the code is loaded) and the result is kept in avr->decoded until the flash
+ * is written to again.
  */
-avr_flashaddr_t avr_run_one(avr_t * avr)
+static void
+_avr_decode_one(
+		avr_t * avr,
+		avr_flashaddr_t pc,
+		avr_decoded_t * op)
 {
-run_one_again:
-#if CONFIG_SIMAVR_TRACE
-	/*
-	 * this traces spurious reset or bad jumps
-	 */
-	if ((avr->pc == 0 && avr->cycle > 0) || avr->pc >= avr->codeend || _avr_sp_get(avr) > avr->ramend) {
-//		avr->trace = 1;
-		STATE("RESET\n");
-		crash(avr);
-	}
-	avr->trace_data->touched[0] = avr->trace_data->touched[1] = avr->trace_data->touched[2] = 0;
-#endif
+	uint32_t		opcode = _avr_flash_read16le(avr, pc);
 
-	/* Ensure we don't crash simavr due to a bad instruction reading past
-	 * the end of the flash.
-	 */
-	if (unlikely(avr->pc >= avr->flashend)) {
-		STATE("CRASH\n");
-		crash(avr);
-		return 0;
-	}
+	op->kind = AVR_OP_INVALID;
+	op->size = 2;
+	op->cycles = 1;
+	op->d = op->r = 0;
+	op->k = 0;
+	op->block = AVR_BLOCK_UNKNOWN;
+	op->block_cycles = 0;
+	op->loop = AVR_LOOP_UNKNOWN;
 
-	uint32_t		opcode = _avr_flash_read16le(avr, avr->pc);
-	avr_flashaddr_t	new_pc = avr->pc + 2;	// future "default" pc
-	int 			cycle = 1;
+#define OP(_kind, _cycles) { op->kind = AVR_OP_##_kind; op->cycles = _cycles; }
 
 	switch (opcode & 0xf000) {
 		case 0x0000: {
 			switch (opcode) {
-				case 0x0000: {	// NOP
-					STATE("nop\n");
-				}	break;
+				case 0x0000: OP(NOP, 1); break;
 				default: {
 					switch (opcode & 0xfc00) {
 						case 0x0400: {	// CPC -- Compare with carry -- 0000 01rd dddd rrrr
-							get_vd5_vr5(opcode);
-							uint8_t res = vd - vr - avr->sreg[S_C];
-							STATE("cpc %s[%02x], %s[%02x] = %02x\n", avr_regname(d), vd, avr_regname(r), vr, res);
-							_avr_flags_sub_Rzns(avr, res, vd, vr);
-							SREG();
+							get_d5_r5(opcode);
+							OP(CPC, 1); op->d = d; op->r = r;
 						}	break;
 						case 0x0c00: {	// ADD -- Add without carry -- 0000 11rd dddd rrrr
-							get_vd5_vr5(opcode);
-							uint8_t res = vd + vr;
-							if (r == d) {
-								STATE("lsl %s[%02x] = %02x\n", avr_regname(d), vd, res & 0xff);
-							} else {
-								STATE("add %s[%02x], %s[%02x] = %02x\n", avr_regname(d), vd, avr_regname(r), vr, res);
-							}
-							_avr_set_r(avr, d, res);
-							_avr_flags_add_zns(avr, res, vd, vr);
-							SREG();
+							get_d5_r5(opcode);
+							OP(ADD, 1); op->d = d; op->r = r;
 						}	break;
 						case 0x0800: {	// SBC -- Subtract with carry -- 0000 10rd dddd rrrr
-							get_vd5_vr5(opcode);
-							uint8_t res = vd - vr - avr->sreg[S_C];
-							STATE("sbc %s[%02x], %s[%02x] = %02x\n", avr_regname(d), avr->data[d], avr_regname(r), avr->data[r], res);
-							_avr_set_r(avr, d, res);
-							_avr_flags_sub_Rzns(avr, res, vd, vr);
-							SREG();
+							get_d5_r5(opcode);
+							OP(SBC, 1); op->d = d; op->r = r;
 						}	break;
 						default:
 							switch (opcode & 0xff00) {
 								case 0x0100: {	// MOVW -- Copy Register Word -- 0000 0001 dddd rrrr
-									uint8_t d = ((opcode >> 4) & 0xf) << 1;
-									uint8_t r = ((opcode) & 0xf) << 1;
-									STATE("movw %s:%s, %s:%s[%02x%02x]\n", avr_regname(d), avr_regname(d+1), avr_regname(r), avr_regname(r+1), avr->data[r+1], avr->data[r]);
-									uint16_t vr = avr->data[r] | (avr->data[r + 1] << 8);
-									_avr_set_r16le(avr, d, vr);
+									OP(MOVW, 1);
+									op->d = ((opcode >> 4) & 0xf) << 1;
+									op->r = ((opcode) & 0xf) << 1;
 								}	break;
 								case 0x0200: {	// MULS -- Multiply Signed -- 0000 0010 dddd rrrr
-									int8_t r = 16 + (opcode & 0xf);
-									int8_t d = 16 + ((opcode >> 4) & 0xf);
-									int16_t res = ((int8_t)avr->data[r]) * ((int8_t)avr->data[d]);
-									STATE("muls %s[%d], %s[%02x] = %d\n", avr_regname(d), ((int8_t)avr->data[d]), avr_regname(r), ((int8_t)avr->data[r]), res);
-									_avr_set_r16le(avr, 0, res);
-									avr->sreg[S_C] = (res >> 15) & 1;
-									avr->sreg[S_Z] = res == 0;
-									cycle++;
-									SREG();
+									OP(MULS, 2);
+									op->r = 16 + (opcode & 0xf);
+									op->d = 16 + ((opcode >> 4) & 0xf);
 								}	break;
 								case 0x0300: {	// MUL -- Multiply -- 0000 0011 fddd frrr
-									int8_t r = 16 + (opcode & 0x7);
-									int8_t d = 16 + ((opcode >> 4) & 0x7);
-									int16_t res = 0;
-									uint8_t c = 0;
-									T(const char * name = "";)
+									op->r = 16 + (opcode & 0x7);
+									op->d = 16 + ((opcode >> 4) & 0x7);
 									switch (opcode & 0x88) {
-										case 0x00: 	// MULSU -- Multiply Signed Unsigned -- 0000 0011 0ddd 0rrr
-											res = ((uint8_t)avr->data[r]) * ((int8_t)avr->data[d]);
-											c = (res >> 15) & 1;
-											T(name = "mulsu";)
-											break;
-										case 0x08: 	// FMUL -- Fractional Multiply Unsigned -- 0000 0011 0ddd 1rrr
-											res = ((uint8_t)avr->data[r]) * ((uint8_t)avr->data[d]);
-											c = (res >> 15) & 1;
-											res <<= 1;
-											T(name = "fmul";)
-											break;
-										case 0x80: 	// FMULS -- Multiply Signed -- 0000 0011 1ddd 0rrr
-											res = ((int8_t)avr->data[r]) * ((int8_t)avr->data[d]);
-											c = (res >> 15) & 1;
-											res <<= 1;
-											T(name = "fmuls";)
-											break;
-										case 0x88: 	// FMULSU -- Multiply Signed Unsigned -- 0000 0011 1ddd 1rrr
-											res = ((uint8_t)avr->data[r]) * ((int8_t)avr->data[d]);
-											c = (res >> 15) & 1;
-											res <<= 1;
-											T(name = "fmulsu";)
-											break;
+										case 0x00: OP(MULSU, 2); break;	// MULSU -- Multiply Signed Unsigned -- 0000 0011 0ddd 0rrr
+										case 0x08: OP(FMUL, 2); break;	// FMUL -- Fractional Multiply Unsigned -- 0000 0011 0ddd 1rrr
+										case 0x80: OP(FMULS, 2); break;	// FMULS -- Multiply Signed -- 0000 0011 1ddd 0rrr
+										case 0x88: OP(FMULSU, 2); break;	// FMULSU -- Multiply Signed Unsigned -- 0000 0011 1ddd 1rrr
 									}
-									cycle++;
-									STATE("%s %s[%d], %s[%02x] = %d\n", name, avr_regname(d), ((int8_t)avr->data[d]), avr_regname(r), ((int8_t)avr->data[r]), res);
-									_avr_set_r16le(avr, 0, res);
-									avr->sreg[S_C] = c;
-									avr->sreg[S_Z] = res == 0;
-									SREG();
 								}	break;
-								default: _avr_invalid_opcode(avr);
 							}
 					}
 				}
@@ -746,136 +774,43 @@ run_one_again:
 		}	break;
 
 		case 0x1000: {
+			get_d5_r5(opcode);
+			op->d = d; op->r = r;
 			switch (opcode & 0xfc00) {
-				case 0x1800: {	// SUB -- Subtract without carry -- 0001 10rd dddd rrrr
-					get_vd5_vr5(opcode);
-					uint8_t res = vd - vr;
-					STATE("sub %s[%02x], %s[%02x] = %02x\n", avr_regname(d), vd, avr_regname(r), vr, res);
-					_avr_set_r(avr, d, res);
-					_avr_flags_sub_zns(avr, res, vd, vr);
-					SREG();
-				}	break;
-				case 0x1000: {	// CPSE -- Compare, skip if equal -- 0001 00rd dddd rrrr
-					get_vd5_vr5(opcode);
-					uint16_t res = vd == vr;
-					STATE("cpse %s[%02x], %s[%02x]\t; Will%s skip\n", avr_regname(d), avr->data[d], avr_regname(r), avr->data[r], res ? "":" not");
-					if (res) {
-						if (_avr_is_instruction_32_bits(avr, new_pc)) {
-							new_pc += 4; cycle += 2;
-						} else {
-							new_pc += 2; cycle++;
-						}
-					}
-				}	break;
-				case 0x1400: {	// CP -- Compare -- 0001 01rd dddd rrrr
-					get_vd5_vr5(opcode);
-					uint8_t res = vd - vr;
-					STATE("cp %s[%02x], %s[%02x] = %02x\n", avr_regname(d), vd, avr_regname(r), vr, res);
-					_avr_flags_sub_zns(avr, res, vd, vr);
-					SREG();
-				}	break;
-				case 0x1c00: {	// ADD -- Add with carry -- 0001 11rd dddd rrrr
-					get_vd5_vr5(opcode);
-					uint8_t res = vd + vr + avr->sreg[S_C];
-					if (r == d) {
-						STATE("rol %s[%02x] = %02x\n", avr_regname(d), avr->data[d], res);
-					} else {
-						STATE("addc %s[%02x], %s[%02x] = %02x\n", avr_regname(d), avr->data[d], avr_regname(r), avr->data[r], res);
-					}
-					_avr_set_r(avr, d, res);
-					_avr_flags_add_zns(avr, res, vd, vr);
-					SREG();
-				}	break;
-				default: _avr_invalid_opcode(avr);
+				case 0x1800: OP(SUB, 1); break;	// SUB -- Subtract without carry -- 0001 10rd dddd rrrr
+				case 0x1000: OP(CPSE, 1); break;	// CPSE -- Compare, skip if equal -- 0001 00rd dddd rrrr
+				case 0x1400: OP(CP, 1); break;		// CP -- Compare -- 0001 01rd dddd rrrr
+				case 0x1c00: OP(ADC, 1); break;	// ADD -- Add with carry -- 0001 11rd dddd rrrr
 			}
 		}	break;
 
 		case 0x2000: {
+			get_d5_r5(opcode);
+			op->d = d; op->r = r;
 			switch (opcode & 0xfc00) {
-				case 0x2000: {	// AND -- Logical AND -- 0010 00rd dddd rrrr
-					get_vd5_vr5(opcode);
-					uint8_t res = vd & vr;
-					if (r == d) {
-						STATE("tst %s[%02x]\n", avr_regname(d), avr->data[d]);
-					} else {
-						STATE("and %s[%02x], %s[%02x] = %02x\n", avr_regname(d), vd, avr_regname(r), vr, res);
-					}
-					_avr_set_r(avr, d, res);
-					_avr_flags_znv0s(avr, res);
-					SREG();
-				}	break;
-				case 0x2400: {	// EOR -- Logical Exclusive OR -- 0010 01rd dddd rrrr
-					get_vd5_vr5(opcode);
-					uint8_t res = vd ^ vr;
-					if (r==d) {
-						STATE("clr %s[%02x]\n", avr_regname(d), avr->data[d]);
-					} else {
-						STATE("eor %s[%02x], %s[%02x] = %02x\n", avr_regname(d), vd, avr_regname(r), vr, res);
-					}
-					_avr_set_r(avr, d, res);
-					_avr_flags_znv0s(avr, res);
-					SREG();
-				}	break;
-				case 0x2800: {	// OR -- Logical OR -- 0010 10rd dddd rrrr
-					get_vd5_vr5(opcode);
-					uint8_t res = vd | vr;
-					STATE("or %s[%02x], %s[%02x] = %02x\n", avr_regname(d), vd, avr_regname(r), vr, res);
-					_avr_set_r(avr, d, res);
-					_avr_flags_znv0s(avr, res);
-					SREG();
-				}	break;
-				case 0x2c00: {	// MOV -- 0010 11rd dddd rrrr
-					get_d5_vr5(opcode);
-					uint8_t res = vr;
-					STATE("mov %s, %s[%02x] = %02x\n", avr_regname(d), avr_regname(r), vr, res);
-					_avr_set_r(avr, d, res);
-				}	break;
-				default: _avr_invalid_opcode(avr);
+				case 0x2000: OP(AND, 1); break;	// AND -- Logical AND -- 0010 00rd dddd rrrr
+				case 0x2400: OP(EOR, 1); break;	// EOR -- Logical Exclusive OR -- 0010 01rd dddd rrrr
+				case 0x2800: OP(OR, 1); break;		// OR -- Logical OR -- 0010 10rd dddd rrrr
+				case 0x2c00: OP(MOV, 1); break;	// MOV -- 0010 11rd dddd rrrr
 			}
 		}	break;
 
-		case 0x3000: {	// CPI -- Compare Immediate -- 0011 kkkk hhhh kkkk
-			get_vh4_k8(opcode);
-			uint8_t res = vh - k;
-			STATE("cpi %s[%02x], 0x%02x\n", avr_regname(h), vh, k);
-			_avr_flags_sub_zns(avr, res, vh, k);
-			SREG();
-		}	break;
-
-		case 0x4000: {	// SBCI -- Subtract Immediate With Carry -- 0100 kkkk hhhh kkkk
-			get_vh4_k8(opcode);
-			uint8_t res = vh - k - avr->sreg[S_C];
-			STATE("sbci %s[%02x], 0x%02x = %02x\n", avr_regname(h), vh, k, res);
-			_avr_set_r(avr, h, res);
-			_avr_flags_sub_Rzns(avr, res, vh, k);
-			SREG();
-		}	break;
-
-		case 0x5000: {	// SUBI -- Subtract Immediate -- 0101 kkkk hhhh kkkk
-			get_vh4_k8(opcode);
-			uint8_t res = vh - k;
-			STATE("subi %s[%02x], 0x%02x = %02x\n", avr_regname(h), vh, k, res);
-			_avr_set_r(avr, h, res);
-			_avr_flags_sub_zns(avr, res, vh, k);
-			SREG();
-		}	break;
-
-		case 0x6000: {	// ORI aka SBR -- Logical OR with Immediate -- 0110 kkkk hhhh kkkk
-			get_vh4_k8(opcode);
-			uint8_t res = vh | k;
-			STATE("ori %s[%02x], 0x%02x\n", avr_regname(h), vh, k);
-			_avr_set_r(avr, h, res);
-			_avr_flags_znv0s(avr, res);
-			SREG();
-		}	break;
-
-		case 0x7000: {	// ANDI	-- Logical AND with Immediate -- 0111 kkkk hhhh kkkk
-			get_vh4_k8(opcode);
-			uint8_t res = vh & k;
-			STATE("andi %s[%02x], 0x%02x\n", avr_regname(h), vh, k);
-			_avr_set_r(avr, h, res);
-			_avr_flags_znv0s(avr, res);
-			SREG();
+		case 0x3000:	// CPI -- Compare Immediate -- 0011 kkkk hhhh kkkk
+		case 0x4000:	// SBCI -- Subtract Immediate With Carry -- 0100 kkkk hhhh kkkk
+		case 0x5000:	// SUBI -- Subtract Immediate -- 0101 kkkk hhhh kkkk
+		case 0x6000:	// ORI aka SBR -- Logical OR with Immediate -- 0110 kkkk hhhh kkkk
+		case 0x7000:	// ANDI	-- Logical AND with Immediate -- 0111 kkkk hhhh kkkk
+		case 0xe000: {	// LDI Rd, K aka SER (LDI r, 0xff) -- 1110 kkkk dddd kkkk
+			get_h4_k8(opcode);
+			op->d = h; op->k = k;
+			switch (opcode & 0xf000) {
+				case 0x3000: OP(CPI, 1); break;
+				case 0x4000: OP(SBCI, 1); break;
+				case 0x5000: OP(SUBI, 1); break;
+				case 0x6000: OP(ORI, 1); break;
+				case 0x7000: OP(ANDI, 1); break;
+				case 0xe000: OP(LDI, 1); break;
+			}
 		}	break;
 
 		case 0xa000:
@@ -888,34 +823,23 @@ run_one_again:
 			 * y = 16 bits register index, 1 = Y, 0 = X
 			 * q = 6 bit displacement
 			 */
+			get_d5_q6(opcode);
+			op->d = d; op->k = q;
 			switch (opcode & 0xd008) {
 				case 0xa000:
-				case 0x8000: {	// LD (LDD) -- Load Indirect using Z -- 10q0 qqsd dddd yqqq
-					uint16_t v = avr->data[R_ZL] | (avr->data[R_ZH] << 8);
-					get_d5_q6(opcode);
-					if (opcode & 0x0200) {
-						STATE("st (Z+%d[%04x]), %s[%02x]\n", q, v+q, avr_regname(d), avr->data[d]);
-						_avr_set_ram(avr, v+q, avr->data[d]);
-					} else {
-						STATE("ld %s, (Z+%d[%04x])=[%02x]\n", avr_regname(d), q, v+q, avr->data[v+q]);
-						_avr_set_r(avr, d, _avr_get_ram(avr, v+q));
-					}
-					cycle += 1; // 2 cycles, 3 for tinyavr
-				}	break;
+				case 0x8000: 	// LD (LDD) -- Load Indirect using Z -- 10q0 qqsd dddd yqqq
+					if (opcode & 0x0200)
+						OP(STD_Z, 2)
+					else
+						OP(LDD_Z, 2)
+					break;
 				case 0xa008:
-				case 0x8008: {	// LD (LDD) -- Load Indirect using Y -- 10q0 qqsd dddd yqqq
-					uint16_t v = avr->data[R_YL] | (avr->data[R_YH] << 8);
-					get_d5_q6(opcode);
-					if (opcode & 0x0200) {
-						STATE("st (Y+%d[%04x]), %s[%02x]\n", q, v+q, avr_regname(d), avr->data[d]);
-						_avr_set_ram(avr, v+q, avr->data[d]);
-					} else {
-						STATE("ld %s, (Y+%d[%04x])=[%02x]\n", avr_regname(d), q, v+q, avr->data[d+q]);
-						_avr_set_r(avr, d, _avr_get_ram(avr, v+q));
-					}
-					cycle += 1; // 2 cycles, 3 for tinyavr
-				}	break;
-				default: _avr_invalid_opcode(avr);
+				case 0x8008: 	// LD (LDD) -- Load Indirect using Y -- 10q0 qqsd dddd yqqq
+					if (opcode & 0x0200)
+						OP(STD_Y, 2)
+					else
+						OP(LDD_Y, 2)
+					break;
 			}
 		}	break;
 
@@ -923,120 +847,50 @@ run_one_again:
 			/* this is an annoying special case, but at least these lines handle all the SREG set/clear opcodes */
 			if ((opcode & 0xff0f) == 0x9408) {
 				get_sreg_bit(opcode);
-				STATE("%s%c\n", opcode & 0x0080 ? "cl" : "se", _sreg_bit_name[b]);
-				avr_sreg_set(avr, b, (opcode & 0x0080) == 0);
-				SREG();
+				OP(BSET, 1);
+				op->d = b;
+				op->r = (opcode & 0x0080) == 0;
 			} else switch (opcode) {
-				case 0x9588: { // SLEEP -- 1001 0101 1000 1000
-					STATE("sleep\n");
-					/* Don't sleep if there are interrupts about to be serviced.
-					 * Without this check, it was possible to incorrectly enter a state
-					 * in which the cpu was sleeping and interrupts were disabled. For more
-					 * details, see the commit message. */
-					if (!avr_has_pending_interrupts(avr) || !avr->sreg[S_I])
-						avr->state = cpu_Sleeping;
-				}	break;
-				case 0x9598: { // BREAK -- 1001 0101 1001 1000
-					STATE("break\n");
-					if (avr->gdb) {
-						// if gdb is on, we break here as in here
-						// and we do so until gdb restores the instruction
-						// that was here before
-						avr->state = cpu_StepDone;
-						new_pc = avr->pc;
-						cycle = 0;
-					}
-				}	break;
-				case 0x95a8: { // WDR -- Watchdog Reset -- 1001 0101 1010 1000
-					STATE("wdr\n");
-					avr_ioctl(avr, AVR_IOCTL_WATCHDOG_RESET, 0);
-				}	break;
-				case 0x95e8: { // SPM -- Store Program Memory -- 1001 0101 1110 1000
-					STATE("spm\n");
-					avr_ioctl(avr, AVR_IOCTL_FLASH_SPM, 0);
-				}	break;
+				case 0x9588: OP(SLEEP, 1); break;	// SLEEP -- 1001 0101 1000 1000
+				case 0x9598: OP(BREAK, 1); break;	// BREAK -- 1001 0101 1001 1000
+				case 0x95a8: OP(WDR, 1); break;	// WDR -- Watchdog Reset -- 1001 0101 1010 1000
+				case 0x95e8: OP(SPM, 1); break;	// SPM -- Store Program Memory -- 1001 0101 1110 1000
 				case 0x9409:   // IJMP -- Indirect jump -- 1001 0100 0000 1001
 				case 0x9419:   // EIJMP -- Indirect jump -- 1001 0100 0001 1001   bit 4 is "indirect"
 				case 0x9509:   // ICALL -- Indirect Call to Subroutine -- 1001 0101 0000 1001
 				case 0x9519: { // EICALL -- Indirect Call to Subroutine -- 1001 0101 0001 1001   bit 8 is "push pc"
-					int e = opcode & 0x10;
-					int p = opcode & 0x100;
-					if (e && !avr->eind)
-						_avr_invalid_opcode(avr);
-					uint32_t z = avr->data[R_ZL] | (avr->data[R_ZH] << 8);
-					if (e)
-						z |= avr->data[avr->eind] << 16;
-					STATE("%si%s Z[%04x]\n", e?"e":"", p?"call":"jmp", z << 1);
-					if (p)
-						cycle += _avr_push_addr(avr, new_pc) - 1;
-					new_pc = z << 1;
-					cycle++;
-					TRACE_JUMP();
-				}	break;
-				case 0x9518: 	// RETI -- Return from Interrupt -- 1001 0101 0001 1000
-					avr_sreg_set(avr, S_I, 1);
-					avr_interrupt_reti(avr);
-					FALLTHROUGH
-				case 0x9508: {	// RET -- Return -- 1001 0101 0000 1000
-					new_pc = _avr_pop_addr(avr);
-					cycle += 1 + avr->address_size;
-					STATE("ret%s\n", opcode & 0x10 ? "i" : "");
-					TRACE_JUMP();
-					STACK_FRAME_POP();
-				}	break;
-				case 0x95c8: {	// LPM -- Load Program Memory R0 <- (Z) -- 1001 0101 1100 1000
-					uint16_t z = avr->data[R_ZL] | (avr->data[R_ZH] << 8);
-					STATE("lpm %s, (Z[%04x])\n", avr_regname(0), z);
-					cycle += 2; // 3 cycles
-					_avr_set_r(avr, 0, avr->flash[z]);
-				}	break;
-				case 0x95d8: {	// ELPM -- Load Program Memory R0 <- (Z) -- 1001 0101 1101 1000
-					if (!avr->rampz)
-						_avr_invalid_opcode(avr);
-					uint32_t z = avr->data[R_ZL] | (avr->data[R_ZH] << 8) | (avr->data[avr->rampz] << 16);
-					STATE("elpm %s, (Z[%02x:%04x])\n", avr_regname(0), z >> 16, z & 0xffff);
-					_avr_set_r(avr, 0, avr->flash[z]);
-					cycle += 2; // 3 cycles
+					OP(IJMP, 2);
+					op->d = (opcode & 0x10) != 0;	// e
+					op->r = (opcode & 0x100) != 0;	// p
 				}	break;
+				case 0x9518: OP(RETI, 2); break;	// RETI -- Return from Interrupt -- 1001 0101 0001 1000
+				case 0x9508: OP(RET, 2); break;	// RET -- Return -- 1001 0101 0000 1000
+				case 0x95c8: OP(LPM_R0, 3); break;	// LPM -- Load Program Memory R0 <- (Z) -- 1001 0101 1100 1000
+				case 0x95d8: OP(ELPM_R0, 3); break;	// ELPM -- Load Program Memory R0 <- (Z) -- 1001 0101 1101 1000
 				default:  {
+					get_d5(opcode);
+					op->d = d;
+					op->r = opcode & 3;	// post increment/pre decrement for LD/ST
 					switch (opcode & 0xfe0f) {
-						case 0x9000: {	// LDS -- Load Direct from Data Space, 32 bits -- 1001 0000 0000 0000
-							get_d5(opcode);
-							uint16_t x = _avr_flash_read16le(avr, new_pc);
-							new_pc += 2;
-							STATE("lds %s[%02x], 0x%04x\n", avr_regname(d), avr->data[d], x);
-							_avr_set_r(avr, d, _avr_get_ram(avr, x));
-							cycle++; // 2 cycles
+						case 0x9000: 	// LDS -- Load Direct from Data Space, 32 bits -- 1001 0000 0000 0000
+						case 0x9200: {	// STS -- Store Direct to Data Space, 32 bits -- 1001 0010 0000 0000
+							if ((opcode & 0xfe0f) == 0x9000)
+								OP(LDS, 2)
+							else
+								OP(STS, 2)
+							op->size = 4;
+							op->k = _avr_flash_read16le(avr, pc + 2);
 						}	break;
 						case 0x9005:
-						case 0x9004: {	// LPM -- Load Program Memory -- 1001 000d dddd 01oo
-							get_d5(opcode);
-							uint16_t z = avr->data[R_ZL] | (avr->data[R_ZH] << 8);
-							int op = opcode & 1;
-							STATE("lpm %s, (Z[%04x]%s)\n", avr_regname(d), z, op ? "+" : "");
-							_avr_set_r(avr, d, avr->flash[z]);
-							if (op) {
-								z++;
-								_avr_set_r16le_hl(avr, R_ZL, z);
-							}
-							cycle += 2; // 3 cycles
-						}	break;
+						case 0x9004: 	// LPM -- Load Program Memory -- 1001 000d dddd 01oo
+							op->r = opcode & 1;
+							OP(LPM, 3);
+							break;
 						case 0x9006:
-						case 0x9007: {	// ELPM -- Extended Load Program Memory -- 1001 000d dddd 01oo
-							if (!avr->rampz)
-								_avr_invalid_opcode(avr);
-							uint32_t z = avr->data[R_ZL] | (avr->data[R_ZH] << 8) | (avr->data[avr->rampz] << 16);
-							get_d5(opcode);
-							int op = opcode & 1;
-							STATE("elpm %s, (Z[%02x:%04x]%s)\n", avr_regname(d), z >> 16, z & 0xffff, op ? "+" : "");
-							_avr_set_r(avr, d, avr->flash[z]);
-							if (op) {
-								z++;
-								_avr_set_r(avr, avr->rampz, z >> 16);
-								_avr_set_r16le_hl(avr, R_ZL, z);
-							}
-							cycle += 2; // 3 cycles
-						}	break;
+						case 0x9007: 	// ELPM -- Extended Load Program Memory -- 1001 000d dddd 01oo
+							op->r = opcode & 1;
+							OP(ELPM, 3);
+							break;
 						/*
 						 * Load store instructions
 						 *
@@ -1047,270 +901,73 @@ run_one_again:
 						 */
 						case 0x900c:
 						case 0x900d:
-						case 0x900e: {	// LD -- Load Indirect from Data using X -- 1001 000d dddd 11oo
-							int op = opcode & 3;
-							get_d5(opcode);
-							uint16_t x = (avr->data[R_XH] << 8) | avr->data[R_XL];
-							STATE("ld %s, %sX[%04x]%s\n", avr_regname(d), op == 2 ? "--" : "", x, op == 1 ? "++" : "");
-							cycle++; // 2 cycles (1 for tinyavr, except with inc/dec 2)
-							if (op == 2) x--;
-							uint8_t vd = _avr_get_ram(avr, x);
-							if (op == 1) x++;
-							_avr_set_r16le_hl(avr, R_XL, x);
-							_avr_set_r(avr, d, vd);
-						}	break;
+						case 0x900e: OP(LD_X, 2); break;	// LD -- Load Indirect from Data using X -- 1001 000d dddd 11oo
 						case 0x920c:
 						case 0x920d:
-						case 0x920e: {	// ST -- Store Indirect Data Space X -- 1001 001d dddd 11oo
-							int op = opcode & 3;
-							get_vd5(opcode);
-							uint16_t x = (avr->data[R_XH] << 8) | avr->data[R_XL];
-							STATE("st %sX[%04x]%s, %s[%02x] \n", op == 2 ? "--" : "", x, op == 1 ? "++" : "", avr_regname(d), vd);
-							cycle++; // 2 cycles, except tinyavr
-							if (op == 2) x--;
-							_avr_set_ram(avr, x, vd);
-							if (op == 1) x++;
-							_avr_set_r16le_hl(avr, R_XL, x);
-						}	break;
+						case 0x920e: OP(ST_X, 2); break;	// ST -- Store Indirect Data Space X -- 1001 001d dddd 11oo
 						case 0x9009:
-						case 0x900a: {	// LD -- Load Indirect from Data using Y -- 1001 000d dddd 10oo
-							int op = opcode & 3;
-							get_d5(opcode);
-							uint16_t y = (avr->data[R_YH] << 8) | avr->data[R_YL];
-							STATE("ld %s, %sY[%04x]%s\n", avr_regname(d), op == 2 ? "--" : "", y, op == 1 ? "++" : "");
-							cycle++; // 2 cycles, except tinyavr
-							if (op == 2) y--;
-							uint8_t vd = _avr_get_ram(avr, y);
-							if (op == 1) y++;
-							_avr_set_r16le_hl(avr, R_YL, y);
-							_avr_set_r(avr, d, vd);
-						}	break;
+						case 0x900a: OP(LD_Y, 2); break;	// LD -- Load Indirect from Data using Y -- 1001 000d dddd 10oo
 						case 0x9209:
-						case 0x920a: {	// ST -- Store Indirect Data Space Y -- 1001 001d dddd 10oo
-							int op = opcode & 3;
-							get_vd5(opcode);
-							uint16_t y = (avr->data[R_YH] << 8) | avr->data[R_YL];
-							STATE("st %sY[%04x]%s, %s[%02x]\n", op == 2 ? "--" : "", y, op == 1 ? "++" : "", avr_regname(d), vd);
-							cycle++;
-							if (op == 2) y--;
-							_avr_set_ram(avr, y, vd);
-							if (op == 1) y++;
-							_avr_set_r16le_hl(avr, R_YL, y);
-						}	break;
-						case 0x9200: {	// STS -- Store Direct to Data Space, 32 bits -- 1001 0010 0000 0000
-							get_vd5(opcode);
-							uint16_t x = _avr_flash_read16le(avr, new_pc);
-							new_pc += 2;
-							STATE("sts 0x%04x, %s[%02x]\n", x, avr_regname(d), vd);
-							cycle++;
-							_avr_set_ram(avr, x, vd);
-						}	break;
+						case 0x920a: OP(ST_Y, 2); break;	// ST -- Store Indirect Data Space Y -- 1001 001d dddd 10oo
 						case 0x9001:
-						case 0x9002: {	// LD -- Load Indirect from Data using Z -- 1001 000d dddd 00oo
-							int op = opcode & 3;
-							get_d5(opcode);
-							uint16_t z = (avr->data[R_ZH] << 8) | avr->data[R_ZL];
-							STATE("ld %s, %sZ[%04x]%s\n", avr_regname(d), op == 2 ? "--" : "", z, op == 1 ? "++" : "");
-							cycle++;; // 2 cycles, except tinyavr
-							if (op == 2) z--;
-							uint8_t vd = _avr_get_ram(avr, z);
-							if (op == 1) z++;
-							_avr_set_r16le_hl(avr, R_ZL, z);
-							_avr_set_r(avr, d, vd);
-						}	break;
+						case 0x9002: OP(LD_Z, 2); break;	// LD -- Load Indirect from Data using Z -- 1001 000d dddd 00oo
 						case 0x9201:
-						case 0x9202: {	// ST -- Store Indirect Data Space Z -- 1001 001d dddd 00oo
-							int op = opcode & 3;
-							get_vd5(opcode);
-							uint16_t z = (avr->data[R_ZH] << 8) | avr->data[R_ZL];
-							STATE("st %sZ[%04x]%s, %s[%02x] \n", op == 2 ? "--" : "", z, op == 1 ? "++" : "", avr_regname(d), vd);
-							cycle++; // 2 cycles, except tinyavr
-							if (op == 2) z--;
-							_avr_set_ram(avr, z, vd);
-							if (op == 1) z++;
-							_avr_set_r16le_hl(avr, R_ZL, z);
-						}	break;
-						case 0x900f: {	// POP -- 1001 000d dddd 1111
-							get_d5(opcode);
-							_avr_set_r(avr, d, _avr_pop8(avr));
-							T(uint16_t sp = _avr_sp_get(avr);)
-							STATE("pop %s (@%04x)[%02x]\n", avr_regname(d), sp, avr->data[sp]);
-							cycle++;
-						}	break;
-						case 0x920f: {	// PUSH -- 1001 001d dddd 1111
-							get_vd5(opcode);
-							_avr_push8(avr, vd);
-							T(uint16_t sp = _avr_sp_get(avr);)
-							STATE("push %s[%02x] (@%04x)\n", avr_regname(d), vd, sp);
-							cycle++;
-						}	break;
-						case 0x9400: {	// COM -- One's Complement -- 1001 010d dddd 0000
-							get_vd5(opcode);
-							uint8_t res = 0xff - vd;
-							STATE("com %s[%02x] = %02x\n", avr_regname(d), vd, res);
-							_avr_set_r(avr, d, res);
-							_avr_flags_znv0s(avr, res);
-							avr->sreg[S_C] = 1;
-							SREG();
-						}	break;
-						case 0x9401: {	// NEG -- Two's Complement -- 1001 010d dddd 0001
-							get_vd5(opcode);
-							uint8_t res = 0x00 - vd;
-							STATE("neg %s[%02x] = %02x\n", avr_regname(d), vd, res);
-							_avr_set_r(avr, d, res);
-							avr->sreg[S_H] = ((res >> 3) | (vd >> 3)) & 1;
-							avr->sreg[S_V] = res == 0x80;
-							avr->sreg[S_C] = res != 0;
-							_avr_flags_zns(avr, res);
-							SREG();
-						}	break;
-						case 0x9402: {	// SWAP -- Swap Nibbles -- 1001 010d dddd 0010
-							get_vd5(opcode);
-							uint8_t res = (vd >> 4) | (vd << 4) ;
-							STATE("swap %s[%02x] = %02x\n", avr_regname(d), vd, res);
-							_avr_set_r(avr, d, res);
-						}	break;
-						case 0x9403: {	// INC -- Increment -- 1001 010d dddd 0011
-							get_vd5(opcode);
-							uint8_t res = vd + 1;
-							STATE("inc %s[%02x] = %02x\n", avr_regname(d), vd, res);
-							_avr_set_r(avr, d, res);
-							avr->sreg[S_V] = res == 0x80;
-							_avr_flags_zns(avr, res);
-							SREG();
-						}	break;
-						case 0x9405: {	// ASR -- Arithmetic Shift Right -- 1001 010d dddd 0101
-							get_vd5(opcode);
-							uint8_t res = (vd >> 1) | (vd & 0x80);
-							STATE("asr %s[%02x]\n", avr_regname(d), vd);
-							_avr_set_r(avr, d, res);
-							_avr_flags_zcnvs(avr, res, vd);
-							SREG();
-						}	break;
-						case 0x9406: {	// LSR -- Logical Shift Right -- 1001 010d dddd 0110
-							get_vd5(opcode);
-							uint8_t res = vd >> 1;
-							STATE("lsr %s[%02x]\n", avr_regname(d), vd);
-							_avr_set_r(avr, d, res);
-							avr->sreg[S_N] = 0;
-							_avr_flags_zcvs(avr, res, vd);
-							SREG();
-						}	break;
-						case 0x9407: {	// ROR -- Rotate Right -- 1001 010d dddd 0111
-							get_vd5(opcode);
-							uint8_t res = (avr->sreg[S_C] ? 0x80 : 0) | vd >> 1;
-							STATE("ror %s[%02x]\n", avr_regname(d), vd);
-							_avr_set_r(avr, d, res);
-							_avr_flags_zcnvs(avr, res, vd);
-							SREG();
-						}	break;
-						case 0x940a: {	// DEC -- Decrement -- 1001 010d dddd 1010
-							get_vd5(opcode);
-							uint8_t res = vd - 1;
-							STATE("dec %s[%02x] = %02x\n", avr_regname(d), vd, res);
-							_avr_set_r(avr, d, res);
-							avr->sreg[S_V] = res == 0x7f;
-							_avr_flags_zns(avr, res);
-							SREG();
-						}	break;
+						case 0x9202: OP(ST_Z, 2); break;	// ST -- Store Indirect Data Space Z -- 1001 001d dddd 00oo
+						case 0x900f: OP(POP, 2); break;	// POP -- 1001 000d dddd 1111
+						case 0x920f: OP(PUSH, 2); break;	// PUSH -- 1001 001d dddd 1111
+						case 0x9400: OP(COM, 1); break;	// COM -- One's Complement -- 1001 010d dddd 0000
+						case 0x9401: OP(NEG, 1); break;	// NEG -- Two's Complement -- 1001 010d dddd 0001
+						case 0x9402: OP(SWAP, 1); break;	// SWAP -- Swap Nibbles -- 1001 010d dddd 0010
+						case 0x9403: OP(INC, 1); break;	// INC -- Increment -- 1001 010d dddd 0011
+						case 0x9405: OP(ASR, 1); break;	// ASR -- Arithmetic Shift Right -- 1001 010d dddd 0101
+						case 0x9406: OP(LSR, 1); break;	// LSR -- Logical Shift Right -- 1001 010d dddd 0110
+						case 0x9407: OP(ROR, 1); break;	// ROR -- Rotate Right -- 1001 010d dddd 0111
+						case 0x940a: OP(DEC, 1); break;	// DEC -- Decrement -- 1001 010d dddd 1010
 						case 0x940c:
-						case 0x940d: {	// JMP -- Long Call to sub, 32 bits -- 1001 010a aaaa 110a
-							avr_flashaddr_t a = ((opcode & 0x01f0) >> 3) | (opcode & 1);
-							uint16_t x = _avr_flash_read16le(avr, new_pc);
-							a = (a << 16) | x;
-							STATE("jmp 0x%06x\n", a);
-							new_pc = a << 1;
-							cycle += 2;
-							TRACE_JUMP();
-						}	break;
+						case 0x940d:	// JMP -- Long Call to sub, 32 bits -- 1001 010a aaaa 110a
 						case 0x940e:
 						case 0x940f: {	// CALL -- Long Call to sub, 32 bits -- 1001 010a aaaa 111a
 							avr_flashaddr_t a = ((opcode & 0x01f0) >> 3) | (opcode & 1);
-							uint16_t x = _avr_flash_read16le(avr, new_pc);
-							a = (a << 16) | x;
-							STATE("call 0x%06x\n", a);
-							new_pc += 2;
-							cycle += 1 + _avr_push_addr(avr, new_pc);
-							new_pc = a << 1;
-							TRACE_JUMP();
-							STACK_FRAME_PUSH();
+							uint16_t x = _avr_flash_read16le(avr, pc + 2);
+							if (opcode & 2)
+								OP(CALL, 2)
+							else
+								OP(JMP, 3)
+							op->d = op->r = 0;
+							op->size = 4;
+							op->k = (a << 16) | x;
 						}	break;
-
 						default: {
 							switch (opcode & 0xff00) {
-								case 0x9600: {	// ADIW -- Add Immediate to Word -- 1001 0110 KKpp KKKK
-									get_vp2_k6(opcode);
-									uint16_t res = vp + k;
-									STATE("adiw %s:%s[%04x], 0x%02x\n", avr_regname(p), avr_regname(p + 1), vp, k);
-									_avr_set_r16le_hl(avr, p, res);
-									avr->sreg[S_V] = ((~vp & res) >> 15) & 1;
-									avr->sreg[S_C] = ((~res & vp) >> 15) & 1;
-									_avr_flags_zns16(avr, res);
-									SREG();
-									cycle++;
-								}	break;
+								case 0x9600: 	// ADIW -- Add Immediate to Word -- 1001 0110 KKpp KKKK
 								case 0x9700: {	// SBIW -- Subtract Immediate from Word -- 1001 0111 KKpp KKKK
-									get_vp2_k6(opcode);
-									uint16_t res = vp - k;
-									STATE("sbiw %s:%s[%04x], 0x%02x\n", avr_regname(p), avr_regname(p + 1), vp, k);
-									_avr_set_r16le_hl(avr, p, res);
-									avr->sreg[S_V] = ((vp & ~res) >> 15) & 1;
-									avr->sreg[S_C] = ((res & ~vp) >> 15) & 1;
-									_avr_flags_zns16(avr, res);
-									SREG();
-									cycle++;
-								}	break;
-								case 0x9800: {	// CBI -- Clear Bit in I/O Register -- 1001 1000 AAAA Abbb
-									get_io5_b3mask(opcode);
-									uint8_t res = _avr_get_ram(avr, io) & ~mask;
-									STATE("cbi %s[%04x], 0x%02x = %02x\n", avr_regname(io), avr->data[io], mask, res);
-									_avr_set_ram(avr, io, res);
-									cycle++;
-								}	break;
-								case 0x9900: {	// SBIC -- Skip if Bit in I/O Register is Cleared -- 1001 1001 AAAA Abbb
-									get_io5_b3mask(opcode);
-									uint8_t res = _avr_get_ram(avr, io) & mask;
-									STATE("sbic %s[%04x], 0x%02x\t; Will%s branch\n", avr_regname(io), avr->data[io], mask, !res?"":" not");
-									if (!res) {
-										if (_avr_is_instruction_32_bits(avr, new_pc)) {
-											new_pc += 4; cycle += 2;
-										} else {
-											new_pc += 2; cycle++;
-										}
-									}
-								}	break;
-								case 0x9a00: {	// SBI -- Set Bit in I/O Register -- 1001 1010 AAAA Abbb
-									get_io5_b3mask(opcode);
-									uint8_t res = _avr_get_ram(avr, io) | mask;
-									STATE("sbi %s[%04x], 0x%02x = %02x\n", avr_regname(io), avr->data[io], mask, res);
-									_avr_set_ram(avr, io, res);
-									cycle++;
+									get_p2_k6(opcode);
+									if ((opcode & 0xff00) == 0x9600)
+										OP(ADIW, 2)
+									else
+										OP(SBIW, 2)
+									op->d = p; op->r = 0; op->k = k;
 								}	break;
+								case 0x9800: 	// CBI -- Clear Bit in I/O Register -- 1001 1000 AAAA Abbb
+								case 0x9900: 	// SBIC -- Skip if Bit in I/O Register is Cleared -- 1001 1001 AAAA Abbb
+								case 0x9a00: 	// SBI -- Set Bit in I/O Register -- 1001 1010 AAAA Abbb
 								case 0x9b00: {	// SBIS -- Skip if Bit in I/O Register is Set -- 1001 1011 AAAA Abbb
-									get_io5_b3mask(opcode);
-									uint8_t res = _avr_get_ram(avr, io) & mask;
-									STATE("sbis %s[%04x], 0x%02x\t; Will%s branch\n", avr_regname(io), avr->data[io], mask, res?"":" not");
-									if (res) {
-										if (_avr_is_instruction_32_bits(avr, new_pc)) {
-											new_pc += 4; cycle += 2;
-										} else {
-											new_pc += 2; cycle++;
-										}
+									get_io5_b3(opcode);
+									switch (opcode & 0xff00) {
+										case 0x9800: OP(CBI, 2); break;
+										case 0x9900: OP(SBIC, 1); break;
+										case 0x9a00: OP(SBI, 2); break;
+										case 0x9b00: OP(SBIS, 1); break;
 									}
+									op->d = io; op->r = 1 << b;
 								}	break;
 								default:
 									switch (opcode & 0xfc00) {
 										case 0x9c00: {	// MUL -- Multiply Unsigned -- 1001 11rd dddd rrrr
-											get_vd5_vr5(opcode);
-											uint16_t res = vd * vr;
-											STATE("mul %s[%02x], %s[%02x] = %04x\n", avr_regname(d), vd, avr_regname(r), vr, res);
-											cycle++;
-											_avr_set_r16le(avr, 0, res);
-											avr->sreg[S_Z] = res == 0;
-											avr->sreg[S_C] = (res >> 15) & 1;
-											SREG();
+											get_d5_r5(opcode);
+											OP(MUL, 2);
+											op->d = d; op->r = r;
 										}	break;
-										default: _avr_invalid_opcode(avr);
 									}
 							}
 						}	break;
@@ -1320,125 +977,526 @@ run_one_again:
 		}	break;
 
 		case 0xb000: {
+			get_d5_a6(opcode);
+			op->d = d; op->r = A;
 			switch (opcode & 0xf800) {
-				case 0xb800: {	// OUT A,Rr -- 1011 1AAd dddd AAAA
-					get_d5_a6(opcode);
-					STATE("out %s, %s[%02x]\n", avr_regname(A), avr_regname(d), avr->data[d]);
-					_avr_set_ram(avr, A, avr->data[d]);
-				}	break;
-				case 0xb000: {	// IN Rd,A -- 1011 0AAd dddd AAAA
-					get_d5_a6(opcode);
-					STATE("in %s, %s[%02x]\n", avr_regname(d), avr_regname(A), avr->data[A]);
-					_avr_set_r(avr, d, _avr_get_ram(avr, A));
-				}	break;
-				default: _avr_invalid_opcode(avr);
+				case 0xb800: OP(OUT, 1); break;	// OUT A,Rr -- 1011 1AAd dddd AAAA
+				case 0xb000: OP(IN, 1); break;		// IN Rd,A -- 1011 0AAd dddd AAAA
 			}
 		}	break;
 
 		case 0xc000: {	// RJMP -- 1100 kkkk kkkk kkkk
 			get_o12(opcode);
-			STATE("rjmp .%d [%04x]\n", o >> 1, new_pc + o);
-			new_pc = (new_pc + o) % (avr->flashend+1);
-			cycle++;
-			TRACE_JUMP();
+			OP(RJMP, 2);
+			op->k = o;
 		}	break;
 
 		case 0xd000: {	// RCALL -- 1101 kkkk kkkk kkkk
 			get_o12(opcode);
-			STATE("rcall .%d [%04x]\n", o >> 1, new_pc + o);
-			cycle += _avr_push_addr(avr, new_pc);
-			new_pc = (new_pc + o) % (avr->flashend+1);
-			// 'rcall .1' is used as a cheap "push 16 bits of room on the stack"
-			if (o != 0) {
-				TRACE_JUMP();
-				STACK_FRAME_PUSH();
-			}
-		}	break;
-
-		case 0xe000: {	// LDI Rd, K aka SER (LDI r, 0xff) -- 1110 kkkk dddd kkkk
-			get_h4_k8(opcode);
-			STATE("ldi %s, 0x%02x\n", avr_regname(h), k);
-			_avr_set_r(avr, h, k);
+			OP(RCALL, 1);
+			op->k = o;
 		}	break;
 
 		case 0xf000: {
 			switch (opcode & 0xfe00) {
 				case 0xf100: {	/* simavr special opcodes */
-					if (opcode == 0xf1f1) { // AVR_OVERFLOW_OPCODE
-						printf("FLASH overflow, soft reset\n");
-						new_pc = 0;
-						TRACE_JUMP();
-					}
+					if (opcode == 0xf1f1) // AVR_OVERFLOW_OPCODE
+						OP(OVERFLOW, 1)
+					else
+						OP(NOP, 1)
 				}	break;
 				case 0xf000:
 				case 0xf200:
 				case 0xf400:
 				case 0xf600: {	// BRXC/BRXS -- All the SREG branches -- 1111 0Boo oooo osss
 					int16_t o = ((int16_t)(opcode << 6)) >> 9; // offset
-					uint8_t s = opcode & 7;
-					int set = (opcode & 0x0400) == 0;		// this bit means BRXC otherwise BRXS
-					int branch = (avr->sreg[s] && set) || (!avr->sreg[s] && !set);
-					const char *names[2][8] = {
-							{ "brcc", "brne", "brpl", "brvc", NULL, "brhc", "brtc", "brid"},
-							{ "brcs", "breq", "brmi", "brvs", NULL, "brhs", "brts", "brie"},
-					};
-					if (names[set][s]) {
-						STATE("%s .%d [%04x]\t; Will%s branch\n", names[set][s], o, new_pc + (o << 1), branch ? "":" not");
-					} else {
-						STATE("%s%c .%d [%04x]\t; Will%s branch\n", set ? "brbs" : "brbc", _sreg_bit_name[s], o, new_pc + (o << 1), branch ? "":" not");
-					}
-					if (branch) {
-						cycle++; // 2 cycles if taken, 1 otherwise
-						new_pc = new_pc + (o << 1);
-					}
+					// this bit means BRXC otherwise BRXS
+					if ((opcode & 0x0400) == 0)
+						OP(BRBS, 1)
+					else
+						OP(BRBC, 1)
+					op->d = opcode & 7;
+					op->k = o;
 				}	break;
 				case 0xf800:
-				case 0xf900: {	// BLD -- Bit Store from T into a Bit in Register -- 1111 100d dddd 0bbb
-					get_vd5_s3_mask(opcode);
-					uint8_t v = (vd & ~mask) | (avr->sreg[S_T] ? mask : 0);
-					STATE("bld %s[%02x], 0x%02x = %02x\n", avr_regname(d), vd, mask, v);
-					_avr_set_r(avr, d, v);
-				}	break;
+				case 0xf900:	// BLD -- Bit Store from T into a Bit in Register -- 1111 100d dddd 0bbb
 				case 0xfa00:
-				case 0xfb00:{	// BST -- Bit Store into T from bit in Register -- 1111 101d dddd 0bbb
-					get_vd5_s3(opcode)
-					STATE("bst %s[%02x], 0x%02x\n", avr_regname(d), vd, 1 << s);
-					avr->sreg[S_T] = (vd >> s) & 1;
-					SREG();
-				}	break;
+				case 0xfb00:	// BST -- Bit Store into T from bit in Register -- 1111 101d dddd 0bbb
 				case 0xfc00:
 				case 0xfe00: {	// SBRS/SBRC -- Skip if Bit in Register is Set/Clear -- 1111 11sd dddd 0bbb
-					get_vd5_s3_mask(opcode)
-					int set = (opcode & 0x0200) != 0;
-					int branch = ((vd & mask) && set) || (!(vd & mask) && !set);
-					STATE("%s %s[%02x], 0x%02x\t; Will%s branch\n", set ? "sbrs" : "sbrc", avr_regname(d), vd, mask, branch ? "":" not");
-					if (branch) {
-						if (_avr_is_instruction_32_bits(avr, new_pc)) {
-							new_pc += 4; cycle += 2;
-						} else {
-							new_pc += 2; cycle++;
-						}
+					get_d5_s3(opcode);
+					op->d = d;
+					op->r = 1 << s;
+					switch (opcode & 0xfe00) {
+						case 0xf800: OP(BLD, 1); break;
+						case 0xfa00: OP(BST, 1); op->r = s; break;
+						case 0xfc00: OP(SBRC, 1); break;
+						case 0xfe00: OP(SBRS, 1); break;
 					}
 				}	break;
-				default: _avr_invalid_opcode(avr);
 			}
 		}	break;
+	}
+#undef OP
+
+	switch (op->kind) {
+		case AVR_OP_MUL: case AVR_OP_MULS: case AVR_OP_MULSU:
+		case AVR_OP_FMUL: case AVR_OP_FMULS: case AVR_OP_FMULSU:
+			if (avr->isa == AVR_ISA_TINY)
+				op->kind = AVR_OP_INVALID;
+			break;
+		case AVR_OP_ELPM_R0: case AVR_OP_ELPM:
+			if (!avr->rampz)
+				op->kind = AVR_OP_INVALID;
+			break;
+		case AVR_OP_IJMP:
+			if (op->d && !avr->eind)
+				op->kind = AVR_OP_INVALID;
+			break;
+	}
+	if (op->kind == AVR_OP_INVALID)
+		op->cycles = 1;
+}
 
-		default: _avr_invalid_opcode(avr);
+/*
+ * Returns the decoded instruction at pc, decoding it if it is not
+ * in the table already
+ */
+static inline avr_decoded_t *
+_avr_fetch(
+		avr_t * avr,
+		avr_flashaddr_t pc)
+{
+	avr_decoded_t * op = &avr->decoded[pc >> 1];
+	if (unlikely(op->kind == AVR_OP_NONE))
+		_avr_decode_one(avr, pc, op);
+	return op;
+}
 
+void
+avr_decode_invalidate(
+		avr_t * avr,
+		avr_flashaddr_t addr,
+		uint32_t size)
+{
+	if (!avr->decoded || !size)
+		return;
+	// the word before might be a 32 bits instruction using this one
+	avr_flashaddr_t start = addr >> 1;
+	avr_flashaddr_t end = (addr + size + 1) >> 1;
+	if (start)
+		start--;
+	if (end > (avr->flashend + 1) >> 1)
+		end = (avr->flashend + 1) >> 1;
+	for (avr_flashaddr_t i = start; i < end; i++)
+		avr->decoded[i].kind = AVR_OP_NONE;
+	// and the blocks before it might run into it
+	avr_flashaddr_t first = start > AVR_BLOCK_MAX ? start - AVR_BLOCK_MAX : 0;
+	for (avr_flashaddr_t i = first; i < start; i++)
+		avr->decoded[i].block = AVR_BLOCK_UNKNOWN;
+	// and so might the loops of the branches after it
+	for (avr_flashaddr_t i = end; i < end + AVR_LOOP_MAX && i < (avr->flashend + 1) >> 1; i++)
+		avr->decoded[i].loop = AVR_LOOP_UNKNOWN;
+#if AVR_HAS_JIT
+	if (avr->jit)
+		avr_jit_invalidate(avr, first, end);
+#endif
+}
+
+/*
+ * Returns nonzero if the instruction can be part of a basic block: it only
+ * works on registers, can't branch, skip, touch IO/SRAM or change the
+ * interrupt state, and always takes the same number of cycles.
+ */
+static inline int
+_avr_op_in_block(
+		const avr_decoded_t * op)
+{
+	switch (op->kind) {
+		case AVR_OP_NOP:
+		case AVR_OP_CPC: case AVR_OP_ADD: case AVR_OP_SBC: case AVR_OP_SUB:
+		case AVR_OP_CP: case AVR_OP_ADC:
+		case AVR_OP_AND: case AVR_OP_EOR: case AVR_OP_OR: case AVR_OP_MOV:
+		case AVR_OP_MOVW:
+		case AVR_OP_MUL: case AVR_OP_MULS: case AVR_OP_MULSU:
+		case AVR_OP_FMUL: case AVR_OP_FMULS: case AVR_OP_FMULSU:
+		case AVR_OP_CPI: case AVR_OP_SBCI: case AVR_OP_SUBI: case AVR_OP_ORI:
+		case AVR_OP_ANDI: case AVR_OP_LDI:
+		case AVR_OP_COM: case AVR_OP_NEG: case AVR_OP_SWAP: case AVR_OP_INC:
+		case AVR_OP_ASR: case AVR_OP_LSR: case AVR_OP_ROR: case AVR_OP_DEC:
+		case AVR_OP_ADIW: case AVR_OP_SBIW:
+		case AVR_OP_BLD: case AVR_OP_BST:
+			return 1;
+		case AVR_OP_BSET:	// except sei/cli
+			return op->d != S_I;
 	}
-	avr->cycle += cycle;
-
-	if ((avr->state == cpu_Running) &&
-		(avr->run_cycle_count > cycle) &&
-		(avr->interrupt_state == 0))
-	{
-		avr->run_cycle_count -= cycle;
-		avr->pc = new_pc;
-		goto run_one_again;
+	return 0;
+}
+
+/*
+ * Basic blocks need the threaded executor, and are not used when tracing
+ * as that needs to see every instruction go through the prologue
+ */
+#if defined(__GNUC__) && !CONFIG_SIMAVR_TRACE
+#define AVR_HAS_BLOCKS 1
+
+/*
+ * Finds the basic block starting at pc, and fills in the block length
+ * of all the instructions in it, as they all start a (shorter) one too.
+ * Blocks that are already known are left alone, so a block never changes
+ * length once it's been entered (the JIT relies on that).
+ */
+static void
+_avr_block_scan(
+		avr_t * avr,
+		avr_flashaddr_t pc)
+{
+	int count = 0;
+
+	while (count < AVR_BLOCK_MAX && pc + (count * 2) < avr->flashend &&
+			_avr_op_in_block(_avr_fetch(avr, pc + (count * 2))))
+		count++;
+	avr_decoded_t * op = &avr->decoded[pc >> 1];
+	op->block = op->block_cycles = 0;
+	for (int i = count - 1, cycles = 0; i >= 0; i--) {
+		cycles += op[i].cycles;
+		if (i && op[i].block != AVR_BLOCK_UNKNOWN)
+			continue;
+		op[i].block = count - i;
+		op[i].block_cycles = cycles;
 	}
+}
+#endif
 
-	return new_pc;
+void
+avr_decode_flash(
+		avr_t * avr,
+		avr_flashaddr_t addr,
+		uint32_t size)
+{
+	if (!avr->decoded)
+		return;
+	avr_decode_invalidate(avr, addr, size);
+	for (avr_flashaddr_t pc = addr & ~1; pc < addr + size && pc <= avr->flashend; pc += 2)
+		_avr_fetch(avr, pc);
 }
 
+/*
+ * Skip instructions need to know how long the next one is
+ */
+static inline int _avr_is_instruction_32_bits(avr_t * avr, avr_flashaddr_t pc)
+{
+	return _avr_fetch(avr, pc)->size == 4;
+}
+
+/*
+ * Returns how far the instruction at pc can go in an idle loop body: to the
+ * next one, past the one it skips, or to its (forward) branch target.
+ * Returns 0 for anything that can't be in an idle loop: stores, IO writes,
+ * stack, calls, sei/cli, SLEEP etc, and reads that change more than registers.
+ */
+static avr_flashaddr_t
+_avr_idle_op_next(
+		avr_t * avr,
+		avr_flashaddr_t pc,
+		const avr_decoded_t * op)
+{
+	switch (op->kind) {
+		case AVR_OP_IN: case AVR_OP_LDS:
+		case AVR_OP_LDD_Y: case AVR_OP_LDD_Z:
+		case AVR_OP_LD_X: case AVR_OP_LD_Y: case AVR_OP_LD_Z:
+		case AVR_OP_LPM_R0: case AVR_OP_LPM: case AVR_OP_ELPM_R0:
+			return pc + op->size;
+		case AVR_OP_ELPM:	// Z+ also writes RAMPZ
+			return op->r ? 0 : pc + op->size;
+		case AVR_OP_CPSE:
+		case AVR_OP_SBIC: case AVR_OP_SBIS: case AVR_OP_SBRC: case AVR_OP_SBRS:
+			return pc + 2 + _avr_fetch(avr, pc + 2)->size;
+		case AVR_OP_RJMP:
+			return op->k >= 0 ? pc + 2 + op->k : 0;
+		case AVR_OP_BRBS: case AVR_OP_BRBC:
+			return op->k >= 0 ? pc + 2 + (op->k << 1) : 0;
+	}
+	return _avr_op_in_block(op) ? pc + op->size : 0;
+}
+
+/*
+ * Matches the body [target, pc) of a brne loop against the avr-libc and
+ * __builtin_avr_delay_cycles() countdowns: dec, sbiw 1, or subi 1 followed
+ * by up to three sbci 0, and fills in the counter registers. Returns the
+ * counter size in bytes, 0 if it's not one of these.
+ */
+static int
+_avr_count_loop_match(
+		avr_t * avr,
+		avr_flashaddr_t pc,
+		avr_flashaddr_t target,
+		uint8_t * counter)
+{
+	const avr_decoded_t * op = _avr_fetch(avr, pc);
+	if (op->kind != AVR_OP_BRBC || op->d != S_Z || target >= pc)
+		return 0;
+	op = _avr_fetch(avr, target);
+	switch (op->kind) {
+		case AVR_OP_DEC:
+			counter[0] = op->d;
+			return pc == target + 2;
+		case AVR_OP_SBIW:
+			counter[0] = op->d;
+			counter[1] = op->d + 1;
+			return pc == target + 2 && op->k == 1 ? 2 : 0;
+		case AVR_OP_SUBI:
+			if (op->k != 1)
+				return 0;
+			counter[0] = op->d;
+			break;
+		default:
+			return 0;
+	}
+	int size = 1;
+	for (avr_flashaddr_t i = target + 2; i < pc; i += 2, size++) {
+		op = _avr_fetch(avr, i);
+		if (size == 4 || op->kind != AVR_OP_SBCI || op->k != 0)
+			return 0;
+		for (int j = 0; j < size; j++)
+			if (counter[j] == op->d)
+				return 0;
+		counter[size] = op->d;
+	}
+	return size > 1 ? size : 0;
+}
 
+/*
+ * A counting loop with 'count' iterations left: the burst ends here so
+ * avr_idle_fast_forward() can run all but the last one in one go.
+ */
+static void
+_avr_count_loop(
+		avr_t * avr,
+		avr_flashaddr_t pc,
+		avr_flashaddr_t target,
+		avr_cycle_count_t when)
+{
+	uint8_t * counter = avr->idle.counter;
+	int size = _avr_count_loop_match(avr, pc, target, counter);
+	uint32_t count = 0;
+
+	for (int i = 0; i < size; i++)
+		count |= (uint32_t)avr->data[counter[i]] << (i * 8);
+	if (count < 2)
+		return;
+	avr->idle.pc = target;
+	avr->idle.cycle = when;
+	avr->idle.skip = 2;	// the taken brne
+	for (avr_flashaddr_t i = target; i < pc; i += 2)
+		avr->idle.skip += avr->decoded[i >> 1].cycles;
+	avr->idle.counter_size = size;
+	avr->run_cycle_count = 0;	// back to the run loop
+}
+
+/*
+ * Works out what the loop closed by the backward branch at pc is: a counting
+ * loop, a candidate idle loop if its body is short, only works on registers
+ * and reads memory, and only branches forward inside the loop so the branch
+ * at pc is the only way out; or neither.
+ */
+static uint8_t
+_avr_loop_scan(
+		avr_t * avr,
+		avr_flashaddr_t pc,
+		avr_flashaddr_t target)
+{
+	uint8_t counter[4];
+
+	if (_avr_count_loop_match(avr, pc, target, counter))
+		return AVR_LOOP_COUNT;
+	if (target > pc || pc - target > AVR_LOOP_MAX * 2)
+		return AVR_LOOP_NONE;
+	for (avr_flashaddr_t i = target; i < pc; ) {
+		avr_flashaddr_t next = _avr_idle_op_next(avr, i, _avr_fetch(avr, i));
+		if (!next || next > pc)
+			return AVR_LOOP_NONE;
+		i += _avr_fetch(avr, i)->size;
+	}
+	return 1;
+}
+
+/*
+ * Called by the taken backward branches that might close an idle loop,
+ * with the branch at 'pc', the start of the loop at 'target' and the cycle
+ * the loop starts again at.
+ *
+ * The first time, the loop is checked by _avr_loop_scan(). Reads that have
+ * side effects (IO callbacks, IO IRQs) can only be checked for when they
+ * happen, in _avr_get_data().
+ *
+ * Then if the core gets back to the start with the same registers and SREG
+ * as last time, and nothing else happened in between (see avr_idle_reset()),
+ * the loop is idle: the burst ends here so avr_idle_fast_forward() can skip
+ * the iterations until the next timer.
+ */
+static void
+_avr_idle_loop(
+		avr_t * avr,
+		avr_flashaddr_t pc,
+		avr_flashaddr_t target,
+		avr_cycle_count_t when)
+{
+	avr_decoded_t * op = &avr->decoded[pc >> 1];
+
+	if (op->loop == AVR_LOOP_UNKNOWN)
+		op->loop = _avr_loop_scan(avr, pc, target);
+	if (op->loop == AVR_LOOP_COUNT) {
+		_avr_count_loop(avr, pc, target, when);
+		return;
+	}
+	if (avr->idle.pc == target) {
+		if (avr_sreg_read(avr) == avr->idle.sreg &&
+				!memcmp(avr->data, avr->idle.regs, 32)) {
+			avr->idle.skip = when - avr->idle.cycle;
+			avr->idle.counter_size = 0;
+			avr->idle.cycle = when;
+			avr->run_cycle_count = 0;	// back to the run loop
+			return;
+		}
+		if (++op->loop > AVR_LOOP_MISSES) {
+			op->loop = AVR_LOOP_NONE;
+			avr_idle_reset(avr);
+			return;
+		}
+	}
+	avr->idle.pc = target;
+	avr->idle.cycle = when;
+	avr->idle.skip = 0;
+	avr->idle.sreg = avr_sreg_read(avr);
+	memcpy(avr->idle.regs, avr->data, 32);
+}
+
+void
+avr_idle_fast_forward(
+		avr_t * avr,
+		avr_cycle_count_t how_long)
+{
+	avr_cycle_count_t skip = avr->idle.skip;
+	int size = avr->idle.counter_size;
+
+	avr->idle.skip = 0;
+	avr->idle.counter_size = 0;
+	if (!skip || how_long <= skip || avr->pc != avr->idle.pc ||
+			avr->state != cpu_Running || avr->interrupt_state)
+		return;
+	/*
+	 * Only whole iterations, and not the one the timer falls in, so that
+	 * one runs and gets to the timer exactly where it would have
+	 */
+	avr_cycle_count_t n = (how_long - 1) / skip;
+	if (size) {
+		/*
+		 * Counting loop, the last iteration is left to run too so it
+		 * sets SREG; the iterations skipped only change the counter,
+		 * and the flags the next one sets anyway.
+		 */
+		uint32_t count = 0;
+		for (int i = 0; i < size; i++)
+			count |= (uint32_t)avr->data[avr->idle.counter[i]] << (i * 8);
+		if (n > count - 1)
+			n = count - 1;
+		count -= n;
+		for (int i = 0; i < size; i++)
+			avr->data[avr->idle.counter[i]] = count >> (i * 8);
+		avr->idle.pc = AVR_IDLE_NONE;
+	}
+	avr->cycle += n * skip;
+	avr->idle.cycle += n * skip;
+	how_long -= n * skip;
+	if (avr->run_cycle_count > how_long)
+		avr->run_cycle_count = how_long;
+}
+
+/*
+ * Main instruction executor
+ *
+ * Runs instructions from the pre-decoded table, until a cycle timer is
+ * due, or an interrupt is pending, or the core changes state.
+ *
+ * The number of cycles taken by instruction has been added, but might not be
+ * entirely accurate.
+ *
+ * The instruction bodies live in sim_core_run.h, the default executor
+ * uses a switch() for dispatch, avr_run_one_threaded() uses computed gotos
+ * when the compiler supports them, and avr_run_one_blocks() runs whole
+ * basic blocks on top of that. avr_run_one_jit() also translates the hot
+ * blocks to native code, when built with CONFIG_SIMAVR_JIT.
+ *
+ * Each of these is instantiated for 2 and 3 bytes return addresses, and
+ * the public functions pick the one that matches the core (AVR_ISA_*);
+ * the instructions the core doesn't have are trapped by the decoder.
+ */
+#define AVR_RUN_VARIANTS(_name) \
+	avr_flashaddr_t _name(avr_t * avr) \
+	{ \
+		if (avr->address_size == 3) \
+			return _name##_pc3(avr); \
+		return _name##_pc2(avr); \
+	}
+
+#define AVR_RUN_ONE avr_run_one_pc2
+#include "sim_core_run.h"
+#define AVR_RUN_ONE avr_run_one_pc3
+#define AVR_RUN_PC_SIZE 3
+#include "sim_core_run.h"
+AVR_RUN_VARIANTS(avr_run_one)
+
+#if defined(__GNUC__)
+#define AVR_RUN_ONE avr_run_one_threaded_pc2
+#define AVR_RUN_THREADED 1
+#include "sim_core_run.h"
+#define AVR_RUN_ONE avr_run_one_threaded_pc3
+#define AVR_RUN_PC_SIZE 3
+#define AVR_RUN_THREADED 1
+#include "sim_core_run.h"
+AVR_RUN_VARIANTS(avr_run_one_threaded)
+#else
+avr_flashaddr_t avr_run_one_threaded(avr_t * avr)
+{
+	return avr_run_one(avr);
+}
+#endif
+
+#if AVR_HAS_BLOCKS
+#define AVR_RUN_ONE avr_run_one_blocks_pc2
+#define AVR_RUN_THREADED 1
+#define AVR_RUN_BLOCKS 1
+#include "sim_core_run.h"
+#define AVR_RUN_ONE avr_run_one_blocks_pc3
+#define AVR_RUN_PC_SIZE 3
+#define AVR_RUN_THREADED 1
+#define AVR_RUN_BLOCKS 1
+#include "sim_core_run.h"
+AVR_RUN_VARIANTS(avr_run_one_blocks)
+#else
+avr_flashaddr_t avr_run_one_blocks(avr_t * avr)
+{
+	return avr_run_one_threaded(avr);
+}
+#endif
+
+#if AVR_HAS_JIT
+#define AVR_RUN_ONE avr_run_one_jit_pc2
+#define AVR_RUN_THREADED 1
+#define AVR_RUN_BLOCKS 1
+#define AVR_RUN_JIT 1
+#include "sim_core_run.h"
+#define AVR_RUN_ONE avr_run_one_jit_pc3
+#define AVR_RUN_PC_SIZE 3
+#define AVR_RUN_THREADED 1
+#define AVR_RUN_BLOCKS 1
+#define AVR_RUN_JIT 1
+#include "sim_core_run.h"
+AVR_RUN_VARIANTS(avr_run_one_jit)
+#else
+avr_flashaddr_t avr_run_one_jit(avr_t * avr)
+{
+	return avr_run_one_blocks(avr);
+}
+#endif
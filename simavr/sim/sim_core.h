@@ -36,10 +36,197 @@ extern "C" {
 	#define FONT_DEFAULT	"\e[0m"
 #endif
 
+/*
+ * Decoded instruction kinds, as found in avr_decoded_t.kind
+ */
+enum {
+	AVR_OP_NONE = 0,	// not decoded yet
+	AVR_OP_INVALID,
+	AVR_OP_NOP,
+	AVR_OP_CPC, AVR_OP_ADD, AVR_OP_SBC, AVR_OP_SUB, AVR_OP_CP, AVR_OP_ADC,
+	AVR_OP_CPSE,
+	AVR_OP_AND, AVR_OP_EOR, AVR_OP_OR, AVR_OP_MOV, AVR_OP_MOVW,
+	AVR_OP_MUL, AVR_OP_MULS, AVR_OP_MULSU,
+	AVR_OP_FMUL, AVR_OP_FMULS, AVR_OP_FMULSU,
+	AVR_OP_CPI, AVR_OP_SBCI, AVR_OP_SUBI, AVR_OP_ORI, AVR_OP_ANDI, AVR_OP_LDI,
+	AVR_OP_LDD_Z, AVR_OP_STD_Z, AVR_OP_LDD_Y, AVR_OP_STD_Y,
+	AVR_OP_BSET,		// also BCLR, and all the SEx/CLx aliases
+	AVR_OP_SLEEP, AVR_OP_BREAK, AVR_OP_WDR, AVR_OP_SPM,
+	AVR_OP_IJMP,		// also EIJMP, ICALL, EICALL
+	AVR_OP_RETI, AVR_OP_RET,
+	AVR_OP_LPM_R0, AVR_OP_ELPM_R0, AVR_OP_LPM, AVR_OP_ELPM,
+	AVR_OP_LDS, AVR_OP_STS,
+	AVR_OP_LD_X, AVR_OP_ST_X, AVR_OP_LD_Y, AVR_OP_ST_Y, AVR_OP_LD_Z, AVR_OP_ST_Z,
+	AVR_OP_POP, AVR_OP_PUSH,
+	AVR_OP_COM, AVR_OP_NEG, AVR_OP_SWAP, AVR_OP_INC, AVR_OP_ASR, AVR_OP_LSR,
+	AVR_OP_ROR, AVR_OP_DEC,
+	AVR_OP_JMP, AVR_OP_CALL,
+	AVR_OP_ADIW, AVR_OP_SBIW,
+	AVR_OP_CBI, AVR_OP_SBIC, AVR_OP_SBI, AVR_OP_SBIS,
+	AVR_OP_OUT, AVR_OP_IN,
+	AVR_OP_RJMP, AVR_OP_RCALL,
+	AVR_OP_OVERFLOW,
+	AVR_OP_BRBS, AVR_OP_BRBC,
+	AVR_OP_BLD, AVR_OP_BST, AVR_OP_SBRC, AVR_OP_SBRS,
+
+	AVR_OP_COUNT
+};
+
+/*
+ * Basic blocks are runs of straight line, register only instructions
+ * that avr_run_one_blocks() executes in one go. They end at the next
+ * branch, skip, IO/SRAM access, sei/cli etc., and are at most
+ * AVR_BLOCK_MAX instructions long.
+ */
+#define AVR_BLOCK_MAX		64
+#define AVR_BLOCK_UNKNOWN	0xff
+
+/*
+ * Idle loops are short backward loops that only read plain memory, and
+ * that come back to their start with the same registers and SREG: they
+ * are going to do the same thing until something else (timer, interrupt)
+ * happens, so the run loops skip straight to that, see avr_idle_fast_forward().
+ * The loop body is at most AVR_LOOP_MAX words, and a branch that misses
+ * AVR_LOOP_MISSES times isn't looked at any more.
+ *
+ * Counting loops are the dec/brne, sbiw/brne and subi/sbci.../brne loops
+ * of _delay_ms() and friends: as their iteration count is known, they
+ * are skipped the same way, with the counter updated to match.
+ */
+#define AVR_LOOP_MAX		16
+#define AVR_LOOP_MISSES		8
+#define AVR_LOOP_NONE		0		// not a candidate
+#define AVR_LOOP_COUNT		0x80	// counting loop
+#define AVR_LOOP_UNKNOWN	0xff	// not looked at yet
+
+/*
+ * A pre-decoded instruction. There is one of these per flash word in
+ * avr->decoded, filled the first time the instruction is fetched, or
+ * when the code is loaded.
+ */
+typedef struct avr_decoded_t {
+	uint8_t		kind;	// AVR_OP_*
+	uint8_t		size;	// instruction size, in bytes (2 or 4)
+	uint8_t		cycles;	// base cycle count, branches/calls add to it
+	uint8_t		d;		// destination register, IO address, SREG bit...
+	uint8_t		r;		// source register, bit mask, addressing mode...
+	uint8_t		block;	// block instructions starting here, or AVR_BLOCK_UNKNOWN
+	uint8_t		block_cycles;	// total base cycles of these
+	uint8_t		loop;	// backward branches: AVR_LOOP_*, or 1 + misses
+	int32_t		k;		// immediate, displacement, offset or address
+} avr_decoded_t;
+
 /*
  * Instruction decoder, run ONE instruction
  */
 avr_flashaddr_t avr_run_one(avr_t * avr);
+/*
+ * Same as avr_run_one, but dispatches using computed gotos if the
+ * compiler supports them
+ */
+avr_flashaddr_t avr_run_one_threaded(avr_t * avr);
+/*
+ * Same as avr_run_one_threaded, but runs whole basic blocks between the
+ * timer/interrupt checks
+ */
+avr_flashaddr_t avr_run_one_blocks(avr_t * avr);
+/*
+ * Same as avr_run_one_blocks, with the hot blocks translated to native
+ * code when the JIT is compiled in, see sim_jit.h
+ */
+avr_flashaddr_t avr_run_one_jit(avr_t * avr);
+
+/*
+ * Pre-decode the instructions from flash for [addr, addr+size)
+ * This is called by avr_loadcode()
+ */
+void
+avr_decode_flash(
+		avr_t * avr,
+		avr_flashaddr_t addr,
+		uint32_t size);
+/*
+ * Discard the decoded instructions for [addr, addr+size), and the basic
+ * blocks running into it -- this needs to be called by anything that
+ * writes to avr->flash after the code was loaded (SPM, gdb...)
+ */
+void
+avr_decode_invalidate(
+		avr_t * avr,
+		avr_flashaddr_t addr,
+		uint32_t size);
+
+/*
+ * Data space access classes, one per data address in avr->data_class.
+ * Loads and stores only look at this to know what to do with an address;
+ * the first three are plain memory and are accessed directly.
+ */
+enum {
+	AVR_DATA_SRAM = 0,
+	AVR_DATA_GPR,		// r0..r31
+	AVR_DATA_IO_PLAIN,	// IO register nobody is listening to
+	AVR_DATA_IO,		// IO register with read/write callbacks or IRQs
+	AVR_DATA_SREG,
+	AVR_DATA_SP,		// SPL, SPH
+	AVR_DATA_WATCHED,	// has a gdb watchpoint
+	AVR_DATA_INVALID,	// past ramend
+};
+// avr->data_class covers the whole 16 bits data address range
+#define AVR_DATA_CLASS_SIZE	0x10000
+
+/*
+ * Works out the access class of the 'count' data addresses from 'addr'.
+ * This needs to be called by anything that changes the way these
+ * addresses are accessed (IO callbacks, IO IRQs, gdb watchpoints...)
+ */
+void
+avr_data_class_update(
+		avr_t * avr,
+		uint32_t addr,
+		uint32_t count);
+
+/*
+ * Forgets the idle loop state, this needs to be called by anything that
+ * can change what a loop reading memory would see (timers, interrupts...)
+ */
+static inline void
+avr_idle_reset(
+		avr_t * avr)
+{
+	avr->idle.pc = AVR_IDLE_NONE;
+	avr->idle.skip = 0;
+	avr->idle.counter_size = 0;
+}
+/*
+ * Called by the run loops after each burst, instead of calling
+ * avr_cycle_timer_process() directly: if no timer is due yet, the next
+ * burst is worked out from the cached deadline without going thru the
+ * timer pool. Returns the cycles until the next timer, the same way.
+ */
+static inline avr_cycle_count_t
+avr_cycle_timer_process_due(
+		avr_t * avr)
+{
+	if (avr->cycle >= avr->next_timer_cycle)
+		return avr_cycle_timer_process(avr);
+
+	avr_cycle_count_t sleep = avr->next_timer_cycle - avr->cycle;
+	avr_cycle_count_t run = avr->run_cycle_limit < sleep ?
+			avr->run_cycle_limit : sleep;
+	avr->run_cycle_count = run ? run : 1;
+	return sleep;
+}
+
+/*
+ * Called by the run loops once the timers have run: if the burst that
+ * just finished ended in an idle loop, skips as many whole iterations of
+ * it as fit in 'how_long' cycles (until the next timer), so the core gets
+ * to the timer cycle for cycle the same as if it had run them.
+ */
+void
+avr_idle_fast_forward(
+		avr_t * avr,
+		avr_cycle_count_t how_long);
 
 /*
  * These are for internal access to the stack (for interrupts)
@@ -90,17 +277,87 @@ void avr_dump_state(avr_t * avr);
 
 #endif
 
-/**
- * Reconstructs the SREG value from avr->sreg into dst.
+/*
+ * Lazy SREG flags.
+ *
+ * The ALU instructions don't compute their flags, they just record their
+ * operands and result in avr->flags, with one of these "recipes", and the
+ * SREG bits it sets are marked pending. The flags are only worked out when
+ * something reads one of these bits (a branch, IN/PUSH of SREG, gdb...),
+ * and most of the time the next ALU instruction overwrites them first.
+ * Whatever the recipe, Z is always res == 0.
  */
-#define READ_SREG_INTO(avr, dst) { \
-			dst = 0; \
-			for (int i = 0; i < 8; i++) \
-				if (avr->sreg[i] > 1) { \
-					printf("** Invalid SREG!!\n"); \
-				} else if (avr->sreg[i]) \
-					dst |= (1 << i); \
-		}
+enum {
+	AVR_FLAGS_NONE = 0,
+	AVR_FLAGS_ADD,		// ADD, ADC: HSVNZC
+	AVR_FLAGS_SUB,		// SUB, SBC, CP, NEG etc: HSVNZC
+	AVR_FLAGS_LOGIC,	// AND, OR, EOR, COM etc: SVNZ, V cleared
+	AVR_FLAGS_INC,		// SVNZ
+	AVR_FLAGS_DEC,		// SVNZ
+	AVR_FLAGS_SHIFT,	// ASR, ROR: SVNZC, C is bit 0 of rd
+	AVR_FLAGS_LSR,		// SVNZC, N cleared
+	AVR_FLAGS_ADIW,		// 16 bits SVNZC
+	AVR_FLAGS_SBIW,		// 16 bits SVNZC
+	AVR_FLAGS_MUL,		// ZC, C is rr
+};
+#define AVR_SREG_ZC		((1 << S_Z) | (1 << S_C))
+#define AVR_SREG_SVNZ	((1 << S_S) | (1 << S_V) | (1 << S_N) | (1 << S_Z))
+#define AVR_SREG_SVNZC	(AVR_SREG_SVNZ | (1 << S_C))
+#define AVR_SREG_HSVNZC	(AVR_SREG_SVNZC | (1 << S_H))
+
+/*
+ * Works out the pending flags into avr->sreg, see sim_core.c
+ */
+void
+avr_sreg_lazy_flush(
+		avr_t * avr);
+
+static inline void
+avr_sreg_flush(
+		avr_t * avr)
+{
+	if (avr->flags.pending)
+		avr_sreg_lazy_flush(avr);
+}
+
+/*
+ * Records the flags of an ALU instruction. The recipe's flags that are
+ * still pending and that this one doesn't set are worked out first.
+ */
+static inline void
+avr_sreg_lazy(
+		avr_t * avr,
+		uint8_t op,
+		uint8_t mask,
+		uint16_t rd,
+		uint16_t rr,
+		uint16_t res)
+{
+	if (avr->flags.pending & ~mask)
+		avr_sreg_flush(avr);
+	avr->flags.op = op;
+	avr->flags.pending = mask;
+	avr->flags.rd = rd;
+	avr->flags.rr = rr;
+	avr->flags.res = res;
+}
+
+/*
+ * Returns one SREG bit, as 0 or 1
+ */
+static inline uint8_t
+avr_sreg_get(
+		avr_t * avr,
+		uint8_t flag)
+{
+	if (avr->flags.pending & (1 << flag)) {
+		// Z is the most looked at, and it's the same for all recipes
+		if (flag == S_Z)
+			return avr->flags.res == 0;
+		avr_sreg_flush(avr);
+	}
+	return (avr->sreg >> flag) & 1;
+}
 
 static inline void avr_sreg_set(avr_t * avr, uint8_t flag, uint8_t ival)
 {
@@ -112,21 +369,52 @@ static inline void avr_sreg_set(avr_t * avr, uint8_t flag, uint8_t ival)
 
 	if (flag == S_I) {
 		if (ival) {
-			if (!avr->sreg[S_I])
+			if (!(avr->sreg & (1 << S_I)))
 				avr->interrupt_state = -2;
 		} else
 			avr->interrupt_state = 0;
 	}
 
-	avr->sreg[flag] = ival;
+	avr->flags.pending &= ~(1 << flag);
+	avr->sreg = (avr->sreg & ~(1 << flag)) | (!!ival << flag);
+}
+
+/*
+ * Returns the whole SREG value
+ */
+static inline uint8_t
+avr_sreg_read(
+		avr_t * avr)
+{
+	avr_sreg_flush(avr);
+	return avr->sreg;
+}
+
+/*
+ * Sets the whole SREG value, as an OUT to SREG would
+ */
+static inline void
+avr_sreg_write(
+		avr_t * avr,
+		uint8_t v)
+{
+	avr_sreg_set(avr, S_I, (v >> S_I) & 1);
+	avr->flags.pending = 0;
+	avr->sreg = v;
 }
 
 /**
- * Splits the SREG value from src into the avr->sreg array.
+ * Reconstructs the SREG value into dst.
+ */
+#define READ_SREG_INTO(avr, dst) { \
+			dst = avr_sreg_read(avr); \
+		}
+
+/**
+ * Sets the SREG value from src.
  */
 #define SET_SREG_FROM(avr, src) { \
-			for (int i = 0; i < 8; i++) \
-				avr_sreg_set(avr, i, (src & (1 << i)) != 0); \
+			avr_sreg_write(avr, src); \
 		}
 
 /*
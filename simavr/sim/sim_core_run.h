@@ -0,0 +1,924 @@
+/*
+	sim_core_run.h
+
+	Copyright 2008, 2009 Michel Pollet <buserror@gmail.com>
+	Copyright 2026 agent <agent@local>
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Main instruction executor template.
+ *
+ * This file is not a normal header, it is included by sim_core.c once for
+ * each flavour of the executor, after defining:
+ *
+ *	AVR_RUN_ONE			name of the (static) function to declare
+ *	AVR_RUN_PC_SIZE		bytes of return address pushed by calls, 2 or 3,
+ *						see AVR_ISA_* in sim_avr.h
+ *	AVR_RUN_THREADED	1 to dispatch with computed gotos ("threaded code")
+ *						0 (or undefined) to use a plain switch()
+ *	AVR_RUN_BLOCKS		1 to also chain basic blocks, needs AVR_RUN_THREADED
+ *						and no CONFIG_SIMAVR_TRACE
+ *	AVR_RUN_JIT			1 to also run the hot blocks as native code, needs
+ *						AVR_RUN_BLOCKS and AVR_HAS_JIT (see sim_jit.h)
+ *
+ * Each instruction body is written once, between OPCODE(kind) and
+ * OPCODE_END. With the switch dispatch these are just 'case' and 'break'.
+ * With the threaded dispatch they are labels, and OPCODE_END is a copy of
+ * the instruction epilogue that fetches the next decoded instruction and
+ * jumps straight to its body, so each instruction gets its own indirect
+ * branch and the host branch predictor has a lot more to work with.
+ *
+ * With the basic blocks, the register only instructions that make up
+ * a block (see _avr_block_scan()) are chained to each other without
+ * any of the epilogue checks, and the cycles of the whole block are
+ * accounted for at once by its last instruction. A block is only entered
+ * if it fits in the cycles left before the next timer.
+ *
+ * With the JIT, a block that has been translated runs as one native call
+ * instead, and is then accounted for exactly like its last instruction.
+ *
+ * All the flavours are cycle for cycle identical.
+ */
+
+#ifndef AVR_RUN_ONE
+#error AVR_RUN_ONE needs to be defined before including sim_core_run.h
+#endif
+#ifndef AVR_RUN_PC_SIZE
+#define AVR_RUN_PC_SIZE 2
+#endif
+#ifndef AVR_RUN_THREADED
+#define AVR_RUN_THREADED 0
+#endif
+#ifndef AVR_RUN_BLOCKS
+#define AVR_RUN_BLOCKS 0
+#endif
+#ifndef AVR_RUN_JIT
+#define AVR_RUN_JIT 0
+#endif
+
+/*
+ * Common instruction epilogue: account for the cycles taken, then either
+ * carry on with the next instruction using _again, or return to the caller
+ * to let it run the timers, interrupts etc.
+ */
+#define OPCODE_NEXT(_again) { \
+		avr->cycle += cycle; \
+		if ((avr->state == cpu_Running) && \
+			(avr->run_cycle_count > cycle) && \
+			(avr->interrupt_state == 0)) { \
+			avr->run_cycle_count -= cycle; \
+			avr->pc = new_pc; \
+			_again; \
+		} \
+		return new_pc; \
+	}
+
+#if AVR_RUN_BLOCKS
+/*
+ * Called with the instruction about to run: if it starts a block, and the
+ * block fits, the rest of the block is chained to it. None of these
+ * instructions look at avr->pc or avr->cycle, so these are only updated
+ * by the last one.
+ */
+#define OPCODE_BLOCK() { \
+		if (unlikely(op->block == AVR_BLOCK_UNKNOWN)) \
+			_avr_block_scan(avr, new_pc - 2); \
+		if (op->block > 1 && avr->interrupt_state == 0 && \
+				avr->run_cycle_count > op->block_cycles) { \
+			OPCODE_JIT(); \
+			block_left = op->block - 1; \
+		} \
+	}
+#define OPCODE_CHAIN() { \
+		if (block_left) { \
+			block_left--; \
+			op++; \
+			new_pc += 2; \
+			cycle += op->cycles; \
+			goto *dispatch[op->kind]; \
+		} \
+	}
+#else
+#define OPCODE_BLOCK()
+#define OPCODE_CHAIN()
+#endif
+
+#if AVR_RUN_JIT
+/*
+ * Called when a block is about to be entered, if it's been translated
+ * it runs natively, and the executor carries on from its last instruction.
+ */
+#define OPCODE_JIT() { \
+		avr_jit_block_t fn = avr_jit_get(avr, new_pc - 2); \
+		if (fn) { \
+			avr_sreg_flush(avr); \
+			fn(avr->data, &avr->sreg); \
+			new_pc += (op->block - 1) * 2; \
+			cycle = op->block_cycles; \
+			goto run_jit_done; \
+		} \
+	}
+#else
+#define OPCODE_JIT()
+#endif
+
+/*
+ * Taken backward branches, from _pc to _target, might be closing an idle
+ * loop, see _avr_idle_loop(). The branches that aren't candidates have
+ * op->loop == AVR_LOOP_NONE.
+ */
+#define OPCODE_LOOP(_pc, _target) { \
+		if (unlikely(op->loop)) \
+			_avr_idle_loop(avr, _pc, _target, avr->cycle + cycle); \
+	}
+
+#if AVR_RUN_THREADED
+#if CONFIG_SIMAVR_TRACE
+#define OPCODE_AGAIN() goto run_one_again
+#else
+#define OPCODE_AGAIN() { \
+		if (unlikely(new_pc >= avr->flashend)) \
+			goto run_one_again; \
+		op = _avr_fetch(avr, new_pc); \
+		new_pc += 2; \
+		cycle = op->cycles; \
+		OPCODE_BLOCK(); \
+		goto *dispatch[op->kind]; \
+	}
+#endif
+#define OPCODE_DISPATCH(_kind)	goto *dispatch[_kind];
+#define OPCODE(_kind)			_op_##_kind:
+#define OPCODE_DEFAULT
+#define OPCODE_FALLTHROUGH
+#define OPCODE_END				{ OPCODE_CHAIN(); OPCODE_NEXT(OPCODE_AGAIN()); }
+#else
+#define OPCODE_DISPATCH(_kind)	switch (_kind)
+#define OPCODE(_kind)			case AVR_OP_##_kind:
+#define OPCODE_DEFAULT			default:
+#define OPCODE_FALLTHROUGH		FALLTHROUGH
+#define OPCODE_END				break
+#endif
+
+static avr_flashaddr_t AVR_RUN_ONE(avr_t * avr)
+{
+#if AVR_RUN_THREADED
+#define _OPL(_kind) [AVR_OP_##_kind] = &&_op_##_kind
+	static const void * const dispatch[AVR_OP_COUNT] = {
+		[AVR_OP_NONE] = &&_op_INVALID,	// _avr_fetch() never returns these
+		_OPL(INVALID),
+		_OPL(NOP),
+		_OPL(CPC), _OPL(ADD), _OPL(SBC), _OPL(SUB), _OPL(CP), _OPL(ADC),
+		_OPL(CPSE),
+		_OPL(AND), _OPL(EOR), _OPL(OR), _OPL(MOV), _OPL(MOVW),
+		_OPL(MUL), _OPL(MULS), _OPL(MULSU),
+		_OPL(FMUL), _OPL(FMULS), _OPL(FMULSU),
+		_OPL(CPI), _OPL(SBCI), _OPL(SUBI), _OPL(ORI), _OPL(ANDI), _OPL(LDI),
+		_OPL(LDD_Z), _OPL(STD_Z), _OPL(LDD_Y), _OPL(STD_Y),
+		_OPL(BSET),
+		_OPL(SLEEP), _OPL(BREAK), _OPL(WDR), _OPL(SPM),
+		_OPL(IJMP),
+		_OPL(RETI), _OPL(RET),
+		_OPL(LPM_R0), _OPL(ELPM_R0), _OPL(LPM), _OPL(ELPM),
+		_OPL(LDS), _OPL(STS),
+		_OPL(LD_X), _OPL(ST_X), _OPL(LD_Y), _OPL(ST_Y), _OPL(LD_Z), _OPL(ST_Z),
+		_OPL(POP), _OPL(PUSH),
+		_OPL(COM), _OPL(NEG), _OPL(SWAP), _OPL(INC), _OPL(ASR), _OPL(LSR),
+		_OPL(ROR), _OPL(DEC),
+		_OPL(JMP), _OPL(CALL),
+		_OPL(ADIW), _OPL(SBIW),
+		_OPL(CBI), _OPL(SBIC), _OPL(SBI), _OPL(SBIS),
+		_OPL(OUT), _OPL(IN),
+		_OPL(RJMP), _OPL(RCALL),
+		_OPL(OVERFLOW),
+		_OPL(BRBS), _OPL(BRBC),
+		_OPL(BLD), _OPL(BST), _OPL(SBRC), _OPL(SBRS),
+	};
+#undef _OPL
+#endif
+	const avr_decoded_t * op;
+	avr_flashaddr_t	new_pc;
+	int 			cycle;
+#if AVR_RUN_BLOCKS
+	int				block_left = 0;	// instructions left to chain
+#endif
+#if AVR_RUN_JIT
+	if (unlikely(!avr->jit))
+		avr_jit_init(avr);
+#endif
+
+run_one_again:
+#if CONFIG_SIMAVR_TRACE
+	/*
+	 * this traces spurious reset or bad jumps
+	 */
+	if ((avr->pc == 0 && avr->cycle > 0) || avr->pc >= avr->codeend || _avr_sp_get(avr) > avr->ramend) {
+//		avr->trace = 1;
+		STATE("RESET\n");
+		crash(avr);
+	}
+	avr->trace_data->touched[0] = avr->trace_data->touched[1] = avr->trace_data->touched[2] = 0;
+#endif
+
+	/* Ensure we don't crash simavr due to a bad instruction reading past
+	 * the end of the flash.
+	 */
+	if (unlikely(avr->pc >= avr->flashend)) {
+		STATE("CRASH\n");
+		crash(avr);
+		return 0;
+	}
+
+	op = _avr_fetch(avr, avr->pc);
+	new_pc = avr->pc + 2;	// future "default" pc
+	cycle = op->cycles;
+	OPCODE_BLOCK();
+
+	OPCODE_DISPATCH(op->kind) {
+		OPCODE(NOP) {	// NOP
+			STATE("nop\n");
+		}	OPCODE_END;
+		OPCODE(CPC) {	// CPC -- Compare with carry -- 0000 01rd dddd rrrr
+			get_vd5_vr5(op);
+			uint8_t res = vd - vr - avr_sreg_get(avr, S_C);
+			STATE("cpc %s[%02x], %s[%02x] = %02x\n", avr_regname(d), vd, avr_regname(r), vr, res);
+			_avr_flags_sub_Rzns(avr, res, vd, vr);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(ADD) {	// ADD -- Add without carry -- 0000 11rd dddd rrrr
+			get_vd5_vr5(op);
+			uint8_t res = vd + vr;
+			if (r == d) {
+				STATE("lsl %s[%02x] = %02x\n", avr_regname(d), vd, res & 0xff);
+			} else {
+				STATE("add %s[%02x], %s[%02x] = %02x\n", avr_regname(d), vd, avr_regname(r), vr, res);
+			}
+			_avr_set_r(avr, d, res);
+			_avr_flags_add_zns(avr, res, vd, vr);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(SBC) {	// SBC -- Subtract with carry -- 0000 10rd dddd rrrr
+			get_vd5_vr5(op);
+			uint8_t res = vd - vr - avr_sreg_get(avr, S_C);
+			STATE("sbc %s[%02x], %s[%02x] = %02x\n", avr_regname(d), avr->data[d], avr_regname(r), avr->data[r], res);
+			_avr_set_r(avr, d, res);
+			_avr_flags_sub_Rzns(avr, res, vd, vr);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(MOVW) {	// MOVW -- Copy Register Word -- 0000 0001 dddd rrrr
+			uint8_t d = op->d;
+			uint8_t r = op->r;
+			STATE("movw %s:%s, %s:%s[%02x%02x]\n", avr_regname(d), avr_regname(d+1), avr_regname(r), avr_regname(r+1), avr->data[r+1], avr->data[r]);
+			uint16_t vr = avr->data[r] | (avr->data[r + 1] << 8);
+			_avr_set_r16le(avr, d, vr);
+		}	OPCODE_END;
+		OPCODE(MULS) {	// MULS -- Multiply Signed -- 0000 0010 dddd rrrr
+			int8_t r = op->r;
+			int8_t d = op->d;
+			int16_t res = ((int8_t)avr->data[r]) * ((int8_t)avr->data[d]);
+			STATE("muls %s[%d], %s[%02x] = %d\n", avr_regname(d), ((int8_t)avr->data[d]), avr_regname(r), ((int8_t)avr->data[r]), res);
+			_avr_set_r16le(avr, 0, res);
+			avr_sreg_lazy(avr, AVR_FLAGS_MUL, AVR_SREG_ZC, 0, (res >> 15) & 1, res);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(MULSU)		// MULSU -- Multiply Signed Unsigned -- 0000 0011 0ddd 0rrr
+		OPCODE(FMUL)		// FMUL -- Fractional Multiply Unsigned -- 0000 0011 0ddd 1rrr
+		OPCODE(FMULS)		// FMULS -- Multiply Signed -- 0000 0011 1ddd 0rrr
+		OPCODE(FMULSU) {	// FMULSU -- Multiply Signed Unsigned -- 0000 0011 1ddd 1rrr
+			int8_t r = op->r;
+			int8_t d = op->d;
+			int16_t res = 0;
+			uint8_t c = 0;
+			T(const char * name = "";)
+			switch (op->kind) {
+				case AVR_OP_MULSU:
+					res = ((uint8_t)avr->data[r]) * ((int8_t)avr->data[d]);
+					c = (res >> 15) & 1;
+					T(name = "mulsu";)
+					break;
+				case AVR_OP_FMUL:
+					res = ((uint8_t)avr->data[r]) * ((uint8_t)avr->data[d]);
+					c = (res >> 15) & 1;
+					res <<= 1;
+					T(name = "fmul";)
+					break;
+				case AVR_OP_FMULS:
+					res = ((int8_t)avr->data[r]) * ((int8_t)avr->data[d]);
+					c = (res >> 15) & 1;
+					res <<= 1;
+					T(name = "fmuls";)
+					break;
+				case AVR_OP_FMULSU:
+					res = ((uint8_t)avr->data[r]) * ((int8_t)avr->data[d]);
+					c = (res >> 15) & 1;
+					res <<= 1;
+					T(name = "fmulsu";)
+					break;
+			}
+			STATE("%s %s[%d], %s[%02x] = %d\n", name, avr_regname(d), ((int8_t)avr->data[d]), avr_regname(r), ((int8_t)avr->data[r]), res);
+			_avr_set_r16le(avr, 0, res);
+			avr_sreg_lazy(avr, AVR_FLAGS_MUL, AVR_SREG_ZC, 0, c, res);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(SUB) {	// SUB -- Subtract without carry -- 0001 10rd dddd rrrr
+			get_vd5_vr5(op);
+			uint8_t res = vd - vr;
+			STATE("sub %s[%02x], %s[%02x] = %02x\n", avr_regname(d), vd, avr_regname(r), vr, res);
+			_avr_set_r(avr, d, res);
+			_avr_flags_sub_zns(avr, res, vd, vr);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(CPSE) {	// CPSE -- Compare, skip if equal -- 0001 00rd dddd rrrr
+			get_vd5_vr5(op);
+			uint16_t res = vd == vr;
+			STATE("cpse %s[%02x], %s[%02x]\t; Will%s skip\n", avr_regname(d), avr->data[d], avr_regname(r), avr->data[r], res ? "":" not");
+			if (res) {
+				if (_avr_is_instruction_32_bits(avr, new_pc)) {
+					new_pc += 4; cycle += 2;
+				} else {
+					new_pc += 2; cycle++;
+				}
+			}
+		}	OPCODE_END;
+		OPCODE(CP) {	// CP -- Compare -- 0001 01rd dddd rrrr
+			get_vd5_vr5(op);
+			uint8_t res = vd - vr;
+			STATE("cp %s[%02x], %s[%02x] = %02x\n", avr_regname(d), vd, avr_regname(r), vr, res);
+			_avr_flags_sub_zns(avr, res, vd, vr);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(ADC) {	// ADD -- Add with carry -- 0001 11rd dddd rrrr
+			get_vd5_vr5(op);
+			uint8_t res = vd + vr + avr_sreg_get(avr, S_C);
+			if (r == d) {
+				STATE("rol %s[%02x] = %02x\n", avr_regname(d), avr->data[d], res);
+			} else {
+				STATE("addc %s[%02x], %s[%02x] = %02x\n", avr_regname(d), avr->data[d], avr_regname(r), avr->data[r], res);
+			}
+			_avr_set_r(avr, d, res);
+			_avr_flags_add_zns(avr, res, vd, vr);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(AND) {	// AND -- Logical AND -- 0010 00rd dddd rrrr
+			get_vd5_vr5(op);
+			uint8_t res = vd & vr;
+			if (r == d) {
+				STATE("tst %s[%02x]\n", avr_regname(d), avr->data[d]);
+			} else {
+				STATE("and %s[%02x], %s[%02x] = %02x\n", avr_regname(d), vd, avr_regname(r), vr, res);
+			}
+			_avr_set_r(avr, d, res);
+			_avr_flags_znv0s(avr, res);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(EOR) {	// EOR -- Logical Exclusive OR -- 0010 01rd dddd rrrr
+			get_vd5_vr5(op);
+			uint8_t res = vd ^ vr;
+			if (r==d) {
+				STATE("clr %s[%02x]\n", avr_regname(d), avr->data[d]);
+			} else {
+				STATE("eor %s[%02x], %s[%02x] = %02x\n", avr_regname(d), vd, avr_regname(r), vr, res);
+			}
+			_avr_set_r(avr, d, res);
+			_avr_flags_znv0s(avr, res);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(OR) {	// OR -- Logical OR -- 0010 10rd dddd rrrr
+			get_vd5_vr5(op);
+			uint8_t res = vd | vr;
+			STATE("or %s[%02x], %s[%02x] = %02x\n", avr_regname(d), vd, avr_regname(r), vr, res);
+			_avr_set_r(avr, d, res);
+			_avr_flags_znv0s(avr, res);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(MOV) {	// MOV -- 0010 11rd dddd rrrr
+			get_d5_vr5(op);
+			uint8_t res = vr;
+			STATE("mov %s, %s[%02x] = %02x\n", avr_regname(d), avr_regname(r), vr, res);
+			_avr_set_r(avr, d, res);
+		}	OPCODE_END;
+		OPCODE(CPI) {	// CPI -- Compare Immediate -- 0011 kkkk hhhh kkkk
+			get_vh4_k8(op);
+			uint8_t res = vh - k;
+			STATE("cpi %s[%02x], 0x%02x\n", avr_regname(h), vh, k);
+			_avr_flags_sub_zns(avr, res, vh, k);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(SBCI) {	// SBCI -- Subtract Immediate With Carry -- 0100 kkkk hhhh kkkk
+			get_vh4_k8(op);
+			uint8_t res = vh - k - avr_sreg_get(avr, S_C);
+			STATE("sbci %s[%02x], 0x%02x = %02x\n", avr_regname(h), vh, k, res);
+			_avr_set_r(avr, h, res);
+			_avr_flags_sub_Rzns(avr, res, vh, k);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(SUBI) {	// SUBI -- Subtract Immediate -- 0101 kkkk hhhh kkkk
+			get_vh4_k8(op);
+			uint8_t res = vh - k;
+			STATE("subi %s[%02x], 0x%02x = %02x\n", avr_regname(h), vh, k, res);
+			_avr_set_r(avr, h, res);
+			_avr_flags_sub_zns(avr, res, vh, k);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(ORI) {	// ORI aka SBR -- Logical OR with Immediate -- 0110 kkkk hhhh kkkk
+			get_vh4_k8(op);
+			uint8_t res = vh | k;
+			STATE("ori %s[%02x], 0x%02x\n", avr_regname(h), vh, k);
+			_avr_set_r(avr, h, res);
+			_avr_flags_znv0s(avr, res);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(ANDI) {	// ANDI	-- Logical AND with Immediate -- 0111 kkkk hhhh kkkk
+			get_vh4_k8(op);
+			uint8_t res = vh & k;
+			STATE("andi %s[%02x], 0x%02x\n", avr_regname(h), vh, k);
+			_avr_set_r(avr, h, res);
+			_avr_flags_znv0s(avr, res);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(LDD_Z)	// LD (LDD) -- Load Indirect using Z -- 10q0 qqsd dddd yqqq
+		OPCODE(STD_Z) {
+			uint16_t v = avr->data[R_ZL] | (avr->data[R_ZH] << 8);
+			const uint8_t d = op->d, q = op->k;
+			if (op->kind == AVR_OP_STD_Z) {
+				STATE("st (Z+%d[%04x]), %s[%02x]\n", q, v+q, avr_regname(d), avr->data[d]);
+				_avr_set_ram(avr, v+q, avr->data[d]);
+			} else {
+				STATE("ld %s, (Z+%d[%04x])=[%02x]\n", avr_regname(d), q, v+q, avr->data[v+q]);
+				_avr_set_r(avr, d, _avr_get_ram(avr, v+q));
+			}
+			// 2 cycles, 3 for tinyavr
+		}	OPCODE_END;
+		OPCODE(LDD_Y)	// LD (LDD) -- Load Indirect using Y -- 10q0 qqsd dddd yqqq
+		OPCODE(STD_Y) {
+			uint16_t v = avr->data[R_YL] | (avr->data[R_YH] << 8);
+			const uint8_t d = op->d, q = op->k;
+			if (op->kind == AVR_OP_STD_Y) {
+				STATE("st (Y+%d[%04x]), %s[%02x]\n", q, v+q, avr_regname(d), avr->data[d]);
+				_avr_set_ram(avr, v+q, avr->data[d]);
+			} else {
+				STATE("ld %s, (Y+%d[%04x])=[%02x]\n", avr_regname(d), q, v+q, avr->data[d+q]);
+				_avr_set_r(avr, d, _avr_get_ram(avr, v+q));
+			}
+			// 2 cycles, 3 for tinyavr
+		}	OPCODE_END;
+		OPCODE(BSET) {	// BSET/BCLR -- all the SREG set/clear opcodes
+			T(const uint8_t b = op->d;)
+			STATE("%s%c\n", op->r ? "se" : "cl", _sreg_bit_name[b]);
+			avr_sreg_set(avr, op->d, op->r);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(SLEEP) { // SLEEP -- 1001 0101 1000 1000
+			STATE("sleep\n");
+			/* Don't sleep if there are interrupts about to be serviced.
+			 * Without this check, it was possible to incorrectly enter a state
+			 * in which the cpu was sleeping and interrupts were disabled. For more
+			 * details, see the commit message. */
+			if (!avr_has_pending_interrupts(avr) || !avr_sreg_get(avr, S_I))
+				avr->state = cpu_Sleeping;
+		}	OPCODE_END;
+		OPCODE(BREAK) { // BREAK -- 1001 0101 1001 1000
+			STATE("break\n");
+			if (avr->gdb) {
+				// if gdb is on, we break here as in here
+				// and we do so until gdb restores the instruction
+				// that was here before
+				avr->state = cpu_StepDone;
+				new_pc = avr->pc;
+				cycle = 0;
+			}
+		}	OPCODE_END;
+		OPCODE(WDR) { // WDR -- Watchdog Reset -- 1001 0101 1010 1000
+			STATE("wdr\n");
+			avr_ioctl(avr, AVR_IOCTL_WATCHDOG_RESET, 0);
+		}	OPCODE_END;
+		OPCODE(SPM) { // SPM -- Store Program Memory -- 1001 0101 1110 1000
+			STATE("spm\n");
+			avr_ioctl(avr, AVR_IOCTL_FLASH_SPM, 0);
+		}	OPCODE_END;
+		OPCODE(IJMP) { // IJMP/EIJMP/ICALL/EICALL -- Indirect jump/call -- 1001 010p 000e 1001
+			int e = op->d;
+			int p = op->r;
+			uint32_t z = avr->data[R_ZL] | (avr->data[R_ZH] << 8);
+			// EIJMP/EICALL only decode on cores with EIND
+			if (AVR_RUN_PC_SIZE == 3 && e)
+				z |= avr->data[avr->eind] << 16;
+			STATE("%si%s Z[%04x]\n", e?"e":"", p?"call":"jmp", z << 1);
+			if (p)
+				cycle += _avr_push_addr_size(avr, new_pc, AVR_RUN_PC_SIZE) - 1;
+			new_pc = z << 1;
+			TRACE_JUMP();
+		}	OPCODE_END;
+		OPCODE(RETI) 	// RETI -- Return from Interrupt -- 1001 0101 0001 1000
+			avr_sreg_set(avr, S_I, 1);
+			avr_interrupt_reti(avr);
+			OPCODE_FALLTHROUGH
+		OPCODE(RET) {	// RET -- Return -- 1001 0101 0000 1000
+			new_pc = _avr_pop_addr_size(avr, AVR_RUN_PC_SIZE);
+			cycle += AVR_RUN_PC_SIZE;
+			STATE("ret%s\n", op->kind == AVR_OP_RETI ? "i" : "");
+			TRACE_JUMP();
+			STACK_FRAME_POP();
+		}	OPCODE_END;
+		OPCODE(LPM_R0) {	// LPM -- Load Program Memory R0 <- (Z) -- 1001 0101 1100 1000
+			uint16_t z = avr->data[R_ZL] | (avr->data[R_ZH] << 8);
+			STATE("lpm %s, (Z[%04x])\n", avr_regname(0), z);
+			_avr_set_r(avr, 0, avr->flash[z]);
+		}	OPCODE_END;
+		OPCODE(ELPM_R0) {	// ELPM -- Load Program Memory R0 <- (Z) -- 1001 0101 1101 1000
+			uint32_t z = avr->data[R_ZL] | (avr->data[R_ZH] << 8) | (avr->data[avr->rampz] << 16);
+			STATE("elpm %s, (Z[%02x:%04x])\n", avr_regname(0), z >> 16, z & 0xffff);
+			_avr_set_r(avr, 0, avr->flash[z]);
+		}	OPCODE_END;
+		OPCODE(LDS) {	// LDS -- Load Direct from Data Space, 32 bits -- 1001 0000 0000 0000
+			const uint8_t d = op->d;
+			uint16_t x = op->k;
+			new_pc += 2;
+			STATE("lds %s[%02x], 0x%04x\n", avr_regname(d), avr->data[d], x);
+			_avr_set_r(avr, d, _avr_get_ram(avr, x));
+		}	OPCODE_END;
+		OPCODE(LPM) {	// LPM -- Load Program Memory -- 1001 000d dddd 01oo
+			const uint8_t d = op->d;
+			uint16_t z = avr->data[R_ZL] | (avr->data[R_ZH] << 8);
+			int opi = op->r;
+			STATE("lpm %s, (Z[%04x]%s)\n", avr_regname(d), z, opi ? "+" : "");
+			_avr_set_r(avr, d, avr->flash[z]);
+			if (opi) {
+				z++;
+				_avr_set_r16le_hl(avr, R_ZL, z);
+			}
+		}	OPCODE_END;
+		OPCODE(ELPM) {	// ELPM -- Extended Load Program Memory -- 1001 000d dddd 01oo
+			uint32_t z = avr->data[R_ZL] | (avr->data[R_ZH] << 8) | (avr->data[avr->rampz] << 16);
+			const uint8_t d = op->d;
+			int opi = op->r;
+			STATE("elpm %s, (Z[%02x:%04x]%s)\n", avr_regname(d), z >> 16, z & 0xffff, opi ? "+" : "");
+			_avr_set_r(avr, d, avr->flash[z]);
+			if (opi) {
+				z++;
+				_avr_set_r(avr, avr->rampz, z >> 16);
+				_avr_set_r16le_hl(avr, R_ZL, z);
+			}
+		}	OPCODE_END;
+		OPCODE(LD_X) {	// LD -- Load Indirect from Data using X -- 1001 000d dddd 11oo
+			int opi = op->r;
+			const uint8_t d = op->d;
+			uint16_t x = (avr->data[R_XH] << 8) | avr->data[R_XL];
+			STATE("ld %s, %sX[%04x]%s\n", avr_regname(d), opi == 2 ? "--" : "", x, opi == 1 ? "++" : "");
+			// 2 cycles (1 for tinyavr, except with inc/dec 2)
+			if (opi == 2) x--;
+			uint8_t vd = _avr_get_ram(avr, x);
+			if (opi == 1) x++;
+			_avr_set_r16le_hl(avr, R_XL, x);
+			_avr_set_r(avr, d, vd);
+		}	OPCODE_END;
+		OPCODE(ST_X) {	// ST -- Store Indirect Data Space X -- 1001 001d dddd 11oo
+			int opi = op->r;
+			get_vd5(op);
+			uint16_t x = (avr->data[R_XH] << 8) | avr->data[R_XL];
+			STATE("st %sX[%04x]%s, %s[%02x] \n", opi == 2 ? "--" : "", x, opi == 1 ? "++" : "", avr_regname(d), vd);
+			// 2 cycles, except tinyavr
+			if (opi == 2) x--;
+			_avr_set_ram(avr, x, vd);
+			if (opi == 1) x++;
+			_avr_set_r16le_hl(avr, R_XL, x);
+		}	OPCODE_END;
+		OPCODE(LD_Y) {	// LD -- Load Indirect from Data using Y -- 1001 000d dddd 10oo
+			int opi = op->r;
+			const uint8_t d = op->d;
+			uint16_t y = (avr->data[R_YH] << 8) | avr->data[R_YL];
+			STATE("ld %s, %sY[%04x]%s\n", avr_regname(d), opi == 2 ? "--" : "", y, opi == 1 ? "++" : "");
+			// 2 cycles, except tinyavr
+			if (opi == 2) y--;
+			uint8_t vd = _avr_get_ram(avr, y);
+			if (opi == 1) y++;
+			_avr_set_r16le_hl(avr, R_YL, y);
+			_avr_set_r(avr, d, vd);
+		}	OPCODE_END;
+		OPCODE(ST_Y) {	// ST -- Store Indirect Data Space Y -- 1001 001d dddd 10oo
+			int opi = op->r;
+			get_vd5(op);
+			uint16_t y = (avr->data[R_YH] << 8) | avr->data[R_YL];
+			STATE("st %sY[%04x]%s, %s[%02x]\n", opi == 2 ? "--" : "", y, opi == 1 ? "++" : "", avr_regname(d), vd);
+			if (opi == 2) y--;
+			_avr_set_ram(avr, y, vd);
+			if (opi == 1) y++;
+			_avr_set_r16le_hl(avr, R_YL, y);
+		}	OPCODE_END;
+		OPCODE(STS) {	// STS -- Store Direct to Data Space, 32 bits -- 1001 0010 0000 0000
+			get_vd5(op);
+			uint16_t x = op->k;
+			new_pc += 2;
+			STATE("sts 0x%04x, %s[%02x]\n", x, avr_regname(d), vd);
+			_avr_set_ram(avr, x, vd);
+		}	OPCODE_END;
+		OPCODE(LD_Z) {	// LD -- Load Indirect from Data using Z -- 1001 000d dddd 00oo
+			int opi = op->r;
+			const uint8_t d = op->d;
+			uint16_t z = (avr->data[R_ZH] << 8) | avr->data[R_ZL];
+			STATE("ld %s, %sZ[%04x]%s\n", avr_regname(d), opi == 2 ? "--" : "", z, opi == 1 ? "++" : "");
+			// 2 cycles, except tinyavr
+			if (opi == 2) z--;
+			uint8_t vd = _avr_get_ram(avr, z);
+			if (opi == 1) z++;
+			_avr_set_r16le_hl(avr, R_ZL, z);
+			_avr_set_r(avr, d, vd);
+		}	OPCODE_END;
+		OPCODE(ST_Z) {	// ST -- Store Indirect Data Space Z -- 1001 001d dddd 00oo
+			int opi = op->r;
+			get_vd5(op);
+			uint16_t z = (avr->data[R_ZH] << 8) | avr->data[R_ZL];
+			STATE("st %sZ[%04x]%s, %s[%02x] \n", opi == 2 ? "--" : "", z, opi == 1 ? "++" : "", avr_regname(d), vd);
+			// 2 cycles, except tinyavr
+			if (opi == 2) z--;
+			_avr_set_ram(avr, z, vd);
+			if (opi == 1) z++;
+			_avr_set_r16le_hl(avr, R_ZL, z);
+		}	OPCODE_END;
+		OPCODE(POP) {	// POP -- 1001 000d dddd 1111
+			const uint8_t d = op->d;
+			_avr_set_r(avr, d, _avr_pop8(avr));
+			T(uint16_t sp = _avr_sp_get(avr);)
+			STATE("pop %s (@%04x)[%02x]\n", avr_regname(d), sp, avr->data[sp]);
+		}	OPCODE_END;
+		OPCODE(PUSH) {	// PUSH -- 1001 001d dddd 1111
+			get_vd5(op);
+			_avr_push8(avr, vd);
+			T(uint16_t sp = _avr_sp_get(avr);)
+			STATE("push %s[%02x] (@%04x)\n", avr_regname(d), vd, sp);
+		}	OPCODE_END;
+		OPCODE(COM) {	// COM -- One's Complement -- 1001 010d dddd 0000
+			get_vd5(op);
+			uint8_t res = 0xff - vd;
+			STATE("com %s[%02x] = %02x\n", avr_regname(d), vd, res);
+			_avr_set_r(avr, d, res);
+			_avr_flags_znv0s(avr, res);
+			avr_sreg_set(avr, S_C, 1);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(NEG) {	// NEG -- Two's Complement -- 1001 010d dddd 0001
+			get_vd5(op);
+			uint8_t res = 0x00 - vd;
+			STATE("neg %s[%02x] = %02x\n", avr_regname(d), vd, res);
+			_avr_set_r(avr, d, res);
+			// same flags as 0 - vd
+			_avr_flags_sub_zns(avr, res, 0, vd);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(SWAP) {	// SWAP -- Swap Nibbles -- 1001 010d dddd 0010
+			get_vd5(op);
+			uint8_t res = (vd >> 4) | (vd << 4) ;
+			STATE("swap %s[%02x] = %02x\n", avr_regname(d), vd, res);
+			_avr_set_r(avr, d, res);
+		}	OPCODE_END;
+		OPCODE(INC) {	// INC -- Increment -- 1001 010d dddd 0011
+			get_vd5(op);
+			uint8_t res = vd + 1;
+			STATE("inc %s[%02x] = %02x\n", avr_regname(d), vd, res);
+			_avr_set_r(avr, d, res);
+			avr_sreg_lazy(avr, AVR_FLAGS_INC, AVR_SREG_SVNZ, vd, 0, res);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(ASR) {	// ASR -- Arithmetic Shift Right -- 1001 010d dddd 0101
+			get_vd5(op);
+			uint8_t res = (vd >> 1) | (vd & 0x80);
+			STATE("asr %s[%02x]\n", avr_regname(d), vd);
+			_avr_set_r(avr, d, res);
+			avr_sreg_lazy(avr, AVR_FLAGS_SHIFT, AVR_SREG_SVNZC, vd, 0, res);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(LSR) {	// LSR -- Logical Shift Right -- 1001 010d dddd 0110
+			get_vd5(op);
+			uint8_t res = vd >> 1;
+			STATE("lsr %s[%02x]\n", avr_regname(d), vd);
+			_avr_set_r(avr, d, res);
+			avr_sreg_lazy(avr, AVR_FLAGS_LSR, AVR_SREG_SVNZC, vd, 0, res);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(ROR) {	// ROR -- Rotate Right -- 1001 010d dddd 0111
+			get_vd5(op);
+			uint8_t res = (avr_sreg_get(avr, S_C) ? 0x80 : 0) | vd >> 1;
+			STATE("ror %s[%02x]\n", avr_regname(d), vd);
+			_avr_set_r(avr, d, res);
+			avr_sreg_lazy(avr, AVR_FLAGS_SHIFT, AVR_SREG_SVNZC, vd, 0, res);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(DEC) {	// DEC -- Decrement -- 1001 010d dddd 1010
+			get_vd5(op);
+			uint8_t res = vd - 1;
+			STATE("dec %s[%02x] = %02x\n", avr_regname(d), vd, res);
+			_avr_set_r(avr, d, res);
+			avr_sreg_lazy(avr, AVR_FLAGS_DEC, AVR_SREG_SVNZ, vd, 0, res);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(JMP) {	// JMP -- Long Call to sub, 32 bits -- 1001 010a aaaa 110a
+			avr_flashaddr_t a = op->k;
+			STATE("jmp 0x%06x\n", a);
+			new_pc = a << 1;
+			TRACE_JUMP();
+		}	OPCODE_END;
+		OPCODE(CALL) {	// CALL -- Long Call to sub, 32 bits -- 1001 010a aaaa 111a
+			avr_flashaddr_t a = op->k;
+			STATE("call 0x%06x\n", a);
+			new_pc += 2;
+			cycle += _avr_push_addr_size(avr, new_pc, AVR_RUN_PC_SIZE);
+			new_pc = a << 1;
+			TRACE_JUMP();
+			STACK_FRAME_PUSH();
+		}	OPCODE_END;
+		OPCODE(ADIW) {	// ADIW -- Add Immediate to Word -- 1001 0110 KKpp KKKK
+			get_vp2_k6(op);
+			uint16_t res = vp + k;
+			STATE("adiw %s:%s[%04x], 0x%02x\n", avr_regname(p), avr_regname(p + 1), vp, k);
+			_avr_set_r16le_hl(avr, p, res);
+			avr_sreg_lazy(avr, AVR_FLAGS_ADIW, AVR_SREG_SVNZC, vp, k, res);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(SBIW) {	// SBIW -- Subtract Immediate from Word -- 1001 0111 KKpp KKKK
+			get_vp2_k6(op);
+			uint16_t res = vp - k;
+			STATE("sbiw %s:%s[%04x], 0x%02x\n", avr_regname(p), avr_regname(p + 1), vp, k);
+			_avr_set_r16le_hl(avr, p, res);
+			avr_sreg_lazy(avr, AVR_FLAGS_SBIW, AVR_SREG_SVNZC, vp, k, res);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(CBI) {	// CBI -- Clear Bit in I/O Register -- 1001 1000 AAAA Abbb
+			const uint8_t io = op->d, mask = op->r;
+			uint8_t res = _avr_get_ram(avr, io) & ~mask;
+			STATE("cbi %s[%04x], 0x%02x = %02x\n", avr_regname(io), avr->data[io], mask, res);
+			_avr_set_ram(avr, io, res);
+		}	OPCODE_END;
+		OPCODE(SBIC) {	// SBIC -- Skip if Bit in I/O Register is Cleared -- 1001 1001 AAAA Abbb
+			const uint8_t io = op->d, mask = op->r;
+			uint8_t res = _avr_get_ram(avr, io) & mask;
+			STATE("sbic %s[%04x], 0x%02x\t; Will%s branch\n", avr_regname(io), avr->data[io], mask, !res?"":" not");
+			if (!res) {
+				if (_avr_is_instruction_32_bits(avr, new_pc)) {
+					new_pc += 4; cycle += 2;
+				} else {
+					new_pc += 2; cycle++;
+				}
+			}
+		}	OPCODE_END;
+		OPCODE(SBI) {	// SBI -- Set Bit in I/O Register -- 1001 1010 AAAA Abbb
+			const uint8_t io = op->d, mask = op->r;
+			uint8_t res = _avr_get_ram(avr, io) | mask;
+			STATE("sbi %s[%04x], 0x%02x = %02x\n", avr_regname(io), avr->data[io], mask, res);
+			_avr_set_ram(avr, io, res);
+		}	OPCODE_END;
+		OPCODE(SBIS) {	// SBIS -- Skip if Bit in I/O Register is Set -- 1001 1011 AAAA Abbb
+			const uint8_t io = op->d, mask = op->r;
+			uint8_t res = _avr_get_ram(avr, io) & mask;
+			STATE("sbis %s[%04x], 0x%02x\t; Will%s branch\n", avr_regname(io), avr->data[io], mask, res?"":" not");
+			if (res) {
+				if (_avr_is_instruction_32_bits(avr, new_pc)) {
+					new_pc += 4; cycle += 2;
+				} else {
+					new_pc += 2; cycle++;
+				}
+			}
+		}	OPCODE_END;
+		OPCODE(MUL) {	// MUL -- Multiply Unsigned -- 1001 11rd dddd rrrr
+			get_vd5_vr5(op);
+			uint16_t res = vd * vr;
+			STATE("mul %s[%02x], %s[%02x] = %04x\n", avr_regname(d), vd, avr_regname(r), vr, res);
+			_avr_set_r16le(avr, 0, res);
+			avr_sreg_lazy(avr, AVR_FLAGS_MUL, AVR_SREG_ZC, 0, (res >> 15) & 1, res);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(OUT) {	// OUT A,Rr -- 1011 1AAd dddd AAAA
+			const uint8_t d = op->d, A = op->r;
+			STATE("out %s, %s[%02x]\n", avr_regname(A), avr_regname(d), avr->data[d]);
+			_avr_set_ram(avr, A, avr->data[d]);
+		}	OPCODE_END;
+		OPCODE(IN) {	// IN Rd,A -- 1011 0AAd dddd AAAA
+			const uint8_t d = op->d, A = op->r;
+			STATE("in %s, %s[%02x]\n", avr_regname(d), avr_regname(A), avr->data[A]);
+			_avr_set_r(avr, d, _avr_get_ram(avr, A));
+		}	OPCODE_END;
+		OPCODE(RJMP) {	// RJMP -- 1100 kkkk kkkk kkkk
+			const int16_t o = op->k;
+			STATE("rjmp .%d [%04x]\n", o >> 1, new_pc + o);
+			avr_flashaddr_t pc = new_pc - 2;
+			new_pc = (new_pc + o) % (avr->flashend+1);
+			if (o < 0)
+				OPCODE_LOOP(pc, new_pc);
+			TRACE_JUMP();
+		}	OPCODE_END;
+		OPCODE(RCALL) {	// RCALL -- 1101 kkkk kkkk kkkk
+			const int16_t o = op->k;
+			STATE("rcall .%d [%04x]\n", o >> 1, new_pc + o);
+			cycle += _avr_push_addr_size(avr, new_pc, AVR_RUN_PC_SIZE);
+			new_pc = (new_pc + o) % (avr->flashend+1);
+			// 'rcall .1' is used as a cheap "push 16 bits of room on the stack"
+			if (o != 0) {
+				TRACE_JUMP();
+				STACK_FRAME_PUSH();
+			}
+		}	OPCODE_END;
+		OPCODE(LDI) {	// LDI Rd, K aka SER (LDI r, 0xff) -- 1110 kkkk dddd kkkk
+			const uint8_t h = op->d, k = op->k;
+			STATE("ldi %s, 0x%02x\n", avr_regname(h), k);
+			_avr_set_r(avr, h, k);
+		}	OPCODE_END;
+		OPCODE(OVERFLOW) {	// AVR_OVERFLOW_OPCODE
+			printf("FLASH overflow, soft reset\n");
+			new_pc = 0;
+			TRACE_JUMP();
+		}	OPCODE_END;
+		OPCODE(BRBS)
+		OPCODE(BRBC) {	// BRXC/BRXS -- All the SREG branches -- 1111 0Boo oooo osss
+			const int16_t o = op->k; // offset
+			uint8_t s = op->d;
+			int set = op->kind == AVR_OP_BRBS;
+			int branch = avr_sreg_get(avr, s) == set;
+#if CONFIG_SIMAVR_TRACE
+			const char *names[2][8] = {
+					{ "brcc", "brne", "brpl", "brvc", NULL, "brhc", "brtc", "brid"},
+					{ "brcs", "breq", "brmi", "brvs", NULL, "brhs", "brts", "brie"},
+			};
+			if (names[set][s]) {
+				STATE("%s .%d [%04x]\t; Will%s branch\n", names[set][s], o, new_pc + (o << 1), branch ? "":" not");
+			} else {
+				STATE("%s%c .%d [%04x]\t; Will%s branch\n", set ? "brbs" : "brbc", _sreg_bit_name[s], o, new_pc + (o << 1), branch ? "":" not");
+			}
+#endif
+			if (branch) {
+				cycle++; // 2 cycles if taken, 1 otherwise
+				new_pc = new_pc + (o << 1);
+				if (o < 0)
+					OPCODE_LOOP(new_pc - (o << 1) - 2, new_pc);
+			} else if (o < 0 && unlikely(op->loop))
+				avr_idle_reset(avr);	// leaving the loop
+		}	OPCODE_END;
+		OPCODE(BLD) {	// BLD -- Bit Store from T into a Bit in Register -- 1111 100d dddd 0bbb
+			get_vd5(op);
+			const uint8_t mask = op->r;
+			uint8_t v = (vd & ~mask) | (avr_sreg_get(avr, S_T) ? mask : 0);
+			STATE("bld %s[%02x], 0x%02x = %02x\n", avr_regname(d), vd, mask, v);
+			_avr_set_r(avr, d, v);
+		}	OPCODE_END;
+		OPCODE(BST) {	// BST -- Bit Store into T from bit in Register -- 1111 101d dddd 0bbb
+			get_vd5(op);
+			const uint8_t s = op->r;
+			STATE("bst %s[%02x], 0x%02x\n", avr_regname(d), vd, 1 << s);
+			avr_sreg_set(avr, S_T, (vd >> s) & 1);
+			SREG();
+		}	OPCODE_END;
+		OPCODE(SBRC)
+		OPCODE(SBRS) {	// SBRS/SBRC -- Skip if Bit in Register is Set/Clear -- 1111 11sd dddd 0bbb
+			get_vd5(op);
+			const uint8_t mask = op->r;
+			int set = op->kind == AVR_OP_SBRS;
+			int branch = ((vd & mask) && set) || (!(vd & mask) && !set);
+			STATE("%s %s[%02x], 0x%02x\t; Will%s branch\n", set ? "sbrs" : "sbrc", avr_regname(d), vd, mask, branch ? "":" not");
+			if (branch) {
+				if (_avr_is_instruction_32_bits(avr, new_pc)) {
+					new_pc += 4; cycle += 2;
+				} else {
+					new_pc += 2; cycle++;
+				}
+			}
+		}	OPCODE_END;
+		OPCODE(INVALID)
+		OPCODE_DEFAULT {
+			_avr_invalid_opcode(avr);
+		}	OPCODE_END;
+	}
+#if AVR_RUN_JIT
+run_jit_done:
+	OPCODE_END;
+#endif
+	OPCODE_NEXT(goto run_one_again);
+}
+
+#undef OPCODE_NEXT
+#undef OPCODE_BLOCK
+#undef OPCODE_CHAIN
+#undef OPCODE_JIT
+#undef OPCODE_LOOP
+#undef OPCODE_AGAIN
+#undef OPCODE_DISPATCH
+#undef OPCODE
+#undef OPCODE_DEFAULT
+#undef OPCODE_FALLTHROUGH
+#undef OPCODE_END
+#undef AVR_RUN_PC_SIZE
+#undef AVR_RUN_THREADED
+#undef AVR_RUN_BLOCKS
+#undef AVR_RUN_JIT
+#undef AVR_RUN_ONE
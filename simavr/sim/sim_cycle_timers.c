@@ -23,44 +23,98 @@
 #include <stdio.h>
 #include <string.h>
 #include "sim_avr.h"
+#include "sim_core.h"
 #include "sim_time.h"
 #include "sim_cycle_timers.h"
 
-#define QUEUE(__q, __e) { \
-		(__e)->next = (__q); \
-		(__q) = __e; \
-	}
-#define DETACH(__q, __l, __e) { \
-		if (__l) \
-			(__l)->next = (__e)->next; \
-		else \
-			(__q) = (__e)->next; \
-	}
-#define INSERT(__q, __l, __e) { \
-		if (__l) { \
-			(__e)->next = (__l)->next; \
-			(__l)->next = (__e); \
-		} else { \
-			(__e)->next = (__q); \
-			(__q) = (__e); \
-		} \
-	}
-
 #define DEFAULT_SLEEP_CYCLES 1000
 
+#define SLOT(__pool, __h) (&(__pool)->slot[(__h) - 1])
+
+static void
+avr_cycle_timer_release(
+		avr_cycle_timer_pool_t * pool,
+		avr_cycle_timer_handle_t h);
+
 void
 avr_cycle_timer_reset(
 		struct avr_t * avr)
 {
 	avr_cycle_timer_pool_t * pool = &avr->cycle_timers;
+	// keep the memory, and the slots handles were given out for
+	for (uint32_t i = 0; i < pool->count; i++)
+		SLOT(pool, pool->heap[i])->heap = 0;
+	pool->count = 0;
+	pool->seq = 0;
+	for (uint32_t h = 1; h <= pool->slot_count; h++)
+		avr_cycle_timer_release(pool, h);
+	avr->next_timer_cycle = 0;
+	avr->run_cycle_count = 1;
+	// keep the limit the application might have set across resets
+	if (!avr->run_cycle_limit)
+		avr->run_cycle_limit = 1;
+}
+
+void
+avr_cycle_timer_free(
+		struct avr_t * avr)
+{
+	avr_cycle_timer_pool_t * pool = &avr->cycle_timers;
+	free(pool->slot);
+	free(pool->heap);
+	free(pool->hash);
 	memset(pool, 0, sizeof(*pool));
-	// queue all slots into the free queue
-	for (int i = 0; i < MAX_CYCLE_TIMERS; i++) {
-		avr_cycle_timer_slot_p t = &pool->timer_slots[i];
-		QUEUE(pool->timer_free, t);
+}
+
+int
+avr_cycle_timer_pool_copy(
+		avr_cycle_timer_pool_p dst,
+		const avr_cycle_timer_pool_t * src)
+{
+	uint32_t size = src->slot_size;
+
+	if (dst->slot_size != size || !size) {
+		// the hash depends on the size, so take the same
+		avr_cycle_timer_pool_t p = { 0 };
+		if (size) {
+			p.slot = malloc(size * sizeof(*p.slot));
+			p.heap = malloc(size * sizeof(*p.heap));
+			p.hash = malloc(size * sizeof(*p.hash));
+		}
+		// dst stays as it was if that fails
+		if (size && (!p.slot || !p.heap || !p.hash)) {
+			free(p.slot);
+			free(p.heap);
+			free(p.hash);
+			return -1;
+		}
+		free(dst->slot);
+		free(dst->heap);
+		free(dst->hash);
+		*dst = p;
 	}
-	avr->run_cycle_count = 1;
-	avr->run_cycle_limit = 1;
+	avr_cycle_timer_slot_p slot = dst->slot;
+	avr_cycle_timer_handle_t * heap = dst->heap;
+	avr_cycle_timer_handle_t * hash = dst->hash;
+	*dst = *src;
+	dst->slot = slot;
+	dst->heap = heap;
+	dst->hash = hash;
+	if (size) {
+		memcpy(slot, src->slot, size * sizeof(*slot));
+		memcpy(heap, src->heap, size * sizeof(*heap));
+		memcpy(hash, src->hash, size * sizeof(*hash));
+	}
+	return 0;
+}
+
+// update the run loops copy of the next deadline
+static inline void
+avr_cycle_timer_update_next(
+		avr_t * avr)
+{
+	avr_cycle_timer_pool_t * pool = &avr->cycle_timers;
+	avr->next_timer_cycle = pool->count ? SLOT(pool, pool->heap[0])->when : 0;
 }
 
 static avr_cycle_count_t
@@ -85,9 +139,11 @@ avr_cycle_timer_reset_sleep_run_cycles_limited(
 	avr_cycle_timer_pool_t * pool = &avr->cycle_timers;
 	avr_cycle_count_t sleep_cycle_count = DEFAULT_SLEEP_CYCLES;
 
-	if(pool->timer) {
-		if(pool->timer->when > avr->cycle) {
-			sleep_cycle_count = pool->timer->when - avr->cycle;
+	avr_cycle_timer_update_next(avr);
+	if(pool->count) {
+		avr_cycle_count_t when = SLOT(pool, pool->heap[0])->when;
+		if(when > avr->cycle) {
+			sleep_cycle_count = when - avr->cycle;
 		} else {
 			sleep_cycle_count = 0;
 		}
@@ -96,40 +152,206 @@ avr_cycle_timer_reset_sleep_run_cycles_limited(
 	avr_cycle_timer_return_sleep_run_cycles_limited(avr, sleep_cycle_count);
 }
 
-// no sanity checks checking here, on purpose
-static void
-avr_cycle_timer_insert(
-		avr_t * avr,
-		avr_cycle_count_t when,
+/*
+ * Hash table on (timer, param), the buckets are chained thru the slots
+ */
+static inline uint32_t
+avr_cycle_timer_hash(
+		avr_cycle_timer_pool_t * pool,
+		avr_cycle_timer_t timer,
+		void * param)
+{
+	uint64_t h = (uint64_t)(uintptr_t)timer * 0x9e3779b97f4a7c15ull;
+	h = (h ^ (uint64_t)(uintptr_t)param) * 0xff51afd7ed558ccdull;
+	return (h >> 32) & (pool->slot_size - 1);
+}
+
+static avr_cycle_timer_handle_t
+avr_cycle_timer_find(
+		avr_cycle_timer_pool_t * pool,
 		avr_cycle_timer_t timer,
 		void * param)
+{
+	if (!pool->slot_size)
+		return 0;
+	avr_cycle_timer_handle_t h = pool->hash[avr_cycle_timer_hash(pool, timer, param)];
+	while (h) {
+		avr_cycle_timer_slot_p s = SLOT(pool, h);
+		if (s->timer == timer && s->param == param)
+			break;
+		h = s->next;
+	}
+	return h;
+}
+
+static int
+avr_cycle_timer_grow(
+		avr_t * avr)
 {
 	avr_cycle_timer_pool_t * pool = &avr->cycle_timers;
+	uint32_t size = pool->slot_size ? pool->slot_size * 2 : 16;
+	avr_cycle_timer_slot_p slot = realloc(pool->slot, size * sizeof(*slot));
+	if (slot)
+		pool->slot = slot;
+	uint32_t * heap = slot ? realloc(pool->heap, size * sizeof(*heap)) : NULL;
+	if (heap)
+		pool->heap = heap;
+	uint32_t * hash = heap ? realloc(pool->hash, size * sizeof(*hash)) : NULL;
+	if (!hash) {
+		AVR_LOG(avr, LOG_ERROR, "CYCLE: %s: ran out of memory (%d timers)!\n",
+				__func__, pool->slot_count);
+		return -1;
+	}
+	pool->hash = hash;
+	pool->slot_size = size;
+	// rehash the slots in use, the free ones keep their list
+	memset(hash, 0, size * sizeof(*hash));
+	for (avr_cycle_timer_handle_t h = 1; h <= pool->slot_count; h++) {
+		avr_cycle_timer_slot_p s = SLOT(pool, h);
+		if (!s->timer)
+			continue;
+		uint32_t b = avr_cycle_timer_hash(pool, s->timer, s->param);
+		s->next = hash[b];
+		hash[b] = h;
+	}
+	return 0;
+}
 
-	when += avr->cycle;
+// return the slot for that timer, making a new one if needed
+static avr_cycle_timer_handle_t
+avr_cycle_timer_alloc(
+		avr_t * avr,
+		avr_cycle_timer_t timer,
+		void * param)
+{
+	avr_cycle_timer_pool_t * pool = &avr->cycle_timers;
+	avr_cycle_timer_handle_t h = avr_cycle_timer_find(pool, timer, param);
+
+	if (h)
+		return h;
+	if (pool->free) {
+		h = pool->free;
+		pool->free = SLOT(pool, h)->next;
+	} else {
+		if (pool->slot_count == pool->slot_size && avr_cycle_timer_grow(avr))
+			return 0;
+		h = ++pool->slot_count;
+	}
+	avr_cycle_timer_slot_p s = SLOT(pool, h);
+	memset(s, 0, sizeof(*s));
+	s->timer = timer;
+	s->param = param;
+	uint32_t b = avr_cycle_timer_hash(pool, timer, param);
+	s->next = pool->hash[b];
+	pool->hash[b] = h;
+	return h;
+}
 
-	avr_cycle_timer_slot_p t = pool->timer_free;
+// give back a slot that is no longer pending, unless a handle was given out
+static void
+avr_cycle_timer_release(
+		avr_cycle_timer_pool_t * pool,
+		avr_cycle_timer_handle_t h)
+{
+	avr_cycle_timer_slot_p s = SLOT(pool, h);
 
-	if (!t) {
-		AVR_LOG(avr, LOG_ERROR, "CYCLE: %s: ran out of timers (%d)!\n", __func__, MAX_CYCLE_TIMERS);
+	if (!s->timer || s->held || s->heap)
 		return;
+	avr_cycle_timer_handle_t * l = &pool->hash[avr_cycle_timer_hash(pool, s->timer, s->param)];
+	while (*l != h)
+		l = &SLOT(pool, *l)->next;
+	*l = s->next;
+	s->timer = NULL;
+	s->next = pool->free;
+	pool->free = h;
+}
+
+/*
+ * Heap ordering, by 'when' then by registration order
+ */
+static inline int
+avr_cycle_timer_before(
+		avr_cycle_timer_pool_t * pool,
+		avr_cycle_timer_handle_t a,
+		avr_cycle_timer_handle_t b)
+{
+	avr_cycle_timer_slot_p sa = SLOT(pool, a), sb = SLOT(pool, b);
+	return sa->when < sb->when || (sa->when == sb->when && sa->seq < sb->seq);
+}
+
+static inline void
+avr_cycle_timer_place(
+		avr_cycle_timer_pool_t * pool,
+		uint32_t pos,
+		avr_cycle_timer_handle_t h)
+{
+	pool->heap[pos] = h;
+	SLOT(pool, h)->heap = pos + 1;
+}
+
+static void
+avr_cycle_timer_sift(
+		avr_cycle_timer_pool_t * pool,
+		uint32_t pos)
+{
+	avr_cycle_timer_handle_t h = pool->heap[pos];
+
+	// up...
+	while (pos) {
+		uint32_t parent = (pos - 1) / 2;
+		if (!avr_cycle_timer_before(pool, h, pool->heap[parent]))
+			break;
+		avr_cycle_timer_place(pool, pos, pool->heap[parent]);
+		pos = parent;
 	}
-	// detach head
-	pool->timer_free = t->next;
-	t->next = NULL;
-	t->timer = timer;
-	t->param = param;
-	t->when = when;
-
-	// find its place in the list
-	avr_cycle_timer_slot_p loop = pool->timer, last = NULL;
-	while (loop) {
-		if (loop->when > when)
+	// ...or down
+	for (;;) {
+		uint32_t child = (pos * 2) + 1;
+		if (child >= pool->count)
 			break;
-		last = loop;
-		loop = loop->next;
+		if (child + 1 < pool->count &&
+				avr_cycle_timer_before(pool, pool->heap[child + 1], pool->heap[child]))
+			child++;
+		if (!avr_cycle_timer_before(pool, pool->heap[child], h))
+			break;
+		avr_cycle_timer_place(pool, pos, pool->heap[child]);
+		pos = child;
 	}
-	INSERT(pool->timer, last, t);
+	avr_cycle_timer_place(pool, pos, h);
+}
+
+static void
+avr_cycle_timer_unschedule(
+		avr_cycle_timer_pool_t * pool,
+		avr_cycle_timer_handle_t h)
+{
+	avr_cycle_timer_slot_p s = SLOT(pool, h);
+
+	if (!s->heap)
+		return;
+	uint32_t pos = s->heap - 1;
+	s->heap = 0;
+	if (pos == --pool->count)
+		return;
+	avr_cycle_timer_place(pool, pos, pool->heap[pool->count]);
+	avr_cycle_timer_sift(pool, pos);
+}
+
+// no sanity checks checking here, on purpose
+static void
+avr_cycle_timer_schedule(
+		avr_t * avr,
+		avr_cycle_timer_handle_t h,
+		avr_cycle_count_t when)
+{
+	avr_cycle_timer_pool_t * pool = &avr->cycle_timers;
+	avr_cycle_timer_slot_p s = SLOT(pool, h);
+
+	avr_cycle_timer_unschedule(pool, h);
+	s->when = avr->cycle + when;
+	s->seq = pool->seq++;
+	avr_cycle_timer_place(pool, pool->count, h);
+	avr_cycle_timer_sift(pool, pool->count++);
 }
 
 void
@@ -139,16 +361,11 @@ avr_cycle_timer_register(
 		avr_cycle_timer_t timer,
 		void * param)
 {
-	avr_cycle_timer_pool_t * pool = &avr->cycle_timers;
+	avr_cycle_timer_handle_t h = avr_cycle_timer_alloc(avr, timer, param);
 
-	// remove it if it was already scheduled
-	avr_cycle_timer_cancel(avr, timer, param);
-
-	if (!pool->timer_free) {
-		AVR_LOG(avr, LOG_ERROR, "CYCLE: %s: pool is full (%d)!\n", __func__, MAX_CYCLE_TIMERS);
+	if (!h)
 		return;
-	}
-	avr_cycle_timer_insert(avr, when, timer, param);
+	avr_cycle_timer_schedule(avr, h, when);
 	avr_cycle_timer_reset_sleep_run_cycles_limited(avr);
 }
 
@@ -169,17 +386,11 @@ avr_cycle_timer_cancel(
 		void * param)
 {
 	avr_cycle_timer_pool_t * pool = &avr->cycle_timers;
+	avr_cycle_timer_handle_t h = avr_cycle_timer_find(pool, timer, param);
 
-	// find its place in the list
-	avr_cycle_timer_slot_p t = pool->timer, last = NULL;
-	while (t) {
-		if (t->timer == timer && t->param == param) {
-			DETACH(pool->timer, last, t);
-			QUEUE(pool->timer_free, t);
-			break;
-		}
-		last = t;
-		t = t->next;
+	if (h) {
+		avr_cycle_timer_unschedule(pool, h);
+		avr_cycle_timer_release(pool, h);
 	}
 	avr_cycle_timer_reset_sleep_run_cycles_limited(avr);
 }
@@ -193,18 +404,78 @@ avr_cycle_timer_status(
 		avr_t * avr,
 		avr_cycle_timer_t timer,
 		void * param)
+{
+	return avr_cycle_timer_status_handle(avr,
+			avr_cycle_timer_find(&avr->cycle_timers, timer, param));
+}
+
+avr_cycle_timer_handle_t
+avr_cycle_timer_get_handle(
+		avr_t * avr,
+		avr_cycle_timer_t timer,
+		void * param)
+{
+	avr_cycle_timer_handle_t h = avr_cycle_timer_alloc(avr, timer, param);
+
+	if (h)
+		SLOT(&avr->cycle_timers, h)->held = 1;
+	return h;
+}
+
+avr_cycle_timer_handle_t
+avr_cycle_timer_register_handle(
+		avr_t * avr,
+		avr_cycle_count_t when,
+		avr_cycle_timer_t timer,
+		void * param)
+{
+	avr_cycle_timer_handle_t h = avr_cycle_timer_get_handle(avr, timer, param);
+
+	avr_cycle_timer_reschedule(avr, h, when);
+	return h;
+}
+
+void
+avr_cycle_timer_reschedule(
+		avr_t * avr,
+		avr_cycle_timer_handle_t h,
+		avr_cycle_count_t when)
+{
+	if (!h)
+		return;
+	avr_cycle_timer_schedule(avr, h, when);
+	avr_cycle_timer_reset_sleep_run_cycles_limited(avr);
+}
+
+void
+avr_cycle_timer_reschedule_usec(
+		avr_t * avr,
+		avr_cycle_timer_handle_t h,
+		uint32_t when)
+{
+	avr_cycle_timer_reschedule(avr, h, avr_usec_to_cycles(avr, when));
+}
+
+void
+avr_cycle_timer_cancel_handle(
+		avr_t * avr,
+		avr_cycle_timer_handle_t h)
+{
+	if (h)
+		avr_cycle_timer_unschedule(&avr->cycle_timers, h);
+	avr_cycle_timer_reset_sleep_run_cycles_limited(avr);
+}
+
+avr_cycle_count_t
+avr_cycle_timer_status_handle(
+		avr_t * avr,
+		avr_cycle_timer_handle_t h)
 {
 	avr_cycle_timer_pool_t * pool = &avr->cycle_timers;
 
-	// find its place in the list
-	avr_cycle_timer_slot_p t = pool->timer;
-	while (t) {
-		if (t->timer == timer && t->param == param) {
-			return 1 + (t->when - avr->cycle);
-		}
-		t = t->next;
-	}
-	return 0;
+	if (!h || !SLOT(pool, h)->heap)
+		return 0;
+	return 1 + (SLOT(pool, h)->when - avr->cycle);
 }
 
 /*
@@ -218,30 +489,42 @@ avr_cycle_timer_process(
 {
 	avr_cycle_timer_pool_t * pool = &avr->cycle_timers;
 
-	if (pool->timer) do {
-		avr_cycle_timer_slot_p t = pool->timer;
-		avr_cycle_count_t when = t->when;
+	while (pool->count) {
+		avr_cycle_timer_handle_t h = pool->heap[0];
+		avr_cycle_timer_slot_p s = SLOT(pool, h);
+		avr_cycle_count_t when = s->when;
 
-		if (when > avr->cycle)
+		if (when > avr->cycle) {
+			avr->next_timer_cycle = when;
 			return avr_cycle_timer_return_sleep_run_cycles_limited(avr, when - avr->cycle);
+		}
 
+		// the timer might change what an idle loop is waiting for
+		avr_idle_reset(avr);
 		// detach from active timers
-		pool->timer = t->next;
-		t->next = NULL;
+		avr_cycle_timer_unschedule(pool, h);
+		// the callback can register/cancel timers, and move the slots
+		avr_cycle_timer_t timer = s->timer;
+		void * param = s->param;
 		do {
-			avr_cycle_count_t w = t->timer(avr, when, t->param);
+			avr_cycle_count_t w = timer(avr, when, param);
 			// make sure the return value is either zero, or greater
 			// than the last one to prevent infinite loop here
 			when = w > when ? w : 0;
 		} while (when && when <= avr->cycle);
-		
+
+		// it might have been cancelled, or reused, meanwhile
+		h = when ? avr_cycle_timer_alloc(avr, timer, param) :
+				avr_cycle_timer_find(pool, timer, param);
+		if (!h)
+			continue;
 		if (when) // reschedule then
-			avr_cycle_timer_insert(avr, when - avr->cycle, t->timer, t->param);
-		
-		// requeue this one into the free ones
-		QUEUE(pool->timer_free, t);
-	} while (pool->timer);
+			avr_cycle_timer_schedule(avr, h, when - avr->cycle);
+		else
+			avr_cycle_timer_release(pool, h);
+	}
 
+	avr->next_timer_cycle = 0;
 	// original behavior was to return 1000 cycles when no timers were present...
 	// run_cycles are bound to at least one cycle but no more than requested limit...
 	//	value passed here is returned unbounded, thus preserving original behavior.
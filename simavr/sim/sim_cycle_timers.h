@@ -24,9 +24,10 @@
  * these timers are one shots, then get cleared if the timer function returns zero,
  * they get reset if the callback function returns a new cycle number
  *
- * the implementation maintains a list of 'pending' timers, sorted by when they
- * should run, it allows very quick comparison with the next timer to run, and
- * quick removal of then from the pile once dispatched.
+ * the implementation maintains a binary heap of 'pending' timers, sorted by when
+ * they should run, it allows very quick comparison with the next timer to run, and
+ * quick insertion and removal of them from the pile. Timers due on the same cycle
+ * run in the order they were registered in.
  */
 #ifndef __SIM_CYCLE_TIMERS_H___
 #define __SIM_CYCLE_TIMERS_H___
@@ -37,8 +38,6 @@
 extern "C" {
 #endif
 
-#define MAX_CYCLE_TIMERS	64
-
 typedef avr_cycle_count_t (*avr_cycle_timer_t)(
 		struct avr_t * avr,
 		avr_cycle_count_t when,
@@ -55,22 +54,36 @@ typedef avr_cycle_count_t (*avr_cycle_timer_t)(
  * repeteadly until it 'caches up'.
  */
 typedef struct avr_cycle_timer_slot_t {
-	struct avr_cycle_timer_slot_t *next;
 	avr_cycle_count_t	when;
-	avr_cycle_timer_t	timer;
+	uint64_t			seq;	// registration order, for the ones due on the same cycle
+	avr_cycle_timer_t	timer;	// NULL for a free slot
 	void * param;
+	uint32_t			heap;	// position in the heap (+1), zero when not pending
+	uint32_t			next;	// next slot in the hash bucket, or in the free list
+	uint8_t				held;	// a handle was given out, the slot stays
 } avr_cycle_timer_slot_t, *avr_cycle_timer_slot_p;
 
 /*
- * Timer pool contains a pool of timer slots available, they all
- * start queued into the 'free' qeueue, are migrated to the
- * 'active' queue when needed and are re-queued to the free one
- * when done
+ * Handle on a timer slot, from avr_cycle_timer_get_handle(). Zero is never
+ * a valid handle. Handles stay valid across avr_reset().
+ */
+typedef uint32_t avr_cycle_timer_handle_t;
+
+/*
+ * Timer pool contains a slot per known timer, handle 'n' is slot[n-1].
+ * The heap holds the handles of the pending timers, the next one to run is
+ * always heap[0]. 'hash' is a table of slot chains on the timer function and
+ * parameter, for the calls that don't use a handle. All of them grow as needed.
  */
 typedef struct avr_cycle_timer_pool_t {
-	avr_cycle_timer_slot_t timer_slots[MAX_CYCLE_TIMERS];
-	avr_cycle_timer_slot_p timer_free;
-	avr_cycle_timer_slot_p timer;
+	avr_cycle_timer_slot_p	slot;
+	uint32_t				slot_count;	// slots ever used
+	uint32_t				slot_size;	// allocated slots, a power of two
+	avr_cycle_timer_handle_t free;		// list of released slots
+	avr_cycle_timer_handle_t * heap;
+	uint32_t				count;		// pending timers
+	avr_cycle_timer_handle_t * hash;	// 'slot_size' buckets
+	uint64_t				seq;
 } avr_cycle_timer_pool_t, *avr_cycle_timer_pool_p;
 
 
@@ -104,6 +117,46 @@ avr_cycle_timer_status(
 		avr_cycle_timer_t timer,
 		void * param);
 
+
+/*
+ * Handle based calls, for the peripherals that keep rescheduling the same
+ * timers; these skip the (timer, param) lookup.
+ * avr_cycle_timer_get_handle() returns the handle of that timer, without
+ * scheduling it; the handle is kept until avr_terminate().
+ */
+avr_cycle_timer_handle_t
+avr_cycle_timer_get_handle(
+		struct avr_t * avr,
+		avr_cycle_timer_t timer,
+		void * param);
+// same as avr_cycle_timer_register(), returns the handle
+avr_cycle_timer_handle_t
+avr_cycle_timer_register_handle(
+		struct avr_t * avr,
+		avr_cycle_count_t when,
+		avr_cycle_timer_t timer,
+		void * param);
+// (re)schedule the timer in 'when' cycles
+void
+avr_cycle_timer_reschedule(
+		struct avr_t * avr,
+		avr_cycle_timer_handle_t handle,
+		avr_cycle_count_t when);
+// (re)schedule the timer in 'when' usec
+void
+avr_cycle_timer_reschedule_usec(
+		struct avr_t * avr,
+		avr_cycle_timer_handle_t handle,
+		uint32_t when);
+void
+avr_cycle_timer_cancel_handle(
+		struct avr_t * avr,
+		avr_cycle_timer_handle_t handle);
+avr_cycle_count_t
+avr_cycle_timer_status_handle(
+		struct avr_t * avr,
+		avr_cycle_timer_handle_t handle);
+
 //
 // Private, called from the core
 //
@@ -113,6 +166,19 @@ avr_cycle_timer_process(
 void
 avr_cycle_timer_reset(
 		struct avr_t * avr);
+// release the timer pool memory, called by avr_terminate()
+void
+avr_cycle_timer_free(
+		struct avr_t * avr);
+/*
+ * Makes 'dst' a copy of 'src', with its own memory, for the checkpoints
+ * (see sim_checkpoint.h). 'dst' is either zeroed, or a pool to replace.
+ * Returns -1 if out of memory, 'dst' is then left as it was.
+ */
+int
+avr_cycle_timer_pool_copy(
+		avr_cycle_timer_pool_p dst,
+		const avr_cycle_timer_pool_t * src);
 
 #ifdef __cplusplus
 };
@@ -28,24 +28,116 @@
 #include <errno.h>
 #include <pthread.h>
 #include "sim_avr.h"
-#include "sim_core.h" // for SET_SREG_FROM, READ_SREG_INTO
+#include "sim_core.h" // for SET_SREG_FROM, READ_SREG_INTO, avr_decode_invalidate
 #include "sim_hex.h"
 #include "avr_eeprom.h"
+#include "avr_uart.h"
+#include "sim_checkpoint.h"
 #include "sim_gdb.h"
 
 #define DBG(w)
 
-#define WATCH_LIMIT (32)
+/*
+ * Largest packet gdb may send us, advertised with qSupported. A 'load'
+ * goes that many bytes at a time, so the larger the better.
+ */
+#define AVR_GDB_PACKET_SIZE	0x8000
 
 typedef struct {
 	uint32_t len; /**< How many points are taken (points[0] .. points[len - 1]). */
-	struct {
+	uint32_t size; /**< How many points fit in 'points' before it's grown. */
+	struct avr_gdb_watchpoint_t {
 		uint32_t addr; /**< Which address is watched. */
 		uint32_t size; /**< How large is the watched segment. */
 		uint32_t kind; /**< Bitmask of enum avr_gdb_watch_type values. */
-	} points[WATCH_LIMIT];
+		uint32_t cond_size; /**< Size of 'cond', 0 if the breakpoint has no condition. */
+		uint8_t * cond; /**< Conditions, 2 bytes of length then the bytecode, for each. */
+	} * points;
 } avr_gdb_watchpoints_t;
 
+/*
+ * The lists above are only walked when gdb changes them, the core itself
+ * looks at these maps: one bit per flash word with a breakpoint, and one
+ * bit per data byte watched for reads (or writes).
+ */
+typedef uint32_t avr_gdb_map_t;
+
+static inline int
+gdb_map_get(
+		const avr_gdb_map_t * map,
+		uint32_t bit )
+{
+	return (map[bit >> 5] >> (bit & 31)) & 1;
+}
+
+static inline void
+gdb_map_set(
+		avr_gdb_map_t * map,
+		uint32_t bit )
+{
+	map[bit >> 5] |= 1 << (bit & 31);
+}
+
+/*
+ * Tracepoints, set by gdb's QTDP packets. Once the trace run is started,
+ * a tracepoint hit collects the registers, and the memory its actions ask
+ * for, in a new frame; then the core carries on. gdb looks at the frames
+ * later on, with QTFrame.
+ */
+#define AVR_GDB_TRACE_SIZE	(1024 * 1024)	// default frame memory budget
+
+typedef struct avr_gdb_trace_action_t {
+	char		type;	// 'M' memory, 'X' expression
+	int32_t		reg;	// 'M': base register, -1 for an absolute address
+	uint32_t	addr;	// 'M': offset to it, or the address
+	uint32_t	len;	// 'M': bytes to collect, 'X': size of 'code'
+	uint8_t *	code;	// 'X': the bytecode, that collects with its trace ops
+} avr_gdb_trace_action_t;
+
+typedef struct avr_gdb_tracepoint_t {
+	uint32_t	number;
+	uint32_t	addr;
+	int			enabled;
+	uint32_t	pass;	// stop the trace run after that many hits, 0 for never
+	uint32_t	hits;
+	uint32_t	cond_size;
+	uint8_t *	cond;
+	uint32_t	action_count;
+	avr_gdb_trace_action_t * action;
+} avr_gdb_tracepoint_t;
+
+typedef struct avr_gdb_frame_t {
+	uint32_t	tracepoint;	// number of the tracepoint that collected it
+	uint8_t		regs[32];
+	uint8_t		sreg;
+	uint16_t	sp;
+	uint32_t	pc;
+	uint32_t	size;	// of 'data'
+	uint8_t *	data;	// memory blocks: 4 bytes of address, 2 of length, the bytes
+} avr_gdb_frame_t;
+
+/*
+ * Reverse execution. While gdb is connected, the core state is saved every
+ * avr->gdb_checkpoint cycles, and the values raised on the input IRQs are
+ * logged. Going back is restoring the last checkpoint before, and running
+ * from there again with the logged inputs, up to the wanted cycle.
+ *
+ * Once gdb went back, the core is "replaying": the live inputs are muted,
+ * and the logged ones raised in their stead, until it gets back to 'head',
+ * where the live run was, and carries on from there.
+ */
+typedef struct avr_gdb_input_t {
+	avr_cycle_count_t	cycle;
+	avr_irq_t *	irq;
+	uint32_t	value;
+	uint8_t		looping;	// raised during an instruction, not between two
+} avr_gdb_input_t;
+
+typedef struct avr_gdb_checkpoint_t {
+	avr_checkpoint_t *	c;
+	uint32_t	input;		// first log entry after it
+} avr_gdb_checkpoint_t;
+
 typedef struct avr_gdb_t {
 	avr_t * avr;
 	int		listen;	// listen socket
@@ -53,6 +145,49 @@ typedef struct avr_gdb_t {
 
 	avr_gdb_watchpoints_t breakpoints;
 	avr_gdb_watchpoints_t watchpoints;
+	avr_gdb_map_t * break_map;	// one bit per flash word
+	avr_gdb_map_t * read_map;	// one bit per data byte
+	avr_gdb_map_t * write_map;
+
+	avr_cycle_count_t poll_cycle;	// next look at the socket, while running
+
+	avr_gdb_tracepoint_t * tracepoint;
+	uint32_t	tracepoint_count;
+	avr_gdb_frame_t * frames;
+	uint32_t	frame_count;
+	uint32_t	frame_size;		// of the 'frames' array
+	uint32_t	trace_used;		// memory taken by the frames
+	uint32_t	trace_size;		// and how much they can take
+	int			trace_running;
+	char		trace_stop[32];	// why the trace run stopped, for qTStatus
+	int			frame;			// frame gdb looks at, -1 for the live core
+
+	avr_gdb_checkpoint_t * checkpoint;	// oldest first
+	uint32_t	checkpoint_count;
+	uint32_t	checkpoint_size;
+	avr_cycle_count_t next_checkpoint;
+	uint32_t	history_used;	// memory taken by the checkpoints and the log
+	avr_gdb_input_t * input;	// the log
+	uint32_t	input_count;
+	uint32_t	input_size;
+	avr_irq_t **	input_irq;
+	uint32_t	input_irq_count;
+	int			looping;	// between avr_gdb_processor() and avr_gdb_processor_done()
+	int			replaying;
+	avr_cycle_count_t head;
+	uint32_t	replay_next;	// next log entry to raise
+	uint32_t	replay_armed;	// log entry the timer waits for, ~0 if none
+	int			replay;		// in gdb_replay()
+	avr_cycle_count_t replay_last;	// last instruction gdb_replay() started
+	avr_cycle_count_t replay_hit;	// and the last that hit a break/watchpoint
+	uint32_t	replay_hit_addr;
+	int			replay_hit_kind;	// 0 if none, else an avr_gdb_watch_type
+
+	// packets can be split across recv() calls, or several come in one
+	uint32_t	rx_len;
+	uint8_t		rx[AVR_GDB_PACKET_SIZE + 16];	// '$', the packet, '#xx'
+	char		rep[AVR_GDB_PACKET_SIZE + 1];	// reply, before the framing
+	uint8_t		tx[(AVR_GDB_PACKET_SIZE * 2) + 4];	// framed, and escaped
 } avr_gdb_t;
 
 
@@ -75,26 +210,6 @@ gdb_watch_find(
 	return -1;
 }
 
-/**
- * Contrary to gdb_watch_find, this actually checks the address against
- * a watched memory _range_.
- */
-static int
-gdb_watch_find_range(
-		const avr_gdb_watchpoints_t * w,
-		uint32_t addr )
-{
-	for (int i = 0; i < w->len; i++) {
-		if (w->points[i].addr > addr) {
-			return -1;
-		} else if (w->points[i].addr <= addr && addr < w->points[i].addr + w->points[i].size) {
-			return i;
-		}
-	}
-
-	return -1;
-}
-
 /**
  * Returns -1 on error, 0 otherwise.
  */
@@ -113,9 +228,14 @@ gdb_watch_add_or_update(
 		return 0;
 	}
 
-	/* Otherwise add it. */
-	if (w->len == WATCH_LIMIT) {
-		return -1;
+	/* Otherwise add it, making room if needed. */
+	if (w->len == w->size) {
+		uint32_t size = w->size ? w->size * 2 : 16;
+		void * points = realloc(w->points, size * sizeof(w->points[0]));
+		if (!points)
+			return -1;
+		w->points = points;
+		w->size = size;
 	}
 
 	/* Find the insertion point. */
@@ -125,17 +245,16 @@ gdb_watch_add_or_update(
 		}
 	}
 
-	w->len++;
-
 	/* Make space for new element, moving old ones from the end. */
-	for (int j = w->len; j > i; j--) {
-		w->points[j] = w->points[j - 1];
-	}
+	memmove(&w->points[i + 1], &w->points[i], (w->len - i) * sizeof(w->points[0]));
+	w->len++;
 
 	/* Insert it. */
 	w->points[i].kind = kind;
 	w->points[i].addr = addr;
 	w->points[i].size = size;
+	w->points[i].cond_size = 0;
+	w->points[i].cond = NULL;
 
 	return 0;
 }
@@ -158,6 +277,7 @@ gdb_watch_rm(
 	if (w->points[i].kind) {
 		return 0;
 	}
+	free(w->points[i].cond);
 
 	for (i = i + 1; i < w->len; i++) {
 		w->points[i - 1] = w->points[i];
@@ -172,44 +292,155 @@ static void
 gdb_watch_clear(
 		avr_gdb_watchpoints_t * w )
 {
+	for (int i = 0; i < w->len; i++)
+		free(w->points[i].cond);
 	w->len = 0;
 }
 
 static void
-gdb_send_reply(
+gdb_watch_free(
+		avr_gdb_watchpoints_t * w )
+{
+	gdb_watch_clear(w);
+	free(w->points);
+	memset(w, 0, sizeof(*w));
+}
+
+/*
+ * Rebuilds the maps from the lists, after gdb changed them
+ */
+static void
+gdb_map_update(
+		avr_gdb_t * g )
+{
+	avr_t * avr = g->avr;
+
+	memset(g->break_map, 0, (((avr->flashend + 1) >> 6) + 1) * sizeof(avr_gdb_map_t));
+	for (int i = 0; i < g->breakpoints.len; i++)
+		gdb_map_set(g->break_map, g->breakpoints.points[i].addr >> 1);
+	// the tracepoints are only looked at during a trace run
+	for (int i = 0; g->trace_running && i < g->tracepoint_count; i++)
+		if (g->tracepoint[i].enabled)
+			gdb_map_set(g->break_map, g->tracepoint[i].addr >> 1);
+
+	memset(g->read_map, 0, (((avr->ramend + 1) >> 5) + 1) * sizeof(avr_gdb_map_t));
+	memset(g->write_map, 0, (((avr->ramend + 1) >> 5) + 1) * sizeof(avr_gdb_map_t));
+	for (int i = 0; i < g->watchpoints.len; i++) {
+		struct avr_gdb_watchpoint_t * w = &g->watchpoints.points[i];
+		for (uint32_t a = w->addr; a < w->addr + w->size && a <= avr->ramend; a++) {
+			if (w->kind & AVR_GDB_WATCH_READ)
+				gdb_map_set(g->read_map, a);
+			if (w->kind & AVR_GDB_WATCH_WRITE)
+				gdb_map_set(g->write_map, a);
+		}
+	}
+}
+
+/*
+ * Sends 'prefix' then 'len' bytes of 'data'; with 'binary', the bytes
+ * that would end the packet are escaped as '}' then the byte ^ 0x20.
+ */
+static void
+gdb_send_packet(
 		avr_gdb_t * g,
-		char * cmd )
+		const char * prefix,
+		const uint8_t * data,
+		uint32_t len,
+		int binary )
 {
-	uint8_t reply[1024];
-	uint8_t * dst = reply;
+	uint8_t * dst = g->tx;
 	uint8_t check = 0;
 	*dst++ = '$';
-	while (*cmd) {
-		check += *cmd;
-		*dst++ = *cmd++;
+	while (*prefix) {
+		check += *prefix;
+		*dst++ = *prefix++;
+	}
+	while (len--) {
+		uint8_t b = *data++;
+		if (binary && (b == '#' || b == '$' || b == '}' || b == '*')) {
+			check += '}';
+			*dst++ = '}';
+			b ^= 0x20;
+		}
+		check += b;
+		*dst++ = b;
 	}
 	sprintf((char*)dst, "#%02x", check);
-	DBG(printf("%s '%s'\n", __FUNCTION__, reply);)
-	send(g->s, reply, dst - reply + 3, 0);
+	DBG(printf("%s '%s'\n", __FUNCTION__, g->tx);)
+	send(g->s, g->tx, dst - g->tx + 3, 0);
 }
 
 static void
-gdb_send_quick_status(
+gdb_send_reply(
 		avr_gdb_t * g,
-		uint8_t signal )
+		char * cmd )
 {
-	char cmd[64];
+	gdb_send_packet(g, cmd, NULL, 0, 0);
+}
+
+/*
+ * Undoes the escaping of binary data sent by gdb, in place, and
+ * returns its new length
+ */
+static uint32_t
+gdb_unescape(
+		uint8_t * data,
+		uint32_t len )
+{
+	uint8_t * dst = data;
+	for (uint32_t i = 0; i < len; i++) {
+		if (data[i] == '}' && i + 1 < len)
+			*dst++ = data[++i] ^ 0x20;
+		else
+			*dst++ = data[i];
+	}
+	return dst - data;
+}
+
+/*
+ * 'reason' is appended to the stop reply, like "watch:800100;"
+ */
+static void
+gdb_send_stop_reason(
+		avr_gdb_t * g,
+		uint8_t signal,
+		const char * reason )
+{
+	char cmd[96];
         uint8_t sreg;
 
         READ_SREG_INTO(g->avr, sreg);
 
-	sprintf(cmd, "T%02x20:%02x;21:%02x%02x;22:%02x%02x%02x00;",
+	snprintf(cmd, sizeof(cmd), "T%02x20:%02x;21:%02x%02x;22:%02x%02x%02x00;%s",
                 signal ? signal : 5, sreg,
 		g->avr->data[R_SPL], g->avr->data[R_SPH],
-		g->avr->pc & 0xff, (g->avr->pc>>8)&0xff, (g->avr->pc>>16)&0xff);
+		g->avr->pc & 0xff, (g->avr->pc>>8)&0xff, (g->avr->pc>>16)&0xff,
+		reason ? reason : "");
 	gdb_send_reply(g, cmd);
 }
 
+static void
+gdb_send_quick_status(
+		avr_gdb_t * g,
+		uint8_t signal )
+{
+	gdb_send_stop_reason(g, signal, NULL);
+}
+
+static void
+gdb_send_watch_status(
+		avr_gdb_t * g,
+		int kind,
+		uint16_t addr )
+{
+	char reason[32];
+	sprintf(reason, "%s:%06x;",
+			(kind & AVR_GDB_WATCH_ACCESS) == AVR_GDB_WATCH_ACCESS ? "awatch" :
+				kind & AVR_GDB_WATCH_WRITE ? "watch" : "rwatch",
+			addr | 0x800000);
+	gdb_send_stop_reason(g, 0, reason);
+}
+
 static int
 gdb_change_breakpoint(
 		avr_gdb_watchpoints_t * w,
@@ -254,49 +485,1163 @@ gdb_write_register(
 	return 1;
 }
 
+/*
+ * Value of gdb register 'regi', from the live core, or from the trace
+ * frame gdb selected. Returns -1 if there is no such register.
+ */
+static int64_t
+gdb_get_register(
+		avr_gdb_t * g,
+		int regi )
+{
+	avr_gdb_frame_t * f = g->frame >= 0 ? &g->frames[g->frame] : NULL;
+
+	switch (regi) {
+		case 0 ... 31:
+			return f ? f->regs[regi] : g->avr->data[regi];
+		case 32: {
+			uint8_t sreg;
+			if (f)
+				return f->sreg;
+			READ_SREG_INTO(g->avr, sreg);
+			return sreg;
+		}
+		case 33:
+			return f ? f->sp : g->avr->data[R_SPL] | (g->avr->data[R_SPH] << 8);
+		case 34:
+			return f ? f->pc : g->avr->pc;
+	}
+	return -1;
+}
+
 static int
 gdb_read_register(
 		avr_gdb_t * g,
 		int regi,
 		char * rep )
 {
+	int64_t v = gdb_get_register(g, regi);
+
 	switch (regi) {
-		case 0 ... 31:
-			sprintf(rep, "%02x", g->avr->data[regi]);
-			break;
-		case 32: {
-				uint8_t sreg;
-				READ_SREG_INTO(g->avr, sreg);
-				sprintf(rep, "%02x", sreg);
-			}
+		case 0 ... 32:
+			sprintf(rep, "%02x", (uint8_t)v);
 			break;
 		case 33:
-			sprintf(rep, "%02x%02x", g->avr->data[R_SPL], g->avr->data[R_SPH]);
+			sprintf(rep, "%02x%02x", (uint8_t)v, (uint8_t)(v >> 8));
 			break;
 		case 34:
 			sprintf(rep, "%02x%02x%02x00",
-				g->avr->pc & 0xff, (g->avr->pc>>8)&0xff, (g->avr->pc>>16)&0xff);
+				(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16));
 			break;
 	}
 	return strlen(rep);
 }
 
+/*
+ * Copies 'len' bytes of the live core memory at gdb address 'addr' (flash,
+ * 0x800000 SRAM, 0x810000 EEPROM). Returns -1 if they are not all there.
+ */
+static int
+gdb_read_memory(
+		avr_gdb_t * g,
+		uint32_t addr,
+		uint8_t * dst,
+		uint32_t len )
+{
+	avr_t * avr = g->avr;
+
+	addr &= 0xffffff;
+	if (addr + len <= avr->flashend + 1) {
+		memcpy(dst, avr->flash + addr, len);
+	} else if (addr >= 0x800000 && (addr - 0x800000) + len <= avr->ramend + 1) {
+		memcpy(dst, avr->data + addr - 0x800000, len);
+	} else if (addr >= 0x810000 && (addr - 0x810000) + len <= avr->e2end + 1) {
+		avr_eeprom_desc_t ee = {.offset = (addr - 0x810000), .size = len, .ee = dst };
+		if (avr_ioctl(avr, AVR_IOCTL_EEPROM_GET, &ee) < 0)
+			return -1;
+	} else
+		return -1;
+	return 0;
+}
+
+/*
+ * Same address spaces as gdb_read_memory(). Writes to the flash drop
+ * the decoded opcodes there.
+ */
+static int
+gdb_write_memory(
+		avr_gdb_t * g,
+		uint32_t addr,
+		const uint8_t * src,
+		uint32_t len )
+{
+	avr_t * avr = g->avr;
+
+	addr &= 0xffffff;
+	if (addr + len <= avr->flashend + 1) {
+		memcpy(avr->flash + addr, src, len);
+		avr_decode_invalidate(avr, addr, len);
+	} else if (addr >= 0x800000 && (addr - 0x800000) + len <= avr->ramend + 1) {
+		memcpy(avr->data + addr - 0x800000, src, len);
+	} else if (addr >= 0x810000 && (addr - 0x810000) + len <= avr->e2end + 1) {
+		if (!len)
+			return 0;
+		avr_eeprom_desc_t ee = {
+				.offset = (addr - 0x810000), .size = len, .ee = (uint8_t*)src };
+		if (avr_ioctl(avr, AVR_IOCTL_EEPROM_SET, &ee) < 0)
+			return -1;
+	} else
+		return -1;
+	return 0;
+}
+
+/*
+ * Finds 'len' bytes at gdb address 'addr' in the memory the selected
+ * trace frame collected. Returns NULL if they weren't collected.
+ */
+static uint8_t *
+gdb_frame_memory(
+		avr_gdb_t * g,
+		uint32_t addr,
+		uint32_t len )
+{
+	avr_gdb_frame_t * f = &g->frames[g->frame];
+
+	addr &= 0xffffff;
+	for (uint32_t o = 0; o + 6 <= f->size; ) {
+		uint32_t base = f->data[o] | (f->data[o + 1] << 8) |
+				(f->data[o + 2] << 16) | ((uint32_t)f->data[o + 3] << 24);
+		uint32_t size = f->data[o + 4] | (f->data[o + 5] << 8);
+		if (base <= addr && addr + len <= base + size)
+			return f->data + o + 6 + (addr - base);
+		o += 6 + size;
+	}
+	return NULL;
+}
+
+static void
+gdb_trace_stop(
+		avr_gdb_t * g,
+		const char * why )
+{
+	g->trace_running = 0;
+	snprintf(g->trace_stop, sizeof(g->trace_stop), "%s", why);
+	gdb_map_update(g);
+}
+
+/*
+ * Adds 'len' bytes of memory at 'addr' to trace frame 'f'. If that goes
+ * over the trace buffer budget, stops the trace run and returns -1; memory
+ * that isn't there is just not collected.
+ */
+static int
+gdb_frame_collect(
+		avr_gdb_t * g,
+		avr_gdb_frame_t * f,
+		uint32_t addr,
+		uint32_t len )
+{
+	addr &= 0xffffff;
+	if (!len || len > 0xffff)
+		return 0;
+	uint8_t * data = NULL;
+	if (g->trace_used + 6 + len > g->trace_size ||
+			!(data = realloc(f->data, f->size + 6 + len))) {
+		gdb_trace_stop(g, "tfull:0");
+		return -1;
+	}
+	f->data = data;
+	data += f->size;
+	if (gdb_read_memory(g, addr, data + 6, len))
+		return 0;
+	for (int i = 0; i < 4; i++)
+		data[i] = addr >> (i * 8);
+	data[4] = len;
+	data[5] = len >> 8;
+	f->size += 6 + len;
+	g->trace_used += 6 + len;
+	return 0;
+}
+
+/*
+ * gdb agent expressions (see GDB User Manual, Appendix F), the bytecode gdb
+ * sends for the breakpoint conditions and the tracepoint collections. The
+ * values are 64 bits, as in gdb. The trace ops collect into 'frame', if
+ * there is one. Returns -1 if the expression can't be evaluated.
+ */
+#define AVR_GDB_AGENT_STACK	32
+#define AVR_GDB_AGENT_STEPS	10000	// so a bad 'goto' can't hang the core
+
+// reads a big endian immediate of 'size' bytes
+static int
+gdb_agent_imm(
+		const uint8_t * code,
+		uint32_t len,
+		uint32_t * pc,
+		int size,
+		uint64_t * v )
+{
+	if (*pc + size > len)
+		return -1;
+	*v = 0;
+	while (size--)
+		*v = (*v << 8) | code[(*pc)++];
+	return 0;
+}
+
+static int
+gdb_agent_eval(
+		avr_gdb_t * g,
+		const uint8_t * code,
+		uint32_t len,
+		avr_gdb_frame_t * frame,
+		uint64_t * result )
+{
+	int64_t stack[AVR_GDB_AGENT_STACK];
+	int sp = 0;
+	uint32_t pc = 0;
+	uint64_t imm;
+
+#define NEED(_n) if (sp < (_n)) return -1
+#define PUSH(_v) { if (sp == AVR_GDB_AGENT_STACK) return -1; stack[sp++] = (_v); }
+#define IMM(_n) if (gdb_agent_imm(code, len, &pc, (_n), &imm)) return -1
+#define A stack[sp - 2]
+#define B stack[sp - 1]
+
+	for (int steps = 0; pc < len && steps < AVR_GDB_AGENT_STEPS; steps++) {
+		uint8_t op = code[pc++];
+		switch (op) {
+			case 0x02: NEED(2); A += B; sp--; break;	// add
+			case 0x03: NEED(2); A -= B; sp--; break;	// sub
+			case 0x04: NEED(2); A *= B; sp--; break;	// mul
+			case 0x05: NEED(2); if (!B) return -1; A /= B; sp--; break;	// div_signed
+			case 0x06: NEED(2); if (!B) return -1;	// div_unsigned
+				A = (uint64_t)A / (uint64_t)B; sp--; break;
+			case 0x07: NEED(2); if (!B) return -1; A %= B; sp--; break;	// rem_signed
+			case 0x08: NEED(2); if (!B) return -1;	// rem_unsigned
+				A = (uint64_t)A % (uint64_t)B; sp--; break;
+			case 0x09: NEED(2); A = (uint64_t)A << (B & 63); sp--; break;	// lsh
+			case 0x0a: NEED(2); A >>= (B & 63); sp--; break;	// rsh_signed
+			case 0x0b: NEED(2); A = (uint64_t)A >> (B & 63); sp--; break;	// rsh_unsigned
+			case 0x0c:	// trace
+				NEED(2);
+				if (frame && gdb_frame_collect(g, frame, A, B))
+					return -1;
+				sp -= 2;
+				break;
+			case 0x0d: {	// trace_quick
+				IMM(1);
+				NEED(1);
+				if (frame && gdb_frame_collect(g, frame, B, imm))
+					return -1;
+			}	break;
+			case 0x0e: NEED(1); B = !B; break;		// log_not
+			case 0x0f: NEED(2); A &= B; sp--; break;	// bit_and
+			case 0x10: NEED(2); A |= B; sp--; break;	// bit_or
+			case 0x11: NEED(2); A ^= B; sp--; break;	// bit_xor
+			case 0x12: NEED(1); B = ~B; break;		// bit_not
+			case 0x13: NEED(2); A = A == B; sp--; break;	// equal
+			case 0x14: NEED(2); A = A < B; sp--; break;	// less_signed
+			case 0x15: NEED(2); A = (uint64_t)A < (uint64_t)B; sp--; break;	// less_unsigned
+			case 0x16: {	// ext
+				IMM(1);
+				int n = imm;
+				NEED(1);
+				if (n > 0 && n < 64)
+					B = (int64_t)((uint64_t)B << (64 - n)) >> (64 - n);
+			}	break;
+			case 0x2a: {	// zero_ext
+				IMM(1);
+				int n = imm;
+				NEED(1);
+				if (n > 0 && n < 64)
+					B &= (1ULL << n) - 1;
+			}	break;
+			case 0x17 ... 0x1a: {	// ref8, ref16, ref32, ref64
+				uint8_t buf[8];
+				int size = 1 << (op - 0x17);
+				NEED(1);
+				if (gdb_read_memory(g, B, buf, size))
+					return -1;
+				uint64_t v = 0;
+				for (int i = size - 1; i >= 0; i--)
+					v = (v << 8) | buf[i];
+				B = v;
+			}	break;
+			case 0x20:	// if_goto
+				IMM(2);
+				NEED(1);
+				if (stack[--sp])
+					pc = imm;
+				break;
+			case 0x21:	// goto
+				IMM(2);
+				pc = imm;
+				break;
+			case 0x22: IMM(1); PUSH(imm); break;	// const8
+			case 0x23: IMM(2); PUSH(imm); break;	// const16
+			case 0x24: IMM(4); PUSH(imm); break;	// const32
+			case 0x25: IMM(8); PUSH(imm); break;	// const64
+			case 0x26: {	// reg
+				IMM(2);
+				int64_t v = gdb_get_register(g, imm);
+				if (v < 0)
+					return -1;
+				PUSH(v);
+			}	break;
+			case 0x27:	// end
+				*result = sp ? B : 0;
+				return 0;
+			case 0x28: {	// dup
+				NEED(1);
+				int64_t v = B;
+				PUSH(v);
+			}	break;
+			case 0x29: NEED(1); sp--; break;		// pop
+			case 0x2b: {	// swap
+				NEED(2);
+				int64_t t = A; A = B; B = t;
+			}	break;
+			case 0x2f: {	// tracenz
+				NEED(2);
+				uint32_t n = 0;
+				uint8_t c;
+				while (n < B && !gdb_read_memory(g, A + n, &c, 1) && c)
+					n++;
+				if (frame && gdb_frame_collect(g, frame, A, n < B ? n + 1 : n))
+					return -1;
+				sp -= 2;
+			}	break;
+			case 0x30: {	// trace16
+				IMM(2);
+				NEED(1);
+				if (frame && gdb_frame_collect(g, frame, B, imm))
+					return -1;
+			}	break;
+			case 0x32: {	// pick
+				IMM(1);
+				NEED((int)imm + 1);
+				int64_t v = stack[sp - 1 - imm];
+				PUSH(v);
+			}	break;
+			case 0x33: {	// rot
+				NEED(3);
+				int64_t c = stack[sp - 3];
+				stack[sp - 3] = A;
+				A = B;
+				B = c;
+			}	break;
+			default:	// floats, trace state variables, printf
+				return -1;
+		}
+	}
+#undef NEED
+#undef PUSH
+#undef IMM
+#undef A
+#undef B
+	return -1;
+}
+
+/*
+ * Parses gdb's "<len>,<bytecode in hex>" at '*src', moves '*src' past it,
+ * and appends the expression to the 'cond' list. Returns -1 on error.
+ */
+static int
+gdb_agent_parse(
+		const char ** src,
+		uint8_t ** cond,
+		uint32_t * cond_size )
+{
+	char * end;
+	uint32_t len = strtoul(*src, &end, 16);
+
+	if (*end != ',' || !len || len > 0xffff || strlen(end + 1) < len * 2)
+		return -1;
+	uint8_t * c = realloc(*cond, *cond_size + 2 + len);
+	if (!c)
+		return -1;
+	*cond = c;
+	c += *cond_size;
+	c[0] = len;
+	c[1] = len >> 8;
+	if (read_hex_string(end + 1, c + 2, len) != len)
+		return -1;
+	*cond_size += 2 + len;
+	*src = end + 1 + len * 2;
+	return 0;
+}
+
+/*
+ * True if one of the conditions in 'cond' is, or can't be evaluated, or
+ * if there are none.
+ */
+static int
+gdb_agent_cond(
+		avr_gdb_t * g,
+		const uint8_t * cond,
+		uint32_t cond_size )
+{
+	if (!cond_size)
+		return 1;
+	for (uint32_t o = 0; o + 2 <= cond_size; ) {
+		uint32_t len = cond[o] | (cond[o + 1] << 8);
+		uint64_t v;
+		if (gdb_agent_eval(g, cond + o + 2, len, NULL, &v) || v)
+			return 1;
+		o += 2 + len;
+	}
+	return 0;
+}
+
+static void
+gdb_trace_free_frames(
+		avr_gdb_t * g )
+{
+	for (int i = 0; i < g->frame_count; i++)
+		free(g->frames[i].data);
+	free(g->frames);
+	g->frames = NULL;
+	g->frame_count = g->frame_size = 0;
+	g->trace_used = 0;
+	g->frame = -1;
+}
+
+static void
+gdb_trace_free(
+		avr_gdb_t * g )
+{
+	for (int i = 0; i < g->tracepoint_count; i++) {
+		avr_gdb_tracepoint_t * t = &g->tracepoint[i];
+		for (int a = 0; a < t->action_count; a++)
+			free(t->action[a].code);
+		free(t->action);
+		free(t->cond);
+	}
+	free(g->tracepoint);
+	g->tracepoint = NULL;
+	g->tracepoint_count = 0;
+	gdb_trace_free_frames(g);
+	gdb_trace_stop(g, "tnotrun:0");
+}
+
+/*
+ * Collects a new frame for tracepoint 't'. Returns -1, and stops the run,
+ * if the trace buffer is full.
+ */
+static int
+gdb_trace_collect(
+		avr_gdb_t * g,
+		avr_gdb_tracepoint_t * t )
+{
+	avr_t * avr = g->avr;
+
+	if (g->trace_used + sizeof(avr_gdb_frame_t) > g->trace_size)
+		goto full;
+	if (g->frame_count == g->frame_size) {
+		uint32_t size = g->frame_size ? g->frame_size * 2 : 64;
+		avr_gdb_frame_t * frames = realloc(g->frames, size * sizeof(*frames));
+		if (!frames)
+			goto full;
+		g->frames = frames;
+		g->frame_size = size;
+	}
+	avr_gdb_frame_t * f = &g->frames[g->frame_count++];
+	memset(f, 0, sizeof(*f));
+	g->trace_used += sizeof(*f);
+	f->tracepoint = t->number;
+	memcpy(f->regs, avr->data, 32);
+	READ_SREG_INTO(avr, f->sreg);
+	f->sp = avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+	f->pc = avr->pc;
+
+	for (int i = 0; i < t->action_count; i++) {
+		avr_gdb_trace_action_t * a = &t->action[i];
+		uint64_t v;
+		switch (a->type) {
+			case 'M': {
+				uint32_t addr = a->addr;
+				if (a->reg != -1)
+					addr += gdb_get_register(g, a->reg);
+				if (gdb_frame_collect(g, f, addr, a->len))
+					return -1;
+			}	break;
+			case 'X':
+				// a trace that overflowed is the only error that matters here
+				if (gdb_agent_eval(g, a->code, a->len, f, &v) && !g->trace_running)
+					return -1;
+				break;
+		}
+	}
+	return 0;
+full:
+	gdb_trace_stop(g, "tfull:0");
+	return -1;
+}
+
+/*
+ * Called when the core is about to run an instruction with a breakpoint or
+ * a tracepoint: collects the tracepoint frames, and stops the core if the
+ * breakpoint condition is true.
+ */
+static void
+gdb_break_hit(
+		avr_gdb_t * g )
+{
+	avr_t * avr = g->avr;
+
+	for (int i = 0; g->trace_running && i < g->tracepoint_count; i++) {
+		avr_gdb_tracepoint_t * t = &g->tracepoint[i];
+		if (!t->enabled || t->addr != avr->pc ||
+				!gdb_agent_cond(g, t->cond, t->cond_size))
+			continue;
+		t->hits++;
+		if (gdb_trace_collect(g, t))
+			break;
+		if (t->pass && t->hits >= t->pass) {
+			char why[32];
+			sprintf(why, "tpasscount:%x", t->number);
+			gdb_trace_stop(g, why);
+		}
+	}
+	int i = gdb_watch_find(&g->breakpoints, avr->pc);
+	if (i == -1 || !gdb_agent_cond(g, g->breakpoints.points[i].cond,
+			g->breakpoints.points[i].cond_size))
+		return;
+	DBG(printf("avr_gdb_processor hit breakpoint at %08x\n", avr->pc);)
+	gdb_send_quick_status(g, 0);
+	avr->state = cpu_Stopped;
+}
+
+static avr_gdb_tracepoint_t *
+gdb_trace_find(
+		avr_gdb_t * g,
+		uint32_t number,
+		uint32_t addr )
+{
+	for (int i = 0; i < g->tracepoint_count; i++)
+		if (g->tracepoint[i].number == number && g->tracepoint[i].addr == addr)
+			return &g->tracepoint[i];
+	return NULL;
+}
+
+/*
+ * QTDP:<n>:<addr>:<E|D>:<step>:<pass>[:F<len>][:X<len>,<cond>][-]
+ * defines a tracepoint, then each
+ * QTDP:-<n>:<addr>:[S]<action>...[-]
+ * adds actions to it: R<mask> registers, M<reg>,<offset>,<len> memory,
+ * X<len>,<bytecode> expression. Returns -1 if gdb asked for something
+ * that isn't supported; the tracepoints are then left as they were.
+ */
+static int
+gdb_trace_define(
+		avr_gdb_t * g,
+		const char * cmd )
+{
+	char * end;
+	int more = cmd[0] == '-';
+	uint32_t number = strtoul(cmd + more, &end, 16);
+	if (*end++ != ':')
+		return -1;
+	uint32_t addr = strtoul(end, &end, 16);
+	if (*end++ != ':' || addr > g->avr->flashend)
+		return -1;
+
+	if (!more) {
+		// parsed on the side, it's only added once it's all there
+		avr_gdb_tracepoint_t n = {
+			.number = number,
+			.addr = addr,
+			.enabled = *end++ == 'E',
+		};
+		if (*end++ != ':')
+			goto error;
+		// stepping frames are not supported, the step count is ignored
+		strtoul(end, &end, 16);
+		if (*end++ != ':')
+			goto error;
+		n.pass = strtoul(end, &end, 16);
+		while (*end == ':') {
+			end++;
+			if (*end == 'F')	// fast tracepoint, no difference here
+				strtoul(end + 1, &end, 16);
+			else if (*end == 'X') {
+				const char * src = end + 1;
+				if (gdb_agent_parse(&src, &n.cond, &n.cond_size))
+					goto error;
+				end = (char*)src;
+			} else
+				goto error;
+		}
+		avr_gdb_tracepoint_t * t = realloc(g->tracepoint,
+				(g->tracepoint_count + 1) * sizeof(*t));
+		if (!t)
+			goto error;
+		g->tracepoint = t;
+		g->tracepoint[g->tracepoint_count++] = n;
+		return 0;
+	error:
+		free(n.cond);
+		return -1;
+	}
+	avr_gdb_tracepoint_t * t = gdb_trace_find(g, number, addr);
+	if (!t)
+		return -1;
+	// the 'while-stepping' actions never run, don't keep them
+	if (*end == 'S')
+		return 0;
+	// the actions of this packet are dropped if one of them is bad
+	uint32_t count = t->action_count;
+	while (*end && *end != '-') {
+		avr_gdb_trace_action_t a = { .type = *end++ };
+		switch (a.type) {
+			case 'R':	// all the registers are always collected
+				strtoul(end, &end, 16);
+				continue;
+			case 'M':
+				a.reg = strtol(end, &end, 16);
+				if (*end++ != ',')
+					goto drop;
+				a.addr = strtoul(end, &end, 16);
+				if (*end++ != ',')
+					goto drop;
+				a.len = strtoul(end, &end, 16);
+				break;
+			case 'X': {
+				const char * src = end;
+				uint32_t size = 0;
+				if (gdb_agent_parse(&src, &a.code, &size))
+					goto drop;
+				// only one expression there, drop the length prefix
+				a.len = size - 2;
+				memmove(a.code, a.code + 2, a.len);
+				end = (char*)src;
+			}	break;
+			default:
+				goto drop;
+		}
+		avr_gdb_trace_action_t * action = realloc(t->action,
+				(t->action_count + 1) * sizeof(*action));
+		if (!action)
+			goto drop;
+		t->action = action;
+		t->action[t->action_count++] = a;
+		continue;
+	drop:
+		free(a.code);
+		while (t->action_count > count)
+			free(t->action[--t->action_count].code);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * QTFrame:<n>, QTFrame:pc:<addr>, QTFrame:tdp:<n>, QTFrame:range:<start>:<end>
+ * and QTFrame:outside:<start>:<end> select a trace frame, the last four
+ * search from the frame after the current one. Returns the frame, or -1.
+ */
+static int
+gdb_trace_select(
+		avr_gdb_t * g,
+		const char * cmd )
+{
+	char * end;
+	int mode = 0;
+	static const char * modes[] = { "pc:", "tdp:", "range:", "outside:" };
+
+	for (int i = 0; i < 4; i++)
+		if (!strncmp(cmd, modes[i], strlen(modes[i]))) {
+			mode = i + 1;
+			cmd += strlen(modes[i]);
+		}
+	if (!mode) {
+		long n = strtol(cmd, NULL, 16);
+		return n >= 0 && n < g->frame_count ? n : -1;
+	}
+	uint32_t start = strtoul(cmd, &end, 16), stop = start;
+	if (*end == ':')
+		stop = strtoul(end + 1, NULL, 16);
+	for (int i = g->frame + 1; i < g->frame_count; i++) {
+		avr_gdb_frame_t * f = &g->frames[i];
+		if ((mode == 1 && f->pc == start) ||
+				(mode == 2 && f->tracepoint == start) ||
+				(mode == 3 && f->pc >= start && f->pc <= stop) ||
+				(mode == 4 && (f->pc < start || f->pc > stop)))
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * The tracepoint packets, cmd is past the 'Q' or 'q'. Returns 0 if it's
+ * not one of them.
+ */
+static int
+gdb_trace_command(
+		avr_gdb_t * g,
+		char * cmd,
+		char * rep )
+{
+	if (!strcmp(cmd, "Tinit")) {
+		gdb_trace_free(g);
+		strcpy(rep, "OK");
+	} else if (!strncmp(cmd, "TDP:", 4)) {
+		strcpy(rep, gdb_trace_define(g, cmd + 4) ? "E01" : "OK");
+	} else if (!strncmp(cmd, "TDPsrc:", 7) || !strncmp(cmd, "TDV:", 4) ||
+			!strncmp(cmd, "Tro", 3) || !strncmp(cmd, "TDisconnected:", 14) ||
+			!strncmp(cmd, "TNotes:", 7)) {
+		strcpy(rep, "OK");
+	} else if (!strncmp(cmd, "TBuffer:size:", 13)) {
+		long size = strtol(cmd + 13, NULL, 16);
+		g->trace_size = size > 0 ? size : AVR_GDB_TRACE_SIZE;
+		strcpy(rep, "OK");
+	} else if (!strcmp(cmd, "TStart")) {
+		gdb_trace_free_frames(g);
+		for (int i = 0; i < g->tracepoint_count; i++)
+			g->tracepoint[i].hits = 0;
+		g->trace_running = 1;
+		strcpy(g->trace_stop, "tnotrun:0");
+		gdb_map_update(g);
+		strcpy(rep, "OK");
+	} else if (!strcmp(cmd, "TStop")) {
+		if (g->trace_running)
+			gdb_trace_stop(g, "tstop::0");
+		strcpy(rep, "OK");
+	} else if (!strncmp(cmd, "TEnable:", 8) || !strncmp(cmd, "TDisable:", 9)) {
+		char * end;
+		int enable = cmd[1] == 'E';
+		uint32_t number = strtoul(cmd + (enable ? 8 : 9), &end, 16);
+		avr_gdb_tracepoint_t * t = gdb_trace_find(g, number,
+				*end == ':' ? strtoul(end + 1, NULL, 16) : 0);
+		if (t) {
+			t->enabled = enable;
+			gdb_map_update(g);
+		}
+		strcpy(rep, t ? "OK" : "E01");
+	} else if (!strcmp(cmd, "TStatus")) {
+		sprintf(rep, "T%d;%s;tframes:%x;tcreated:%x;tfree:%x;tsize:%x;circular:0;disconn:0",
+				g->trace_running, g->trace_stop, g->frame_count, g->frame_count,
+				g->trace_size - g->trace_used, g->trace_size);
+	} else if (!strncmp(cmd, "TP:", 3)) {
+		char * end;
+		uint32_t number = strtoul(cmd + 3, &end, 16);
+		avr_gdb_tracepoint_t * t = gdb_trace_find(g, number,
+				*end == ':' ? strtoul(end + 1, NULL, 16) : 0);
+		if (t)
+			sprintf(rep, "V%x:0", t->hits);
+		else
+			strcpy(rep, "E01");
+	} else if (!strncmp(cmd, "TFrame:", 7)) {
+		g->frame = gdb_trace_select(g, cmd + 7);
+		if (g->frame == -1)
+			strcpy(rep, "F-1");
+		else
+			sprintf(rep, "F%xT%x", g->frame, g->frames[g->frame].tracepoint);
+	} else if (!strcmp(cmd, "TfP") || !strcmp(cmd, "TsP") ||
+			!strcmp(cmd, "TfV") || !strcmp(cmd, "TsV")) {
+		// nothing to upload back to gdb
+		strcpy(rep, "l");
+	} else
+		return 0;
+	return 1;
+}
+
+/*
+ * Z0 and Z1 can carry the breakpoint conditions, ";X<len>,<bytecode>" after
+ * the kind. These replace the ones the breakpoint had; if one can't be
+ * parsed the breakpoint stops every time, as it would with gdb evaluating.
+ */
+static void
+gdb_break_cond(
+		avr_gdb_t * g,
+		uint32_t addr,
+		const char * cmd )
+{
+	int i = gdb_watch_find(&g->breakpoints, addr);
+	if (i == -1)
+		return;
+	struct avr_gdb_watchpoint_t * b = &g->breakpoints.points[i];
+	free(b->cond);
+	b->cond = NULL;
+	b->cond_size = 0;
+
+	const char * src = strchr(cmd, ';');
+	while (src && src[1] == 'X') {
+		src += 2;
+		if (gdb_agent_parse(&src, &b->cond, &b->cond_size)) {
+			free(b->cond);
+			b->cond = NULL;
+			b->cond_size = 0;
+			return;
+		}
+		if (*src != ';')
+			break;
+	}
+}
+
+static void
+gdb_input_mute(
+		avr_gdb_t * g,
+		int mute )
+{
+	for (int i = 0; i < g->input_irq_count; i++)
+		if (mute)
+			g->input_irq[i]->flags |= IRQ_FLAG_MUTED;
+		else
+			g->input_irq[i]->flags &= ~IRQ_FLAG_MUTED;
+}
+
+static avr_cycle_count_t
+gdb_replay_timer(
+		avr_t * avr,
+		avr_cycle_count_t when,
+		void * param );
+
+/*
+ * Raises the logged inputs that are due, up to the first one that was
+ * raised at the other 'looping' phase: between two instructions, or
+ * during one (then from gdb_replay_timer(), with the other timers).
+ */
+static void
+gdb_replay_inputs(
+		avr_gdb_t * g,
+		int looping )
+{
+	avr_t * avr = g->avr;
+
+	while (g->replay_next < g->input_count) {
+		avr_gdb_input_t * in = &g->input[g->replay_next];
+		if (in->looping != looping || in->cycle > avr->cycle)
+			break;
+		g->replay_next++;
+		in->irq->flags &= ~IRQ_FLAG_MUTED;
+		avr_raise_irq(in->irq, (in->irq->flags & IRQ_FLAG_NOT) ? !in->value : in->value);
+		in->irq->flags |= IRQ_FLAG_MUTED;
+	}
+}
+
+static void
+gdb_replay_arm(
+		avr_gdb_t * g )
+{
+	avr_t * avr = g->avr;
+
+	if (g->replay_next >= g->input_count || g->replay_armed == g->replay_next ||
+			!g->input[g->replay_next].looping)
+		return;
+	avr_gdb_input_t * in = &g->input[g->replay_next];
+	avr_cycle_timer_register(avr, in->cycle > avr->cycle ? in->cycle - avr->cycle : 0,
+			gdb_replay_timer, g);
+	g->replay_armed = g->replay_next;
+}
+
+static avr_cycle_count_t
+gdb_replay_timer(
+		avr_t * avr,
+		avr_cycle_count_t when,
+		void * param )
+{
+	avr_gdb_t * g = (avr_gdb_t *)param;
+
+	gdb_replay_inputs(g, 1);
+	g->replay_armed = ~0;
+	if (g->replay_next >= g->input_count || !g->input[g->replay_next].looping)
+		return 0;
+	g->replay_armed = g->replay_next;
+	return g->input[g->replay_next].cycle;
+}
+
+// back to the live run, with its inputs
+static void
+gdb_replay_stop(
+		avr_gdb_t * g )
+{
+	if (!g->replaying)
+		return;
+	g->replaying = 0;
+	gdb_input_mute(g, 0);
+	avr_cycle_timer_cancel(g->avr, gdb_replay_timer, g);
+	g->replay_armed = ~0;
+}
+
+/*
+ * Forgets it all, gdb changed the core state in a way a replay wouldn't
+ * redo (memory, registers), or left.
+ */
+static void
+gdb_history_reset(
+		avr_gdb_t * g )
+{
+	gdb_replay_stop(g);
+	for (int i = 0; i < g->checkpoint_count; i++)
+		avr_checkpoint_free(g->checkpoint[i].c);
+	g->checkpoint_count = 0;
+	g->input_count = 0;
+	g->history_used = 0;
+	g->next_checkpoint = 0;
+}
+
+static void
+gdb_history_free(
+		avr_gdb_t * g )
+{
+	gdb_history_reset(g);
+	free(g->checkpoint);
+	g->checkpoint = NULL;
+	g->checkpoint_size = 0;
+	free(g->input);
+	g->input = NULL;
+	g->input_size = 0;
+}
+
+// drop the oldest checkpoints, and their inputs, to fit in avr->gdb_history
+static void
+gdb_history_trim(
+		avr_gdb_t * g )
+{
+	avr_t * avr = g->avr;
+	uint32_t size = avr->gdb_history ? avr->gdb_history : AVR_GDB_HISTORY_SIZE;
+
+	while (g->history_used > size && g->checkpoint_count > 1) {
+		g->history_used -= g->checkpoint[0].c->size;
+		avr_checkpoint_free(g->checkpoint[0].c);
+		g->checkpoint_count--;
+		memmove(g->checkpoint, g->checkpoint + 1,
+				g->checkpoint_count * sizeof(g->checkpoint[0]));
+		uint32_t n = g->checkpoint[0].input;
+		g->input_count -= n;
+		g->history_used -= n * sizeof(g->input[0]);
+		memmove(g->input, g->input + n, g->input_count * sizeof(g->input[0]));
+		for (int i = 0; i < g->checkpoint_count; i++)
+			g->checkpoint[i].input -= n;
+		g->replay_next = g->replay_next > n ? g->replay_next - n : 0;
+	}
+}
+
+static void
+gdb_history_save(
+		avr_gdb_t * g )
+{
+	avr_t * avr = g->avr;
+
+	g->next_checkpoint = avr->cycle +
+			(avr->gdb_checkpoint ? avr->gdb_checkpoint : AVR_GDB_CHECKPOINT_CYCLES);
+	if (g->checkpoint_count == g->checkpoint_size) {
+		uint32_t size = g->checkpoint_size ? g->checkpoint_size * 2 : 64;
+		avr_gdb_checkpoint_t * c = realloc(g->checkpoint, size * sizeof(*c));
+		if (!c)
+			return;
+		g->checkpoint = c;
+		g->checkpoint_size = size;
+	}
+	avr_checkpoint_t * c = avr_checkpoint_save(avr);
+	if (!c) {
+		AVR_LOG(avr, LOG_WARNING, "GDB: out of memory for a checkpoint\n");
+		return;
+	}
+	// single stepping gets there too, replays just run
+	if (avr->state == cpu_Step)
+		((avr_t *)c->core)->state = cpu_Running;
+	g->checkpoint[g->checkpoint_count].c = c;
+	g->checkpoint[g->checkpoint_count].input = g->input_count;
+	g->checkpoint_count++;
+	g->history_used += c->size;
+	gdb_history_trim(g);
+}
+
+static void
+gdb_input_notify(
+		struct avr_irq_t * irq,
+		uint32_t value,
+		void * param )
+{
+	avr_gdb_t * g = (avr_gdb_t *)param;
+
+	// the replayed ones are in the log already
+	if (g->replaying || g->s == -1 || !g->checkpoint_count)
+		return;
+	if (g->input_count == g->input_size) {
+		uint32_t size = g->input_size ? g->input_size * 2 : 256;
+		avr_gdb_input_t * in = realloc(g->input, size * sizeof(*in));
+		if (!in) {
+			// can't replay past that
+			gdb_history_reset(g);
+			return;
+		}
+		g->input = in;
+		g->input_size = size;
+	}
+	avr_gdb_input_t * in = &g->input[g->input_count++];
+	in->cycle = g->avr->cycle;
+	in->irq = irq;
+	in->value = value;
+	in->looping = g->looping;
+	g->history_used += sizeof(*in);
+	gdb_history_trim(g);
+}
+
+/*
+ * Called before each instruction: replays the inputs, or saves a
+ * checkpoint when one is due.
+ */
+static void
+gdb_history_step(
+		avr_gdb_t * g )
+{
+	avr_t * avr = g->avr;
+
+	if (g->replaying) {
+		gdb_replay_inputs(g, 0);
+		if (avr->cycle >= g->head)
+			gdb_replay_stop(g);
+		else
+			gdb_replay_arm(g);
+		return;
+	}
+	if (g->s != -1 && avr->cycle >= g->next_checkpoint &&
+			(avr->state == cpu_Running || avr->state == cpu_Sleeping ||
+				avr->state == cpu_Step))
+		gdb_history_save(g);
+}
+
+static int
+gdb_history_restore(
+		avr_gdb_t * g,
+		int index )
+{
+	// out of memory, the core is left as it was
+	if (avr_checkpoint_restore(g->avr, g->checkpoint[index].c))
+		return -1;
+	g->replay_next = g->checkpoint[index].input;
+	// the timers are the checkpoint's now
+	g->replay_armed = ~0;
+	g->poll_cycle = 0;
+	return 0;
+}
+
+static void
+gdb_replay_sleep(
+		avr_t * avr,
+		avr_cycle_count_t howLong )
+{
+}
+
+/*
+ * Runs the core up to cycle 'until', like the gdb run loop does, but
+ * without looking at the socket, nor stopping on breakpoints: with 'scan',
+ * the last instruction that hit one is in replay_hit. Like in the gdb run
+ * loop, idle loops aren't skipped, so replay_last is one instruction.
+ */
+static void
+gdb_replay(
+		avr_gdb_t * g,
+		avr_cycle_count_t until,
+		int scan )
+{
+	avr_t * avr = g->avr;
+	void (*sleep)(struct avr_t * avr, avr_cycle_count_t howLong) = avr->sleep;
+
+	avr->sleep = gdb_replay_sleep;
+	g->replay = 1;
+	while (avr->cycle < until &&
+			(avr->state == cpu_Running || avr->state == cpu_Sleeping)) {
+		gdb_replay_inputs(g, 0);
+		gdb_replay_arm(g);
+		g->replay_last = avr->cycle;
+		if (scan && avr->state == cpu_Running) {
+			int i = gdb_watch_find(&g->breakpoints, avr->pc);
+			if (i != -1 && gdb_agent_cond(g, g->breakpoints.points[i].cond,
+					g->breakpoints.points[i].cond_size)) {
+				g->replay_hit = avr->cycle;
+				g->replay_hit_kind = AVR_GDB_BREAK_SOFT;
+			}
+		}
+		g->looping = 1;
+		avr_callback_run_noskip(avr);
+		g->looping = 0;
+	}
+	g->replay = 0;
+	avr->sleep = sleep;
+}
+
+/*
+ * 'bs' goes back to the instruction before this one, 'bc' to the last
+ * breakpoint or watchpoint hit before it. Checkpoints are looked at from
+ * the last one before 'now' back, replaying each to find where to stop.
+ */
+static void
+gdb_reverse(
+		avr_gdb_t * g,
+		int cont )
+{
+	avr_t * avr = g->avr;
+	avr_cycle_count_t now = avr->cycle;
+
+	if (!g->replaying) {
+		g->replaying = 1;
+		g->head = now;
+		gdb_input_mute(g, 1);
+	}
+	int i = g->checkpoint_count - 1;
+	while (i >= 0 && g->checkpoint[i].c->cycle >= now)
+		i--;
+	for (avr_cycle_count_t end = now; i >= 0; end = g->checkpoint[i--].c->cycle) {
+		if (gdb_history_restore(g, i))
+			goto error;
+		g->replay_hit_kind = 0;
+		gdb_replay(g, end, cont);
+		if (cont && !g->replay_hit_kind)
+			continue;
+		avr_cycle_count_t target = cont ? g->replay_hit : g->replay_last;
+		int kind = cont ? g->replay_hit_kind : 0;
+		uint32_t addr = g->replay_hit_addr;
+		if (gdb_history_restore(g, i))
+			goto error;
+		gdb_replay(g, target, 0);
+		avr->state = cpu_Stopped;
+		if (kind & AVR_GDB_WATCH_ACCESS)
+			gdb_send_watch_status(g, kind, addr);
+		else
+			gdb_send_quick_status(g, 0);
+		return;
+	}
+	// nothing before, stay at the start of the history
+	if (g->checkpoint_count && avr->cycle != g->checkpoint[0].c->cycle &&
+			gdb_history_restore(g, 0))
+		goto error;
+	avr->state = cpu_Stopped;
+	gdb_send_stop_reason(g, 0, "replaylog:begin;");
+	return;
+error:
+	avr->state = cpu_Stopped;
+	gdb_send_reply(g, "E01");
+}
+
 static void
 gdb_handle_command(
 		avr_gdb_t * g,
-		char * cmd )
+		char * cmd,
+		uint32_t length )
 {
 	avr_t * avr = g->avr;
-	char rep[1024];
+	char * rep = g->rep;
 	uint8_t command = *cmd++;
+	length--;
 	switch (command) {
 		case 'q':
 			if (strncmp(cmd, "Supported", 9) == 0) {
 				/* If GDB asked what features we support, report back
-				 * the features we support, which is just memory layout
-				 * information for now.
+				 * the features we support: memory layout information,
+				 * large and binary packets, tracepoints, and reverse
+				 * execution.
 				 */
-				gdb_send_reply(g, "qXfer:memory-map:read+");
+				sprintf(rep, "PacketSize=%x;qXfer:memory-map:read+;binary-upload+;"
+						"ConditionalBreakpoints+;"
+						"ConditionalTracepoints+;EnableDisableTracepoints+;"
+						"TracepointSource+;QTBuffer:size+;"
+						"ReverseStep+;ReverseContinue+", AVR_GDB_PACKET_SIZE);
+				gdb_send_reply(g, rep);
 				break;
 			} else if (strncmp(cmd, "Attached", 8) == 0) {
 				/* Respond that we are attached to an existing process..
@@ -308,21 +1653,44 @@ gdb_handle_command(
 			// } else if (strncmp(cmd, "Offsets", 7) == 0) {
 			//	gdb_send_reply(g, "Text=0;Data=800000;Bss=800000");
 			//	break;
-			} else if (strncmp(cmd, "Xfer:memory-map:read", 20) == 0) {
-				snprintf(rep, sizeof(rep),
-						"l<memory-map>\n"
+			} else if (strncmp(cmd, "Xfer:memory-map:read::", 22) == 0) {
+				uint32_t offset = 0, len = 0;
+				sscanf(cmd + 22, "%x,%x", &offset, &len);
+				char map[512];
+				int size = snprintf(map, sizeof(map),
+						"<memory-map>\n"
 						" <memory type='ram' start='0x800000' length='%#x'/>\n"
 						" <memory type='flash' start='0' length='%#x'>\n"
 						"  <property name='blocksize'>0x80</property>\n"
-						" </memory>\n"
-						"</memory-map>",
+						" </memory>\n",
 						g->avr->ramend + 1, g->avr->flashend + 1);
-
+				// so 'load' also takes the .eeprom section
+				if (g->avr->e2end)
+					size += snprintf(map + size, sizeof(map) - size,
+						" <memory type='ram' start='0x810000' length='%#x'/>\n",
+						g->avr->e2end + 1);
+				size += snprintf(map + size, sizeof(map) - size, "</memory-map>");
+				// gdb reads it in chunks, 'm' says there is more
+				if (offset > size)
+					offset = size;
+				if (len > AVR_GDB_PACKET_SIZE / 2)
+					len = AVR_GDB_PACKET_SIZE / 2;
+				if (len > size - offset)
+					len = size - offset;
+				gdb_send_packet(g, offset + len < size ? "m" : "l",
+						(uint8_t*)map + offset, len, 1);
+				break;
+            } else if (gdb_trace_command(g, cmd, rep)) {
 				gdb_send_reply(g, rep);
 				break;
-            }
+			}
 			gdb_send_reply(g, "");
 			break;
+		case 'Q':
+			if (!gdb_trace_command(g, cmd, rep))
+				rep[0] = 0;
+			gdb_send_reply(g, rep);
+			break;
 		case '?':
 			gdb_send_quick_status(g, 0);
 			break;
@@ -332,6 +1700,7 @@ gdb_handle_command(
 			uint8_t *src = (uint8_t*)rep;
 			for (int i = 0; i < 35; i++)
 				src += gdb_write_register(g, i, src);
+			gdb_history_reset(g);
 			gdb_send_reply(g, "OK");
 		}	break;
 		case 'g': {	// read all general purpose registers
@@ -355,74 +1724,112 @@ gdb_handle_command(
 			sscanf(cmd, "%x", &regi);
 			read_hex_string(val, (uint8_t*)rep, strlen(val));
 			gdb_write_register(g, regi, (uint8_t*)rep);
+			gdb_history_reset(g);
 			gdb_send_reply(g, "OK");
 		}	break;
-		case 'm': {	// read memory
-			avr_flashaddr_t addr;
-			uint32_t len;
+		case 'm':	// read memory
+		case 'x': {	// same, in binary
+			uint32_t addr = 0, len = 0;
 			sscanf(cmd, "%x,%x", &addr, &len);
-			uint8_t * src = NULL;
+			uint8_t data[AVR_GDB_PACKET_SIZE / 2];
 			/* GDB seems to also use 0x1800000 for sram ?!?! */
 			addr &= 0xffffff;
-			if (addr < avr->flashend) {
-				src = avr->flash + addr;
-			} else if (addr >= 0x800000 && (addr - 0x800000) <= avr->ramend) {
-				src = avr->data + addr - 0x800000;
+			// gdb asks for the rest, if the reply is short
+			if (len > sizeof(data))
+				len = sizeof(data);
+			if (g->frame >= 0) {
+				// looking at a trace frame, only what it collected is there
+				uint8_t * src = gdb_frame_memory(g, addr, len);
+				if (!src) {
+					gdb_send_reply(g, "E01");
+					break;
+				}
+				memcpy(data, src, len);
 			} else if (addr == (0x800000 + avr->ramend + 1) && len == 2) {
 				// Allow GDB to read a value just after end of stack.
 				// This is necessary to make instruction stepping work when stack is empty
 				AVR_LOG(avr, LOG_TRACE,
 						"GDB: read just past end of stack %08x, %08x; returning zero\n", addr, len);
-				gdb_send_reply(g, "0000");
-				break;
-			} else if (addr >= 0x810000 && (addr - 0x810000) <= avr->e2end) {
-				avr_eeprom_desc_t ee = {.offset = (addr - 0x810000)};
-				avr_ioctl(avr, AVR_IOCTL_EEPROM_GET, &ee);
-				if (ee.ee)
-					src = ee.ee;
-				else {
-					gdb_send_reply(g, "E01");
-					break;
-				}
-			} else {
+				memset(data, 0, len);
+			} else if (gdb_read_memory(g, addr, data, len)) {
 				AVR_LOG(avr, LOG_ERROR,
 						"GDB: read memory error %08x, %08x (ramend %04x)\n",
 						addr, len, avr->ramend+1);
 				gdb_send_reply(g, "E01");
 				break;
 			}
-			char * dst = rep;
-			while (len--) {
-				sprintf(dst, "%02x", *src++);
-				dst += 2;
+			if (command == 'x') {
+				gdb_send_packet(g, "b", data, len, 1);
+				break;
 			}
+			char * dst = rep;
+			for (uint32_t i = 0; i < len; i++, dst += 2)
+				sprintf(dst, "%02x", data[i]);
 			*dst = 0;
 			gdb_send_reply(g, rep);
 		}	break;
-		case 'M': {	// write memory
-			uint32_t addr, len;
+		case 'M':	// write memory
+		case 'X': {	// same, in binary
+			uint32_t addr = 0, len = 0;
 			sscanf(cmd, "%x,%x", &addr, &len);
-			char * start = strchr(cmd, ':');
-			if (!start) {
+			uint8_t * start = memchr(cmd, ':', length);
+			if (!start || len > AVR_GDB_PACKET_SIZE) {
 				gdb_send_reply(g, "E01");
 				break;
 			}
-			if (addr < 0xffff) {
-				read_hex_string(start + 1, avr->flash + addr, strlen(start+1));
-				gdb_send_reply(g, "OK");
-			} else if (addr >= 0x800000 && (addr - 0x800000) <= avr->ramend) {
-				read_hex_string(start + 1, avr->data + addr - 0x800000, strlen(start+1));
-				gdb_send_reply(g, "OK");
-			} else if (addr >= 0x810000 && (addr - 0x810000) <= avr->e2end) {
-				read_hex_string(start + 1, (uint8_t*)rep, strlen(start+1));
-				avr_eeprom_desc_t ee = {.offset = (addr - 0x810000), .size = len, .ee = (uint8_t*)rep };
-				avr_ioctl(avr, AVR_IOCTL_EEPROM_SET, &ee);
-				gdb_send_reply(g, "OK");
-			} else {
+			start++;
+			uint32_t size = length - (start - (uint8_t*)cmd);
+			if (command == 'X')
+				size = gdb_unescape(start, size);
+			else	// decoded in place, it's half the size
+				size = read_hex_string((char*)start, start, len);
+			if (size != len || gdb_write_memory(g, addr, start, len)) {
 				AVR_LOG(avr, LOG_ERROR, "GDB: write memory error %08x, %08x\n", addr, len);
 				gdb_send_reply(g, "E01");
+				break;
 			}
+			if (len)
+				gdb_history_reset(g);
+			gdb_send_reply(g, "OK");
 		}	break;
+		case 'v':
+			/*
+			 * With the flash in the memory map, 'load' erases and
+			 * writes it with these, a whole packet at a time.
+			 */
+			if (strncmp(cmd, "FlashErase:", 11) == 0) {
+				uint32_t addr = 0, len = 0;
+				sscanf(cmd + 11, "%x,%x", &addr, &len);
+				if (addr > avr->flashend || len > avr->flashend + 1 - addr) {
+					gdb_send_reply(g, "E01");
+					break;
+				}
+				memset(avr->flash + addr, 0xff, len);
+				avr_decode_invalidate(avr, addr, len);
+				gdb_history_reset(g);
+				gdb_send_reply(g, "OK");
+			} else if (strncmp(cmd, "FlashWrite:", 11) == 0) {
+				uint32_t addr = 0;
+				sscanf(cmd + 11, "%x", &addr);
+				uint8_t * start = memchr(cmd + 11, ':', length - 11);
+				if (!start) {
+					gdb_send_reply(g, "E01");
+					break;
+				}
+				start++;
+				uint32_t size = gdb_unescape(start, length - (start - (uint8_t*)cmd));
+				if (addr > avr->flashend || size > avr->flashend + 1 - addr ||
+						gdb_write_memory(g, addr, start, size)) {
+					gdb_send_reply(g, "E01");
+					break;
+				}
+				gdb_history_reset(g);
+				gdb_send_reply(g, "OK");
+			} else if (strncmp(cmd, "FlashDone", 9) == 0) {
+				gdb_send_reply(g, "OK");
+			} else
+				gdb_send_reply(g, "");
+			break;
 		case 'c': {	// continue
 			avr->state = cpu_Running;
 		}	break;
@@ -431,8 +1838,15 @@ gdb_handle_command(
 		}	break;
 		case 'r': {	// deprecated, suggested for AVRStudio compatibility
 			avr->state = cpu_StepDone;
+			gdb_history_reset(g);
 			avr_reset(avr);
 		}	break;
+		case 'b':	// reverse step, or continue
+			if (*cmd == 's' || *cmd == 'c')
+				gdb_reverse(g, *cmd == 'c');
+			else
+				gdb_send_reply(g, "");
+			break;
 		case 'Z': 	// set clear break/watchpoint
 		case 'z': {
 			uint32_t kind, addr, len;
@@ -447,6 +1861,9 @@ gdb_handle_command(
 						gdb_send_reply(g, "E01");
 						break;
 					}
+					if (set)
+						gdb_break_cond(g, addr, cmd);
+					gdb_map_update(g);
 
 					gdb_send_reply(g, "OK");
 					break;
@@ -456,10 +1873,14 @@ gdb_handle_command(
 					/* Mask out the offset applied to SRAM addresses. */
 					addr &= ~0x800000;
 					if (addr > avr->ramend ||
-							gdb_change_breakpoint(&g->watchpoints, set, 1 << kind, addr, len) == -1) {
+							gdb_change_breakpoint(&g->watchpoints, set,
+								kind == 4 ? AVR_GDB_WATCH_ACCESS : 1 << kind,
+								addr, len) == -1) {
 						gdb_send_reply(g, "E01");
 						break;
 					}
+					gdb_map_update(g);
+					avr_data_class_update(avr, addr, len);
 
 					gdb_send_reply(g, "OK");
 					break;
@@ -511,17 +1932,19 @@ gdb_network_handler(
 	}
 
 	if (g->s != -1 && FD_ISSET(g->s, &read_set)) {
-		uint8_t buffer[1024];
-
-		ssize_t r = recv(g->s, buffer, sizeof(buffer)-1, 0);
+		ssize_t r = recv(g->s, g->rx + g->rx_len, sizeof(g->rx) - g->rx_len, 0);
 
 		if (r == 0) {
 			printf("%s connection closed\n", __FUNCTION__);
 			close(g->s);
 			gdb_watch_clear(&g->breakpoints);
 			gdb_watch_clear(&g->watchpoints);
+			gdb_trace_free(g);
+			gdb_history_reset(g);
+			avr_data_class_update(g->avr, 0, AVR_DATA_CLASS_SIZE);
 			g->avr->state = cpu_Running;	// resume
 			g->s = -1;
+			g->rx_len = 0;
 			return 1;
 		}
 		if (r == -1) {
@@ -529,36 +1952,69 @@ gdb_network_handler(
 			sleep(1);
 			return 1;
 		}
-		buffer[r] = 0;
-	//	printf("%s: received %d bytes\n'%s'\n", __FUNCTION__, r, buffer);
-	//	hdump("gdb", buffer, r);
-
-		uint8_t * src = buffer;
-		while (*src == '+' || *src == '-')
-			src++;
-		// control C -- lets send the guy a nice status packet
-		if (*src == 3) {
-			src++;
-			g->avr->state = cpu_StepDone;
-			printf("GDB hit control-c\n");
-		}
-		if (*src  == '$') {
-			// strip checksum
-			uint8_t * end = buffer + r - 1;
-			while (end > src && *end != '#')
-				*end-- = 0;
-			*end = 0;
-			src++;
-			DBG(printf("GDB command = '%s'\n", src);)
+		g->rx_len += r;
+	//	printf("%s: received %d bytes\n", __FUNCTION__, r);
+	//	hdump("gdb", g->rx, g->rx_len);
+
+		uint8_t * src = g->rx;
+		uint8_t * end = g->rx + g->rx_len;
+		while (src < end) {
+			// control C -- lets send the guy a nice status packet
+			if (*src == 3) {
+				src++;
+				g->avr->state = cpu_StepDone;
+				printf("GDB hit control-c\n");
+				continue;
+			}
+			// acks, and whatever else is between packets
+			if (*src != '$') {
+				src++;
+				continue;
+			}
+			uint8_t * hash = memchr(src, '#', end - src);
+			if (!hash || end - hash < 3)
+				break;	// wait for the rest of it
+			uint8_t check = 0;
+			for (uint8_t * c = src + 1; c < hash; c++)
+				check += *c;
+			char sum[3] = { hash[1], hash[2], 0 };
+			if (strtoul(sum, NULL, 16) != check) {
+				AVR_LOG(g->avr, LOG_WARNING, "GDB: bad packet checksum\n");
+				send(g->s, "-", 1, 0);	// gdb sends it again
+				src = hash + 3;
+				continue;
+			}
+			*hash = 0;
+			DBG(printf("GDB command = '%s'\n", src + 1);)
 
 			send(g->s, "+", 1, 0);
 
-			gdb_handle_command(g, (char*)src);
+			gdb_handle_command(g, (char*)src + 1, hash - src - 1);
+			src = hash + 3;
+		}
+		g->rx_len = end - src;
+		memmove(g->rx, src, g->rx_len);
+		if (g->rx_len == sizeof(g->rx)) {
+			AVR_LOG(g->avr, LOG_ERROR, "GDB: packet too large, dropped\n");
+			send(g->s, "-", 1, 0);
+			g->rx_len = 0;
 		}
 	}
 	return 1;
 }
 
+int
+avr_gdb_watched(
+		avr_t * avr,
+		uint16_t addr )
+{
+	avr_gdb_t * g = avr->gdb;
+
+	if (addr > avr->ramend)
+		return 0;
+	return gdb_map_get(g->read_map, addr) || gdb_map_get(g->write_map, addr);
+}
+
 /**
  * If an applicable watchpoint exists for addr, stop the cpu and send a status report.
  * type is one of AVR_GDB_WATCH_READ, AVR_GDB_WATCH_WRITE depending on the type of access.
@@ -571,29 +2027,57 @@ avr_gdb_handle_watchpoints(
 {
 	avr_gdb_t *g = avr->gdb;
 
-	int i = gdb_watch_find_range(&g->watchpoints, addr);
-	if (i == -1) {
+	if (addr > avr->ramend ||
+			!gdb_map_get(type == AVR_GDB_WATCH_READ ? g->read_map : g->write_map, addr))
+		return;
+	/* Find which one it is, ranges can overlap */
+	int kind = 0;
+	for (int i = 0; i < g->watchpoints.len; i++) {
+		struct avr_gdb_watchpoint_t * w = &g->watchpoints.points[i];
+		if (w->addr <= addr && addr < w->addr + w->size && (w->kind & type)) {
+			kind = w->kind;
+			break;
+		}
+	}
+	if (g->replay) {
+		// going back, remember the last instruction that hit one
+		g->replay_hit = g->replay_last;
+		g->replay_hit_addr = addr;
+		g->replay_hit_kind = kind;
 		return;
 	}
+	/* Send gdb reply (see GDB user manual appendix E.3). */
+	gdb_send_watch_status(g, kind, addr);
 
-	int kind = g->watchpoints.points[i].kind;
-	if (kind & type) {
-		/* Send gdb reply (see GDB user manual appendix E.3). */
-		char cmd[78];
-                uint8_t sreg;
+	avr->state = cpu_Stopped;
+}
 
-                READ_SREG_INTO(g->avr, sreg);
-		sprintf(cmd, "T%02x20:%02x;21:%02x%02x;22:%02x%02x%02x00;%s:%06x;",
-				5, sreg,
-				g->avr->data[R_SPL], g->avr->data[R_SPH],
-				g->avr->pc & 0xff, (g->avr->pc>>8)&0xff, (g->avr->pc>>16)&0xff,
-				kind & AVR_GDB_WATCH_ACCESS ? "awatch" :
-					kind & AVR_GDB_WATCH_WRITE ? "watch" : "rwatch",
-				addr | 0x800000);
-		gdb_send_reply(g, cmd);
+static int
+gdb_process(
+		avr_gdb_t * g,
+		int sleep )
+{
+	avr_t * avr = g->avr;
 
+	if (avr->state == cpu_Running && gdb_map_get(g->break_map, avr->pc >> 1)) {
+		gdb_break_hit(g);
+	} else if (avr->state == cpu_StepDone) {
+		gdb_send_quick_status(g, 0);
 		avr->state = cpu_Stopped;
 	}
+	/*
+	 * While the core runs, a select() per instruction is what made gdb
+	 * sessions crawl; nothing comes from gdb then but a control-C, so
+	 * the socket is only looked at every avr->gdb_poll cycles.
+	 */
+	if (!sleep && (avr->state == cpu_Running || avr->state == cpu_Sleeping)) {
+		if (avr->cycle < g->poll_cycle)
+			return 0;
+		g->poll_cycle = avr->cycle +
+				(avr->gdb_poll ? avr->gdb_poll : AVR_GDB_POLL_CYCLES);
+	}
+	// this also sleeps for a bit
+	return gdb_network_handler(g, sleep);
 }
 
 int
@@ -605,19 +2089,44 @@ avr_gdb_processor(
 		return 0;
 	avr_gdb_t * g = avr->gdb;
 
-	if (avr->state == cpu_Running &&
-			gdb_watch_find(&g->breakpoints, avr->pc) != -1) {
-		DBG(printf("avr_gdb_processor hit breakpoint at %08x\n", avr->pc);)
-		gdb_send_quick_status(g, 0);
-		avr->state = cpu_Stopped;
-	} else if (avr->state == cpu_StepDone) {
-		gdb_send_quick_status(g, 0);
-		avr->state = cpu_Stopped;
-	}
-	// this also sleeps for a bit
-	return gdb_network_handler(g, sleep);
+	// the calls made while an instruction sleeps aren't between two
+	if (g->looping)
+		return gdb_process(g, sleep);
+	if (g->replaying || avr->cycle >= g->next_checkpoint)
+		gdb_history_step(g);
+	int res = gdb_process(g, sleep);
+	g->looping = avr->state != cpu_Stopped;
+	return res;
 }
 
+void
+avr_gdb_processor_done(
+		avr_t * avr )
+{
+	if (avr->gdb)
+		avr->gdb->looping = 0;
+}
+
+void
+avr_gdb_add_input(
+		avr_t * avr,
+		avr_irq_t * irq )
+{
+	avr_gdb_t * g = avr->gdb;
+
+	if (!g || !irq)
+		return;
+	avr_irq_t ** in = realloc(g->input_irq, (g->input_irq_count + 1) * sizeof(*in));
+	if (!in)
+		return;
+	g->input_irq = in;
+	g->input_irq[g->input_irq_count++] = irq;
+	avr_irq_register_notify(irq, gdb_input_notify, g);
+	if (g->replaying)
+		irq->flags |= IRQ_FLAG_MUTED;
+}
+
+
 
 int
 avr_gdb_init(
@@ -695,7 +2204,17 @@ avr_gdb_init(
 	printf("avr_gdb_init is listening on port %d!\n", avr->gdb_port);
 	g->avr = avr;
 	g->s = -1;
+	g->break_map = calloc(((avr->flashend + 1) >> 6) + 1, sizeof(avr_gdb_map_t));
+	g->read_map = calloc(((avr->ramend + 1) >> 5) + 1, sizeof(avr_gdb_map_t));
+	g->write_map = calloc(((avr->ramend + 1) >> 5) + 1, sizeof(avr_gdb_map_t));
+	g->trace_size = AVR_GDB_TRACE_SIZE;
+	g->frame = -1;
+	strcpy(g->trace_stop, "tnotrun:0");
+	g->replay_armed = ~0;
 	avr->gdb = g;
+	for (char name = '0'; name <= '9'; name++)
+		avr_gdb_add_input(avr,
+				avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ(name), UART_IRQ_INPUT));
 	// change default run behaviour to use the slightly slower versions
 	avr->run = avr_callback_run_gdb;
 	avr->sleep = avr_callback_sleep_gdb;
@@ -724,8 +2243,20 @@ avr_deinit_gdb(
 	if (avr->gdb->s != -1)
 		close(avr->gdb->s);
 	avr->gdb->s = -1;
+	gdb_watch_free(&avr->gdb->breakpoints);
+	gdb_watch_free(&avr->gdb->watchpoints);
+	gdb_trace_free(avr->gdb);
+	gdb_history_free(avr->gdb);
+	for (int i = 0; i < avr->gdb->input_irq_count; i++)
+		avr_irq_unregister_notify(avr->gdb->input_irq[i], gdb_input_notify, avr->gdb);
+	free(avr->gdb->input_irq);
+	free(avr->gdb->break_map);
+	free(avr->gdb->read_map);
+	free(avr->gdb->write_map);
 	free(avr->gdb);
 	avr->gdb = NULL;
+	// drop the watchpoints from the data access classes
+	avr_data_class_update(avr, 0, AVR_DATA_CLASS_SIZE);
 
 	network_release();
 }
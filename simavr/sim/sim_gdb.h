@@ -37,15 +37,40 @@ enum avr_gdb_watch_type {
 	AVR_GDB_WATCH_ACCESS = AVR_GDB_WATCH_WRITE | AVR_GDB_WATCH_READ,
 };
 
+/*
+ * Default avr->gdb_poll. Breakpoints are still checked before each
+ * instruction, this is only how late a control-C or a new connection
+ * is seen, in cycles.
+ */
+#define AVR_GDB_POLL_CYCLES	10000
+
+/*
+ * Reverse execution defaults, see avr->gdb_checkpoint and avr->gdb_history.
+ * Going back one instruction replays at most that many cycles, twice.
+ */
+#define AVR_GDB_CHECKPOINT_CYCLES	1000000
+#define AVR_GDB_HISTORY_SIZE		(32 * 1024 * 1024)
+
 int avr_gdb_init(avr_t * avr);
 
 void avr_deinit_gdb(avr_t * avr);
 
 // call from the main AVR decoder thread
 int avr_gdb_processor(avr_t * avr, int sleep);
+// and once the instruction it let run is done, interrupts included
+void avr_gdb_processor_done(avr_t * avr);
+
+/*
+ * 'irq' is raised from outside of the core (a board, a VCD input...): its
+ * values are logged, and raised again when gdb replays that part of the
+ * run. The UART inputs are already there.
+ */
+void avr_gdb_add_input(avr_t * avr, avr_irq_t * irq);
 
 // Called from sim_core.c
 void avr_gdb_handle_watchpoints(avr_t * g, uint16_t addr, enum avr_gdb_watch_type type);
+// Returns non-zero if there is a watchpoint on addr
+int avr_gdb_watched(avr_t * avr, uint16_t addr);
 
 #ifdef __cplusplus
 };
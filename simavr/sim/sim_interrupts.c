@@ -28,7 +28,32 @@
 #include "sim_avr.h"
 #include "sim_core.h"
 
-DEFINE_FIFO(avr_int_vector_p, avr_int_pending);
+static inline void
+_avr_int_pending_set(
+		avr_int_table_p table,
+		uint8_t v)
+{
+	table->pending[v >> 6] |= 1ULL << (v & 63);
+}
+
+static inline void
+_avr_int_pending_clear(
+		avr_int_table_p table,
+		uint8_t v)
+{
+	table->pending[v >> 6] &= ~(1ULL << (v & 63));
+}
+
+// returns the highest priority (lowest) pending vector number, zero for none
+static inline int
+_avr_int_pending_first(
+		avr_int_table_p table)
+{
+	for (int i = 0; i < AVR_INT_MAP_WORDS; i++)
+		if (table->pending[i])
+			return (i * 64) + __builtin_ctzll(table->pending[i]);
+	return 0;
+}
 
 void
 avr_interrupt_init(
@@ -50,7 +75,7 @@ avr_interrupt_reset(
 	avr_int_table_p table = &avr->interrupts;
 
 	table->running_ptr = 0;
-	avr_int_pending_reset(&table->pending);
+	memset(table->pending, 0, sizeof(table->pending));
 	avr->interrupt_state = 0;
 	for (int i = 0; i < table->vector_count; i++)
 		table->vector[i]->pending = 0;
@@ -63,6 +88,11 @@ avr_register_vector(
 {
 	if (!vector->vector)
 		return;
+	if (vector->vector >= AVR_INT_VECTOR_MAX) {
+		AVR_LOG(avr, LOG_ERROR, "IRQ%d past the last vector (%d)!\n",
+			vector->vector, AVR_INT_VECTOR_MAX - 1);
+		return;
+	}
 
 	avr_int_table_p table = &avr->interrupts;
 
@@ -88,7 +118,10 @@ avr_has_pending_interrupts(
 		avr_t * avr)
 {
 	avr_int_table_p table = &avr->interrupts;
-	return !avr_int_pending_isempty(&table->pending);
+	for (int i = 0; i < AVR_INT_MAP_WORDS; i++)
+		if (table->pending[i])
+			return 1;
+	return 0;
 }
 
 int
@@ -112,12 +145,12 @@ avr_raise_interrupt(
 		avr_t * avr,
 		avr_int_vector_t * vector)
 {
-	if (!vector || !vector->vector)
+	if (!vector || !vector->vector || vector->vector >= AVR_INT_VECTOR_MAX)
 		return 0;
 	if (vector->pending) {
 		if (vector->trace)
 			printf("IRQ%d:I=%d already raised (enabled %d) (cycle %lld pc 0x%x)\n",
-				vector->vector, !!avr->sreg[S_I], avr_regbit_get(avr, vector->enable),
+				vector->vector, !!avr_sreg_get(avr, S_I), avr_regbit_get(avr, vector->enable),
 				(long long int)avr->cycle, avr->pc);
 		return 0;
 	}
@@ -129,20 +162,20 @@ avr_raise_interrupt(
 	// driven UART and so so. These flags are often "write one to clear"
 	if (vector->raised.reg)
 		avr_regbit_set(avr, vector->raised);
+	avr_idle_reset(avr);
 
-	avr_raise_irq(vector->irq + AVR_INT_IRQ_PENDING, 1);
-	avr_raise_irq(avr->interrupts.irq + AVR_INT_IRQ_PENDING, 1);
+	avr_raise_irq_status(vector->irq + AVR_INT_IRQ_PENDING, 1);
+	avr_raise_irq_status(avr->interrupts.irq + AVR_INT_IRQ_PENDING, 1);
 
 	// If the interrupt is enabled, attempt to wake the core
 	if (avr_regbit_get(avr, vector->enable)) {
 		// Mark the interrupt as pending
 		vector->pending = 1;
 
-		avr_int_table_p table = &avr->interrupts;
+		_avr_int_pending_set(&avr->interrupts, vector->vector);
+		avr->interrupts.by_number[vector->vector] = vector;
 
-		avr_int_pending_write(&table->pending, vector);
-
-		if (avr->sreg[S_I] && avr->interrupt_state == 0)
+		if (avr_sreg_get(avr, S_I) && avr->interrupt_state == 0)
 			avr->interrupt_state = 1;
 		if (avr->state == cpu_Sleeping) {
 			if (vector->trace)
@@ -165,13 +198,13 @@ avr_clear_interrupt(
 	if (vector->trace)
 		printf("IRQ%d cleared\n", vector->vector);
 	vector->pending = 0;
+	if (vector->vector < AVR_INT_VECTOR_MAX)
+		_avr_int_pending_clear(&avr->interrupts, vector->vector);
 
-	avr_raise_irq(vector->irq + AVR_INT_IRQ_PENDING, 0);
-	avr_raise_irq_float(avr->interrupts.irq + AVR_INT_IRQ_PENDING,
-			avr_has_pending_interrupts(avr) ?
-					avr_int_pending_read_at(
-							&avr->interrupts.pending, 0)->vector : 0,
-							!avr_has_pending_interrupts(avr));
+	int next = _avr_int_pending_first(&avr->interrupts);
+	avr_raise_irq_status(vector->irq + AVR_INT_IRQ_PENDING, 0);
+	avr_raise_irq_status_float(avr->interrupts.irq + AVR_INT_IRQ_PENDING,
+			next, !next);
 
 	if (vector->raised.reg && !vector->raise_sticky)
 		avr_regbit_clear(avr, vector->raised);
@@ -183,7 +216,7 @@ avr_clear_interrupt_if(
 		avr_int_vector_t * vector,
 		uint8_t old)
 {
-	avr_raise_irq(avr->interrupts.irq + AVR_INT_IRQ_PENDING,
+	avr_raise_irq_status(avr->interrupts.irq + AVR_INT_IRQ_PENDING,
 			avr_has_pending_interrupts(avr));
 	if (avr_regbit_get(avr, vector->raised)) {
 		avr_clear_interrupt(avr, vector);
@@ -215,12 +248,12 @@ avr_interrupt_reti(
 	avr_int_table_p table = &avr->interrupts;
 	if (table->running_ptr) {
 		avr_int_vector_t * vector = table->running[--table->running_ptr];
-		avr_raise_irq(vector->irq + AVR_INT_IRQ_RUNNING, 0);
+		avr_raise_irq_status(vector->irq + AVR_INT_IRQ_RUNNING, 0);
 	}
-	avr_raise_irq(table->irq + AVR_INT_IRQ_RUNNING,
+	avr_raise_irq_status(table->irq + AVR_INT_IRQ_RUNNING,
 			table->running_ptr > 0 ?
 					table->running[table->running_ptr-1]->vector : 0);
-	avr_raise_irq(avr->interrupts.irq + AVR_INT_IRQ_PENDING,
+	avr_raise_irq_status(avr->interrupts.irq + AVR_INT_IRQ_PENDING,
 			avr_has_pending_interrupts(avr));
 }
 
@@ -232,7 +265,7 @@ void
 avr_service_interrupts(
 		avr_t * avr)
 {
-	if (!avr->sreg[S_I] || !avr->interrupt_state)
+	if (!avr_sreg_get(avr, S_I) || !avr->interrupt_state)
 		return;
 
 	if (avr->interrupt_state < 0) {
@@ -244,25 +277,16 @@ avr_service_interrupts(
 
 	avr_int_table_p table = &avr->interrupts;
 
-	// how many are pending...
-	int cnt = avr_int_pending_get_read_size(&table->pending);
-	// locate the highest priority one
-	int min = 0xff;
-	int mini = 0;
-	for (int ii = 0; ii < cnt; ii++) {
-		avr_int_vector_t * v = avr_int_pending_read_at(&table->pending, ii);
-		if (v->vector < min) {
-			min = v->vector;
-			mini = ii;
-		}
+	// the highest priority one is the lowest vector number
+	int v = _avr_int_pending_first(table);
+	if (!v) {
+		avr->interrupt_state = 0;
+		return;
 	}
-	avr_int_vector_t * vector = avr_int_pending_read_at(&table->pending, mini);
+	avr_int_vector_t * vector = table->by_number[v];
 
-	// now move the one at the front of the fifo in the slot of
-	// the one we service
-	table->pending.buffer[(table->pending.read + mini) % avr_int_pending_fifo_size] =
-			avr_int_pending_read(&table->pending);
-	avr_raise_irq(avr->interrupts.irq + AVR_INT_IRQ_PENDING,
+	_avr_int_pending_clear(table, v);
+	avr_raise_irq_status(avr->interrupts.irq + AVR_INT_IRQ_PENDING,
 			avr_has_pending_interrupts(avr));
 
 	// if that single interrupt is masked, ignore it and continue
@@ -271,14 +295,15 @@ avr_service_interrupts(
 		vector->pending = 0;
 		avr->interrupt_state = avr_has_pending_interrupts(avr);
 	} else {
-		if (vector && vector->trace)
+		if (vector->trace)
 			printf("IRQ%d calling\n", vector->vector);
 		_avr_push_addr(avr, avr->pc);
+		avr_idle_reset(avr);
 		avr_sreg_set(avr, S_I, 0);
 		avr->pc = vector->vector * avr->vector_size;
 
-		avr_raise_irq(vector->irq + AVR_INT_IRQ_RUNNING, 1);
-		avr_raise_irq(table->irq + AVR_INT_IRQ_RUNNING, vector->vector);
+		avr_raise_irq_status(vector->irq + AVR_INT_IRQ_RUNNING, 1);
+		avr_raise_irq_status(table->irq + AVR_INT_IRQ_RUNNING, vector->vector);
 		if (table->running_ptr == ARRAY_SIZE(table->running)) {
 			AVR_LOG(avr, LOG_ERROR, "%s run out of nested stack!", __func__);
 		} else {
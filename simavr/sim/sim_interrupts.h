@@ -44,20 +44,24 @@ typedef struct avr_int_vector_t {
 
 	// 'pending' IRQ, and 'running' status as signaled here
 	avr_irq_t		irq[AVR_INT_IRQ_COUNT];
-	uint8_t			pending : 1,	// 1 while scheduled in the fifo
+	uint8_t			pending : 1,	// 1 while set in the pending bitmap
 					trace : 1,		// only for debug of a vector
 					raise_sticky : 1;	// 1 if the interrupt flag (= the raised regbit) is not cleared
 										// by the hardware when executing the interrupt routine (see TWINT)
 } avr_int_vector_t, *avr_int_vector_p;
 
-// Size needs to be >= max number of vectors, and a power of two
-DECLARE_FIFO(avr_int_vector_p, avr_int_pending, 64);
+// vector numbers go up to AVR_INT_VECTOR_MAX - 1
+#define AVR_INT_VECTOR_MAX	128
+#define AVR_INT_MAP_WORDS	(AVR_INT_VECTOR_MAX / 64)
 
 // interrupt vectors, and their enable/clear registers
 typedef struct  avr_int_table_t {
 	avr_int_vector_t * vector[64];
 	uint8_t			vector_count;
-	avr_int_pending_t pending;
+	// bit 'n' is set while vector number 'n' is pending, the lowest
+	// one is the highest priority
+	uint64_t		pending[AVR_INT_MAP_WORDS];
+	avr_int_vector_t * by_number[AVR_INT_VECTOR_MAX];	// the one that raised it
 	uint8_t			running_ptr;
 	avr_int_vector_t *running[64]; // stack of nested interrupts
 	// global status for pending + running in interrupt context
@@ -119,7 +123,7 @@ void
 avr_interrupt_init(
 		struct avr_t * avr );
 
-// reset the interrupt table and the fifo
+// reset the interrupt table and the pending bitmap
 void
 avr_interrupt_reset(
 		struct avr_t * avr );
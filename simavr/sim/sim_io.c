@@ -26,6 +26,7 @@
 #include <ctype.h>
 #include <stdint.h>
 #include "sim_io.h"
+#include "sim_core.h"
 
 int
 avr_ioctl(
@@ -75,6 +76,7 @@ avr_register_io_read(
 	}
 	avr->io[a].r.param = param;
 	avr->io[a].r.c = readp;
+	avr_data_class_update(avr, addr, 1);
 }
 
 static void
@@ -147,6 +149,7 @@ avr_register_io_write(
 
 	avr->io[a].w.param = param;
 	avr->io[a].w.c = writep;
+	avr_data_class_update(avr, addr, 1);
 }
 
 avr_irq_t *
@@ -171,7 +174,7 @@ avr_iomem_getirq(
 		const char * name,
 		int index)
 {
-	if (index > 8)
+	if (index > AVR_IOMEM_IRQ_READ)
 		return NULL;
 	avr_io_addr_t a = AVR_DATA_TO_IO(addr);
 	if (avr->io[a].irq == NULL) {
@@ -179,21 +182,24 @@ avr_iomem_getirq(
 		 * Prepare an array of names for the io IRQs. Ideally we'd love to have
 		 * a proper name for these, but it's not possible at this time.
 		 */
-		char names[9 * 20];
+		char names[10 * 20];
 		char * d = names;
-		const char * namep[9];
-		for (int ni = 0; ni < 9; ni++) {
+		const char * namep[10];
+		for (int ni = 0; ni < 10; ni++) {
 			if (ni < 8)
 				sprintf(d, "=avr.io.%04x.%d", addr, ni);
-			else
+			else if (ni == AVR_IOMEM_IRQ_ALL)
 				sprintf(d, "8=avr.io.%04x.all", addr);
+			else
+				sprintf(d, "8=avr.io.%04x.read", addr);
 			namep[ni] = d;
 			d += strlen(d) + 1;
 		}
-		avr->io[a].irq = avr_alloc_irq(&avr->irq_pool, 0, 9, namep);
+		avr->io[a].irq = avr_alloc_irq(&avr->irq_pool, 0, 10, namep);
 		// mark the pin ones as filtered, so they only are raised when changing
 		for (int i = 0; i < 8; i++)
 			avr->io[a].irq[i].flags |= IRQ_FLAG_FILTERED;
+		avr_data_class_update(avr, addr, 1);
 	}
 	// if given a name, replace the default one...
 	if (name) {
@@ -206,6 +212,33 @@ avr_iomem_getirq(
 	return avr->io[a].irq + index;
 }
 
+void
+avr_iomem_raise_irq(
+		avr_t * avr,
+		avr_io_addr_t io,
+		uint8_t v,
+		int read)
+{
+	avr_irq_t * irq = avr->io[io].irq;
+
+	if (read)
+		avr_raise_irq_status(irq + AVR_IOMEM_IRQ_READ, v);
+	/*
+	 * The "all" IRQ holds the value the bit IRQs were last raised with,
+	 * they all need raising the first time around
+	 */
+	uint8_t changed = (irq[AVR_IOMEM_IRQ_ALL].flags & IRQ_FLAG_INIT) ?
+			0xff : v ^ irq[AVR_IOMEM_IRQ_ALL].value;
+	if (read && !changed)
+		return;
+	avr_raise_irq(irq + AVR_IOMEM_IRQ_ALL, v);
+	while (changed) {
+		int i = __builtin_ctz(changed);
+		avr_raise_irq(irq + i, (v >> i) & 1);
+		changed &= changed - 1;
+	}
+}
+
 avr_irq_t *
 avr_io_setirqs(
 		avr_io_t * io,
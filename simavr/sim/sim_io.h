@@ -112,7 +112,11 @@ avr_io_getirq(
 // when the AVR code attempt to read and write at that address
 //
 // the "index" is a bit number, or ALL bits if index == 8
+// The bit IRQs are only raised for the bits that changed, and reads only
+// raise anything if the value changed behind the AVR's back. Use
+// AVR_IOMEM_IRQ_READ to be told about every read, with the value read.
 #define AVR_IOMEM_IRQ_ALL 8
+#define AVR_IOMEM_IRQ_READ 9
 avr_irq_t *
 avr_iomem_getirq(
 		avr_t * avr,
@@ -120,6 +124,14 @@ avr_iomem_getirq(
 		const char * name /* Optional, if NULL, "ioXXXX" will be used */ ,
 		int index);
 
+// raise the IRQs of an IO register that was just read or written with 'v'
+void
+avr_iomem_raise_irq(
+		avr_t * avr,
+		avr_io_addr_t io,
+		uint8_t v,
+		int read);
+
 // Terminates all IOs and remove from them from the io chain
 void
 avr_deallocate_ios(
@@ -22,18 +22,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include "sim_irq.h"
 
-// internal structure for a hook, never seen by the notify procs
-typedef struct avr_irq_hook_t {
-	struct avr_irq_hook_t * next;
-	int busy;	// prevent reentrance of callbacks
-
-	struct avr_irq_t * chain;	// raise the IRQ on this too - optional if "notify" is on
-	avr_irq_notify_t notify;	// called when IRQ is raised - optional if "chain" is on
-	void * param;				// "notify" parameter
-} avr_irq_hook_t;
-
 static void
 _avr_irq_pool_add(
 		avr_irq_pool_t * pool,
@@ -52,6 +43,8 @@ _avr_irq_pool_add(
 	}
 	pool->irq[insert] = irq;
 	irq->pool = pool;
+	if (pool->stats && !irq->stats)
+		irq->stats = calloc(1, sizeof(avr_irq_stats_t));
 }
 
 static void
@@ -103,17 +96,85 @@ avr_alloc_irq(
 	return irq;
 }
 
+/*
+ * Hooks are kept in the order they were registered in, and called the
+ * other way around, most recent first. 'hook' points to 'hook_inline' until
+ * there are more hooks than fit in there; a callback registering a new hook
+ * can then move them to a bigger block, so the raise code reloads 'hook'
+ * after each callback.
+ */
 static avr_irq_hook_t *
 _avr_alloc_irq_hook(
 		avr_irq_t * irq)
 {
-	avr_irq_hook_t *hook = malloc(sizeof(avr_irq_hook_t));
+	if (!irq->hook)
+		irq->hook = irq->hook_inline;
+	int size = irq->hook_size ? irq->hook_size : AVR_IRQ_HOOK_INLINE;
+	if (irq->hook_count == size) {
+		avr_irq_hook_t * hook = malloc(size * 2 * sizeof(avr_irq_hook_t));
+		memcpy(hook, irq->hook, size * sizeof(avr_irq_hook_t));
+		if (irq->hook_size)
+			free(irq->hook);
+		irq->hook = hook;
+		irq->hook_size = size * 2;
+	}
+	avr_irq_hook_t * hook = irq->hook + irq->hook_count++;
 	memset(hook, 0, sizeof(avr_irq_hook_t));
-	hook->next = irq->hook;
-	irq->hook = hook;
 	return hook;
 }
 
+/*
+ * Removes the hooks that were unregistered, keeping the others in order.
+ * Goes back to the inline hooks when they fit in there again.
+ */
+static void
+_avr_irq_hook_compact(
+		avr_irq_t * irq)
+{
+	avr_irq_hook_t * hooks = irq->hook;
+	int count = 0;
+	for (int i = 0; i < irq->hook_count; i++)
+		if (hooks[i].notify || hooks[i].chain)
+			hooks[count++] = hooks[i];
+	irq->hook_count = count;
+	irq->hook_dead = 0;
+	if (irq->hook_size && count <= AVR_IRQ_HOOK_INLINE) {
+		memcpy(irq->hook_inline, irq->hook, count * sizeof(avr_irq_hook_t));
+		free(irq->hook);
+		irq->hook = irq->hook_inline;
+		irq->hook_size = 0;
+	}
+}
+
+/*
+ * A hook is busy while its callback runs, and the callbacks can unregister
+ * hooks. In that case the hook is only cleared, so the raise loop doesn't see
+ * the other hooks move; the raise removes it once no hook is busy anymore.
+ */
+static int
+_avr_irq_hook_busy(
+		avr_irq_t * irq)
+{
+	avr_irq_hook_t * hooks = irq->hook;
+	for (int i = 0; i < irq->hook_count; i++)
+		if (hooks[i].busy)
+			return 1;
+	return 0;
+}
+
+static void
+_avr_irq_hook_remove(
+		avr_irq_t * irq,
+		avr_irq_hook_t * hook)
+{
+	hook->notify = NULL;
+	hook->chain = NULL;
+	hook->param = NULL;
+	irq->hook_dead = 1;
+	if (!_avr_irq_hook_busy(irq))
+		_avr_irq_hook_compact(irq);
+}
+
 void
 avr_free_irq(
 		avr_irq_t * irq,
@@ -128,14 +189,14 @@ avr_free_irq(
 		if (iq->name)
 			free((char*)iq->name);
 		iq->name = NULL;
+		if (iq->stats)
+			free(iq->stats);
+		iq->stats = NULL;
 		// purge hooks
-		avr_irq_hook_t *hook = iq->hook;
-		while (hook) {
-			avr_irq_hook_t * next = hook->next;
-			free(hook);
-			hook = next;
-		}
+		if (iq->hook_size)
+			free(iq->hook);
 		iq->hook = NULL;
+		iq->hook_count = iq->hook_size = 0;
 	}
 	// if that irq list was allocated by us, free it
 	if (irq->flags & IRQ_FLAG_ALLOC)
@@ -152,11 +213,9 @@ avr_irq_register_notify(
 		return;
 
 	avr_irq_hook_t *hook = irq->hook;
-	while (hook) {
-		if (hook->notify == notify && hook->param == param)
+	for (int i = 0; i < irq->hook_count; i++)
+		if (hook[i].notify == notify && hook[i].param == param)
 			return;	// already there
-		hook = hook->next;
-	}
 	hook = _avr_alloc_irq_hook(irq);
 	hook->notify = notify;
 	hook->param = param;
@@ -168,24 +227,23 @@ avr_irq_unregister_notify(
 		avr_irq_notify_t notify,
 		void * param)
 {
-	avr_irq_hook_t *hook, *prev;
 	if (!irq || !notify)
 		return;
 
-	hook = irq->hook;
-	prev = NULL;
-	while (hook) {
-		if (hook->notify == notify && hook->param == param) {
-			if ( prev )
-				prev->next = hook->next;
-			else
-				irq->hook = hook->next;
-			free(hook);
+	avr_irq_hook_t *hook = irq->hook;
+	for (int i = 0; i < irq->hook_count; i++)
+		if (hook[i].notify == notify && hook[i].param == param) {
+			_avr_irq_hook_remove(irq, hook + i);
 			return;
 		}
-		prev = hook;
-		hook = hook->next;
-	}
+}
+
+static uint64_t
+_avr_irq_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
 }
 
 void
@@ -194,30 +252,50 @@ avr_raise_irq_float(
 		uint32_t value,
 		int floating)
 {
-	if (!irq)
+	if (!irq || (irq->flags & IRQ_FLAG_MUTED))
 		return ;
+#if CONFIG_SIMAVR_TRACE
+	if (irq->pool)
+		irq->pool->raise_count++;
+#endif
 	uint32_t output = (irq->flags & IRQ_FLAG_NOT) ? !value : value;
+	if (irq->stats)
+		irq->stats->raise++;
 	// if value is the same but it's the first time, raise it anyway
 	if (irq->value == output &&
-			(irq->flags & IRQ_FLAG_FILTERED) && !(irq->flags & IRQ_FLAG_INIT))
+			(irq->flags & IRQ_FLAG_FILTERED) && !(irq->flags & IRQ_FLAG_INIT)) {
+		if (irq->stats)
+			irq->stats->filtered++;
 		return;
+	}
 	irq->flags &= ~(IRQ_FLAG_INIT | IRQ_FLAG_FLOATING);
 	if (floating)
 		irq->flags |= IRQ_FLAG_FLOATING;
-	avr_irq_hook_t *hook = irq->hook;
-	while (hook) {
-		avr_irq_hook_t * next = hook->next;
-			// prevents reentrance / endless calling loops
-		if (hook->busy == 0) {
-			hook->busy++;
-			if (hook->notify)
-				hook->notify(irq, output,  hook->param);
-			if (hook->chain)
-				avr_raise_irq_float(hook->chain, output, floating);
-			hook->busy--;
-		}
-		hook = next;
+	avr_irq_hook_t * hooks = irq->hook;
+	// hooks added by the callbacks go past 'i', and are not called
+	for (int i = irq->hook_count - 1; i >= 0; i--) {
+		avr_irq_hook_t * hook = hooks + i;
+		// prevents reentrance / endless calling loops
+		if (hook->busy)
+			continue;
+		avr_irq_notify_t notify = hook->notify;
+		avr_irq_t * chain = hook->chain;
+		hook->busy++;
+		if (notify && irq->stats) {
+			uint64_t start = _avr_irq_now_ns();
+			notify(irq, output, hook->param);
+			if (irq->stats)	// the hook might have turned them off
+				irq->stats->hook_ns += _avr_irq_now_ns() - start;
+		} else if (notify)
+			notify(irq, output, hook->param);
+		if (chain)
+			avr_raise_irq_float(chain, output, floating);
+		// a callback might have moved the hooks to a bigger block
+		hooks = irq->hook;
+		hooks[i].busy--;
 	}
+	if (irq->hook_dead && !_avr_irq_hook_busy(irq))
+		_avr_irq_hook_compact(irq);
 	// the value is set after the callbacks are called, so the callbacks
 	// can themselves compare for old/new values between their parameter
 	// they are passed (new value) and the previous irq->value
@@ -242,11 +320,9 @@ avr_connect_irq(
 		return;
 	}
 	avr_irq_hook_t *hook = src->hook;
-	while (hook) {
-		if (hook->chain == dst)
+	for (int i = 0; i < src->hook_count; i++)
+		if (hook[i].chain == dst)
 			return;	// already there
-		hook = hook->next;
-	}
 	hook = _avr_alloc_irq_hook(src);
 	hook->chain = dst;
 }
@@ -256,26 +332,16 @@ avr_unconnect_irq(
 		avr_irq_t * src,
 		avr_irq_t * dst)
 {
-	avr_irq_hook_t *hook, *prev;
-
 	if (!src || !dst || src == dst) {
 		fprintf(stderr, "error: %s invalid irq %p/%p", __FUNCTION__, src, dst);
 		return;
 	}
-	hook = src->hook;
-	prev = NULL;
-	while (hook) {
-		if (hook->chain == dst) {
-			if ( prev )
-				prev->next = hook->next;
-			else
-				src->hook = hook->next;
-			free(hook);
+	avr_irq_hook_t *hook = src->hook;
+	for (int i = 0; i < src->hook_count; i++)
+		if (hook[i].chain == dst) {
+			_avr_irq_hook_remove(src, hook + i);
 			return;
 		}
-		prev = hook;
-		hook = hook->next;
-	}
 }
 
 uint8_t
@@ -292,3 +358,125 @@ avr_irq_set_flags(
 {
 	irq->flags = flags;
 }
+
+void
+avr_irq_pool_stats(
+		avr_irq_pool_t * pool,
+		int enable)
+{
+	pool->stats = enable;
+	for (int i = 0; i < pool->count; i++) {
+		avr_irq_t * irq = pool->irq[i];
+		if (!irq)
+			continue;
+		if (enable && !irq->stats)
+			irq->stats = calloc(1, sizeof(avr_irq_stats_t));
+		else if (!enable && irq->stats) {
+			free(irq->stats);
+			irq->stats = NULL;
+		}
+	}
+}
+
+// index of 'irq' in the pool, -1 if it's not in there
+static int
+_avr_irq_pool_index(
+		avr_irq_pool_t * pool,
+		avr_irq_t * irq)
+{
+	for (int i = 0; i < pool->count; i++)
+		if (pool->irq[i] == irq)
+			return i;
+	return -1;
+}
+
+// a DOT string, the IRQ names have no quotes, but who knows
+static void
+_avr_irq_dot_name(
+		FILE * o,
+		avr_irq_t * irq)
+{
+	for (const char * c = irq->name ? irq->name : "?"; *c; c++)
+		fprintf(o, *c == '"' || *c == '\\' ? "\\%c" : "%c", *c);
+}
+
+int
+avr_irq_pool_dump_dot(
+		avr_irq_pool_t * pool,
+		const char * filename)
+{
+	FILE * o = fopen(filename, "w");
+	if (!o) {
+		perror(filename);
+		return -1;
+	}
+	fprintf(o, "digraph irqs {\n\trankdir=LR;\n\tnode [shape=box];\n");
+	/*
+	 * The nodes are named after the pool index of the IRQs, the chained
+	 * IRQs that aren't in the pool get the next ones. The notify hooks
+	 * have no name, they are the hooks of their IRQ.
+	 */
+	int extra = pool->count;
+	for (int i = 0; i < pool->count; i++) {
+		avr_irq_t * irq = pool->irq[i];
+		if (!irq)
+			continue;
+		fprintf(o, "\tirq%d [label=\"", i);
+		_avr_irq_dot_name(o, irq);
+		fprintf(o, "\\n%u", irq->irq);
+		if (irq->stats)
+			fprintf(o, "\\n%llu raises", (unsigned long long)irq->stats->raise);
+		fprintf(o, "\"];\n");
+		for (int h = 0; h < irq->hook_count; h++) {
+			avr_irq_hook_t * hook = irq->hook + h;
+			if (hook->chain) {
+				int c = _avr_irq_pool_index(pool, hook->chain);
+				if (c == -1) {
+					c = extra++;
+					fprintf(o, "\tirq%d [style=dashed,label=\"", c);
+					_avr_irq_dot_name(o, hook->chain);
+					fprintf(o, "\\n%u\"];\n", hook->chain->irq);
+				}
+				fprintf(o, "\tirq%d -> irq%d;\n", i, c);
+			}
+			if (hook->notify) {
+				fprintf(o, "\thook%d_%d [shape=ellipse,label=\"notify %d\"];\n",
+						i, h, h);
+				fprintf(o, "\tirq%d -> hook%d_%d;\n", i, i, h);
+			}
+		}
+	}
+	fprintf(o, "}\n");
+	fclose(o);
+	return 0;
+}
+
+int
+avr_irq_pool_dump_csv(
+		avr_irq_pool_t * pool,
+		const char * filename)
+{
+	FILE * o = fopen(filename, "w");
+	if (!o) {
+		perror(filename);
+		return -1;
+	}
+	fprintf(o, "name,irq,hooks,value,raise,filtered,hook_ns\n");
+	for (int i = 0; i < pool->count; i++) {
+		avr_irq_t * irq = pool->irq[i];
+		if (!irq)
+			continue;
+		avr_irq_stats_t none = { 0 };
+		avr_irq_stats_t * st = irq->stats ? irq->stats : &none;
+		// the quotes in the name are doubled
+		fputc('"', o);
+		for (const char * c = irq->name ? irq->name : ""; *c; c++)
+			fprintf(o, *c == '"' ? "\"\"" : "%c", *c);
+		fprintf(o, "\",%u,%d,%u,%llu,%llu,%llu\n",
+				irq->irq, irq->hook_count, irq->value,
+				(unsigned long long)st->raise, (unsigned long long)st->filtered,
+				(unsigned long long)st->hook_ns);
+	}
+	fclose(o);
+	return 0;
+}
@@ -58,14 +58,42 @@ enum {
 	IRQ_FLAG_INIT		= (1 << 3), //!< this irq hasn't been used yet
 	IRQ_FLAG_FLOATING	= (1 << 4), //!< this 'pin'/signal is floating
 	IRQ_FLAG_USER		= (1 << 5), //!< Can be used by irq users
+	IRQ_FLAG_MUTED		= (1 << 6), //!< raises are ignored, while gdb replays this input
 };
 
+/*
+ * A hook is either a "notify" callback, or another IRQ to raise too ("chain").
+ * Each IRQ keeps its first AVR_IRQ_HOOK_INLINE hooks in the IRQ structure
+ * itself, and moves them all to a single malloced block when it needs more.
+ */
+#define AVR_IRQ_HOOK_INLINE	2
+
+typedef struct avr_irq_hook_t {
+	struct avr_irq_t * chain;	//!< raise the IRQ on this too - optional if "notify" is on
+	avr_irq_notify_t notify;	//!< called when IRQ is raised - optional if "chain" is on
+	void * param;				//!< "notify" parameter
+	int busy;					//!< prevent reentrance of callbacks
+} avr_irq_hook_t;
+
+/*
+ * Per IRQ counters, only kept once avr_irq_pool_stats() turned them on
+ */
+typedef struct avr_irq_stats_t {
+	uint64_t raise;				//!< calls to avr_raise_irq*()
+	uint64_t filtered;			//!< raises dropped by IRQ_FLAG_FILTERED
+	uint64_t hook_ns;			//!< time spent in the notify hooks, nested raises included
+} avr_irq_stats_t;
+
 /*
  * IRQ Pool structure
  */
 typedef struct avr_irq_pool_t {
 	int count;						//!< number of irqs living in the pool
 	struct avr_irq_t ** irq;		//!< irqs belonging in this pool
+	int stats;						//!< new irqs get counters too
+	// DEBUG ONLY -- only counted if CONFIG_SIMAVR_TRACE = 1
+	uint64_t raise_count;			//!< raises that went thru avr_raise_irq_float()
+	uint64_t raise_skip_count;		//!< status raises with nothing hooked
 } avr_irq_pool_t;
 
 /*!
@@ -77,7 +105,12 @@ typedef struct avr_irq_t {
 	uint32_t			irq;		//!< any value the user needs
 	uint32_t			value;		//!< current value
 	uint8_t				flags;		//!< IRQ_* flags
-	struct avr_irq_hook_t * hook;	//!< list of hooks to be notified
+	uint8_t				hook_dead;	//!< some hooks were unregistered while busy
+	uint16_t			hook_count;	//!< number of hooks to be notified
+	uint16_t			hook_size;	//!< size of the 'hook' block, 0 when it's 'hook_inline'
+	avr_irq_hook_t *	hook;		//!< hooks to be notified
+	avr_irq_hook_t		hook_inline[AVR_IRQ_HOOK_INLINE];
+	avr_irq_stats_t *	stats;		//!< NULL unless the pool keeps stats
 } avr_irq_t;
 
 //! allocates 'count' IRQs, initializes their "irq" starting from 'base' and increment
@@ -120,6 +153,45 @@ avr_raise_irq_float(
 		avr_irq_t * irq,
 		uint32_t value,
 		int floating);
+
+/*
+ * Status IRQs (interrupt pending/running...) are raised all the time, but
+ * are only looked at when something is hooked to them (VCD trace, a part).
+ * These are the same as avr_raise_irq() and avr_raise_irq_float(), but when
+ * 'irq' has no hooks they only update its value and flags, inline.
+ */
+static inline void
+avr_raise_irq_status_float(
+		avr_irq_t * irq,
+		uint32_t value,
+		int floating)
+{
+	if (irq->hook_count || irq->stats) {
+		avr_raise_irq_float(irq, value, floating);
+		return;
+	}
+#if CONFIG_SIMAVR_TRACE
+	if (irq->pool)
+		irq->pool->raise_skip_count++;
+#endif
+	uint32_t output = (irq->flags & IRQ_FLAG_NOT) ? !value : value;
+	if (irq->value == output &&
+			(irq->flags & IRQ_FLAG_FILTERED) && !(irq->flags & IRQ_FLAG_INIT))
+		return;
+	irq->flags &= ~(IRQ_FLAG_INIT | IRQ_FLAG_FLOATING);
+	if (floating)
+		irq->flags |= IRQ_FLAG_FLOATING;
+	irq->value = output;
+}
+
+static inline void
+avr_raise_irq_status(
+		avr_irq_t * irq,
+		uint32_t value)
+{
+	avr_raise_irq_status_float(irq, value, !!(irq->flags & IRQ_FLAG_FLOATING));
+}
+
 //! this connects a "source" IRQ to a "destination" IRQ
 void
 avr_connect_irq(
@@ -143,6 +215,27 @@ avr_irq_unregister_notify(
 		avr_irq_notify_t notify,
 		void * param);
 
+/*
+ * IRQ instrumentation. Turning the stats on gives every IRQ of the pool
+ * (and the ones allocated in it afterward) raise, filtered and hook time
+ * counters; turning them off frees the counters. IRQs without a pool are
+ * not counted.
+ */
+void
+avr_irq_pool_stats(
+		avr_irq_pool_t * pool,
+		int enable);
+//! Writes the pool IRQs, their chains and notify hooks as a Graphviz DOT graph
+int
+avr_irq_pool_dump_dot(
+		avr_irq_pool_t * pool,
+		const char * filename);
+//! Writes the counters of the pool IRQs as CSV, one IRQ per line
+int
+avr_irq_pool_dump_csv(
+		avr_irq_pool_t * pool,
+		const char * filename);
+
 #ifdef __cplusplus
 };
 #endif
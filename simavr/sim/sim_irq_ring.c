@@ -0,0 +1,170 @@
+/*
+	sim_irq_ring.c
+
+	Deferred IRQ delivery, from the simulation thread to a host thread
+
+	Copyright 2026 agent <agent@local>
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "sim_irq_ring.h"
+
+DEFINE_FIFO(avr_irq_event_t, avr_irq_event_fifo);
+
+void
+avr_irq_ring_init(
+		struct avr_t * avr,
+		avr_irq_ring_t * ring,
+		int policy)
+{
+	memset(ring, 0, sizeof(*ring));
+	ring->avr = avr;
+	ring->policy = policy;
+}
+
+/*
+ * Simulation thread. The 'latest' entry is a seqlock: the host thread
+ * retries its read if 'seq' was odd, or changed while it was reading.
+ */
+static void
+avr_irq_ring_latest_set(
+		avr_irq_ring_latest_t * l,
+		uint32_t value,
+		avr_cycle_count_t cycle)
+{
+	l->seq++;
+	__sync_synchronize();
+	l->after = l->ring->written;
+	l->value = value;
+	l->cycle = cycle;
+	__sync_synchronize();
+	l->seq++;
+	l->pending = 1;
+}
+
+static void
+avr_irq_ring_notify(
+		struct avr_irq_t * irq,
+		uint32_t value,
+		void * param)
+{
+	avr_irq_ring_latest_t * l = (avr_irq_ring_latest_t *)param;
+	avr_irq_ring_t * ring = l->ring;
+	avr_irq_event_t e = {
+		.irq = irq,
+		.value = value,
+		.cycle = ring->avr->cycle,
+	};
+
+	switch (ring->policy) {
+		case AVR_IRQ_RING_COALESCE:
+			// once an event waits there, the newer ones have to follow it
+			if (l->pending || !avr_irq_event_fifo_write(&ring->fifo, e)) {
+				if (l->pending)
+					ring->coalesced++;
+				avr_irq_ring_latest_set(l, value, e.cycle);
+			} else
+				ring->written++;
+			break;
+		case AVR_IRQ_RING_BLOCK:
+			while (!avr_irq_event_fifo_write(&ring->fifo, e))
+				sched_yield();
+			break;
+		default:
+			if (!avr_irq_event_fifo_write(&ring->fifo, e))
+				ring->dropped++;
+			break;
+	}
+}
+
+void
+avr_irq_ring_attach(
+		avr_irq_ring_t * ring,
+		struct avr_irq_t * irq)
+{
+	avr_irq_ring_latest_t * l = calloc(1, sizeof(*l));
+	l->ring = ring;
+	l->irq = irq;
+	l->next = ring->latest;
+	ring->latest = l;
+	avr_irq_register_notify(irq, avr_irq_ring_notify, l);
+}
+
+void
+avr_irq_ring_free(
+		avr_irq_ring_t * ring)
+{
+	while (ring->latest) {
+		avr_irq_ring_latest_t * l = ring->latest;
+		ring->latest = l->next;
+		avr_irq_unregister_notify(l->irq, avr_irq_ring_notify, l);
+		free(l);
+	}
+	avr_irq_event_fifo_reset(&ring->fifo);
+}
+
+/*
+ * Host thread. With the coalesce policy, a waiting event is only delivered
+ * once the ring events written before it were, so the last event delivered
+ * for an IRQ is always its most recent value. The same value can show up
+ * twice, though, if the simulation thread updated it during the drain.
+ */
+int
+avr_irq_ring_drain(
+		avr_irq_ring_t * ring,
+		avr_irq_ring_event_t event,
+		void * param)
+{
+	int res = 0;
+	// don't chase the simulation thread, just take what is there now
+	int count = avr_irq_event_fifo_get_read_size(&ring->fifo);
+
+	while (count--) {
+		avr_irq_event_t e = avr_irq_event_fifo_read(&ring->fifo);
+		ring->read++;
+		event(ring, &e, param);
+		res++;
+	}
+	if (ring->policy != AVR_IRQ_RING_COALESCE)
+		return res;
+
+	for (avr_irq_ring_latest_t * l = ring->latest; l; l = l->next) {
+		if (!l->pending)
+			continue;
+		// older events of that IRQ are still in the ring, wait for them
+		if ((int32_t)(l->after - ring->read) > 0)
+			continue;
+		if (!__sync_lock_test_and_set(&l->pending, 0))
+			continue;
+		avr_irq_event_t e = { .irq = l->irq };
+		uint32_t seq;
+		do {
+			while ((seq = l->seq) & 1)
+				sched_yield();
+			__sync_synchronize();
+			e.value = l->value;
+			e.cycle = l->cycle;
+			__sync_synchronize();
+		} while (seq != l->seq);
+		event(ring, &e, param);
+		res++;
+	}
+	return res;
+}
@@ -0,0 +1,123 @@
+/*
+	sim_irq_ring.h
+
+	Deferred IRQ delivery, from the simulation thread to a host thread
+
+	Copyright 2026 agent <agent@local>
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SIM_IRQ_RING_H__
+#define __SIM_IRQ_RING_H__
+
+#include "sim_avr.h"
+#include "fifo_declare.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * IRQ hooks run in the simulation thread, in the middle of avr_run().
+ * Boards with a GUI, or anything else that looks at the pins from another
+ * thread, can instead "attach" IRQs to a ring: raising them then only
+ * queues (irq, value, cycle) events, that the host thread picks up with
+ * avr_irq_ring_drain() whenever it sees fit.
+ *
+ * The ring has a single producer (the simulation thread) and a single
+ * consumer (the host thread), and takes no locks. When the host thread
+ * doesn't keep up, the ring policy decides what happens to new events.
+ *
+ * IRQs have to be attached before the host thread starts draining.
+ */
+typedef struct avr_irq_event_t {
+	struct avr_irq_t *	irq;
+	uint32_t			value;
+	avr_cycle_count_t	cycle;		//!< avr->cycle when the IRQ was raised
+} avr_irq_event_t;
+
+DECLARE_FIFO(avr_irq_event_t, avr_irq_event_fifo, 4096);
+
+enum {
+	AVR_IRQ_RING_DROP = 0,	//!< drop the new events, and count them
+	AVR_IRQ_RING_COALESCE,	//!< keep only the last event of each IRQ until there is room
+	AVR_IRQ_RING_BLOCK,		//!< stall the simulation until the host thread makes room
+};
+
+/*
+ * One per attached IRQ. With the coalesce policy, it holds the last event
+ * of the IRQ while the ring is full.
+ */
+typedef struct avr_irq_ring_latest_t {
+	struct avr_irq_ring_latest_t * next;
+	struct avr_irq_ring_t *	ring;
+	struct avr_irq_t *	irq;
+	volatile uint32_t	seq;		//!< odd while the simulation thread writes it
+	volatile uint32_t	pending;	//!< there is an event not read yet
+	uint32_t			after;		//!< ring events written before this one
+	uint32_t			value;
+	avr_cycle_count_t	cycle;
+} avr_irq_ring_latest_t;
+
+typedef struct avr_irq_ring_t {
+	struct avr_t *		avr;
+	int					policy;		//!< AVR_IRQ_RING_*
+	avr_irq_event_fifo_t fifo;
+	avr_irq_ring_latest_t * latest;	//!< attached IRQs
+	uint32_t			read;		//!< events read, by the host thread
+	// written by the simulation thread only
+	uint32_t			written;	//!< events written
+	uint64_t			dropped;	//!< events lost with AVR_IRQ_RING_DROP
+	uint64_t			coalesced;	//!< events folded with AVR_IRQ_RING_COALESCE, give or take a drain racing it
+} avr_irq_ring_t;
+
+typedef void (*avr_irq_ring_event_t)(
+		avr_irq_ring_t * ring,
+		const avr_irq_event_t * event,
+		void * param);
+
+void
+avr_irq_ring_init(
+		struct avr_t * avr,
+		avr_irq_ring_t * ring,
+		int policy);
+//! detaches all the IRQs
+void
+avr_irq_ring_free(
+		avr_irq_ring_t * ring);
+
+//! raising 'irq' now queues an event in the ring
+void
+avr_irq_ring_attach(
+		avr_irq_ring_t * ring,
+		struct avr_irq_t * irq);
+
+/*
+ * Called by the host thread. Calls 'event' for each queued event, oldest
+ * first, then for the coalesced ones, and returns how many there were.
+ */
+int
+avr_irq_ring_drain(
+		avr_irq_ring_t * ring,
+		avr_irq_ring_event_t event,
+		void * param);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_IRQ_RING_H__ */
@@ -0,0 +1,547 @@
+/*
+	sim_jit.c
+
+	Copyright 2026 agent <agent@local>
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sim_jit.h"
+
+#if AVR_HAS_JIT
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "sim_core.h"
+
+/*
+ * The translated blocks are called as void fn(uint8_t * data, uint8_t * sreg)
+ * so with the SysV ABI the AVR registers are at [rdi + r] and the packed
+ * SREG at [rsi]. The code only uses eax, ecx and edx as scratch, and keeps
+ * the flags one per byte in the red zone, at [rsp - 8 + bit], so it needs
+ * no prologue at all.
+ *
+ * Each instruction is translated on its own: the operands are loaded,
+ * the x86 equivalent does the work, and the AVR flags are set from the
+ * x86 ones, which have the same meaning for C, Z, N, V and S (setl is
+ * N ^ V). H is worked out from the operands, like the interpreter does.
+ *
+ * Flags that a later instruction of the block sets again before anything
+ * reads them are not computed at all. The flags the block reads before
+ * setting them are unpacked from SREG on the way in, and the ones it sets
+ * are packed back on the way out.
+ */
+enum {
+	X_EAX = 0, X_ECX, X_EDX,
+	X_RSI = 6, X_RDI,
+};
+enum {	// setcc condition codes
+	X_CC_O = 0x0, X_CC_C = 0x2, X_CC_Z = 0x4, X_CC_S = 0x8, X_CC_L = 0xc,
+};
+
+// biggest translation of any instruction, see _avr_jit_op()
+#define AVR_JIT_OP_MAX	96
+// and of the unpacking/packing of SREG around the block
+#define AVR_JIT_SREG_MAX	256
+
+#define X_MEM(_reg, _base)	(0x40 | ((_reg) << 3) | (_base))	// [base + disp8]
+#define X_REG(_reg, _rm)	(0xc0 | ((_reg) << 3) | (_rm))
+#define X_FLAG(_reg, _bit)	X_MEM(_reg, 4), 0x24, (uint8_t)((_bit) - 8)	// [rsp - 8 + bit]
+
+#define E(...) do { \
+		const uint8_t _b[] = { __VA_ARGS__ }; \
+		memcpy(p, _b, sizeof(_b)); p += sizeof(_b); \
+	} while (0)
+// movzx/movsx r32, byte/word [rdi + r]
+#define LOAD(_x, _r)		E(0x0f, 0xb6, X_MEM(_x, X_RDI), _r)
+#define LOADS(_x, _r)		E(0x0f, 0xbe, X_MEM(_x, X_RDI), _r)
+#define LOADW(_x, _r)		E(0x0f, 0xb7, X_MEM(_x, X_RDI), _r)
+#define LOADI(_x, _k)		E(0xb8 + (_x), _k, 0, 0, 0)
+// mov byte/word [rdi + r], r8/r16/imm8
+#define STORE(_x, _r)		E(0x88, X_MEM(_x, X_RDI), _r)
+#define STOREW(_x, _r)		E(0x66, 0x89, X_MEM(_x, X_RDI), _r)
+#define STOREI(_r, _k)		E(0xc6, X_MEM(0, X_RDI), _r, _k)
+// setcc/mov r8/mov imm8 into a flag, if anything needs it
+#define LIVE(_bit)			(live & (1 << (_bit)))
+#define SETF(_cc, _bit)		do { if (LIVE(_bit)) E(0x0f, 0x90 | (_cc), X_FLAG(0, _bit)); } while (0)
+#define FLAG(_bit, _x)		do { if (LIVE(_bit)) E(0x88, X_FLAG(_x, _bit)); } while (0)
+#define FLAGI(_bit, _k)		do { if (LIVE(_bit)) E(0xc6, X_FLAG(0, _bit), _k); } while (0)
+#define SETR(_cc, _x)		E(0x0f, 0x90 | (_cc), X_REG(0, _x))
+// shr byte [S_C], 1 -- AVR carry into the x86 one
+#define CARRY_IN()			E(0xd0, X_FLAG(5, S_C))
+// 8 bits "op dst, src" and "op dst, imm8", _alu is the x86 group 1 index
+#define ALU(_alu, _dst, _src)	E((_alu) << 3, X_REG(_src, _dst))
+#define ALUI(_alu, _dst, _k)	E(0x80, X_REG(_alu, _dst), _k)
+enum {
+	X_ADD = 0, X_OR, X_ADC, X_SBB, X_AND, X_SUB, X_XOR,
+};
+// H is bit 4 of rd ^ rr ^ res; edx = rd ^ rr before, eax = res after
+#define HALF_PRE()	if (LIVE(S_H)) { \
+		E(0x89, X_REG(X_EAX, X_EDX)); \
+		E(0x31, X_REG(X_ECX, X_EDX)); \
+	}
+#define HALF_POST()	if (LIVE(S_H)) { \
+		E(0x31, X_REG(X_EAX, X_EDX)); \
+		E(0xc1, X_REG(5, X_EDX), 4); \
+		E(0x83, X_REG(4, X_EDX), 1); \
+		FLAG(S_H, X_EDX); \
+	}
+// Z, C from ecx, N from edx, V = N ^ C and S = C: the right shifts
+#define SHIFT_FLAGS() { \
+		SETR(X_CC_C, X_ECX); \
+		SETR(X_CC_S, X_EDX); \
+		SETF(X_CC_Z, S_Z); \
+		FLAG(S_C, X_ECX); \
+		FLAG(S_N, X_EDX); \
+		FLAG(S_S, X_ECX); \
+		E(0x31, X_REG(X_ECX, X_EDX)); \
+		FLAG(S_V, X_EDX); \
+	}
+
+/*
+ * SREG bits an instruction reads and sets
+ */
+static void
+_avr_jit_flags(
+		const avr_decoded_t * op,
+		uint8_t * reads,
+		uint8_t * sets)
+{
+	*reads = *sets = 0;
+	switch (op->kind) {
+		case AVR_OP_ADD: case AVR_OP_SUB: case AVR_OP_CP:
+		case AVR_OP_SUBI: case AVR_OP_CPI: case AVR_OP_NEG:
+			*sets = AVR_SREG_HSVNZC;
+			break;
+		case AVR_OP_ADC:
+			*reads = 1 << S_C;
+			*sets = AVR_SREG_HSVNZC;
+			break;
+		case AVR_OP_SBC: case AVR_OP_CPC: case AVR_OP_SBCI:
+			*reads = AVR_SREG_ZC;
+			*sets = AVR_SREG_HSVNZC;
+			break;
+		case AVR_OP_AND: case AVR_OP_EOR: case AVR_OP_OR:
+		case AVR_OP_ANDI: case AVR_OP_ORI:
+		case AVR_OP_INC: case AVR_OP_DEC:
+			*sets = AVR_SREG_SVNZ;
+			break;
+		case AVR_OP_ROR:
+			*reads = 1 << S_C;
+			// fall through
+		case AVR_OP_COM: case AVR_OP_ASR: case AVR_OP_LSR:
+		case AVR_OP_ADIW: case AVR_OP_SBIW:
+			*sets = AVR_SREG_SVNZC;
+			break;
+		case AVR_OP_MUL: case AVR_OP_MULS: case AVR_OP_MULSU:
+		case AVR_OP_FMUL: case AVR_OP_FMULS: case AVR_OP_FMULSU:
+			*sets = AVR_SREG_ZC;
+			break;
+		case AVR_OP_BLD:
+			*reads = 1 << S_T;
+			break;
+		case AVR_OP_BST:
+			*sets = 1 << S_T;
+			break;
+		case AVR_OP_BSET:
+			*sets = 1 << op->d;
+			break;
+	}
+}
+
+/*
+ * Translates one instruction, 'live' are the flags that are read
+ * later on, the others are not worth computing.
+ */
+static uint8_t *
+_avr_jit_op(
+		uint8_t * p,
+		const avr_decoded_t * op,
+		uint8_t live)
+{
+	const uint8_t d = op->d, r = op->r, k = op->k;
+
+	switch (op->kind) {
+		case AVR_OP_NOP:
+			break;
+		case AVR_OP_ADD: case AVR_OP_ADC:
+		case AVR_OP_SUB: case AVR_OP_SBC: case AVR_OP_CP: case AVR_OP_CPC:
+		case AVR_OP_SUBI: case AVR_OP_SBCI: case AVR_OP_CPI: {
+			const int imm = op->kind == AVR_OP_SUBI || op->kind == AVR_OP_SBCI ||
+					op->kind == AVR_OP_CPI;
+			const int carry = op->kind == AVR_OP_ADC || op->kind == AVR_OP_SBC ||
+					op->kind == AVR_OP_CPC || op->kind == AVR_OP_SBCI;
+			const int store = op->kind != AVR_OP_CP && op->kind != AVR_OP_CPC &&
+					op->kind != AVR_OP_CPI;
+			int alu = X_SUB;
+			if (op->kind == AVR_OP_ADD)
+				alu = X_ADD;
+			else if (op->kind == AVR_OP_ADC)
+				alu = X_ADC;
+			else if (carry)
+				alu = X_SBB;
+			LOAD(X_EAX, d);
+			if (imm)
+				LOADI(X_ECX, k);
+			else
+				LOAD(X_ECX, r);
+			HALF_PRE();
+			if (carry)
+				CARRY_IN();
+			ALU(alu, X_EAX, X_ECX);
+			SETF(X_CC_C, S_C);
+			SETF(X_CC_S, S_N);
+			SETF(X_CC_O, S_V);
+			SETF(X_CC_L, S_S);
+			if (carry && alu != X_ADC) {
+				// Z is only ever cleared, for multi byte compares
+				if (LIVE(S_Z)) {
+					SETR(X_CC_Z, X_ECX);
+					E(0x20, X_FLAG(X_ECX, S_Z));
+				}
+			} else
+				SETF(X_CC_Z, S_Z);
+			if (store)
+				STORE(X_EAX, d);
+			HALF_POST();
+		}	break;
+		case AVR_OP_AND: case AVR_OP_EOR: case AVR_OP_OR:
+		case AVR_OP_ANDI: case AVR_OP_ORI: {
+			const int alu = op->kind == AVR_OP_AND || op->kind == AVR_OP_ANDI ? X_AND :
+					op->kind == AVR_OP_EOR ? X_XOR : X_OR;
+			LOAD(X_EAX, d);
+			if (op->kind == AVR_OP_ANDI || op->kind == AVR_OP_ORI)
+				ALUI(alu, X_EAX, k);
+			else {
+				LOAD(X_ECX, r);
+				ALU(alu, X_EAX, X_ECX);
+			}
+			SETF(X_CC_Z, S_Z);
+			SETF(X_CC_S, S_N);
+			SETF(X_CC_S, S_S);
+			FLAGI(S_V, 0);
+			STORE(X_EAX, d);
+		}	break;
+		case AVR_OP_MOV:
+			LOAD(X_EAX, r);
+			STORE(X_EAX, d);
+			break;
+		case AVR_OP_MOVW:
+			LOADW(X_EAX, r);
+			STOREW(X_EAX, d);
+			break;
+		case AVR_OP_LDI:
+			STOREI(d, k);
+			break;
+		case AVR_OP_MUL: case AVR_OP_MULS: case AVR_OP_MULSU:
+		case AVR_OP_FMUL: case AVR_OP_FMULS: case AVR_OP_FMULSU:
+			// same operand order and signedness as the interpreter
+			if (op->kind == AVR_OP_MUL) {
+				LOAD(X_EAX, d);
+				LOAD(X_ECX, r);
+			} else if (op->kind == AVR_OP_FMUL) {
+				LOAD(X_EAX, r);
+				LOAD(X_ECX, d);
+			} else {
+				if (op->kind == AVR_OP_MULS || op->kind == AVR_OP_FMULS)
+					LOADS(X_EAX, r);
+				else
+					LOAD(X_EAX, r);
+				LOADS(X_ECX, d);
+			}
+			E(0x0f, 0xaf, X_REG(X_EAX, X_ECX));		// imul eax, ecx
+			E(0x66, 0x85, X_REG(X_EAX, X_EAX));		// test ax, ax
+			if (op->kind == AVR_OP_MUL || op->kind == AVR_OP_MULS ||
+					op->kind == AVR_OP_MULSU) {
+				SETF(X_CC_S, S_C);
+				SETF(X_CC_Z, S_Z);
+			} else {
+				SETR(X_CC_S, X_EDX);
+				E(0x66, 0x01, X_REG(X_EAX, X_EAX));	// add ax, ax
+				SETF(X_CC_Z, S_Z);
+				FLAG(S_C, X_EDX);
+			}
+			STOREW(X_EAX, 0);
+			break;
+		case AVR_OP_COM:
+			LOAD(X_EAX, d);
+			ALUI(X_XOR, X_EAX, 0xff);
+			SETF(X_CC_Z, S_Z);
+			SETF(X_CC_S, S_N);
+			SETF(X_CC_S, S_S);
+			FLAGI(S_V, 0);
+			FLAGI(S_C, 1);
+			STORE(X_EAX, d);
+			break;
+		case AVR_OP_NEG:
+			LOAD(X_EAX, d);
+			E(0x89, X_REG(X_EAX, X_EDX));
+			E(0xf6, X_REG(3, X_EAX));				// neg al
+			SETF(X_CC_C, S_C);
+			SETF(X_CC_Z, S_Z);
+			SETF(X_CC_S, S_N);
+			SETF(X_CC_O, S_V);
+			SETF(X_CC_L, S_S);
+			STORE(X_EAX, d);
+			// H = bit 3 of res | rd
+			if (LIVE(S_H)) {
+				E(0x09, X_REG(X_EAX, X_EDX));
+				E(0xc1, X_REG(5, X_EDX), 3);
+				E(0x83, X_REG(4, X_EDX), 1);
+				FLAG(S_H, X_EDX);
+			}
+			break;
+		case AVR_OP_SWAP:
+			LOAD(X_EAX, d);
+			E(0xc0, X_REG(0, X_EAX), 4);			// rol al, 4
+			STORE(X_EAX, d);
+			break;
+		case AVR_OP_INC:
+		case AVR_OP_DEC:
+			LOAD(X_EAX, d);
+			E(0xfe, X_REG(op->kind == AVR_OP_INC ? 0 : 1, X_EAX));
+			SETF(X_CC_Z, S_Z);
+			SETF(X_CC_S, S_N);
+			SETF(X_CC_O, S_V);
+			SETF(X_CC_L, S_S);
+			STORE(X_EAX, d);
+			break;
+		case AVR_OP_ASR:
+			LOAD(X_EAX, d);
+			E(0xd0, X_REG(7, X_EAX));				// sar al, 1
+			SHIFT_FLAGS();
+			STORE(X_EAX, d);
+			break;
+		case AVR_OP_ROR:
+			LOAD(X_EAX, d);
+			CARRY_IN();
+			E(0xd0, X_REG(3, X_EAX));				// rcr al, 1
+			SETR(X_CC_C, X_ECX);
+			E(0x84, X_REG(X_EAX, X_EAX));			// test al, al
+			SETR(X_CC_S, X_EDX);
+			SETF(X_CC_Z, S_Z);
+			FLAG(S_C, X_ECX);
+			FLAG(S_N, X_EDX);
+			FLAG(S_S, X_ECX);
+			E(0x31, X_REG(X_ECX, X_EDX));
+			FLAG(S_V, X_EDX);
+			STORE(X_EAX, d);
+			break;
+		case AVR_OP_LSR:
+			LOAD(X_EAX, d);
+			E(0xd0, X_REG(5, X_EAX));				// shr al, 1
+			SETF(X_CC_C, S_C);
+			SETF(X_CC_C, S_V);
+			SETF(X_CC_C, S_S);
+			SETF(X_CC_Z, S_Z);
+			FLAGI(S_N, 0);
+			STORE(X_EAX, d);
+			break;
+		case AVR_OP_ADIW:
+		case AVR_OP_SBIW:
+			LOADW(X_EAX, d);
+			E(0x66, 0x83, X_REG(op->kind == AVR_OP_ADIW ? X_ADD : X_SUB, X_EAX), k);
+			SETF(X_CC_C, S_C);
+			SETF(X_CC_Z, S_Z);
+			SETF(X_CC_S, S_N);
+			SETF(X_CC_O, S_V);
+			SETF(X_CC_L, S_S);
+			STOREW(X_EAX, d);
+			break;
+		case AVR_OP_BLD:	// r is the mask
+			LOAD(X_EAX, d);
+			ALUI(X_AND, X_EAX, (uint8_t)~r);
+			E(0x0f, 0xb6, X_FLAG(X_ECX, S_T));
+			E(0xf7, X_REG(3, X_ECX));				// neg ecx
+			ALUI(X_AND, X_ECX, r);
+			ALU(X_OR, X_EAX, X_ECX);
+			STORE(X_EAX, d);
+			break;
+		case AVR_OP_BST:	// r is the bit number
+			LOAD(X_EAX, d);
+			E(0xc1, X_REG(5, X_EAX), r);			// shr eax, r
+			E(0x83, X_REG(4, X_EAX), 1);
+			FLAG(S_T, X_EAX);
+			break;
+		case AVR_OP_BSET:	// never sei/cli, see _avr_op_in_block()
+			FLAGI(d, r);
+			break;
+		default:
+			return NULL;
+	}
+	return p;
+}
+
+/*
+ * There is one perf map per process, shared by the cores; it is closed,
+ * and so flushed, when the last one goes.
+ */
+static FILE *	perf_map;
+static int		perf_map_users;
+
+static void
+_avr_jit_perf_map_open(
+		avr_t * avr)
+{
+	if (perf_map_users++ || !getenv("SIMAVR_PERF_MAP"))
+		return;
+	char name[64];
+	snprintf(name, sizeof(name), "/tmp/perf-%d.map", (int)getpid());
+	int fd = open(name, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+			0644);
+	if (fd == -1 || !(perf_map = fdopen(fd, "w"))) {
+		AVR_LOG(avr, LOG_WARNING, "JIT: can't create %s\n", name);
+		if (fd != -1)
+			close(fd);
+	}
+}
+
+void
+avr_jit_init(
+		avr_t * avr)
+{
+	uint32_t words = ((avr->flashend + 1) >> 1) + 1;
+	avr_jit_t * jit = calloc(1, sizeof(avr_jit_t));
+
+	jit->block = calloc(words, sizeof(jit->block[0]));
+	jit->hits = calloc(words, sizeof(jit->hits[0]));
+	jit->code = mmap(NULL, AVR_JIT_CODE_SIZE,
+			PROT_READ | PROT_WRITE | PROT_EXEC,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (jit->code == MAP_FAILED) {
+		AVR_LOG(avr, LOG_WARNING,
+				"JIT: can't map the code buffer, running interpreted\n");
+		jit->code = NULL;
+	}
+	_avr_jit_perf_map_open(avr);
+	avr->jit = jit;
+}
+
+void
+avr_jit_free(
+		avr_t * avr)
+{
+	avr_jit_t * jit = avr->jit;
+
+	if (!jit)
+		return;
+	if (jit->code)
+		munmap(jit->code, AVR_JIT_CODE_SIZE);
+	if (!--perf_map_users && perf_map) {
+		fclose(perf_map);
+		perf_map = NULL;
+	}
+	free(jit->block);
+	free(jit->hits);
+	free(jit);
+	avr->jit = NULL;
+}
+
+avr_jit_block_t
+avr_jit_compile(
+		avr_t * avr,
+		avr_flashaddr_t pc)
+{
+	avr_jit_t * jit = avr->jit;
+	const avr_decoded_t * op = &avr->decoded[pc >> 1];
+	const int count = op->block;
+
+	// if it fails, don't try again for a while
+	jit->hits[pc >> 1] = 0;
+	if (!jit->code)
+		return NULL;
+	if (jit->used + (count * AVR_JIT_OP_MAX) + AVR_JIT_SREG_MAX > AVR_JIT_CODE_SIZE) {
+		// out of space, start again from scratch
+		memset(jit->block, 0, (((avr->flashend + 1) >> 1) + 1) * sizeof(jit->block[0]));
+		jit->used = 0;
+	}
+	/*
+	 * Walk the block backward to find which flags each instruction has
+	 * to compute: at the end, all the ones the block sets go to SREG.
+	 */
+	uint8_t live[AVR_BLOCK_MAX];
+	uint8_t need = 0xff, sets = 0, reads = 0;
+	for (int i = count - 1; i >= 0; i--) {
+		uint8_t r, s;
+		_avr_jit_flags(op + i, &r, &s);
+		live[i] = need;
+		need = (need & ~s) | r;
+		sets |= s;
+		reads |= r;
+	}
+	need &= reads;
+
+	uint8_t * start = jit->code + jit->used;
+	uint8_t * p = start;
+	if (need) {	// movzx eax, byte [rsi], then unpack the flags read
+		E(0x0f, 0xb6, X_MEM(X_EAX, X_RSI), 0);
+		for (int b = 0; b < 8; b++) {
+			if (!(need & (1 << b)))
+				continue;
+			E(0x89, X_REG(X_EAX, X_EDX));
+			if (b)
+				E(0xc1, X_REG(5, X_EDX), b);
+			E(0x83, X_REG(4, X_EDX), 1);
+			E(0x88, X_FLAG(X_EDX, b));
+		}
+	}
+	for (int i = 0; i < count && p; i++)
+		p = _avr_jit_op(p, op + i, live[i]);
+	if (!p)
+		return NULL;
+	if (sets) {	// pack the flags set into edx, and merge them into SREG
+		E(0x31, X_REG(X_EDX, X_EDX));
+		for (int b = 0; b < 8; b++) {
+			if (!(sets & (1 << b)))
+				continue;
+			E(0x0f, 0xb6, X_FLAG(X_ECX, b));
+			if (b)
+				E(0xc1, X_REG(4, X_ECX), b);
+			E(0x09, X_REG(X_ECX, X_EDX));
+		}
+		E(0x80, X_MEM(4, X_RSI), 0, (uint8_t)~sets);
+		E(0x08, X_MEM(X_EDX, X_RSI), 0);
+	}
+	*p++ = 0xc3;	// ret
+	const uint32_t size = p - start;
+	jit->used = (jit->used + size + 15) & ~15;
+
+	if (perf_map)
+		fprintf(perf_map, "%lx %x avr_%s_0x%05x\n",
+				(unsigned long)start, size, avr->mmcu, pc);
+	jit->block[pc >> 1] = (avr_jit_block_t)start;
+	return jit->block[pc >> 1];
+}
+
+void
+avr_jit_invalidate(
+		avr_t * avr,
+		uint32_t start,
+		uint32_t end)
+{
+	avr_jit_t * jit = avr->jit;
+
+	for (uint32_t i = start; i < end; i++) {
+		jit->block[i] = NULL;
+		jit->hits[i] = 0;
+	}
+}
+
+#endif /* AVR_HAS_JIT */
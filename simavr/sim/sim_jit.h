@@ -0,0 +1,124 @@
+/*
+	sim_jit.h
+
+	Copyright 2026 agent <agent@local>
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Optional x86-64 translator for the hot basic blocks.
+ *
+ * The basic blocks found by the block executor (see _avr_block_scan())
+ * only work on registers and SREG, so once a block has been entered
+ * AVR_JIT_HOT times it is translated into a small native function that
+ * works directly on avr->data and avr->sreg. Everything else, IO, SRAM,
+ * branches etc. keeps running in the interpreter, with the exact same
+ * cycle accounting as the block executor.
+ *
+ * This is only compiled in with CONFIG_SIMAVR_JIT=1 (see simavr/Makefile)
+ * on x86-64 hosts, and used with avr->run = avr_callback_run_jit.
+ *
+ * With SIMAVR_PERF_MAP set in the environment, the translations are listed
+ * in /tmp/perf-<pid>.map so perf(1) can name them. That file has to be a
+ * new one, it is not reused nor followed if it's a link.
+ */
+#ifndef __SIM_JIT_H__
+#define __SIM_JIT_H__
+
+#include "sim_avr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if CONFIG_SIMAVR_JIT && defined(__GNUC__) && defined(__x86_64__) && \
+		!defined(_WIN32) && !CONFIG_SIMAVR_TRACE
+#define AVR_HAS_JIT 1
+
+// number of times a block is entered before it gets translated
+#ifndef AVR_JIT_HOT
+#define AVR_JIT_HOT			64
+#endif
+// size of the native code buffer, it is flushed when full
+#define AVR_JIT_CODE_SIZE	(1024 * 1024)
+
+/*
+ * A translated block. Runs all the instructions of the block, the caller
+ * takes care of the pc and cycles.
+ */
+typedef void (*avr_jit_block_t)(
+		uint8_t * data,
+		uint8_t * sreg);
+
+typedef struct avr_jit_t {
+	avr_jit_block_t *	block;		// native code, one per flash word
+	uint8_t *			hits;		// block entries, one per flash word
+	uint8_t *			code;		// mmap()ed code buffer, NULL if unavailable
+	uint32_t			used;		// bytes used in the code buffer
+} avr_jit_t;
+
+/*
+ * Allocates avr->jit, called lazily by the executor.
+ */
+void
+avr_jit_init(
+		avr_t * avr);
+void
+avr_jit_free(
+		avr_t * avr);
+/*
+ * Translates the block starting at pc, the block length has to be known
+ * already. Returns NULL if it can't be translated.
+ */
+avr_jit_block_t
+avr_jit_compile(
+		avr_t * avr,
+		avr_flashaddr_t pc);
+/*
+ * Drops the translations for the flash words from 'start' to 'end'
+ * (excluded), because the flash changed.
+ */
+void
+avr_jit_invalidate(
+		avr_t * avr,
+		uint32_t start,
+		uint32_t end);
+
+/*
+ * Called by the executor each time it enters the block at pc, returns
+ * the native code for it once it is hot enough.
+ */
+static inline avr_jit_block_t
+avr_jit_get(
+		avr_t * avr,
+		avr_flashaddr_t pc)
+{
+	avr_jit_t * jit = avr->jit;
+	avr_jit_block_t fn = jit->block[pc >> 1];
+
+	if (fn || ++jit->hits[pc >> 1] < AVR_JIT_HOT)
+		return fn;
+	return avr_jit_compile(avr, pc);
+}
+
+#endif /* AVR_HAS_JIT */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_JIT_H__ */
@@ -0,0 +1,75 @@
+/*
+	atmega88_bench.c
+
+	Copyright 2026 agent <agent@local>
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <util/crc16.h>
+
+/*
+ * Firmware for the core benchmark, bench_core.c
+ *
+ * It doesn't use any peripheral and never sleeps, it just keeps the core
+ * busy forever with a mix of arithmetic, SRAM accesses, calls and branches
+ */
+#include "avr_mcu_section.h"
+AVR_MCU(F_CPU, "atmega88");
+
+static uint8_t buf[128];
+volatile uint16_t result;
+
+static void fill(uint16_t seed)
+{
+	for (uint8_t i = 0; i < sizeof(buf); i++) {
+		seed = seed * 109 + 89;
+		buf[i] = seed >> 8;
+	}
+}
+
+static void sort(void)
+{
+	for (uint8_t i = 1; i < sizeof(buf); i++) {
+		uint8_t v = buf[i];
+		uint8_t j = i;
+		for (; j > 0 && buf[j - 1] > v; j--)
+			buf[j] = buf[j - 1];
+		buf[j] = v;
+	}
+}
+
+static uint16_t crc(void)
+{
+	uint16_t c = 0xffff;
+	for (uint8_t i = 0; i < sizeof(buf); i++)
+		c = _crc16_update(c, buf[i]);
+	return c;
+}
+
+int main()
+{
+	uint16_t seed = 1;
+
+	for (;;) {
+		fill(seed);
+		sort();
+		seed = crc();
+		result += seed * (uint8_t)(seed >> 8);
+	}
+}
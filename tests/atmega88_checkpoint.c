@@ -0,0 +1,51 @@
+/*
+	atmega88_checkpoint.c
+
+	Copyright 2026 agent <agent@local>
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "avr_mcu_section.h"
+AVR_MCU(F_CPU, "atmega88");
+
+volatile uint8_t ticks;
+volatile uint8_t sum;
+
+ISR(TIMER1_COMPA_vect)
+{
+	ticks++;
+	if (UCSR0A & (1 << UDRE0))
+		UDR0 = ticks;
+}
+
+int main(void)
+{
+	UCSR0B = (1 << TXEN0);
+	UBRR0L = 12;
+
+	OCR1A = 999;
+	TCCR1B = (1 << WGM12) | (1 << CS10);	// CTC, clk/1
+	TIMSK1 = (1 << OCIE1A);
+	sei();
+
+	// keeps the registers and SRAM changing between the interrupts
+	for (uint8_t i = 0; ; i++)
+		sum += ticks + i;
+}
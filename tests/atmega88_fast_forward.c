@@ -0,0 +1,78 @@
+/*
+	atmega88_fast_forward.c
+
+	Copyright 2026 agent <agent@local>
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/delay.h>
+#include <util/delay_basic.h>
+
+#include "avr_mcu_section.h"
+AVR_MCU(F_CPU, "atmega88");
+// tell simavr to listen to commands written in this (unused) register
+AVR_MCU_SIMAVR_COMMAND(&GPIOR0);
+
+/*
+ * The loops the run loops can fast-forward: polls that only the timer
+ * interrupt ends, the countdown loops of <util/delay.h>, and a poll on
+ * the UART, that must never be skipped.
+ */
+volatile uint8_t ticks;
+volatile uint8_t stop;
+
+ISR(TIMER1_COMPA_vect)
+{
+	ticks++;
+	// quits the simulator from the rjmp . below
+	if (stop && ticks == 5) {
+		cli();
+		sleep_mode();
+	}
+}
+
+int main(void)
+{
+	OCR1A = 12345;
+	TCCR1B = (1 << WGM12) | (1 << CS10);	// CTC, clk/1
+	TIMSK1 = (1 << OCIE1A);
+	sei();
+
+	while (ticks < 3)
+		;
+
+	_delay_ms(3);
+	_delay_us(500);
+	_delay_loop_1(200);
+	_delay_loop_2(40000);
+	__builtin_avr_delay_cycles(100000);
+
+	// this tell simavr to put the UART in loopback mode
+	GPIOR0 = SIMAVR_CMD_UART_LOOPBACK;
+	UCSR0B = (1 << RXEN0) | (1 << TXEN0);
+	UDR0 = 'a';
+	loop_until_bit_is_set(UCSR0A, RXC0);
+	(void)UDR0;
+
+	ticks = 0;
+	stop = 1;
+	for (;;)
+		;
+}
@@ -0,0 +1,104 @@
+/*
+	bench_core.c
+
+	Copyright 2026 agent <agent@local>
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Core executor benchmark. Runs the same firmware with each of the
+ * executors, checks they all end up in the very same state, and prints
+ * the simulated MHz and MIPS each of them achieves.
+ *
+ * Usage: bench_core.tst [firmware.axf [megacycles]]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "tests.h"
+#include "sim_core.h"
+
+static const struct {
+	const char * name;
+	void (*run)(avr_t * avr);
+} engines[] = {
+	{ "switch", avr_callback_run_raw },
+	{ "threaded", avr_callback_run_threaded },
+	{ "blocks", avr_callback_run_blocks },
+	{ "jit", avr_callback_run_jit },
+};
+
+/*
+ * Run one instruction per avr_run_one() call to count how many
+ * instructions the firmware executes in 'cycles'
+ */
+static uint64_t
+bench_count_instructions(
+		avr_t * avr,
+		avr_cycle_count_t cycles)
+{
+	uint64_t count = 0;
+
+	while (avr->cycle < cycles && avr->state == cpu_Running) {
+		avr->run_cycle_count = 1;
+		avr_flashaddr_t new_pc = avr_run_one(avr);
+		avr_cycle_timer_process(avr);
+		avr->pc = new_pc;
+		if (avr->interrupt_state)
+			avr_service_interrupts(avr);
+		count++;
+	}
+	return count;
+}
+
+int main(int argc, char **argv)
+{
+	const char * fname = argc > 1 ? argv[1] : "atmega88_bench.axf";
+	avr_cycle_count_t cycles = (argc > 2 ? atoi(argv[2]) : 100) * 1000000ULL;
+
+	tests_disable_stdout = 0;
+
+	avr_t * avr = tests_init_avr(fname);
+	uint64_t insn = bench_count_instructions(avr, cycles);
+	if (avr->state != cpu_Running)
+		fail("%s stopped after %" PRI_avr_cycle_count " cycles", fname, avr->cycle);
+	double cpi = (double)avr->cycle / insn;
+	avr_terminate(avr);
+
+	printf("%s: %" PRI_avr_cycle_count " cycles, %.3f cycles/instruction\n",
+			fname, cycles, cpi);
+
+	avr_t * ref = NULL;
+	for (unsigned i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+		avr = tests_init_avr(fname);
+		avr->run = engines[i].run;
+		// let the executors run until the next timer is due
+		avr->run_cycle_limit = 100000;
+
+		double t = tests_timed_run(avr, cycles);
+
+		printf("%-10s %8.3fs %8.1f MHz %8.1f MIPS\n", engines[i].name, t,
+				avr->cycle / t / 1e6, avr->cycle / cpi / t / 1e6);
+		if (!ref) {
+			ref = avr;
+			continue;
+		}
+		tests_assert_same_state(avr, ref, engines[i].name);
+		avr_terminate(avr);
+	}
+	avr_terminate(ref);
+	return 0;
+}
@@ -0,0 +1,89 @@
+/*
+	bench_irq.c
+
+	Copyright 2026 agent <agent@local>
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * IRQ raise benchmark. Hooks 1, 4 and 16 notify callbacks to each of a
+ * set of IRQs, like the pins of a busy board, toggles them in turn, checks
+ * every hook was called each time, most recently registered first, and
+ * prints the raise throughput.
+ *
+ * Usage: bench_irq.tst [megaraises]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "tests.h"
+#include "sim_irq.h"
+
+#define BENCH_HOOKS_MAX	16
+#define BENCH_IRQS		256
+
+static uint64_t calls[BENCH_HOOKS_MAX];
+static int hook_count, last;
+
+static void
+bench_notify(
+		struct avr_irq_t * irq,
+		uint32_t value,
+		void * param)
+{
+	int index = (intptr_t)param;
+	// hooks are called in reverse registration order
+	if (index != last - 1)
+		fail("hook %d called after hook %d", index, last);
+	last = index ? index : hook_count;
+	calls[index]++;
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t raises = (argc > 1 ? atoi(argv[1]) : 10) * 1000000ULL;
+	static const int hooks[] = { 1, 4, 16 };
+	const char * names[BENCH_IRQS];
+
+	tests_disable_stdout = 0;
+	for (int q = 0; q < BENCH_IRQS; q++)
+		names[q] = "bench";
+
+	for (unsigned i = 0; i < sizeof(hooks) / sizeof(hooks[0]); i++) {
+		avr_irq_t * irq = avr_alloc_irq(NULL, 0, BENCH_IRQS, names);
+		// register the hooks the way a board does, one part after the other
+		for (int h = 0; h < hooks[i]; h++) {
+			for (int q = 0; q < BENCH_IRQS; q++)
+				avr_irq_register_notify(irq + q, bench_notify, (void*)(intptr_t)h);
+			calls[h] = 0;
+		}
+		hook_count = last = hooks[i];
+
+		double start = tests_now();
+		for (uint64_t r = 0; r < raises; r++)
+			avr_raise_irq(irq + (r % BENCH_IRQS), (r / BENCH_IRQS) & 1);
+		double t = tests_now() - start;
+
+		for (int h = 0; h < hooks[i]; h++)
+			if (calls[h] != raises)
+				fail("hook %d called %llu times out of %llu raises", h,
+						(unsigned long long)calls[h], (unsigned long long)raises);
+		printf("%2d hooks %8.3fs %8.1f Mraises/s %8.1f Mcalls/s\n", hooks[i], t,
+				raises / t / 1e6, raises * hooks[i] / t / 1e6);
+		avr_free_irq(irq, BENCH_IRQS);
+	}
+	return 0;
+}
@@ -0,0 +1,114 @@
+/*
+	bench_timers.c
+
+	Copyright 2026 agent <agent@local>
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Cycle timer benchmark. Runs a timer driven firmware to its end with the
+ * default one instruction bursts, first with a run loop that goes thru
+ * avr_cycle_timer_process() after every instruction, then with avr_run()
+ * that only does so when a timer is due. Checks both end up in the very
+ * same state, and prints the time each of them took.
+ *
+ * Usage: bench_timers.tst [firmware.axf [runs]]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "tests.h"
+#include "sim_core.h"
+
+// don't sync with the wall clock when the firmware sleeps
+static void
+bench_sleep(
+		avr_t * avr,
+		avr_cycle_count_t how_long)
+{
+}
+
+/*
+ * The run loop as it was, calling into the timer pool after each burst
+ */
+static void
+bench_run_process(
+		avr_t * avr)
+{
+	avr_flashaddr_t new_pc = avr->pc;
+
+	if (avr->state == cpu_Running)
+		new_pc = avr_run_one(avr);
+
+	avr_cycle_count_t sleep = avr_cycle_timer_process(avr);
+
+	avr->pc = new_pc;
+	avr_idle_fast_forward(avr, sleep);
+
+	if (avr->state == cpu_Sleeping) {
+		if (!avr_sreg_get(avr, S_I)) {
+			avr->state = cpu_Done;
+			return;
+		}
+		avr->sleep(avr, sleep);
+		avr->cycle += 1 + sleep;
+	}
+	if (avr->state == cpu_Running || avr->state == cpu_Sleeping) {
+		if (avr->interrupt_state)
+			avr_service_interrupts(avr);
+	}
+}
+
+static const struct {
+	const char * name;
+	void (*run)(avr_t * avr);
+} loops[] = {
+	{ "process", bench_run_process },
+	{ "due", avr_callback_run_raw },
+};
+
+int main(int argc, char **argv)
+{
+	const char * fname = argc > 1 ? argv[1] : "atmega88_timer16.axf";
+	int runs = argc > 2 ? atoi(argv[2]) : 20;
+
+	tests_disable_stdout = 0;
+
+	avr_t * ref = NULL;
+	for (unsigned i = 0; i < sizeof(loops) / sizeof(loops[0]); i++) {
+		double t = 0;
+		for (int r = 0; r < runs; r++) {
+			avr_t * avr = tests_init_avr(fname);
+			avr->run = loops[i].run;
+			avr->sleep = bench_sleep;
+			avr->log = 0;
+
+			t += tests_timed_run(avr, ~0ULL);
+
+			if (!ref) {
+				ref = avr;
+				continue;
+			}
+			tests_assert_same_state(avr, ref, loops[i].name);
+			avr_terminate(avr);
+		}
+		printf("%-10s %8.3fs %8.1f MHz\n", loops[i].name, t,
+				ref->cycle * runs / t / 1e6);
+	}
+	printf("%s: %" PRI_avr_cycle_count " cycles\n", fname, ref->cycle);
+	avr_terminate(ref);
+	return 0;
+}
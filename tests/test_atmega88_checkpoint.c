@@ -0,0 +1,104 @@
+#include <string.h>
+#include "tests.h"
+#include "avr_uart.h"
+#include "sim_core.h"
+#include "sim_checkpoint.h"
+
+typedef struct state_t {
+	avr_cycle_count_t cycle;
+	avr_flashaddr_t pc;
+	uint8_t sreg;
+	uint8_t data[0x500];
+	uint32_t timer_count;
+	struct {
+		avr_cycle_count_t when;
+		avr_cycle_timer_t timer;
+		void * param;
+	} timer[32];
+	char uart[256];
+	int uart_len;
+} state_t;
+
+static state_t * current;
+
+static void uart_output(struct avr_irq_t * irq, uint32_t value, void * param) {
+	if (current->uart_len < sizeof(current->uart))
+		current->uart[current->uart_len++] = value;
+}
+
+static void take_state(avr_t * avr, state_t * s) {
+	avr_cycle_timer_pool_t * pool = &avr->cycle_timers;
+
+	s->cycle = avr->cycle;
+	s->pc = avr->pc;
+	s->sreg = avr_sreg_read(avr);
+	memcpy(s->data, avr->data, avr->ramend + 1);
+	s->timer_count = pool->count;
+	if (s->timer_count > 32)
+		fail("%d timers pending", s->timer_count);
+	for (int i = 0; i < s->timer_count; i++) {
+		avr_cycle_timer_slot_p slot = &pool->slot[pool->heap[i] - 1];
+		s->timer[i].when = slot->when;
+		s->timer[i].timer = slot->timer;
+		s->timer[i].param = slot->param;
+	}
+}
+
+static void run(avr_t * avr, state_t * s) {
+	memset(s, 0, sizeof(*s));
+	current = s;
+	avr_run_cycles(avr, 200000);
+	take_state(avr, s);
+}
+
+int main(int argc, char **argv) {
+	static state_t first, second;
+
+	tests_init(argc, argv);
+	avr_t *avr = tests_init_avr("atmega88_checkpoint.axf");
+	if (avr->ramend >= sizeof(first.data))
+		fail("ramend %04x is too big", avr->ramend);
+	avr_irq_register_notify(
+			avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT),
+			uart_output, NULL);
+
+	// somewhere in the middle of the timer and UART traffic
+	current = &first;
+	avr_run_cycles(avr, 100000);
+	avr_checkpoint_t * c = avr_checkpoint_save(avr);
+	if (!c)
+		fail("Checkpoint failed");
+
+	run(avr, &first);
+	if (avr_checkpoint_restore(avr, c))
+		fail("Restore failed");
+	if (avr->cycle != c->cycle)
+		fail("Restored at cycle %" PRI_avr_cycle_count ", not %" PRI_avr_cycle_count,
+				avr->cycle, c->cycle);
+	run(avr, &second);
+	avr_checkpoint_free(c);
+
+	if (!first.uart_len || !first.timer_count)
+		fail("The firmware didn't run");
+	if (first.cycle != second.cycle)
+		fail("Cycle %" PRI_avr_cycle_count ", then %" PRI_avr_cycle_count,
+				first.cycle, second.cycle);
+	if (first.pc != second.pc || first.sreg != second.sreg)
+		fail("PC/SREG %04x/%02x, then %04x/%02x",
+				first.pc, first.sreg, second.pc, second.sreg);
+	for (int i = 0; i <= avr->ramend; i++)
+		if (first.data[i] != second.data[i])
+			fail("Data %04x is %02x, then %02x", i, first.data[i], second.data[i]);
+	if (first.timer_count != second.timer_count)
+		fail("%d timers pending, then %d", first.timer_count, second.timer_count);
+	for (int i = 0; i < first.timer_count; i++)
+		if (first.timer[i].when != second.timer[i].when ||
+				first.timer[i].timer != second.timer[i].timer ||
+				first.timer[i].param != second.timer[i].param)
+			fail("Timer %d differs", i);
+	if (first.uart_len != second.uart_len ||
+			memcmp(first.uart, second.uart, first.uart_len))
+		fail("UART output differs");
+	tests_success();
+	return 0;
+}
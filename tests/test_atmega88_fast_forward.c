@@ -0,0 +1,57 @@
+#include <string.h>
+#include "tests.h"
+#include "sim_core.h"
+
+typedef struct state_t {
+	avr_cycle_count_t cycle;
+	avr_flashaddr_t pc;
+	uint8_t sreg;
+	uint16_t ramend;
+	uint8_t data[0x500];
+} state_t;
+
+/*
+ * Runs the firmware to the end with 'loop' as the run loop, the firmware
+ * quits well before the 100M cycles
+ */
+static void run(void (*loop)(avr_t * avr), state_t * s) {
+	avr_t *avr = tests_init_avr("atmega88_fast_forward.axf");
+	// only close stdout once
+	tests_disable_stdout = 0;
+	if (avr->ramend >= sizeof(s->data))
+		fail("ramend %04x is too big", avr->ramend);
+	avr->run = loop;
+	while (avr->cycle < 100000000 &&
+			(avr->state == cpu_Running || avr->state == cpu_Sleeping))
+		avr_run(avr);
+	if (avr->state != cpu_Done)
+		fail("Firmware did not finish, state %d", avr->state);
+	s->cycle = avr->cycle;
+	s->pc = avr->pc;
+	s->sreg = avr_sreg_read(avr);
+	s->ramend = avr->ramend;
+	memcpy(s->data, avr->data, avr->ramend + 1);
+}
+
+int main(int argc, char **argv) {
+	static state_t every, skipped;
+
+	tests_init(argc, argv);
+	run(avr_callback_run_noskip, &every);
+	run(avr_callback_run_raw, &skipped);
+
+	if (every.cycle != skipped.cycle)
+		fail("Finished on cycle %" PRI_avr_cycle_count ", not %" PRI_avr_cycle_count,
+				skipped.cycle, every.cycle);
+	if (every.pc != skipped.pc || every.sreg != skipped.sreg)
+		fail("PC/SREG are %04x/%02x, not %04x/%02x",
+				skipped.pc, skipped.sreg, every.pc, every.sreg);
+	for (int i = 0; i < 32; i++)
+		if (every.data[i] != skipped.data[i])
+			fail("r%d is %02x, not %02x", i, skipped.data[i], every.data[i]);
+	for (int i = 32; i <= every.ramend; i++)
+		if (every.data[i] != skipped.data[i])
+			fail("Data %04x is %02x, not %02x", i, skipped.data[i], every.data[i]);
+	tests_success();
+	return 0;
+}
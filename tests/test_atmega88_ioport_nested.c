@@ -0,0 +1,42 @@
+#include <stdlib.h>
+#include "tests.h"
+#include "avr_ioport.h"
+
+static avr_irq_t * pb7;
+static uint32_t seen[8];
+
+static void pin_changed(struct avr_irq_t * irq, uint32_t value, void * param) {
+	seen[irq->irq] = value & 0xff;
+}
+
+// writes the port, from the middle of the port update that raised PB0
+static void pb0_changed(struct avr_irq_t * irq, uint32_t value, void * param) {
+	if (value & 0xff)
+		avr_raise_irq(pb7, 1 | AVR_IOPORT_OUTPUT);
+}
+
+int main(int argc, char **argv) {
+	tests_init(argc, argv);
+	avr_t *avr = tests_init_avr("atmega88_ioport_nested.axf");
+
+	for (int i = 0; i < 8; i++)
+		avr_irq_register_notify(
+				avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), i),
+				pin_changed, NULL);
+	pb7 = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 7);
+	avr_irq_register_notify(
+			avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 0),
+			pb0_changed, NULL);
+
+	if (tests_run_test(avr, 100000) != LJR_SPECIAL_DEINIT)
+		fail("Firmware did not finish");
+	if (avr->data[0x25] != 0x8f)
+		fail("PORTB is %02x, not 8f", avr->data[0x25]);
+	for (int i = 0; i < 8; i++) {
+		uint32_t expected = (0x8f >> i) & 1;
+		if (seen[i] != expected)
+			fail("PB%d IRQ is %d, not %d", i, seen[i], expected);
+	}
+	tests_success();
+	return 0;
+}
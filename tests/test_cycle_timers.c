@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <string.h>
+#include "tests.h"
+#include "sim_cycle_timers.h"
+
+// 00: rjmp 00, the core isn't run anyway
+static const uint8_t code[] = { 0xff, 0xcf };
+
+static avr_t *avr;
+static int fired[256], fired_count;
+
+static avr_cycle_count_t log_timer(avr_t *avr, avr_cycle_count_t when,
+		void *param) {
+	fired[fired_count++] = (intptr_t)param;
+	return 0;
+}
+
+// fires 3 times, 10 cycles apart
+static avr_cycle_count_t periodic_timer(avr_t *avr, avr_cycle_count_t when,
+		void *param) {
+	fired[fired_count++] = (intptr_t)param;
+	return fired_count < 3 ? when + 10 : 0;
+}
+
+static void reg(avr_cycle_count_t when, int param) {
+	avr_cycle_timer_register(avr, when, log_timer, (void *)(intptr_t)param);
+}
+
+// runs the timers due in 'cycles', checks they fired in that order
+static void expect(avr_cycle_count_t cycles, const int *order, int count) {
+	avr->cycle += cycles;
+	avr_cycle_timer_process(avr);
+	if (fired_count != count)
+		fail("%d timers fired by cycle %d, not %d", fired_count,
+				(int)avr->cycle, count);
+	for (int i = 0; i < count; i++)
+		if (fired[i] != order[i])
+			fail("Timer %d fired in place of %d", fired[i], order[i]);
+	fired_count = 0;
+}
+
+/*
+ * More timers than the fixed pool used to have, the odd ones 10 cycles
+ * after the even ones: they fire by 'when', then in registration order.
+ */
+static void test_order(void) {
+	int order[100];
+
+	for (int i = 0; i < 100; i++)
+		reg(100 + (i & 1) * 10, i);
+	for (int i = 0; i < 100; i++)
+		order[i] = i < 50 ? i * 2 : (i - 50) * 2 + 1;
+	expect(110, order, 100);
+
+	// registering again moves it to the back of the ones due then
+	reg(10, 1);
+	reg(10, 2);
+	reg(10, 3);
+	reg(10, 1);
+	expect(10, (int[]){ 2, 3, 1 }, 3);
+}
+
+static void test_cancel(void) {
+	reg(10, 1);
+	reg(10, 2);
+	reg(20, 3);
+	if (!avr_cycle_timer_status(avr, log_timer, (void *)2))
+		fail("Timer 2 isn't pending");
+	avr_cycle_timer_cancel(avr, log_timer, (void *)2);
+	if (avr_cycle_timer_status(avr, log_timer, (void *)2))
+		fail("Timer 2 is still pending");
+	// not there anymore, nothing happens
+	avr_cycle_timer_cancel(avr, log_timer, (void *)2);
+	expect(20, (int[]){ 1, 3 }, 2);
+
+	avr_cycle_timer_register(avr, 10, periodic_timer, (void *)4);
+	expect(30, (int[]){ 4, 4, 4 }, 3);
+	if (avr_cycle_timer_status(avr, periodic_timer, (void *)4))
+		fail("Periodic timer still pending");
+}
+
+#define HANDLE(_p) avr_cycle_timer_get_handle(avr, log_timer, (void *)(_p))
+
+static void test_handles(void) {
+	avr_cycle_timer_handle_t h1 = HANDLE(1), h2 = HANDLE(2);
+
+	if (!h1 || !h2 || h1 == h2)
+		fail("Handles %d and %d", h1, h2);
+	if (HANDLE(1) != h1)
+		fail("Another handle for the same timer");
+	if (avr_cycle_timer_status_handle(avr, h1))
+		fail("Getting a handle scheduled the timer");
+
+	// same cycle, in the order they were (re)scheduled in
+	avr_cycle_timer_reschedule(avr, h1, 10);
+	avr_cycle_timer_reschedule(avr, h2, 10);
+	avr_cycle_timer_reschedule(avr, h1, 10);
+	expect(10, (int[]){ 2, 1 }, 2);
+
+	// a reschedule replaces the previous one, later or sooner
+	avr_cycle_timer_reschedule(avr, h1, 10);
+	avr_cycle_timer_reschedule(avr, h1, 30);
+	avr_cycle_timer_reschedule(avr, h2, 20);
+	avr_cycle_timer_reschedule(avr, h2, 5);
+	expect(10, (int[]){ 2 }, 1);
+	expect(20, (int[]){ 1 }, 1);
+
+	avr_cycle_timer_reschedule(avr, h1, 10);
+	avr_cycle_timer_cancel_handle(avr, h1);
+	if (avr_cycle_timer_status_handle(avr, h1))
+		fail("Handle 1 is still pending");
+	expect(10, NULL, 0);
+
+	// the handle and the (timer, param) calls are on the same timer
+	reg(10, 2);
+	if (!avr_cycle_timer_status_handle(avr, h2))
+		fail("Handle 2 isn't pending");
+	avr_cycle_timer_cancel(avr, log_timer, (void *)2);
+	if (avr_cycle_timer_status_handle(avr, h2))
+		fail("Handle 2 is still pending");
+	avr_cycle_timer_reschedule(avr, h2, 10);
+	if (!avr_cycle_timer_status(avr, log_timer, (void *)2))
+		fail("Timer 2 isn't pending");
+	expect(10, (int[]){ 2 }, 1);
+
+	// a reset drops the pending timers, not the handles
+	avr_cycle_timer_reschedule(avr, h1, 10);
+	reg(10, 3);
+	avr_reset(avr);
+	avr_cycle_timer_process(avr);
+	fired_count = 0;
+	if (avr_cycle_timer_status_handle(avr, h1) ||
+			avr_cycle_timer_status(avr, log_timer, (void *)3))
+		fail("Timers still pending after the reset");
+	if (HANDLE(1) != h1 || HANDLE(2) != h2)
+		fail("The handles changed with the reset");
+	if (HANDLE(3) == h1 || HANDLE(3) == h2)
+		fail("A new handle reused an old one");
+	avr_cycle_timer_reschedule(avr, h2, 10);
+	avr_cycle_timer_reschedule(avr, h1, 10);
+	expect(10, (int[]){ 2, 1 }, 2);
+}
+
+int main(int argc, char **argv) {
+	tests_init(argc, argv);
+	avr = tests_init_code("atmega88", code, sizeof(code));
+	// let the timers the peripherals set at reset go first
+	avr->cycle = 1000;
+	avr_cycle_timer_process(avr);
+
+	test_order();
+	test_cancel();
+	test_handles();
+
+	avr_terminate(avr);
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <string.h>
+#include "tests.h"
+
+/*
+ * 00: ldi r24, 0x34
+ * 02: ldi r25, 0x12
+ * 04: inc r16
+ * 06: sts 0x0100, r16
+ * 0a: lds r17, 0x0102
+ * 0e: rjmp 04
+ */
+static uint8_t code[] = {
+	0x84, 0xe3, 0x92, 0xe1, 0x03, 0x95, 0x00, 0x93, 0x00, 0x01,
+	0x10, 0x91, 0x02, 0x01, 0xfa, 0xcf,
+};
+
+static avr_t *avr;
+static int s;
+
+static void expect(const char *cmd, const char *reply) {
+	const char *r = tests_gdb_command(avr, s, cmd);
+	if (strcmp(r, reply))
+		fail("'%s' replied '%s', not '%s'", cmd, r, reply);
+}
+
+// runs from 0 to the breakpoint at 04 with condition 'cond', or to 0a
+static int stops(const char *cond) {
+	char cmd[256];
+
+	tests_gdb_command(avr, s, "z0,4,2");
+	tests_gdb_command(avr, s, "z0,a,2");
+	expect("P22=00000000", "OK");
+	snprintf(cmd, sizeof(cmd), "Z0,4,2;X%x,%s", (int)strlen(cond) / 2, cond);
+	expect(cmd, "OK");
+	expect("Z0,a,2", "OK");
+	const char *r = tests_gdb_command(avr, s, "c");
+	if (strstr(r, "22:04000000"))
+		return 1;
+	if (!strstr(r, "22:0a000000"))
+		fail("Stopped with '%s'", r);
+	return 0;
+}
+
+/*
+ * The expressions are 0 if they evaluate right; anything else, an
+ * evaluation error included, stops on the breakpoint.
+ */
+static const struct {
+	const char *name, *cond;
+} good[] = {
+	{ "ext", "22ff160822010227" },				// -1 + 1
+	{ "if_goto", "2201200008220127220027" },	// taken
+	{ "if_goto", "2200200008220027220127" },	// not taken
+	{ "ref16", "240080020019231234" "1127" },	// 0x1234 at 0x200
+	{ "reg", "26001822341127" },			// r24 is 0x34
+	// 1 2 3 rot is 2 3 1
+	{ "rot", "220122022203" "33" "2201112b" "22031110" "2b22021110" "27" },
+	{ "pick", "22052207320122051127" },			// 5 7 5
+	{ "end", "27" },							// empty stack
+};
+
+static const struct {
+	const char *name, *cond;
+} bad[] = {
+	{ "add underflow", "0227" },
+	{ "pick underflow", "2200320127" },
+	{ "if_goto underflow", "20000027" },
+	{ "truncated const16", "2301" },
+	{ "endless goto", "210000" },
+	{ "unknown op", "2200ff27" },
+};
+
+static void test_agent(void) {
+	char cond[256];
+
+	expect("M800200,2:3412", "OK");
+	for (int i = 0; i < sizeof(good) / sizeof(good[0]); i++)
+		if (stops(good[i].cond))
+			fail("'%s' didn't evaluate to 0", good[i].name);
+	for (int i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+		if (!stops(bad[i].cond))
+			fail("'%s' didn't fail", bad[i].name);
+	// a nonzero value stops too
+	if (!stops("220127"))
+		fail("const8 1 didn't stop");
+
+	// the stack holds 32 values, not one more
+	strcpy(cond, "");
+	for (int i = 0; i < 32; i++)
+		strcat(cond, "2200");
+	strcat(cond, "27");
+	if (stops(cond))
+		fail("32 values overflowed the stack");
+	strcpy(cond, "");
+	for (int i = 0; i < 33; i++)
+		strcat(cond, "2200");
+	strcat(cond, "27");
+	if (!stops(cond))
+		fail("33 values didn't overflow the stack");
+
+	tests_gdb_command(avr, s, "z0,4,2");
+	tests_gdb_command(avr, s, "z0,a,2");
+}
+
+/*
+ * Tracepoint 1 at 04, when r16 is odd, collects 0x100 and, with an
+ * expression, 0x104-0x105; it stops the trace run after 2 hits. The
+ * breakpoint stops the core once r16 is 5.
+ */
+static void test_trace(void) {
+	// no such tracepoint, address out of the flash, unknown field
+	expect("QTDP:-1:4:M-1,800100,1", "E01");
+	expect("QTDP:3:100000:E:0:0", "E01");
+	expect("QTDP:4:4:E:0:0:Q", "E01");
+	// and that left nothing behind
+	expect("qTP:4:4", "E01");
+
+	expect("QTinit", "OK");
+	expect("QTDP:1:4:E:0:2:X7,26001022010f27", "OK");
+	expect("QTDP:-1:4:M-1,800100,1-", "OK");
+	expect("QTDP:-1:4:X8,24008001040d0227", "OK");
+	expect("QTDP:-1:4:Q", "E01");
+	// a bad action drops the good ones before it, 0x103 isn't collected
+	expect("QTDP:-1:4:M-1,800103,1X1,zz", "E01");
+
+	expect("P22=00000000", "OK");
+	expect("P10=00", "OK");
+	expect("QTStart", "OK");
+	expect("Z0,4,2;X7,26001022051327", "OK");
+	const char *r = tests_gdb_command(avr, s, "c");
+	if (!strstr(r, "22:04000000"))
+		fail("Stopped with '%s'", r);
+	expect("p10", "05");
+
+	r = tests_gdb_command(avr, s, "qTStatus");
+	if (strncmp(r, "T0;tpasscount:1;tframes:2;", 26))
+		fail("qTStatus replied '%s'", r);
+	expect("qTP:1:4", "V2:0");
+
+	expect("QTFrame:0", "F0T1");
+	expect("p10", "01");
+	expect("p22", "04000000");
+	expect("m800100,1", "01");
+	expect("m800104,2", "0000");
+	expect("m800103,1", "E01");
+	expect("QTFrame:1", "F1T1");
+	expect("p10", "03");
+	expect("m800100,1", "03");
+	expect("QTFrame:2", "F-1");
+	// back to the live core
+	expect("p10", "05");
+	expect("m800100,1", "05");
+	expect("m800103,1", "00");
+}
+
+int main(int argc, char **argv) {
+	tests_init(argc, argv);
+
+	avr = tests_init_code("atmega88", code, sizeof(code));
+	s = tests_gdb_connect(avr);
+
+	test_agent();
+	test_trace();
+
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <string.h>
+#include "tests.h"
+
+/*
+ * 00: ldi r24, 0x34
+ * 02: ldi r25, 0x12
+ * 04: inc r16
+ * 06: sts 0x0100, r16
+ * 0a: lds r17, 0x0102
+ * 0e: rjmp 04
+ */
+static uint8_t code[] = {
+	0x84, 0xe3, 0x92, 0xe1, 0x03, 0x95, 0x00, 0x93, 0x00, 0x01,
+	0x10, 0x91, 0x02, 0x01, 0xfa, 0xcf,
+};
+
+static avr_t *avr;
+static int s;
+
+static void expect(const char *cmd, const char *reply) {
+	const char *r = tests_gdb_command(avr, s, cmd);
+	if (strcmp(r, reply))
+		fail("'%s' replied '%s', not '%s'", cmd, r, reply);
+}
+
+// continues from 0, and checks the stop reply has 'reason' in it
+static void stops_with(const char *reason) {
+	expect("P22=00000000", "OK");
+	const char *r = tests_gdb_command(avr, s, "c");
+	if (!strstr(r, reason))
+		fail("Stopped with '%s', not '%s'", r, reason);
+}
+
+// lets the server read what was sent, there is no reply to wait for
+static void pump(void) {
+	for (int i = 0; i < 3; i++)
+		avr_run(avr);
+}
+
+static void test_watchpoints(void) {
+	// the write of the sts, then the read of the lds
+	expect("Z4,800100,1", "OK");
+	stops_with("awatch:800100;");
+	expect("z4,800100,1", "OK");
+	expect("Z4,800102,1", "OK");
+	stops_with("awatch:800102;");
+	expect("z4,800102,1", "OK");
+
+	// only the accesses of their kind
+	expect("Z3,800100,1", "OK");
+	expect("Z3,800102,1", "OK");
+	stops_with("rwatch:800102;");
+	expect("z3,800100,1", "OK");
+	expect("z3,800102,1", "OK");
+	expect("Z2,800102,1", "OK");
+	expect("Z2,800100,1", "OK");
+	stops_with(";watch:800100;");
+	expect("z2,800100,1", "OK");
+	expect("z2,800102,1", "OK");
+	expect("z2,800102,1", "E01");
+}
+
+/*
+ * There used to be room for 32 of each, and the insertion went one past
+ * the end. These go in backward, so each one moves all the others.
+ */
+static void test_many_points(void) {
+	char cmd[32];
+
+	for (int i = 39; i >= 0; i--) {
+		sprintf(cmd, "Z0,%x,2", 0x100 + (i * 2));
+		expect(cmd, "OK");
+		sprintf(cmd, "Z2,%x,1", 0x800200 + i);
+		expect(cmd, "OK");
+	}
+	expect("Z0,a,2", "OK");
+	stops_with("22:0a000000");
+	expect("z0,a,2", "OK");
+	expect("Z2,800100,1", "OK");
+	stops_with(";watch:800100;");
+	expect("z2,800100,1", "OK");
+
+	for (int i = 0; i < 40; i++) {
+		sprintf(cmd, "z0,%x,2", 0x100 + (i * 2));
+		expect(cmd, "OK");
+		sprintf(cmd, "z2,%x,1", 0x800200 + i);
+		expect(cmd, "OK");
+	}
+	expect("z0,100,2", "E01");
+	expect("z2,800200,1", "E01");
+}
+
+static void test_framing(void) {
+	char buf[128];
+	int len;
+
+	expect("M800100,3:a55a3c", "OK");
+	// split, in the command and in the checksum
+	len = tests_gdb_frame(buf, "m800100,3");
+	tests_gdb_send(s, buf, 4);
+	pump();
+	tests_gdb_send(s, buf + 4, len - 5);
+	pump();
+	tests_gdb_send(s, buf + len - 1, 1);
+	const char *r = tests_gdb_reply(avr, s, NULL);
+	if (strcmp(r, "a55a3c"))
+		fail("Split packet replied '%s'", r);
+
+	// several in one, with acks and a bad checksum in between
+	len = tests_gdb_frame(buf, "m800100,1");
+	len += sprintf(buf + len, "+");
+	len += tests_gdb_frame(buf + len, "m800101,1");
+	len += sprintf(buf + len, "$m800101,1#00+");
+	len += tests_gdb_frame(buf + len, "m800102,1");
+	tests_gdb_send(s, buf, len);
+	static const char *replies[] = { "a5", "5a", "3c" };
+	for (int i = 0; i < 3; i++) {
+		r = tests_gdb_reply(avr, s, NULL);
+		if (strcmp(r, replies[i]))
+			fail("Packet %d replied '%s', not '%s'", i, r, replies[i]);
+	}
+
+	// a control-C stops the running core
+	expect("P22=00000000", "OK");
+	tests_gdb_packet(s, "c");
+	pump();
+	tests_gdb_send(s, "\x03", 1);
+	r = tests_gdb_reply(avr, s, NULL);
+	if (r[0] != 'T')
+		fail("Control-C replied '%s'", r);
+}
+
+static void test_binary(void) {
+	// '}', '#', '$' and '*' are escaped, a 0x03 in a packet isn't a control-C
+	expect("X800200,5:}]}\x03}\x04}\x0a\x03", "OK");
+	expect("m800200,5", "7d23242a03");
+	expect("X800200,0:", "OK");
+
+	int len;
+	tests_gdb_packet(s, "x800200,5");
+	const char *r = tests_gdb_reply(avr, s, &len);
+	if (len != 10 || memcmp(r, "b}]}\x03}\x04}\x0a\x03", len))
+		fail("Binary read replied '%s'", r);
+}
+
+int main(int argc, char **argv) {
+	tests_init(argc, argv);
+
+	avr = tests_init_code("atmega88", code, sizeof(code));
+	s = tests_gdb_connect(avr);
+
+	test_watchpoints();
+	test_many_points();
+	test_framing();
+	test_binary();
+
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include "tests.h"
+#include "sim_core.h"
+#include "sim_interrupts.h"
+
+// 00: rjmp 00, the core isn't run anyway
+static const uint8_t code[] = { 0xff, 0xcf };
+
+// GPIOR0 holds the enable bits, GPIOR1 the raised flags
+#define ENABLE	0x3e
+#define RAISED	0x4a
+
+/*
+ * Past the vectors of the atmega88, on both sides of the 64 bit boundary
+ * of the pending bitmap, up to the last one there can be.
+ */
+static avr_int_vector_t vector[] = {
+	{ .vector = 100, .enable = AVR_IO_REGBIT(ENABLE, 0), .raised = AVR_IO_REGBIT(RAISED, 0) },
+	{ .vector = 64, .enable = AVR_IO_REGBIT(ENABLE, 1), .raised = AVR_IO_REGBIT(RAISED, 1) },
+	{ .vector = 127, .enable = AVR_IO_REGBIT(ENABLE, 2), .raised = AVR_IO_REGBIT(RAISED, 2) },
+	{ .vector = 63, .enable = AVR_IO_REGBIT(ENABLE, 3), .raised = AVR_IO_REGBIT(RAISED, 3) },
+	{ .vector = 40, .enable = AVR_IO_REGBIT(ENABLE, 4), .raised = AVR_IO_REGBIT(RAISED, 4) },
+};
+#define VECTORS	(int)(sizeof(vector) / sizeof(vector[0]))
+
+static avr_t *avr;
+
+// returns the vector the core jumps to next, and returns from it; 0 for none
+static int service(void) {
+	avr->pc = 0x100;
+	avr_sreg_set(avr, S_I, 1);
+	// a masked one is dropped, and the next one is for the next call
+	while (avr->pc == 0x100 && avr_has_pending_interrupts(avr)) {
+		avr->interrupt_state = 1;
+		avr_service_interrupts(avr);
+	}
+	if (avr->pc == 0x100)
+		return 0;
+	int v = avr->pc / avr->vector_size;
+	if (avr->pc != v * avr->vector_size)
+		fail("Jumped to %04x", avr->pc);
+	avr_interrupt_reti(avr);
+	// and pop the return address, as the RETI instruction does
+	avr->data[R_SPL] += avr->address_size;
+	return v;
+}
+
+static void expect(const int *order, int count) {
+	for (int i = 0; i < count; i++) {
+		int v = service();
+		if (v != order[i])
+			fail("Vector %d ran in place of %d", v, order[i]);
+	}
+	if (service())
+		fail("More vectors pending");
+	if (avr_has_pending_interrupts(avr))
+		fail("The pending bitmap isn't empty");
+}
+
+static void raise_all(void) {
+	for (int i = 0; i < VECTORS; i++)
+		if (!avr_raise_interrupt(avr, &vector[i]))
+			fail("Vector %d wasn't raised", vector[i].vector);
+}
+
+int main(int argc, char **argv) {
+	tests_init(argc, argv);
+	avr = tests_init_code("atmega88", code, sizeof(code));
+	for (int i = 0; i < VECTORS; i++)
+		avr_register_vector(avr, &vector[i]);
+	avr_irq_t *pending = avr_get_interrupt_irq(avr, AVR_INT_ANY);
+
+	// the lowest number first, whatever the order they were raised in
+	avr->data[ENABLE] = 0x1f;
+	raise_all();
+	if (!avr_is_interrupt_pending(avr, &vector[2]))
+		fail("Vector 127 isn't pending");
+	if (avr->data[RAISED] != 0x1f)
+		fail("Raised flags are %02x", avr->data[RAISED]);
+	expect((int[]){ 40, 63, 64, 100, 127 }, 5);
+	if (avr->data[RAISED])
+		fail("Raised flags are %02x", avr->data[RAISED]);
+
+	// only the flag of a disabled one is raised
+	avr->data[ENABLE] = 0x1f & ~(1 << 3);
+	raise_all();
+	if (avr_is_interrupt_pending(avr, &vector[3]))
+		fail("Disabled vector 63 is pending");
+	if (!(avr->data[RAISED] & (1 << 3)))
+		fail("Disabled vector 63 has no raised flag");
+	avr->data[RAISED] = 0;
+
+	// cleared, or disabled since, they don't run; the rest does
+	avr_clear_interrupt(avr, &vector[4]);
+	if (pending->value != 64)
+		fail("Next pending vector is %d, not 64", pending->value);
+	avr->data[ENABLE] &= ~(1 << 1);
+	expect((int[]){ 100, 127 }, 2);
+
+	// a reset forgets them all
+	avr->data[ENABLE] = 0x1f;
+	raise_all();
+	avr_interrupt_reset(avr);
+	if (avr_has_pending_interrupts(avr) || avr_is_interrupt_pending(avr, &vector[0]))
+		fail("Vectors still pending after the reset");
+	expect(NULL, 0);
+
+	avr_terminate(avr);
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include "tests.h"
+#include "sim_io.h"
+
+#define GPIOR0	0x3e
+
+/*
+ * 00: ldi r16, 0x01
+ * 02: out GPIOR0, r16
+ * 04: ldi r16, 0x03
+ * 06: out GPIOR0, r16
+ * 08: out GPIOR0, r16
+ * 0a: in r17, GPIOR0
+ * 0c: in r17, GPIOR0
+ * 0e: ldi r16, 0x80
+ * 10: out GPIOR0, r16
+ * 12: rjmp 12
+ */
+static const uint8_t code[] = {
+	0x01, 0xe0, 0x0e, 0xbb, 0x03, 0xe0, 0x0e, 0xbb, 0x0e, 0xbb,
+	0x1e, 0xb3, 0x1e, 0xb3, 0x00, 0xe8, 0x0e, 0xbb, 0xff, 0xcf,
+};
+
+static int raised[10];
+
+static void count(struct avr_irq_t *irq, uint32_t value, void *param) {
+	raised[(intptr_t)param]++;
+}
+
+int main(int argc, char **argv) {
+	tests_init(argc, argv);
+	avr_t *avr = tests_init_code("atmega88", code, sizeof(code));
+	avr_irq_t *irq = avr_iomem_getirq(avr, GPIOR0, NULL, 0);
+	for (int i = 0; i < 10; i++)
+		avr_irq_register_notify(irq + i, count, (void *)(intptr_t)i);
+
+	for (int i = 0; i < 1000 && avr->pc != 0x12; i++)
+		avr_run(avr);
+	if (avr->pc != 0x12)
+		fail("Stuck at %04x", avr->pc);
+
+	/*
+	 * The first write raises the eight bits, the next ones only the bits
+	 * that changed: 1 then 7 and 0; the 'all' IRQ is raised for each
+	 * write, the 'read' one for each read.
+	 */
+	static const int expected[10] = { 2, 3, 1, 1, 1, 1, 1, 2, 4, 2 };
+	for (int i = 0; i < 10; i++)
+		if (raised[i] != expected[i])
+			fail("IRQ %d raised %d times, not %d", i, raised[i], expected[i]);
+	if (irq[AVR_IOMEM_IRQ_ALL].value != 0x80 || irq[AVR_IOMEM_IRQ_READ].value != 0x03)
+		fail("IRQ values are %02x and %02x", irq[AVR_IOMEM_IRQ_ALL].value,
+				irq[AVR_IOMEM_IRQ_READ].value);
+
+	avr_terminate(avr);
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "tests.h"
+#include "sim_irq.h"
+
+static int notified;
+
+static void notify(struct avr_irq_t *irq, uint32_t value, void *param) {
+	notified++;
+}
+
+// the whole of 'filename', which is removed
+static char *slurp(const char *filename) {
+	static char buf[4096];
+	FILE *f = fopen(filename, "r");
+	if (!f)
+		fail("Can't read %s", filename);
+	int len = fread(buf, 1, sizeof(buf) - 1, f);
+	buf[len] = 0;
+	fclose(f);
+	unlink(filename);
+	return buf;
+}
+
+/*
+ * 'a' is chained to 'b', in the pool, and to 'x', which isn't; 'b' has a
+ * notify hook and is filtered, 'c' has nothing.
+ */
+int main(int argc, char **argv) {
+	avr_irq_pool_t pool = { 0 };
+	const char *names[] = { "a", "b", "c\"" }, *xname[] = { "x" };
+	char csv[64], dot[64];
+
+	tests_init(argc, argv);
+	snprintf(csv, sizeof(csv), "/tmp/test_irq_dump.%d.csv", getpid());
+	snprintf(dot, sizeof(dot), "/tmp/test_irq_dump.%d.dot", getpid());
+
+	avr_irq_t *irq = avr_alloc_irq(&pool, 0, 2, names);
+	avr_irq_pool_stats(&pool, 1);
+	// allocated afterward, it gets counters too
+	avr_irq_t *c = avr_alloc_irq(&pool, 2, 1, names + 2);
+	avr_irq_t *x = avr_alloc_irq(NULL, 9, 1, xname);
+	if (!irq[0].stats || !c->stats || x->stats)
+		fail("Counters on the wrong IRQs");
+
+	avr_connect_irq(irq, irq + 1);
+	avr_connect_irq(irq, x);
+	avr_irq_register_notify(irq + 1, notify, NULL);
+	avr_irq_set_flags(irq + 1, IRQ_FLAG_FILTERED);
+	avr_raise_irq(irq, 1);
+	avr_raise_irq(irq, 1);
+	avr_raise_irq(irq, 2);
+	if (notified != 2)
+		fail("Notified %d times", notified);
+	if (irq[0].stats->raise != 3 || irq[0].stats->filtered != 0 ||
+			irq[1].stats->raise != 3 || irq[1].stats->filtered != 1 ||
+			c->stats->raise != 0)
+		fail("Counted %d/%d raises, %d/%d filtered",
+				(int)irq[0].stats->raise, (int)irq[1].stats->raise,
+				(int)irq[0].stats->filtered, (int)irq[1].stats->filtered);
+
+	if (avr_irq_pool_dump_csv(&pool, csv))
+		fail("Can't write %s", csv);
+	char *r = slurp(csv);
+	// the hook time of 'b' is whatever it was
+	static const char *lines[] = {
+		"name,irq,hooks,value,raise,filtered,hook_ns\n",
+		"\"a\",0,2,2,3,0,0\n",
+		"\"b\",1,1,2,3,1,",
+	};
+	for (int i = 0; i < 3; i++) {
+		if (strncmp(r, lines[i], strlen(lines[i])))
+			fail("CSV line %d is '%.*s'", i, (int)strcspn(r, "\n"), r);
+		r += strcspn(r, "\n") + 1;
+	}
+	if (strcmp(r, "\"c\"\"\",2,0,0,0,0,0\n"))
+		fail("CSV ends with '%s'", r);
+
+	if (avr_irq_pool_dump_dot(&pool, dot))
+		fail("Can't write %s", dot);
+	r = slurp(dot);
+	static const char *graph =
+		"digraph irqs {\n"
+		"\trankdir=LR;\n"
+		"\tnode [shape=box];\n"
+		"\tirq0 [label=\"a\\n0\\n3 raises\"];\n"
+		"\tirq0 -> irq1;\n"
+		"\tirq3 [style=dashed,label=\"x\\n9\"];\n"
+		"\tirq0 -> irq3;\n"
+		"\tirq1 [label=\"b\\n1\\n3 raises\"];\n"
+		"\thook1_0 [shape=ellipse,label=\"notify 0\"];\n"
+		"\tirq1 -> hook1_0;\n"
+		"\tirq2 [label=\"c\\\"\\n2\\n0 raises\"];\n"
+		"}\n";
+	if (strcmp(r, graph))
+		fail("DOT is:\n%s", r);
+
+	avr_irq_pool_stats(&pool, 0);
+	if (irq[0].stats || c->stats)
+		fail("Counters still there");
+
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,119 @@
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "tests.h"
+#include "sim_irq.h"
+#include "sim_irq_ring.h"
+
+/*
+ * The simulation thread (main) raises IRQs with increasing values, while
+ * a host thread drains the ring, and checks what it gets.
+ */
+#define IRQ_COUNT	4
+#define EVENTS		200000
+
+static avr_t * avr;
+static avr_irq_t * irq;
+static volatile int done;
+
+static struct {
+	uint32_t count;		// events delivered, without the repeats
+	uint32_t last[IRQ_COUNT];	// last value delivered, per IRQ
+	avr_cycle_count_t cycle;	// of the last event
+	int ordered;		// the events are in cycle order across IRQs
+} got;
+
+static void event(avr_irq_ring_t * ring, const avr_irq_event_t * e, void * param) {
+	int i = e->irq - irq;
+	if (i < 0 || i >= IRQ_COUNT)
+		fail("Event for an IRQ that isn't attached");
+	// the coalesce policy can deliver the last value twice
+	if (!got.ordered && e->value == got.last[i])
+		return;
+	if (e->value <= got.last[i])
+		fail("IRQ %d went from %d to %d", i, got.last[i], e->value);
+	if (e->value != e->cycle)
+		fail("IRQ %d value %d at cycle %d", i, e->value, (int)e->cycle);
+	if (got.ordered && e->cycle <= got.cycle)
+		fail("Event at cycle %d after one at %d", (int)e->cycle, (int)got.cycle);
+	got.last[i] = e->value;
+	got.cycle = e->cycle;
+	got.count++;
+}
+
+static void * drain_thread(void * param) {
+	avr_irq_ring_t * ring = param;
+	for (int n = 0; ; n++) {
+		int last = done;
+		__sync_synchronize();
+		avr_irq_ring_drain(ring, event, NULL);
+		if (last)
+			break;
+		// lag behind now and then, so the ring fills up
+		if (!(n % 64))
+			usleep(100);
+	}
+	return NULL;
+}
+
+static void test_policy(int policy) {
+	avr_irq_ring_t ring;
+	pthread_t thread;
+	uint32_t last[IRQ_COUNT] = { 0 };
+
+	avr_irq_ring_init(avr, &ring, policy);
+	for (int i = 0; i < IRQ_COUNT; i++)
+		avr_irq_ring_attach(&ring, irq + i);
+	memset(&got, 0, sizeof(got));
+	got.ordered = policy != AVR_IRQ_RING_COALESCE;
+	done = 0;
+	if (pthread_create(&thread, NULL, drain_thread, &ring))
+		fail("Can't start the drain thread");
+	for (int e = 1; e <= EVENTS; e++) {
+		int i = (e * 7) % IRQ_COUNT;
+		avr->cycle = e;
+		avr_raise_irq(irq + i, e);
+		last[i] = e;
+	}
+	__sync_synchronize();
+	done = 1;
+	pthread_join(thread, NULL);
+
+	switch (policy) {
+		case AVR_IRQ_RING_DROP:
+			if (got.count + ring.dropped != EVENTS)
+				fail("Drop: %d delivered and %d dropped, of %d",
+						got.count, (int)ring.dropped, EVENTS);
+			break;
+		case AVR_IRQ_RING_COALESCE:
+			// 'coalesced' can be a few off when the drain races the raise
+			if (got.count > EVENTS || got.count + ring.coalesced + 16 < EVENTS)
+				fail("Coalesce: %d delivered and %d coalesced, of %d",
+						got.count, (int)ring.coalesced, EVENTS);
+			for (int i = 0; i < IRQ_COUNT; i++)
+				if (got.last[i] != last[i])
+					fail("Coalesce: IRQ %d ended at %d, not %d",
+							i, got.last[i], last[i]);
+			break;
+		case AVR_IRQ_RING_BLOCK:
+			if (got.count != EVENTS)
+				fail("Block: %d delivered, of %d", got.count, EVENTS);
+			break;
+	}
+	avr_irq_ring_free(&ring);
+}
+
+int main(int argc, char **argv) {
+	tests_init(argc, argv);
+	avr = avr_make_mcu_by_name("atmega88");
+	if (!avr)
+		fail("Creating AVR failed.");
+	avr_init(avr);
+	irq = avr_alloc_irq(&avr->irq_pool, 0, IRQ_COUNT, NULL);
+
+	test_policy(AVR_IRQ_RING_DROP);
+	test_policy(AVR_IRQ_RING_COALESCE);
+	test_policy(AVR_IRQ_RING_BLOCK);
+	tests_success();
+	return 0;
+}
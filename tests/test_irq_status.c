@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include "tests.h"
+#include "sim_irq.h"
+
+/*
+ * Built with CONFIG_SIMAVR_TRACE=1 (see the Makefile), so the inline status
+ * raises count the ones that skip the hooks. The library isn't, so the
+ * raise_count of the full raises isn't.
+ */
+static int notified;
+static uint32_t seen;
+
+static void notify(struct avr_irq_t *irq, uint32_t value, void *param) {
+	notified++;
+	seen = value;
+}
+
+static void check(avr_irq_pool_t *pool, avr_irq_t *irq, uint32_t value,
+		int skipped, int calls) {
+	if (irq->value != value)
+		fail("%s is %d, not %d", irq->name, irq->value, value);
+	if (pool->raise_skip_count != skipped)
+		fail("%d raises skipped, not %d", (int)pool->raise_skip_count, skipped);
+	if (notified != calls)
+		fail("Notified %d times, not %d", notified, calls);
+}
+
+int main(int argc, char **argv) {
+	avr_irq_pool_t pool = { 0 };
+	const char *names[] = { "status", "not" };
+
+	tests_init(argc, argv);
+	avr_irq_t *irq = avr_alloc_irq(&pool, 0, 2, names);
+
+	// nothing hooked, the value is updated inline
+	avr_raise_irq_status(irq, 1);
+	check(&pool, irq, 1, 1, 0);
+	if (irq->flags & IRQ_FLAG_INIT)
+		fail("The first raise didn't clear IRQ_FLAG_INIT");
+	avr_raise_irq_status_float(irq, 0, 1);
+	check(&pool, irq, 0, 2, 0);
+	if (!(irq->flags & IRQ_FLAG_FLOATING))
+		fail("Floating raise didn't set IRQ_FLAG_FLOATING");
+	avr_irq_set_flags(irq + 1, IRQ_FLAG_NOT | IRQ_FLAG_FILTERED);
+	avr_raise_irq_status(irq + 1, 0);
+	check(&pool, irq + 1, 1, 3, 0);
+
+	// with a hook, it goes thru the full raise and gets notified
+	avr_irq_register_notify(irq, notify, NULL);
+	avr_raise_irq_status(irq, 1);
+	check(&pool, irq, 1, 3, 1);
+	if (seen != 1)
+		fail("Notified with %d", seen);
+	// a filtered raise of the same value is dropped either way
+	avr_irq_set_flags(irq, avr_irq_get_flags(irq) | IRQ_FLAG_FILTERED);
+	avr_raise_irq_status(irq, 1);
+	check(&pool, irq, 1, 3, 1);
+
+	// and back to the inline path once it's gone
+	avr_irq_unregister_notify(irq, notify, NULL);
+	avr_raise_irq_status(irq, 0);
+	check(&pool, irq, 0, 4, 1);
+
+	avr_free_irq(irq, 2);
+	tests_success();
+	return 0;
+}
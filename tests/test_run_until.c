@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "tests.h"
+
+/*
+ * 00: inc r16
+ * 02: sts 0x0100, r16
+ * 06: rjmp 00
+ */
+static const uint8_t busy[] = {
+	0x03, 0x95, 0x00, 0x93, 0x00, 0x01, 0xfc, 0xcf,
+};
+
+/*
+ * 00: sei
+ * 02: sleep
+ * 04: rjmp 02
+ */
+static const uint8_t asleep[] = {
+	0x78, 0x94, 0x88, 0x95, 0xfe, 0xcf,
+};
+
+static void *breaker(void *param) {
+	avr_t *avr = param;
+	usleep(100000);
+	avr->run_break = 1;
+	return NULL;
+}
+
+/*
+ * Runs 'code' for about a year of AVR time, another thread sets
+ * run_break after 100ms: avr_run_until() has to return soon after.
+ */
+static void test(const char *name, void (*loop)(avr_t *avr),
+		const uint8_t *code, int size) {
+	avr_t *avr = tests_init_code("atmega88", code, size);
+	// only close stdout once
+	tests_disable_stdout = 0;
+	avr->run = loop;
+	pthread_t thread;
+	pthread_create(&thread, NULL, breaker, avr);
+	double start = tests_now();
+	int state = avr_run_cycles(avr, 8000000ULL * 3600 * 24 * 365);
+	double took = tests_now() - start;
+	pthread_join(thread, NULL);
+	if (took > 2)
+		fail("%s: run_break took %.2fs to stop the run", name, took);
+	if (state != cpu_Running && state != cpu_Sleeping)
+		fail("%s: stopped in state %d", name, state);
+	if (avr->run_break)
+		fail("%s: run_break wasn't cleared", name);
+	avr_terminate(avr);
+}
+
+int main(int argc, char **argv) {
+	tests_init(argc, argv);
+	// a regression just runs the year, don't wait for that
+	alarm(30);
+
+	test("raw", avr_callback_run_raw, busy, sizeof(busy));
+	test("threaded", avr_callback_run_threaded, busy, sizeof(busy));
+	test("blocks", avr_callback_run_blocks, busy, sizeof(busy));
+	test("jit", avr_callback_run_jit, busy, sizeof(busy));
+	test("sleeping", avr_callback_run_raw, asleep, sizeof(asleep));
+
+	tests_success();
+	return 0;
+}
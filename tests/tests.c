@@ -3,18 +3,31 @@
 #include "sim_elf.h"
 #include "sim_core.h"
 #include "avr_uart.h"
+#include "sim_gdb.h"
 #include <stdio.h>
 #include <setjmp.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 #include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
 
 avr_cycle_count_t tests_cycle_count = 0;
 int tests_disable_stdout = 1;
 
 static char *test_name = "(uninitialized test)";
 static int finished = 0;
+/*
+ * Executor used by the tests, "--threaded", "--blocks" or "--jit" on the
+ * command line select the other ones, and let them run more than one
+ * instruction per call
+ */
+static avr_flashaddr_t (*tests_run_one)(avr_t * avr) = avr_run_one;
+static avr_cycle_count_t tests_run_cycle_limit = 0;
 
 #ifdef __MINGW32__
 #define restore_stderr()	{}
@@ -42,6 +55,19 @@ void tests_success(void) {
 
 void tests_init(int argc, char **argv) {
 	test_name = strdup(argv[0]);
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--threaded"))
+			tests_run_one = avr_run_one_threaded;
+		else if (!strcmp(argv[i], "--blocks"))
+			tests_run_one = avr_run_one_blocks;
+		else if (!strcmp(argv[i], "--jit"))
+			tests_run_one = avr_run_one_jit;
+		else
+			continue;
+		tests_run_cycle_limit = 1000;
+		test_name = malloc(strlen(argv[0]) + strlen(argv[i]) + 4);
+		sprintf(test_name, "%s (%s)", argv[0], argv[i] + 2);
+	}
 	atexit(atexit_handler);
 }
 
@@ -67,16 +93,18 @@ static int my_avr_run(avr_t * avr)
 	uint16_t new_pc = avr->pc;
 
 	if (avr->state == cpu_Running)
-		new_pc = avr_run_one(avr);
+		new_pc = tests_run_one(avr);
 
 	// run the cycle timers, get the suggested sleep time
 	// until the next timer is due
-	avr_cycle_count_t sleep = avr_cycle_timer_process(avr);
+	avr_cycle_count_t sleep = avr_cycle_timer_process_due(avr);
 
 	avr->pc = new_pc;
+	// skip the rest of an idle loop until then
+	avr_idle_fast_forward(avr, sleep);
 
 	if (avr->state == cpu_Sleeping) {
-		if (!avr->sreg[S_I]) {
+		if (!avr_sreg_get(avr, S_I)) {
 			printf("simavr: sleeping with interrupts off, quitting gracefully\n");
 			avr_terminate(avr);
 			fail("Test case error: special_deinit() returned?");
@@ -110,10 +138,27 @@ avr_t *tests_init_avr(const char *elfname) {
 	if (!avr)
 		fail("Creating AVR failed.");
 	avr_init(avr);
+	if (tests_run_cycle_limit)
+		avr->run_cycle_limit = tests_run_cycle_limit;
 	avr_load_firmware(avr, &fw);
 	return avr;
 }
 
+avr_t *tests_init_code(const char *mmcu, const uint8_t *code, int size) {
+	tests_cycle_count = 0;
+	map_stderr();
+
+	avr_t *avr = avr_make_mcu_by_name(mmcu);
+	if (!avr)
+		fail("Creating AVR failed.");
+	avr_init(avr);
+	if (tests_run_cycle_limit)
+		avr->run_cycle_limit = tests_run_cycle_limit;
+	avr->frequency = 8000000;
+	avr_loadcode(avr, (uint8_t *)code, size, 0);
+	return avr;
+}
+
 int tests_run_test(avr_t *avr, unsigned long run_usec) {
 	if (!avr)
 		fail("Internal test error: avr == NULL in run_test()");
@@ -230,6 +275,122 @@ void tests_assert_cycles_between(unsigned long min, unsigned long max) {
 	tests_assert_cycles_at_most(max);
 }
 
+double tests_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+double tests_timed_run(avr_t *avr, avr_cycle_count_t cycles) {
+	double start = tests_now();
+	while (avr->cycle < cycles &&
+			(avr->state == cpu_Running || avr->state == cpu_Sleeping))
+		avr_run(avr);
+	return tests_now() - start;
+}
+
+void tests_assert_same_state(avr_t *avr, avr_t *ref, const char *name) {
+	if (avr->cycle != ref->cycle || avr->pc != ref->pc ||
+			avr_sreg_read(avr) != avr_sreg_read(ref) ||
+			memcmp(avr->data, ref->data, avr->ramend + 1))
+		_fail(NULL, 0, "%s diverged at cycle %" PRI_avr_cycle_count,
+				name, avr->cycle);
+}
+
+// same as the server's
+#define TESTS_GDB_PACKET_SIZE	0x8000
+
+int tests_gdb_connect(avr_t *avr) {
+	if (avr_gdb_init(avr))
+		fail("Can't start the gdb server");
+	// the breakpoints are looked at between bursts, so no bursts
+	avr->run_cycle_limit = 1;
+	struct sockaddr_in address = {
+			.sin_family = AF_INET,
+			.sin_port = htons(avr->gdb_port),
+			.sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+	int s = socket(PF_INET, SOCK_STREAM, 0);
+	if (s < 0 || connect(s, (struct sockaddr *)&address, sizeof(address)))
+		fail("Can't connect to the gdb server");
+	int i = 1;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &i, sizeof(i));
+	// the server stops the core when it takes the connection
+	time_t timeout = time(NULL) + 10;
+	while (avr->state != cpu_Stopped) {
+		avr_run(avr);
+		if (time(NULL) > timeout)
+			fail("The gdb server didn't take the connection");
+	}
+	return s;
+}
+
+void tests_gdb_send(int s, const char *data, int len) {
+	if (send(s, data, len, 0) != len)
+		fail("Can't send to the gdb server");
+}
+
+int tests_gdb_frame(char *dst, const char *cmd) {
+	uint8_t check = 0;
+	int len = strlen(cmd);
+
+	if (len > TESTS_GDB_PACKET_SIZE)
+		fail("gdb packet too large");
+	for (int i = 0; i < len; i++)
+		check += cmd[i];
+	return sprintf(dst, "$%s#%02x", cmd, check);
+}
+
+void tests_gdb_packet(int s, const char *cmd) {
+	char packet[TESTS_GDB_PACKET_SIZE + 8];
+
+	tests_gdb_send(s, packet, tests_gdb_frame(packet, cmd));
+}
+
+const char *tests_gdb_reply(avr_t *avr, int s, int *len) {
+	static char buf[(TESTS_GDB_PACKET_SIZE * 2) + 8];
+	static int buf_len;
+	static char reply[(TESTS_GDB_PACKET_SIZE * 2) + 1];
+	time_t timeout = time(NULL) + 10;
+
+	for (;;) {
+		char *start = memchr(buf, '$', buf_len);
+		char *hash = start ? memchr(start, '#', buf + buf_len - start) : NULL;
+		if (hash && buf + buf_len - hash >= 3) {
+			uint8_t check = 0;
+			for (char *c = start + 1; c < hash; c++)
+				check += *c;
+			char sum[3] = { hash[1], hash[2], 0 };
+			if (strtoul(sum, NULL, 16) != check)
+				fail("Bad gdb reply checksum");
+			int size = hash - start - 1;
+			memcpy(reply, start + 1, size);
+			reply[size] = 0;
+			buf_len -= hash + 3 - buf;
+			memmove(buf, hash + 3, buf_len);
+			if (len)
+				*len = size;
+			return reply;
+		}
+		ssize_t r = recv(s, buf + buf_len, sizeof(buf) - buf_len, MSG_DONTWAIT);
+		if (r > 0) {
+			buf_len += r;
+			continue;
+		}
+		if (r == 0)
+			fail("The gdb server closed the connection");
+		if (avr->state == cpu_Done || avr->state == cpu_Crashed)
+			fail("The core stopped while waiting for gdb");
+		avr_run(avr);
+		if (time(NULL) > timeout)
+			fail("No reply from the gdb server");
+	}
+}
+
+const char *tests_gdb_command(avr_t *avr, int s, const char *cmd) {
+	tests_gdb_packet(s, cmd);
+	return tests_gdb_reply(avr, s, NULL);
+}
+
 void _fail(const char *filename, int linenum, const char *fmt, ...) {
 	restore_stderr();
 
@@ -19,6 +19,8 @@ void __attribute__ ((noreturn,format (printf, 3, 4)))
 _fail(const char *filename, int linenum, const char *fmt, ...);
 
 avr_t *tests_init_avr(const char *elfname);
+// same, with 'code' loaded at 0 instead of a firmware file, at 8MHz
+avr_t *tests_init_code(const char *mmcu, const uint8_t *code, int size);
 void tests_init(int argc, char **argv);
 void tests_success(void);
 
@@ -39,6 +41,32 @@ void tests_assert_cycles_at_most(unsigned long n);
 // the range is inclusive
 void tests_assert_cycles_between(unsigned long min, unsigned long max);
 
+/*
+ * For the benchmarks: the monotonic clock, in seconds; runs 'avr' for
+ * 'cycles' or until it stops, and returns the seconds that took; and
+ * checks two cores ended up in the very same state.
+ */
+double tests_now(void);
+double tests_timed_run(avr_t *avr, avr_cycle_count_t cycles);
+void tests_assert_same_state(avr_t *avr, avr_t *ref, const char *name);
+
+/*
+ * A gdb client, on the gdb server of 'avr' (see sim_gdb.h). There is no
+ * other thread, the core runs while the client waits for a reply.
+ */
+// starts the server, connects, and returns the socket
+int tests_gdb_connect(avr_t *avr);
+// sends raw bytes: part of a packet, several packets, a control-C...
+void tests_gdb_send(int s, const char *data, int len);
+// frames 'cmd' as a packet in 'dst', returns its length
+int tests_gdb_frame(char *dst, const char *cmd);
+// frames 'cmd', and sends it
+void tests_gdb_packet(int s, const char *cmd);
+// runs the core until a reply packet comes, returns it, and its length
+const char *tests_gdb_reply(avr_t *avr, int s, int *len);
+// tests_gdb_packet() then tests_gdb_reply()
+const char *tests_gdb_command(avr_t *avr, int s, const char *cmd);
+
 extern avr_cycle_count_t tests_cycle_count;
 extern int tests_disable_stdout;
 